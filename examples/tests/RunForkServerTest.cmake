@@ -0,0 +1,63 @@
+# Starts INTERPRETER as a fork server for INPUT with its socket in WORK_DIR, then has a client run every request of REQUESTS through it.
+# REQUESTS holds one "<stdin file>,<exit code>,<expected stdout file>,<program arguments>" entry per request, separated by "|". A stdin file of "-" stands for /dev/null. The server is killed at the end, whether or not the requests pass
+
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR})
+set(socket ${WORK_DIR}/server.sock)
+
+# execute_process() waits for what it starts, so the shell puts the server in the background and reports its pid
+execute_process(COMMAND sh -c "\"$0\" -fork-server=\"$1\" \"$2\" >\"$3\" 2>&1 & echo $!" ${INTERPRETER} ${socket} ${INPUT} ${WORK_DIR}/server.log
+	OUTPUT_VARIABLE serverPid
+	OUTPUT_STRIP_TRAILING_WHITESPACE)
+
+set(tries 0)
+while(NOT EXISTS ${socket} AND tries LESS 100)
+	execute_process(COMMAND ${CMAKE_COMMAND} -E sleep 0.1)
+	math(EXPR tries "${tries} + 1")
+endwhile()
+
+set(failure "")
+if(NOT EXISTS ${socket})
+	set(failure "The fork server did not create its socket")
+endif()
+
+string(REPLACE "|" ";" requests "${REQUESTS}")
+set(request 0)
+foreach(entry IN LISTS requests)
+	if(failure)
+		break()
+	endif()
+	math(EXPR request "${request} + 1")
+	string(REPLACE "," ";" fields "${entry}")
+	list(GET fields 0 stdin)
+	list(GET fields 1 exit)
+	list(GET fields 2 expectedFile)
+	list(GET fields 3 programArgs)
+	separate_arguments(programArgs UNIX_COMMAND "${programArgs}")
+	file(READ ${CMAKE_CURRENT_LIST_DIR}/${expectedFile} expected)
+	if(NOT stdin STREQUAL "-")
+		set(stdin ${CMAKE_CURRENT_LIST_DIR}/${stdin})
+	else()
+		set(stdin /dev/null)
+	endif()
+
+	execute_process(COMMAND ${INTERPRETER} -fork-client=${socket} ${programArgs}
+		WORKING_DIRECTORY ${CMAKE_CURRENT_LIST_DIR}
+		INPUT_FILE ${stdin}
+		OUTPUT_VARIABLE out
+		ERROR_VARIABLE err
+		RESULT_VARIABLE rc)
+
+	if(NOT rc STREQUAL exit)
+		set(failure "Request ${request} (${programArgs}) exited with ${rc} instead of ${exit}. stderr:\n${err}")
+	elseif(NOT out STREQUAL expected)
+		set(failure "Request ${request} (${programArgs}) printed\n${out}\ninstead of\n${expected}\nstderr:\n${err}")
+	endif()
+endforeach()
+
+if(serverPid)
+	execute_process(COMMAND kill ${serverPid})
+endif()
+if(failure)
+	message(FATAL_ERROR "${failure}")
+endif()
@@ -0,0 +1,44 @@
+# Runs INTERPRETER on INPUT (a .ll file of this directory) once for every entry of RUNS, which holds the extra interpreter options of each run separated by "|" (DEFAULT for none).
+# Every run has to exit with EXIT (0 by default), print exactly the contents of EXPECTED to stdout and, if ERROR is set, print something matching that regex to stderr.
+# WORK_DIR, if set, is emptied before the first run, so that runs can share files there (e.g. a cache that the second run finds warm)
+
+if(WORK_DIR)
+	file(REMOVE_RECURSE ${WORK_DIR})
+	file(MAKE_DIRECTORY ${WORK_DIR})
+endif()
+if(NOT DEFINED EXIT)
+	set(EXIT 0)
+endif()
+if(NOT STDIN)
+	set(STDIN /dev/null)
+endif()
+
+file(READ ${EXPECTED} expected)
+separate_arguments(guestArgs UNIX_COMMAND "${GUEST_ARGS}")
+string(REPLACE "|" ";" runs "${RUNS}")
+
+set(run 0)
+foreach(runArgs IN LISTS runs)
+	math(EXPR run "${run} + 1")
+	if(runArgs STREQUAL "DEFAULT")
+		set(runArgs "")
+	endif()
+	separate_arguments(args UNIX_COMMAND "${runArgs}")
+
+	execute_process(COMMAND ${INTERPRETER} ${args} ${INPUT} ${guestArgs}
+		WORKING_DIRECTORY ${CMAKE_CURRENT_LIST_DIR}
+		INPUT_FILE ${STDIN}
+		OUTPUT_VARIABLE out
+		ERROR_VARIABLE err
+		RESULT_VARIABLE rc)
+
+	if(NOT rc STREQUAL EXIT)
+		message(FATAL_ERROR "Run ${run} (${runArgs}) exited with ${rc} instead of ${EXIT}. stderr:\n${err}")
+	endif()
+	if(NOT out STREQUAL expected)
+		message(FATAL_ERROR "Run ${run} (${runArgs}) printed\n${out}\ninstead of\n${expected}\nstderr:\n${err}")
+	endif()
+	if(ERROR AND NOT err MATCHES "${ERROR}")
+		message(FATAL_ERROR "Run ${run} (${runArgs}) printed\n${err}\nto stderr, which does not match \"${ERROR}\"")
+	endif()
+endforeach()
@@ -0,0 +1,23 @@
+; Batch entries: main with its arguments, and functions taking integers, one of which faults
+
+@fmt = private constant [9 x i8] c"main %s\0A\00"
+
+declare i32 @printf(i8*, ...)
+
+define i32 @main(i32 %argc, i8** %argv) {
+  %argp = getelementptr i8*, i8** %argv, i64 1
+  %arg = load i8*, i8** %argp
+  %f = getelementptr [9 x i8], [9 x i8]* @fmt, i64 0, i64 0
+  call i32 (i8*, ...) @printf(i8* %f, i8* %arg)
+  ret i32 %argc
+}
+
+define i64 @square(i64 %x) {
+  %r = mul i64 %x, %x
+  ret i64 %r
+}
+
+define i32 @fault(i32 %x) {
+  store i32 %x, i32* null
+  ret i32 %x
+}
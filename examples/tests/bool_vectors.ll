@@ -0,0 +1,33 @@
+; <N x i1> vectors are packed one bit per lane in memory: loads and stores of <10 x i1> touch only the first two bytes (whose bits past the lanes LLVM leaves unspecified).
+; Scalar i1 and i20 take up their store size of one and three bytes
+
+@m = global <10 x i1> <i1 1, i1 0, i1 1, i1 1, i1 0, i1 0, i1 0, i1 0, i1 0, i1 1>
+@flag = global i1 false
+@odd = global i20 0
+@fmt = private constant [16 x i8] c"%d %d %d %d %d\0A\00"
+declare i32 @printf(i8*, ...)
+define i32 @main() {
+  %p = bitcast <10 x i1>* @m to i16*
+  %raw = load i16, i16* %p
+  %rawi = zext i16 %raw to i32
+  %v = load <10 x i1>, <10 x i1>* @m
+  %x = xor <10 x i1> %v, <i1 1, i1 1, i1 0, i1 0, i1 0, i1 0, i1 0, i1 0, i1 0, i1 0>
+  %a = alloca [4 x i8]
+  %ap = bitcast [4 x i8]* %a to i32*
+  store i32 -1, i32* %ap
+  %vp = bitcast [4 x i8]* %a to <10 x i1>*
+  store <10 x i1> %x, <10 x i1>* %vp
+  %raw32 = load i32, i32* %ap
+  %back = and i32 %raw32, -64513
+  %e = extractelement <10 x i1> %x, i32 9
+  %ei = zext i1 %e to i32
+  store i1 true, i1* @flag
+  %flag = load i1, i1* @flag
+  %flagi = zext i1 %flag to i32
+  store i20 -2, i20* @odd
+  %odd = load i20, i20* @odd
+  %oddi = sext i20 %odd to i32
+  %f = getelementptr [16 x i8], [16 x i8]* @fmt, i64 0, i64 0
+  call i32 (i8*, ...) @printf(i8* %f, i32 %rawi, i32 %back, i32 %ei, i32 %flagi, i32 %oddi)
+  ret i32 0
+}
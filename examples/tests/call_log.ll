@@ -0,0 +1,46 @@
+; Record and replay of the calls that reach the host: appending to a file, reading it back with stdio and mapping it.
+; Returns 1000 * the bytes read + the first mapped byte. A replay neither appends again nor sees a longer file, and writes no output
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+%struct.FILE = type opaque
+
+@append = private constant [2 x i8] c"a\00"
+@read = private constant [2 x i8] c"r\00"
+@line = private constant [5 x i8] c"abc\0A\00"
+
+declare %struct.FILE* @fopen(i8*, i8*)
+declare i32 @fputs(i8*, %struct.FILE*)
+declare i64 @fread(i8*, i64, i64, %struct.FILE*)
+declare i32 @fclose(%struct.FILE*)
+declare i32 @open(i8*, i32, ...)
+declare i8* @mmap(i8*, i64, i32, i32, i32, i64)
+declare i32 @close(i32)
+
+define i32 @main(i32 %argc, i8** %argv) {
+  %pathp = getelementptr i8*, i8** %argv, i64 1
+  %path = load i8*, i8** %pathp
+  %a = getelementptr [2 x i8], [2 x i8]* @append, i64 0, i64 0
+  %out = call %struct.FILE* @fopen(i8* %path, i8* %a)
+  %l = getelementptr [5 x i8], [5 x i8]* @line, i64 0, i64 0
+  call i32 @fputs(i8* %l, %struct.FILE* %out)
+  call i32 @fclose(%struct.FILE* %out)
+
+  %r = getelementptr [2 x i8], [2 x i8]* @read, i64 0, i64 0
+  %in = call %struct.FILE* @fopen(i8* %path, i8* %r)
+  %buf = alloca [64 x i8]
+  %bufp = getelementptr [64 x i8], [64 x i8]* %buf, i64 0, i64 0
+  %n = call i64 @fread(i8* %bufp, i64 1, i64 64, %struct.FILE* %in)
+  call i32 @fclose(%struct.FILE* %in)
+
+  %fd = call i32 (i8*, i32, ...) @open(i8* %path, i32 0)
+  %m = call i8* @mmap(i8* null, i64 4096, i32 1, i32 2, i32 %fd, i64 0)
+  call i32 @close(i32 %fd)
+  %c = load i8, i8* %m
+  %c32 = zext i8 %c to i32
+  %n32 = trunc i64 %n to i32
+  %k = mul i32 %n32, 1000
+  %res = add i32 %k, %c32
+  ret i32 %res
+}
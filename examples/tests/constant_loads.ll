@@ -0,0 +1,40 @@
+; Loads from constant globals inside a loop are folded into the decoded block. A constant pointer to a mutable global is folded, what it points to is not
+
+@k = constant i32 7
+@table = constant [4 x i16] [i16 1, i16 10, i16 100, i16 1000]
+@counter = global i32 0
+@counterRef = constant i32* @counter
+@fmt = private constant [10 x i8] c"%d %d %d\0A\00"
+
+declare i32 @printf(i8*, ...)
+
+define i32 @main() {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %next, %loop ]
+  %acc = phi i32 [ 0, %entry ], [ %acc.next, %loop ]
+  %k = load i32, i32* @k
+  %slot = and i64 %i, 3
+  %tp = getelementptr [4 x i16], [4 x i16]* @table, i64 0, i64 %slot
+  %t = load i16, i16* %tp
+  %t32 = zext i16 %t to i32
+  %kt = mul i32 %k, %t32
+  %acc.next = add i32 %acc, %kt
+  %ref = load i32*, i32** @counterRef
+  %c = load i32, i32* %ref
+  %c1 = add i32 %c, 1
+  store i32 %c1, i32* %ref
+  %next = add i64 %i, 1
+  %done = icmp eq i64 %next, 8
+  br i1 %done, label %out, label %loop
+
+out:
+  %last = load i16, i16* getelementptr ([4 x i16], [4 x i16]* @table, i64 0, i64 3)
+  %last32 = zext i16 %last to i32
+  %count = load i32, i32* @counter
+  %f = getelementptr [10 x i8], [10 x i8]* @fmt, i64 0, i64 0
+  call i32 (i8*, ...) @printf(i8* %f, i32 %acc.next, i32 %last32, i32 %count)
+  ret i32 0
+}
@@ -0,0 +1,20 @@
+; A native call that writes into a constant global is a guest fault, reported on stderr before anything is written
+
+@s = constant [6 x i8] c"hello\00"
+@src = private constant [7 x i8] c"broken\00"
+@fmt = private constant [4 x i8] c"%s\0A\00"
+
+declare i32 @printf(i8*, ...)
+declare i32 @fflush(i8*)
+declare i8* @strcpy(i8*, i8*)
+
+define i32 @main() {
+entry:
+  %f = getelementptr [4 x i8], [4 x i8]* @fmt, i64 0, i64 0
+  %d = getelementptr [6 x i8], [6 x i8]* @s, i64 0, i64 0
+  call i32 (i8*, ...) @printf(i8* %f, i8* %d)
+  call i32 @fflush(i8* null)
+  call i8* @strcpy(i8* %d, i8* getelementptr ([7 x i8], [7 x i8]* @src, i64 0, i64 0))
+  call i32 (i8*, ...) @printf(i8* %f, i8* %d)
+  ret i32 0
+}
@@ -0,0 +1,31 @@
+; Fork server requests: argv, stdin and stdout come from the client, every child starts from the globals as the server prepared them, and a guest fault only ends its own request
+
+@runs = global i32 0
+@fmt = private constant [10 x i8] c"%s %d %d\0A\00"
+
+declare i32 @printf(i8*, ...)
+declare i32 @getchar()
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %r = load i32, i32* @runs
+  %r1 = add i32 %r, 1
+  store i32 %r1, i32* @runs
+  %argp = getelementptr i8*, i8** %argv, i64 1
+  %arg = load i8*, i8** %argp
+  %first = load i8, i8* %arg
+  %fault = icmp eq i8 %first, 33
+  br i1 %fault, label %crash, label %print
+
+crash:
+  store i32 1, i32* null
+  ret i32 0
+
+print:
+  %c = call i32 @getchar()
+  %f = getelementptr [10 x i8], [10 x i8]* @fmt, i64 0, i64 0
+  call i32 (i8*, ...) @printf(i8* %f, i8* %arg, i32 %r1, i32 %c)
+  %k = mul i32 %r1, 10
+  %ret = add i32 %k, %argc
+  ret i32 %ret
+}
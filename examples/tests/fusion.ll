@@ -0,0 +1,59 @@
+; Instruction sequences executed as superinstructions: gep+store, gep+load, add+icmp, load+add+store and an icmp deciding a branch.
+; The loop counters are also adds followed by icmps, but they feed the phis too, so they must be left unfused
+
+@arr = global [64 x i32] zeroinitializer
+@hits = global i64 0
+@fmt = private constant [17 x i8] c"%d %d %d %ld %d\0A\00"
+
+declare i32 @printf(i8*, ...)
+
+define i32 @main() {
+entry:
+  br label %fill
+
+fill:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %fill ]
+  %v = trunc i64 %i to i32
+  %sq = mul i32 %v, %v
+  %p = getelementptr [64 x i32], [64 x i32]* @arr, i64 0, i64 %i
+  store i32 %sq, i32* %p
+  %i.next = add i64 %i, 1
+  %fill.done = icmp eq i64 %i.next, 64
+  br i1 %fill.done, label %sum, label %fill
+
+sum:
+  %j = phi i64 [ 0, %fill ], [ %j.next, %sum.latch ]
+  %acc = phi i32 [ 0, %fill ], [ %acc.next, %sum.latch ]
+  %big = phi i32 [ 0, %fill ], [ %big.next, %sum.latch ]
+  %q = getelementptr [64 x i32], [64 x i32]* @arr, i64 0, i64 %j
+  %x = load i32, i32* %q
+  %acc.next = add i32 %acc, %x
+  %shifted = add i32 %x, 100
+  %over = icmp sgt i32 %shifted, 1000
+  %over32 = zext i1 %over to i32
+  %big.next = add i32 %big, %over32
+  %odd = and i32 %x, 1
+  %is.odd = icmp ne i32 %odd, 0
+  br i1 %is.odd, label %count, label %sum.latch
+
+count:
+  %h = load i64, i64* @hits
+  %h1 = add i64 %h, 1
+  store i64 %h1, i64* @hits
+  %q2 = getelementptr [64 x i32], [64 x i32]* @arr, i64 0, i64 %j
+  store i32 0, i32* %q2
+  br label %sum.latch
+
+sum.latch:
+  %j.next = add i64 %j, 1
+  %sum.done = icmp eq i64 %j.next, 64
+  br i1 %sum.done, label %out, label %sum
+
+out:
+  %hits = load i64, i64* @hits
+  %even = load i32, i32* getelementptr ([64 x i32], [64 x i32]* @arr, i64 0, i64 2)
+  %cleared = load i32, i32* getelementptr ([64 x i32], [64 x i32]* @arr, i64 0, i64 3)
+  %f = getelementptr [17 x i8], [17 x i8]* @fmt, i64 0, i64 0
+  call i32 (i8*, ...) @printf(i8* %f, i32 %acc.next, i32 %even, i32 %cleared, i64 %hits, i32 %big.next)
+  ret i32 0
+}
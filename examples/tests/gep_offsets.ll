@@ -0,0 +1,66 @@
+; getelementptr with all-constant indices (folded into one byte offset when decoded), variable indices, negative indices and byte-wise indexing, on globals and the stack.
+; Addresses are printed as differences, so that only the layout of %S matters, which the data layout fixes
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+
+%S = type { i32, i64, [4 x i16] }
+
+@arr = global [3 x %S] [%S { i32 1, i64 2, [4 x i16] [i16 3, i16 4, i16 5, i16 6] }, %S { i32 7, i64 8, [4 x i16] [i16 9, i16 10, i16 11, i16 12] }, %S { i32 13, i64 14, [4 x i16] [i16 15, i16 16, i16 17, i16 18] }]
+@fmt = private constant [29 x i8] c"%ld %ld %ld %ld %d %d %d %d\0A\00"
+
+declare i32 @printf(i8*, ...)
+
+define i32 @main() {
+entry:
+  %base = getelementptr [3 x %S], [3 x %S]* @arr, i64 0, i64 0
+  %p1 = getelementptr %S, %S* %base, i64 1, i32 1
+  %b8 = bitcast %S* %base to i8*
+  %p3 = getelementptr i8, i8* %b8, i64 32
+  %last = getelementptr [3 x %S], [3 x %S]* @arr, i64 0, i64 2
+  %back = getelementptr %S, %S* %last, i64 -1, i32 2, i64 3
+  %x0 = ptrtoint %S* %base to i64
+  %x1 = ptrtoint i64* %p1 to i64
+  %x3 = ptrtoint i8* %p3 to i64
+  %xb = ptrtoint i16* %back to i64
+  %d1 = sub i64 %x1, %x0
+  %d3 = sub i64 %x3, %x0
+  %db = sub i64 %xb, %x0
+  %vb = load i16, i16* %back
+  %vb32 = sext i16 %vb to i32
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %acc = phi i32 [ 0, %entry ], [ %acc.next, %loop ]
+  %f0 = getelementptr [3 x %S], [3 x %S]* @arr, i64 0, i64 %i, i32 0
+  %v0 = load i32, i32* %f0
+  %f2 = getelementptr [3 x %S], [3 x %S]* @arr, i64 0, i64 %i, i32 2, i64 %i
+  %v2 = load i16, i16* %f2
+  %v232 = sext i16 %v2 to i32
+  %sum = add i32 %v0, %v232
+  %acc.next = add i32 %acc, %sum
+  %i.next = add i64 %i, 1
+  %done = icmp eq i64 %i.next, 3
+  br i1 %done, label %stack, label %loop
+
+stack:
+  %local = alloca [2 x %S]
+  %s1 = getelementptr [2 x %S], [2 x %S]* %local, i64 0, i64 1
+  %s1f = getelementptr %S, %S* %s1, i64 0, i32 2, i64 1
+  store i16 -5, i16* %s1f
+  %local8 = bitcast [2 x %S]* %local to i8*
+  %raw = getelementptr i8, i8* %local8, i64 42
+  %raw16 = bitcast i8* %raw to i16*
+  %vs = load i16, i16* %raw16
+  %vs32 = sext i16 %vs to i32
+  %far = getelementptr %S, %S* %s1, i64 -1, i32 1
+  %xs0 = ptrtoint [2 x %S]* %local to i64
+  %xsf = ptrtoint i64* %far to i64
+  %ds = sub i64 %xsf, %xs0
+  %v3p = bitcast i8* %p3 to i64*
+  %v3 = load i64, i64* %v3p
+  %v3lo = trunc i64 %v3 to i32
+  %f = getelementptr [29 x i8], [29 x i8]* @fmt, i64 0, i64 0
+  call i32 (i8*, ...) @printf(i8* %f, i64 %d1, i64 %d3, i64 %db, i64 %ds, i32 %vb32, i32 %acc.next, i32 %vs32, i32 %v3lo)
+  ret i32 0
+}
@@ -0,0 +1,45 @@
+; Initializers mixing plain constant data (copied in bulk), zeroinitializer (filled) and aggregates with pointers (split into their fields)
+
+@data = constant [16 x i32] [i32 1, i32 2, i32 3, i32 4, i32 5, i32 6, i32 7, i32 8, i32 9, i32 10, i32 11, i32 12, i32 13, i32 14, i32 15, i32 16]
+@text = global [12 x i8] c"interpreter\00"
+@zeros = global [200000 x i8] zeroinitializer
+@nested = global [2 x [3 x i16]] [[3 x i16] [i16 100, i16 200, i16 300], [3 x i16] [i16 -1, i16 -2, i16 -3]]
+@records = global [2 x { i32, i8*, [2 x double] }] [
+  { i32, i8*, [2 x double] } { i32 7, i8* getelementptr ([12 x i8], [12 x i8]* @text, i64 0, i64 5), [2 x double] [double 1.5, double 2.25] },
+  { i32, i8*, [2 x double] } { i32 9, i8* null, [2 x double] zeroinitializer }
+]
+@fmt = private constant [22 x i8] c"%d %s %d %d %s %d %f\0A\00"
+
+declare i32 @printf(i8*, ...)
+
+define i32 @main() {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %next, %loop ]
+  %sum = phi i32 [ 0, %entry ], [ %sum.next, %loop ]
+  %p = getelementptr [16 x i32], [16 x i32]* @data, i64 0, i64 %i
+  %v = load i32, i32* %p
+  %sum.next = add i32 %sum, %v
+  %next = add i64 %i, 1
+  %done = icmp eq i64 %next, 16
+  br i1 %done, label %out, label %loop
+
+out:
+  %z = load i8, i8* getelementptr ([200000 x i8], [200000 x i8]* @zeros, i64 0, i64 199999)
+  %z32 = zext i8 %z to i32
+  %n0 = load i16, i16* getelementptr ([2 x [3 x i16]], [2 x [3 x i16]]* @nested, i64 0, i64 0, i64 2)
+  %n1 = load i16, i16* getelementptr ([2 x [3 x i16]], [2 x [3 x i16]]* @nested, i64 0, i64 1, i64 1)
+  %n = add i16 %n0, %n1
+  %n32 = sext i16 %n to i32
+  %str = load i8*, i8** getelementptr ([2 x { i32, i8*, [2 x double] }], [2 x { i32, i8*, [2 x double] }]* @records, i64 0, i64 0, i32 1)
+  %r1 = load i32, i32* getelementptr ([2 x { i32, i8*, [2 x double] }], [2 x { i32, i8*, [2 x double] }]* @records, i64 0, i64 1, i32 0)
+  %d0 = load double, double* getelementptr ([2 x { i32, i8*, [2 x double] }], [2 x { i32, i8*, [2 x double] }]* @records, i64 0, i64 0, i32 2, i64 1)
+  %d1 = load double, double* getelementptr ([2 x { i32, i8*, [2 x double] }], [2 x { i32, i8*, [2 x double] }]* @records, i64 0, i64 1, i32 2, i64 0)
+  %d = fadd double %d0, %d1
+  %f = getelementptr [22 x i8], [22 x i8]* @fmt, i64 0, i64 0
+  %t = getelementptr [12 x i8], [12 x i8]* @text, i64 0, i64 0
+  call i32 (i8*, ...) @printf(i8* %f, i32 %sum.next, i8* %t, i32 %z32, i32 %n32, i8* %str, i32 %r1, double %d)
+  ret i32 0
+}
@@ -0,0 +1,51 @@
+; 30 threads increment a counter without synchronisation, with a load and a store in different blocks. Under green threads, the lost updates
+; depend only on the seed and the quantum of the scheduler, so every run with the same ones prints the same count
+
+@cnt = global i64 0
+@fmt = private constant [5 x i8] c"%ld\0A\00"
+declare i32 @pthread_create(i64*, i8*, i8* (i8*)*, i8*)
+declare i32 @pthread_join(i64, i8**)
+declare i32 @printf(i8*, ...)
+define i8* @w(i8* %a) {
+e:
+  br label %l
+l:
+  %i = phi i32 [0, %e], [%n, %l2]
+  %v = load i64, i64* @cnt
+  br label %l2
+l2:
+  %v1 = add i64 %v, 1
+  store i64 %v1, i64* @cnt
+  %n = add i32 %i, 1
+  %c = icmp ult i32 %n, 1000
+  br i1 %c, label %l, label %d
+d:
+  ret i8* null
+}
+define i32 @main() {
+e:
+  %ts = alloca [30 x i64]
+  br label %c
+c:
+  %i = phi i64 [0, %e], [%n, %c]
+  %p = getelementptr [30 x i64], [30 x i64]* %ts, i64 0, i64 %i
+  call i32 @pthread_create(i64* %p, i8* null, i8* (i8*)* @w, i8* null)
+  %n = add i64 %i, 1
+  %cc = icmp ult i64 %n, 30
+  br i1 %cc, label %c, label %j0
+j0:
+  br label %j
+j:
+  %k = phi i64 [0, %j0], [%kn, %j]
+  %q = getelementptr [30 x i64], [30 x i64]* %ts, i64 0, i64 %k
+  %t = load i64, i64* %q
+  call i32 @pthread_join(i64 %t, i8** null)
+  %kn = add i64 %k, 1
+  %kc = icmp ult i64 %kn, 30
+  br i1 %kc, label %j, label %d
+d:
+  %r = load i64, i64* @cnt
+  %f = getelementptr [5 x i8], [5 x i8]* @fmt, i32 0, i32 0
+  call i32 (i8*, ...) @printf(i8* %f, i64 %r)
+  ret i32 0
+}
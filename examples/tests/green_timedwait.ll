@@ -0,0 +1,54 @@
+; Two threads wait on different condition variables with a timeout that has already passed, thread 1 first. Green threads time out
+; such waits in the order they started, so thread 1 reports first
+
+@m = global [40 x i8] zeroinitializer, align 8
+@c = global [2 x [48 x i8]] zeroinitializer, align 8
+@started = global i32 0, align 4
+@fmt = private constant [16 x i8] c"timeout %ld %d\0A\00"
+
+declare i32 @pthread_create(i64*, i8*, i8* (i8*)*, i8*)
+declare i32 @pthread_join(i64, i8**)
+declare i32 @pthread_mutex_lock(i8*)
+declare i32 @pthread_mutex_unlock(i8*)
+declare i32 @pthread_cond_timedwait(i8*, i8*, i8*)
+declare i32 @printf(i8*, ...)
+
+define i8* @waiter(i8* %arg) {
+  %i = ptrtoint i8* %arg to i64
+  %ts = alloca { i64, i64 }, align 8
+  %tsp = bitcast { i64, i64 }* %ts to i8*
+  call void @llvm.memset.p0i8.i64(i8* %tsp, i8 0, i64 16, i1 false)
+  %mp = getelementptr [40 x i8], [40 x i8]* @m, i64 0, i64 0
+  call i32 @pthread_mutex_lock(i8* %mp)
+  %s = load volatile i32, i32* @started
+  %s1 = add i32 %s, 1
+  store volatile i32 %s1, i32* @started
+  %cp = getelementptr [2 x [48 x i8]], [2 x [48 x i8]]* @c, i64 0, i64 %i, i64 0
+  %r = call i32 @pthread_cond_timedwait(i8* %cp, i8* %mp, i8* %tsp)
+  %nz = icmp ne i32 %r, 0
+  %nzi = zext i1 %nz to i32
+  %f = getelementptr [16 x i8], [16 x i8]* @fmt, i64 0, i64 0
+  call i32 (i8*, ...) @printf(i8* %f, i64 %i, i32 %nzi)
+  call i32 @pthread_mutex_unlock(i8* %mp)
+  ret i8* null
+}
+
+declare void @llvm.memset.p0i8.i64(i8*, i8, i64, i1)
+
+define i32 @main() {
+  %t1 = alloca i64
+  %t0 = alloca i64
+  call i32 @pthread_create(i64* %t1, i8* null, i8* (i8*)* @waiter, i8* inttoptr (i64 1 to i8*))
+  br label %spin
+spin:
+  %s = load volatile i32, i32* @started
+  %done = icmp sge i32 %s, 1
+  br i1 %done, label %go, label %spin
+go:
+  call i32 @pthread_create(i64* %t0, i8* null, i8* (i8*)* @waiter, i8* null)
+  %h1 = load i64, i64* %t1
+  call i32 @pthread_join(i64 %h1, i8** null)
+  %h0 = load i64, i64* %t0
+  call i32 @pthread_join(i64 %h0, i8** null)
+  ret i32 0
+}
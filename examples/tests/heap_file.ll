@@ -0,0 +1,58 @@
+; A heap working set of 96 MiB touched sparsely, plus a 4 MiB memset and a copy into a 32 MiB block, so that a file-backed heap has to page blocks in and out
+
+@fmt = private constant [14 x i8] c"%ld %d %d %d\0A\00"
+
+declare i8* @malloc(i64)
+declare void @llvm.memset.p0i8.i64(i8*, i8, i64, i1)
+declare void @llvm.memcpy.p0i8.p0i8.i64(i8*, i8*, i64, i1)
+declare void @free(i8*)
+declare i32 @printf(i8*, ...)
+
+define i32 @main() {
+entry:
+  %big = call i8* @malloc(i64 100663296)
+  br label %write
+
+write:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %write ]
+  %p = getelementptr i8, i8* %big, i64 %i
+  %b = trunc i64 %i to i8
+  store i8 %b, i8* %p
+  %i.next = add i64 %i, 65537
+  %w.done = icmp uge i64 %i.next, 100663296
+  br i1 %w.done, label %read, label %write
+
+read:
+  %j = phi i64 [ 0, %write ], [ %j.next, %read ]
+  %sum = phi i64 [ 0, %write ], [ %sum.next, %read ]
+  %q = getelementptr i8, i8* %big, i64 %j
+  %v = load i8, i8* %q
+  %v64 = zext i8 %v to i64
+  %sum.next = add i64 %sum, %v64
+  %j.next = add i64 %j, 65537
+  %r.done = icmp uge i64 %j.next, 100663296
+  br i1 %r.done, label %more, label %read
+
+more:
+  %z = call i8* @malloc(i64 4194304)
+  call void @llvm.memset.p0i8.i64(i8* %z, i8 0, i64 4194304, i1 false)
+  %zp = getelementptr i8, i8* %z, i64 4000000
+  %zv = load i8, i8* %zp
+  %z32 = zext i8 %zv to i32
+  %small = call i8* @malloc(i64 16)
+  store i8 77, i8* %small
+  %grown = call i8* @malloc(i64 33554432)
+  call void @llvm.memcpy.p0i8.p0i8.i64(i8* %grown, i8* %small, i64 16, i1 false)
+  call void @free(i8* %small)
+  %gv = load i8, i8* %grown
+  %g32 = zext i8 %gv to i32
+  %tail = getelementptr i8, i8* %big, i64 100599295
+  %tv = load i8, i8* %tail
+  %t32 = zext i8 %tv to i32
+  call void @free(i8* %big)
+  call void @free(i8* %z)
+  call void @free(i8* %grown)
+  %f = getelementptr [14 x i8], [14 x i8]* @fmt, i64 0, i64 0
+  call i32 (i8*, ...) @printf(i8* %f, i64 %sum.next, i32 %z32, i32 %g32, i32 %t32)
+  ret i32 0
+}
@@ -0,0 +1,318 @@
+// HotFix 回归测试: hotfix_tests <case>, exits with 0 if the case passes
+// Besides the HotFix API, the cases cover what embedders use directly, such as interpreters sharing a ModuleImage
+#include "LLVMInterpreter/HotFix.h"
+#include "LLVMInterpreter/ModuleImage.h"
+
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <thread>
+#include <vector>
+
+using namespace llvm_interpreter;
+
+namespace {
+
+const TypeInfo INT32_TYPE = { TypeKind::INT32, sizeof(int32_t), nullptr };
+
+bool check(bool ok, const std::string& what) {
+    if (!ok)
+        std::cerr << "FAILED: " << what << "\n";
+    return ok;
+}
+
+// Call an i32 (i32) function of the loaded module, and check that it succeeds with (expected)
+bool expectCall(HotFix& hotfix, const char* functionName, int32_t arg, int32_t expected) {
+    const void* args[] = { &arg };
+    int32_t result = 0;
+    if (!hotfix.executeFunction(functionName, args, &INT32_TYPE, 1, &INT32_TYPE, &result))
+        return check(false, std::string(functionName) + "(" + std::to_string(arg) + ") failed");
+    return check(result == expected, std::string(functionName) + "(" + std::to_string(arg) + ") returned " + std::to_string(result) + " instead of " + std::to_string(expected));
+}
+
+// Guest memory written after a snapshot (globals and the heap) is reset by restoring it. A file mapped shared into the heap cannot be reset, so taking a snapshot then fails
+bool testSnapshot() {
+    const char* dataFile = "snapshot.dat";
+    std::ofstream(dataFile) << "Snapshot data\n";
+
+    std::string irCode = R"(
+@counter = global i32 0
+@last = global i8* null
+@path = private constant [13 x i8] c"snapshot.dat\00"
+
+declare i8* @malloc(i64)
+declare i32 @open(i8*, i32, ...)
+declare i8* @mmap(i8*, i64, i32, i32, i32, i64)
+
+define i32 @bump(i32 %x) {
+  %c = load i32, i32* @counter
+  %n = add i32 %c, %x
+  store i32 %n, i32* @counter
+  %m = call i8* @malloc(i64 4096)
+  %prev = load i8*, i8** @last
+  %fresh = icmp eq i8* %prev, null
+  store i8* %m, i8** @last
+  %r = select i1 %fresh, i32 %n, i32 -1
+  ret i32 %r
+}
+
+define i32 @mapFile(i32 %flags) {
+  %p = getelementptr [13 x i8], [13 x i8]* @path, i64 0, i64 0
+  %fd = call i32 (i8*, i32, ...) @open(i8* %p, i32 2)
+  %m = call i8* @mmap(i8* null, i64 4096, i32 3, i32 %flags, i32 %fd, i64 0)
+  %c = load i8, i8* %m
+  %c32 = zext i8 %c to i32
+  ret i32 %c32
+}
+)";
+
+    HotFix hotfix;
+    if (!check(hotfix.loadBitcodeFromString(irCode), "loading the module"))
+        return false;
+    if (!check(hotfix.takeSnapshot(), "snapshot after loading"))
+        return false;
+    // The second call sees the first one's global writes and allocation
+    if (!expectCall(hotfix, "bump", 5, 5) || !expectCall(hotfix, "bump", 5, -1))
+        return false;
+    if (!check(hotfix.restoreSnapshot(), "restoring the snapshot") || !expectCall(hotfix, "bump", 5, 5))
+        return false;
+
+    if (!check(hotfix.restoreSnapshot(), "restoring the snapshot") || !expectCall(hotfix, "mapFile", MAP_PRIVATE, 'S'))
+        return false;
+    if (!check(hotfix.takeSnapshot(), "snapshot with a private file mapping"))
+        return false;
+    if (!expectCall(hotfix, "mapFile", MAP_SHARED, 'S'))
+        return false;
+    return check(!hotfix.takeSnapshot(), "snapshot with a shared file mapping succeeded");
+}
+
+// Replacing a function takes effect both where it is called and where it was inlined, and a patch that does not fit leaves the module as it was
+bool testReplaceFunctions() {
+    const char* irCode = R"(
+@k = constant i32 100
+
+define i32 @step(i32 %x) {
+  %r = add i32 %x, 1
+  ret i32 %r
+}
+
+define i32 @caller(i32 %x) {
+  %k = load i32, i32* @k
+  %s = call i32 @step(i32 %x)
+  %r = add i32 %s, %k
+  ret i32 %r
+}
+)";
+    const char* patch = R"(
+@k = external constant i32
+
+define i32 @step(i32 %x) {
+  %k = load i32, i32* @k
+  %m = mul i32 %x, 2
+  %r = add i32 %m, %k
+  ret i32 %r
+}
+)";
+    const char* wrongType = R"(
+define i64 @step(i64 %x) {
+  ret i64 %x
+}
+)";
+
+    HotFix hotfix;
+    hotfix.setInlineThreshold(10);
+    if (!check(hotfix.loadBitcodeFromString(irCode), "loading the module"))
+        return false;
+    if (!expectCall(hotfix, "caller", 3, 104) || !expectCall(hotfix, "step", 5, 6))
+        return false;
+    if (!check(!hotfix.replaceFunctions(wrongType), "a patch changing the type of @step was applied") || !expectCall(hotfix, "step", 5, 6))
+        return false;
+    if (!check(hotfix.replaceFunctions(patch), "applying the patch"))
+        return false;
+    return expectCall(hotfix, "caller", 3, 206) && expectCall(hotfix, "step", 5, 110);
+}
+
+// Interpreters created from one loaded image run on different host threads at the same time, each with its own copy of the globals it writes. The image keeps the initial values for the next interpreter
+bool testSharedImage() {
+    const char* irCode = R"(
+@counter = global i32 0
+@table = global [1024 x i32] zeroinitializer
+
+define i32 @work(i32 %seed) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %c = load i32, i32* @counter
+  %c1 = add i32 %c, %seed
+  store i32 %c1, i32* @counter
+  %slot = and i32 %i, 1023
+  %p = getelementptr [1024 x i32], [1024 x i32]* @table, i32 0, i32 %slot
+  %t = load i32, i32* %p
+  %t1 = add i32 %t, %seed
+  store i32 %t1, i32* %p
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, 10000
+  br i1 %done, label %out, label %loop
+
+out:
+  %first = load i32, i32* getelementptr ([1024 x i32], [1024 x i32]* @table, i32 0, i32 0)
+  %r = add i32 %c1, %first
+  ret i32 %r
+}
+)";
+
+    llvm::LLVMContext context;
+    llvm::SMDiagnostic err;
+    auto module = llvm::parseIR(llvm::MemoryBufferRef(irCode, "shared_image"), err, context);
+    if (!check(module != nullptr, "parsing the module"))
+        return false;
+    auto work = module->getFunction("work");
+    auto image = ModuleImage::load(module.get());
+
+    auto run = [&image, work] (int32_t seed) {
+        Interpreter interpreter(image);
+        interpreter.evaluateGlobals();
+        auto args = std::vector<DynamicValue>();
+        args.push_back(DynamicValue::getIntValue(llvm::APInt(32, seed)));
+        return int32_t(interpreter.runFunction(work, args).getAsIntValue().getInt().getSExtValue());
+    };
+
+    const int32_t numThreads = 4;
+    int32_t results[numThreads] = {};
+    auto threads = std::vector<std::thread>();
+    for (auto i = 0; i < numThreads; ++i)
+        threads.emplace_back([&run, &results, i] { results[i] = run(i + 1); });
+    for (auto& thread: threads)
+        thread.join();
+
+    auto ok = true;
+    // 10000 additions to the counter and 10 to table[0] each
+    for (auto i = 0; i < numThreads; ++i)
+        ok &= check(results[i] == 10010 * (i + 1), "thread " + std::to_string(i) + " returned " + std::to_string(results[i]) + " instead of " + std::to_string(10010 * (i + 1)));
+    return ok && check(run(7) == 70070, "an interpreter created afterwards does not start from the initial globals");
+}
+
+// A guest fault makes executeFunction() fail without leaving frames behind, so the module can still be called, and snapshots taken and restored
+bool testFault() {
+    const char* irCode = R"(
+@calls = global i32 0
+
+define i32 @count(i32 %x) {
+  %c = load i32, i32* @calls
+  %n = add i32 %c, %x
+  store i32 %n, i32* @calls
+  ret i32 %n
+}
+
+define i32 @fault(i32 %x) {
+  %n = call i32 @count(i32 %x)
+  store i32 %n, i32* null
+  ret i32 %n
+}
+)";
+
+    HotFix hotfix;
+    if (!check(hotfix.loadBitcodeFromString(irCode), "loading the module") || !check(hotfix.takeSnapshot(), "snapshot after loading"))
+        return false;
+    int32_t arg = 1;
+    const void* args[] = { &arg };
+    int32_t result = 0;
+    if (!check(!hotfix.executeFunction("fault", args, &INT32_TYPE, 1, &INT32_TYPE, &result), "fault(1) succeeded"))
+        return false;
+    // The call to @count finished before the fault
+    if (!expectCall(hotfix, "count", 2, 3))
+        return false;
+    if (!check(hotfix.restoreSnapshot(), "restoring the snapshot after a fault") || !expectCall(hotfix, "count", 2, 2))
+        return false;
+    return check(hotfix.takeSnapshot(), "snapshot after a fault");
+}
+
+// A module cache miss returns a fully parsed module and a hit one whose bodies are read on first call, and inlining at call time works on both
+bool testModuleCache() {
+    const char* irFile = "module_cache.ll";
+    std::ofstream(irFile) << R"(
+define i32 @step(i32 %x) {
+  %r = mul i32 %x, 3
+  ret i32 %r
+}
+
+define i32 @caller(i32 %x) {
+  %s = call i32 @step(i32 %x)
+  %t = call i32 @step(i32 %s)
+  %r = add i32 %t, 1
+  ret i32 %r
+}
+
+define i32 @unused(i32 %x) {
+  ret i32 %x
+}
+)";
+
+    auto lazyBodies = [] (const llvm::Module& module) {
+        auto numLazy = 0u;
+        for (const auto& f: module)
+            numLazy += f.isMaterializable();
+        return numLazy;
+    };
+    // Runs of the test share the scratch directory, so the caches start out empty only once they are removed
+    llvm::sys::fs::remove_directories("cache");
+    llvm::sys::fs::remove_directories("hotfix_cache");
+    ModuleCache cache("cache");
+    llvm::SMDiagnostic err;
+    llvm::LLVMContext coldContext;
+    auto cold = cache.loadModule(irFile, PrepassLevel::NONE, coldContext, err);
+    if (!check(cold != nullptr, "loading the module into an empty cache") || !check(lazyBodies(*cold) == 0, "a cache miss left function bodies unread"))
+        return false;
+    llvm::LLVMContext warmContext;
+    auto warm = cache.loadModule(irFile, PrepassLevel::NONE, warmContext, err);
+    if (!check(warm != nullptr, "loading the module from the cache") || !check(lazyBodies(*warm) == 3, "a cache hit read function bodies up front"))
+        return false;
+
+    // Cold, then warm: @step is inlined into @caller either way
+    for (auto run = 0; run < 2; ++run) {
+        HotFix hotfix;
+        hotfix.setModuleCacheDir("hotfix_cache");
+        hotfix.setInlineThreshold(10);
+        if (!check(hotfix.loadBitcodeFromFile(irFile), "loading the module through HotFix"))
+            return false;
+        if (!expectCall(hotfix, "caller", 2, 19) || !expectCall(hotfix, "caller", 5, 46) || !expectCall(hotfix, "step", 4, 12))
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " <case>\n";
+        return 2;
+    }
+
+    const struct {
+        const char* name;
+        bool (*run)();
+    } cases[] = {
+        { "snapshot", testSnapshot },
+        { "replace_functions", testReplaceFunctions },
+        { "shared_image", testSharedImage },
+        { "fault", testFault },
+        { "module_cache", testModuleCache },
+    };
+    for (const auto& testCase : cases) {
+        if (std::strcmp(argv[1], testCase.name) == 0)
+            return testCase.run() ? 0 : 1;
+    }
+    std::cerr << "Unknown case: " << argv[1] << "\n";
+    return 2;
+}
@@ -0,0 +1,57 @@
+; Small callees (accessors and a function with a local) are inlined at call time, and a recursive one must still work
+
+declare i32 @printf(i8*, ...)
+@fmt = private constant [5 x i8] c"%ld\0A\00"
+%S = type { i64, i64 }
+
+define i64 @get(%S* %s) {
+  %p = getelementptr %S, %S* %s, i32 0, i32 0
+  %v = load i64, i64* %p
+  ret i64 %v
+}
+define void @set(%S* %s, i64 %v) {
+  %p = getelementptr %S, %S* %s, i32 0, i32 0
+  store i64 %v, i64* %p
+  ret void
+}
+define i64 @twice(i64 %x) {
+  %t = alloca i64
+  store i64 %x, i64* %t
+  %l = load i64, i64* %t
+  %r = add i64 %l, %l
+  ret i64 %r
+}
+define i64 @fact(i64 %n) {
+  %c = icmp sle i64 %n, 1
+  br i1 %c, label %base, label %rec
+base:
+  ret i64 1
+rec:
+  %m = sub i64 %n, 1
+  %f = call i64 @fact(i64 %m)
+  %r = mul i64 %n, %f
+  ret i64 %r
+}
+
+define i32 @main() {
+entry:
+  %s = alloca %S
+  call void @set(%S* %s, i64 0)
+  br label %loop
+loop:
+  %i = phi i64 [0, %entry], [%i1, %loop]
+  %v = call i64 @get(%S* %s)
+  %w = call i64 @twice(i64 %i)
+  %v2 = add i64 %v, %w
+  call void @set(%S* %s, i64 %v2)
+  %i1 = add i64 %i, 1
+  %c = icmp slt i64 %i1, 30000
+  br i1 %c, label %loop, label %done
+done:
+  %res = call i64 @get(%S* %s)
+  %f = call i64 @fact(i64 10)
+  %sum = add i64 %res, %f
+  %fp = getelementptr [5 x i8], [5 x i8]* @fmt, i32 0, i32 0
+  call i32 (i8*, ...) @printf(i8* %fp, i64 %sum)
+  ret i32 0
+}
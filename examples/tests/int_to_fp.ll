@@ -0,0 +1,16 @@
+; Integer to floating-point casts round once, to the nearest float. sitofp keeps the sign, and vector lanes round like scalars
+
+@fmt = private constant [14 x i8] c"%f %.1f %.1f\0A\00"
+declare i32 @printf(i8*, ...)
+define i32 @main() {
+  %a = sitofp i32 -3 to double
+  %b = sitofp i64 9007199791611905 to float
+  %bd = fpext float %b to double
+  %v = insertelement <2 x i64> zeroinitializer, i64 9007199791611905, i32 0
+  %vf = sitofp <2 x i64> %v to <2 x float>
+  %e = extractelement <2 x float> %vf, i32 0
+  %ed = fpext float %e to double
+  %f = getelementptr [14 x i8], [14 x i8]* @fmt, i64 0, i64 0
+  call i32 (i8*, ...) @printf(i8* %f, double %a, double %bd, double %ed)
+  ret i32 0
+}
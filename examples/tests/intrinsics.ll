@@ -0,0 +1,95 @@
+; The intrinsics -O2 code calls: integer min/max/abs and bit counting, byte swaps and funnel shifts, math, memory intrinsics, hints, vector reductions and overflow checks
+
+declare i32 @printf(i8*, ...)
+declare i32 @llvm.smax.i32(i32, i32)
+declare i32 @llvm.umin.i32(i32, i32)
+declare i32 @llvm.abs.i32(i32, i1)
+declare i32 @llvm.ctpop.i32(i32)
+declare i32 @llvm.ctlz.i32(i32, i1)
+declare i32 @llvm.cttz.i32(i32, i1)
+declare i32 @llvm.bswap.i32(i32)
+declare i32 @llvm.fshl.i32(i32, i32, i32)
+declare i32 @llvm.fshr.i32(i32, i32, i32)
+declare double @llvm.fmuladd.f64(double, double, double)
+declare double @llvm.sqrt.f64(double)
+declare void @llvm.lifetime.start.p0i8(i64, i8*)
+declare void @llvm.lifetime.end.p0i8(i64, i8*)
+declare void @llvm.assume(i1)
+declare i64 @llvm.expect.i64(i64, i64)
+declare void @llvm.memcpy.p0i8.p0i8.i64(i8*, i8*, i64, i1)
+declare void @llvm.memset.p0i8.i64(i8*, i8, i64, i1)
+declare <4 x i32> @llvm.smax.v4i32(<4 x i32>, <4 x i32>)
+declare i32 @llvm.vector.reduce.add.v4i32(<4 x i32>)
+declare {i32, i1} @llvm.uadd.with.overflow.i32(i32, i32)
+declare {i32, i1} @llvm.smul.with.overflow.i32(i32, i32)
+declare i8 @llvm.usub.sat.i8(i8, i8)
+declare i8 @llvm.sadd.sat.i8(i8, i8)
+declare i16 @llvm.bitreverse.i16(i16)
+declare double @llvm.copysign.f64(double, double)
+declare double @llvm.floor.f64(double)
+declare float @llvm.vector.reduce.fmax.v4f32(<4 x float>)
+declare void @llvm.memmove.p0i8.p0i8.i64(i8*, i8*, i64, i1)
+@fmt = private constant [37 x i8] c"%d %u %d %d %d %d %x %x %x %f %f %d\0A\00"
+@fmt2 = private constant [16 x i8] c"%d %d %d %d %d\0A\00"
+@fmt3 = private constant [22 x i8] c"%d %d %d %d %x %f %f\0A\00"
+@text = private constant [9 x i8] c"abcdefgh\00"
+
+define i32 @main() {
+  %buf = alloca [16 x i8]
+  %buf2 = alloca [16 x i8]
+  %p = getelementptr [16 x i8], [16 x i8]* %buf, i32 0, i32 0
+  %p2 = getelementptr [16 x i8], [16 x i8]* %buf2, i32 0, i32 0
+  call void @llvm.lifetime.start.p0i8(i64 16, i8* %p)
+  call void @llvm.assume(i1 true)
+  call void @llvm.memset.p0i8.i64(i8* %p, i8 7, i64 16, i1 false)
+  call void @llvm.memcpy.p0i8.p0i8.i64(i8* %p2, i8* %p, i64 16, i1 false)
+  %q = getelementptr i8, i8* %p2, i32 5
+  %b = load i8, i8* %q
+  %bi = zext i8 %b to i32
+  %a1 = call i32 @llvm.smax.i32(i32 -5, i32 3)
+  %a2 = call i32 @llvm.umin.i32(i32 -5, i32 3)
+  %a3 = call i32 @llvm.abs.i32(i32 -42, i1 false)
+  %a4 = call i32 @llvm.ctpop.i32(i32 255)
+  %a5 = call i32 @llvm.ctlz.i32(i32 1000, i1 true)
+  %a6 = call i32 @llvm.cttz.i32(i32 1024, i1 true)
+  %a7 = call i32 @llvm.bswap.i32(i32 305419896)
+  %a8 = call i32 @llvm.fshl.i32(i32 305419896, i32 305419896, i32 8)
+  %a9 = call i32 @llvm.fshr.i32(i32 305419896, i32 305419896, i32 8)
+  %f1 = call double @llvm.fmuladd.f64(double 2.0, double 3.0, double 0.5)
+  %f2 = call double @llvm.sqrt.f64(double 2.0)
+  %e = call i64 @llvm.expect.i64(i64 1, i64 1)
+  call void @llvm.lifetime.end.p0i8(i64 16, i8* %p)
+  %fp = getelementptr [37 x i8], [37 x i8]* @fmt, i32 0, i32 0
+  call i32 (i8*, ...) @printf(i8* %fp, i32 %a1, i32 %a2, i32 %a3, i32 %a4, i32 %a5, i32 %a6, i32 %a7, i32 %a8, i32 %a9, double %f1, double %f2, i32 %bi)
+  %v = call <4 x i32> @llvm.smax.v4i32(<4 x i32> <i32 1, i32 -2, i32 3, i32 -4>, <4 x i32> zeroinitializer)
+  %r = call i32 @llvm.vector.reduce.add.v4i32(<4 x i32> %v)
+  %o = call {i32, i1} @llvm.uadd.with.overflow.i32(i32 -1, i32 2)
+  %o0 = extractvalue {i32, i1} %o, 0
+  %o1 = extractvalue {i32, i1} %o, 1
+  %o1i = zext i1 %o1 to i32
+  %v1 = extractelement <4 x i32> %v, i32 1
+  %fp2 = getelementptr [16 x i8], [16 x i8]* @fmt2, i32 0, i32 0
+  %e32 = trunc i64 %e to i32
+  call i32 (i8*, ...) @printf(i8* %fp2, i32 %r, i32 %o0, i32 %o1i, i32 %v1, i32 %e32)
+  %m = call {i32, i1} @llvm.smul.with.overflow.i32(i32 65536, i32 -32768)
+  %m1 = extractvalue {i32, i1} %m, 1
+  %m1i = zext i1 %m1 to i32
+  %s1 = call i8 @llvm.usub.sat.i8(i8 10, i8 20)
+  %s1i = zext i8 %s1 to i32
+  %s2 = call i8 @llvm.sadd.sat.i8(i8 100, i8 100)
+  %s2i = sext i8 %s2 to i32
+  call void @llvm.memcpy.p0i8.p0i8.i64(i8* %p, i8* getelementptr ([9 x i8], [9 x i8]* @text, i64 0, i64 0), i64 9, i1 false)
+  %p1 = getelementptr i8, i8* %p, i64 2
+  call void @llvm.memmove.p0i8.p0i8.i64(i8* %p1, i8* %p, i64 5, i1 false)
+  %mv = bitcast i8* %p to i32*
+  %mvw = load i32, i32* %mv
+  %br = call i16 @llvm.bitreverse.i16(i16 1)
+  %bri = zext i16 %br to i32
+  %cs = call double @llvm.copysign.f64(double 2.5, double -0.0)
+  %fl = call double @llvm.floor.f64(double %cs)
+  %fm = call float @llvm.vector.reduce.fmax.v4f32(<4 x float> <float 1.0, float 4.5, float -9.0, float 2.0>)
+  %fmd = fpext float %fm to double
+  %fp3 = getelementptr [22 x i8], [22 x i8]* @fmt3, i32 0, i32 0
+  call i32 (i8*, ...) @printf(i8* %fp3, i32 %m1i, i32 %s1i, i32 %s2i, i32 %bri, i32 %mvw, double %fl, double %fmd)
+  ret i32 0
+}
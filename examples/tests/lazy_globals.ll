@@ -0,0 +1,43 @@
+; Globals reached only through other globals: a pointer in an initializer, a function pointer table and a global written before it is read
+
+@counter = global i32 40
+@target = global [4 x i32] [i32 10, i32 20, i32 30, i32 40]
+@link = global i32* getelementptr ([4 x i32], [4 x i32]* @target, i64 0, i64 2)
+@chain = global i32** @link
+@ops = global [2 x i32 (i32)*] [i32 (i32)* @twice, i32 (i32)* @inc]
+@written = global [8 x i8] zeroinitializer
+@fmt = private constant [16 x i8] c"%d %d %d %d %s\0A\00"
+
+declare i32 @printf(i8*, ...)
+
+define i32 @twice(i32 %x) {
+  %r = mul i32 %x, 2
+  ret i32 %r
+}
+
+define i32 @inc(i32 %x) {
+  %r = add i32 %x, 1
+  ret i32 %r
+}
+
+define i32 @main() {
+entry:
+  %c = load i32, i32* @counter
+  %c1 = add i32 %c, 2
+  store i32 %c1, i32* @counter
+  %l = load i32**, i32*** @chain
+  %p = load i32*, i32** %l
+  %v = load i32, i32* %p
+  %f0 = load i32 (i32)*, i32 (i32)** getelementptr ([2 x i32 (i32)*], [2 x i32 (i32)*]* @ops, i64 0, i64 0)
+  %f1 = load i32 (i32)*, i32 (i32)** getelementptr ([2 x i32 (i32)*], [2 x i32 (i32)*]* @ops, i64 0, i64 1)
+  %a = call i32 %f0(i32 %v)
+  %b = call i32 %f1(i32 %a)
+  %w = getelementptr [8 x i8], [8 x i8]* @written, i64 0, i64 0
+  store i8 111, i8* %w
+  %w1 = getelementptr [8 x i8], [8 x i8]* @written, i64 0, i64 1
+  store i8 107, i8* %w1
+  %c2 = load i32, i32* @counter
+  %f = getelementptr [16 x i8], [16 x i8]* @fmt, i64 0, i64 0
+  call i32 (i8*, ...) @printf(i8* %f, i32 %c2, i32 %v, i32 %a, i32 %b, i8* %w)
+  ret i32 0
+}
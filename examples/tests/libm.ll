@@ -0,0 +1,72 @@
+; Native libm: scalar double and float functions, the ones taking pointers, and the x86 vector function ABI variants applied to vector lanes in one batch
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@scalarFmt = private constant [62 x i8] c"sqrt=%.6f pow=%.1f sqrtf=%.1f ldexp=%.1f fma=%.1f lround=%ld\0A\00"
+@pointerFmt = private constant [69 x i8] c"frexp=%.2f,%d modf=%.2f,%.1f remquo=%.1f,%d sincos=%.1f,%.1f nan=%d\0A\00"
+@vectorFmt = private constant [53 x i8] c"sqrt4=%.1f %.1f %.1f %.1f powf4=%.1f %.1f %.1f %.1f\0A\00"
+@empty = private constant [1 x i8] zeroinitializer
+
+declare i32 @printf(i8*, ...)
+declare double @sqrt(double)
+declare double @pow(double, double)
+declare float @sqrtf(float)
+declare double @ldexp(double, i32)
+declare double @fma(double, double, double)
+declare i64 @lround(double)
+declare double @frexp(double, i32*)
+declare double @modf(double, double*)
+declare double @remquo(double, double, i32*)
+declare void @sincos(double, double*, double*)
+declare double @nan(i8*)
+declare <4 x double> @_ZGVdN4v_sqrt(<4 x double>)
+declare <4 x float> @_ZGVbN4vv_powf(<4 x float>, <4 x float>)
+
+define i32 @main() {
+  %sqrt = call double @sqrt(double 2.0)
+  %pow = call double @pow(double 2.0, double 10.0)
+  %sqrtf = call float @sqrtf(float 16.0)
+  %sqrtfd = fpext float %sqrtf to double
+  %ldexp = call double @ldexp(double 1.5, i32 4)
+  %fma = call double @fma(double 2.0, double 3.0, double 0.5)
+  %lround = call i64 @lround(double 2.5)
+  %sf = getelementptr [62 x i8], [62 x i8]* @scalarFmt, i64 0, i64 0
+  call i32 (i8*, ...) @printf(i8* %sf, double %sqrt, double %pow, double %sqrtfd, double %ldexp, double %fma, i64 %lround)
+
+  %exp = alloca i32
+  %frexp = call double @frexp(double 48.0, i32* %exp)
+  %e = load i32, i32* %exp
+  %ip = alloca double
+  %modf = call double @modf(double 3.25, double* %ip)
+  %i = load double, double* %ip
+  %quo = alloca i32
+  %remquo = call double @remquo(double 10.0, double 3.0, i32* %quo)
+  %q = load i32, i32* %quo
+  %sinp = alloca double
+  %cosp = alloca double
+  call void @sincos(double 0.0, double* %sinp, double* %cosp)
+  %s = load double, double* %sinp
+  %c = load double, double* %cosp
+  %emptyp = getelementptr [1 x i8], [1 x i8]* @empty, i64 0, i64 0
+  %nan = call double @nan(i8* %emptyp)
+  %isnan = fcmp uno double %nan, %nan
+  %isnani = zext i1 %isnan to i32
+  %pf = getelementptr [69 x i8], [69 x i8]* @pointerFmt, i64 0, i64 0
+  call i32 (i8*, ...) @printf(i8* %pf, double %frexp, i32 %e, double %modf, double %i, double %remquo, i32 %q, double %s, double %c, i32 %isnani)
+
+  %sqrt4 = call <4 x double> @_ZGVdN4v_sqrt(<4 x double> <double 1.0, double 4.0, double 9.0, double 16.0>)
+  %powf4 = call <4 x float> @_ZGVbN4vv_powf(<4 x float> <float 2.0, float 3.0, float 4.0, float 5.0>, <4 x float> <float 2.0, float 2.0, float 2.0, float 2.0>)
+  %s0 = extractelement <4 x double> %sqrt4, i32 0
+  %s1 = extractelement <4 x double> %sqrt4, i32 1
+  %s2 = extractelement <4 x double> %sqrt4, i32 2
+  %s3 = extractelement <4 x double> %sqrt4, i32 3
+  %pd = fpext <4 x float> %powf4 to <4 x double>
+  %p0 = extractelement <4 x double> %pd, i32 0
+  %p1 = extractelement <4 x double> %pd, i32 1
+  %p2 = extractelement <4 x double> %pd, i32 2
+  %p3 = extractelement <4 x double> %pd, i32 3
+  %vf = getelementptr [53 x i8], [53 x i8]* @vectorFmt, i64 0, i64 0
+  call i32 (i8*, ...) @printf(i8* %vf, double %s0, double %s1, double %s2, double %s3, double %p0, double %p1, double %p2, double %p3)
+  ret i32 0
+}
@@ -0,0 +1,96 @@
+; mmap of a file the guest wrote first (argv[1], 3 pages of i % 251): read-only MAP_SHARED over a file opened read-only, a writable private
+; mapping at a page offset whose writes must not reach the file, a misaligned offset that fails, and an anonymous mapping
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+%FILE = type opaque
+@w = private constant [2 x i8] c"w\00"
+@fmt = private constant [30 x i8] c"%ld %ld %d %d %d %d %d %d %d\0A\00"
+
+declare %FILE* @fopen(i8*, i8*)
+declare i64 @fwrite(i8*, i64, i64, %FILE*)
+declare i32 @fclose(%FILE*)
+declare i8* @malloc(i64)
+declare i32 @printf(i8*, ...)
+declare i32 @open(i8*, i32, ...)
+declare i32 @close(i32)
+declare i8* @mmap(i8*, i64, i32, i32, i32, i64)
+declare i32 @munmap(i8*, i64)
+
+define i64 @sum(i8* %p, i64 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %s = phi i64 [ 0, %entry ], [ %s.next, %loop ]
+  %q = getelementptr i8, i8* %p, i64 %i
+  %b = load i8, i8* %q
+  %z = zext i8 %b to i64
+  %s.next = add i64 %s, %z
+  %i.next = add i64 %i, 1
+  %done = icmp eq i64 %i.next, %n
+  br i1 %done, label %out, label %loop
+
+out:
+  ret i64 %s.next
+}
+
+define i32 @byteAt(i8* %p, i64 %i) {
+  %q = getelementptr i8, i8* %p, i64 %i
+  %b = load i8, i8* %q
+  %z = zext i8 %b to i32
+  ret i32 %z
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %pathp = getelementptr i8*, i8** %argv, i64 1
+  %path = load i8*, i8** %pathp
+  %buf = call i8* @malloc(i64 12288)
+  br label %fill
+
+fill:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %fill ]
+  %v = urem i64 %i, 251
+  %v8 = trunc i64 %v to i8
+  %p = getelementptr i8, i8* %buf, i64 %i
+  store i8 %v8, i8* %p
+  %i.next = add i64 %i, 1
+  %filled = icmp eq i64 %i.next, 12288
+  br i1 %filled, label %write, label %fill
+
+write:
+  %f = call %FILE* @fopen(i8* %path, i8* getelementptr ([2 x i8], [2 x i8]* @w, i64 0, i64 0))
+  call i64 @fwrite(i8* %buf, i64 1, i64 12288, %FILE* %f)
+  call i32 @fclose(%FILE* %f)
+
+  ; O_RDONLY, PROT_READ, MAP_SHARED
+  %fd = call i32 (i8*, i32, ...) @open(i8* %path, i32 0)
+  %shared = call i8* @mmap(i8* null, i64 12288, i32 1, i32 1, i32 %fd, i64 0)
+  %sharedSum = call i64 @sum(i8* %shared, i64 12288)
+
+  ; PROT_READ | PROT_WRITE, MAP_PRIVATE, from the second page on
+  %private = call i8* @mmap(i8* null, i64 5000, i32 3, i32 2, i32 %fd, i64 4096)
+  %first = call i32 @byteAt(i8* %private, i64 0)
+  store i8 7, i8* %private
+  %written = call i32 @byteAt(i8* %private, i64 0)
+  %fileByte = call i32 @byteAt(i8* %shared, i64 4096)
+  %privateSum = call i64 @sum(i8* %private, i64 5000)
+
+  %misaligned = call i8* @mmap(i8* null, i64 100, i32 1, i32 2, i32 %fd, i64 100)
+  %failed = icmp eq i8* %misaligned, inttoptr (i64 -1 to i8*)
+  %failed32 = zext i1 %failed to i32
+
+  ; MAP_PRIVATE | MAP_ANONYMOUS
+  %anon = call i8* @mmap(i8* null, i64 8192, i32 3, i32 34, i32 -1, i64 0)
+  %anonByte = call i32 @byteAt(i8* %anon, i64 8191)
+
+  %u1 = call i32 @munmap(i8* %private, i64 5000)
+  %u2 = call i32 @munmap(i8* %shared, i64 12288)
+  %u = or i32 %u1, %u2
+  call i32 @close(i32 %fd)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([30 x i8], [30 x i8]* @fmt, i64 0, i64 0), i64 %sharedSum, i64 %privateSum, i32 %first, i32 %written, i32 %fileByte, i32 %failed32, i32 %anonByte, i32 %u, i32 %argc)
+  ret i32 0
+}
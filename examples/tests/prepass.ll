@@ -0,0 +1,78 @@
+; Code as clang -O0 emits it (locals in allocas, optnone) and an invoke, which only runs once lowered. Every prepass level has to keep its behaviour
+
+declare i32 @printf(i8*, ...)
+declare i32 @__gxx_personality_v0(...)
+@fmt = private constant [8 x i8] c"%ld %d\0A\00"
+@arr = global [100 x i64] zeroinitializer
+
+define i64 @work(i32 %n) #0 {
+entry:
+  %n.addr = alloca i32
+  %i = alloca i32
+  %j = alloca i32
+  %s = alloca i64
+  store i32 %n, i32* %n.addr
+  store i64 0, i64* %s
+  store i32 0, i32* %i
+  br label %cond
+cond:
+  %0 = load i32, i32* %i
+  %1 = load i32, i32* %n.addr
+  %c = icmp slt i32 %0, %1
+  br i1 %c, label %body, label %end
+body:
+  store i32 0, i32* %j
+  br label %icond
+icond:
+  %j0 = load i32, i32* %j
+  %ic = icmp slt i32 %j0, 100
+  br i1 %ic, label %ibody, label %iend
+ibody:
+  %j1 = load i32, i32* %j
+  %jx = sext i32 %j1 to i64
+  %p = getelementptr [100 x i64], [100 x i64]* @arr, i64 0, i64 %jx
+  %v = load i64, i64* %p
+  %i2 = load i32, i32* %i
+  %ix = sext i32 %i2 to i64
+  %nv = add i64 %v, %ix
+  store i64 %nv, i64* %p
+  %s0 = load i64, i64* %s
+  %s1 = add i64 %s0, %nv
+  store i64 %s1, i64* %s
+  %j2 = load i32, i32* %j
+  %j3 = add i32 %j2, 1
+  store i32 %j3, i32* %j
+  br label %icond
+iend:
+  %x3 = load i32, i32* %i
+  %x4 = add i32 %x3, 1
+  store i32 %x4, i32* %i
+  br label %cond
+end:
+  %r = load i64, i64* %s
+  ret i64 %r
+}
+
+define i32 @divide(i32 %a, i32 %b) #0 {
+  %q = sdiv i32 %a, %b
+  ret i32 %q
+}
+
+define i32 @safeDivide(i32 %a, i32 %b) #0 personality i32 (...)* @__gxx_personality_v0 {
+entry:
+  %q = invoke i32 @divide(i32 %a, i32 %b) to label %ok unwind label %failed
+ok:
+  ret i32 %q
+failed:
+  %x = landingpad { i8*, i32 } cleanup
+  ret i32 -1
+}
+
+define i32 @main() #0 {
+  %r = call i64 @work(i32 1000)
+  %d = call i32 @safeDivide(i32 84, i32 2)
+  %fp = getelementptr [8 x i8], [8 x i8]* @fmt, i32 0, i32 0
+  call i32 (i8*, ...) @printf(i8* %fp, i64 %r, i32 %d)
+  ret i32 0
+}
+attributes #0 = { noinline nounwind optnone }
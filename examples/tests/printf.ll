@@ -0,0 +1,77 @@
+; printf family conversions: flags, widths and precisions from arguments, length modifiers, %n, truncating snprintf, unknown directives and fprintf to both streams.
+; Format strings in writable memory are parsed again after they change, while constant ones are parsed once and reused
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+%struct._IO_FILE = type opaque
+@stderr = external global %struct._IO_FILE*
+@stdout = external global %struct._IO_FILE*
+@f1 = private constant [21 x i8] c"[%5d|%-4s|%*d|%hhd]\0A\00"
+@f2 = private constant [13 x i8] c"x=%08.3f %x\0A\00"
+@f3 = private constant [11 x i8] c"%s %lld%n\0A\00"
+@s1 = private constant [3 x i8] c"ab\00"
+@s2 = private constant [6 x i8] c"hello\00"
+@f4 = private constant [10 x i8] c"n=%d r=%d\00"
+@f5 = private constant [5 x i8] c"%s!\0A\00"
+@f6 = private constant [12 x i8] c"%% %q %5.2s\00"
+@dyn = global [6 x i8] c"<%d>\0A\00"
+@f7 = private constant [7 x i8] c"%%%dd|\00"
+@f8 = private constant [3 x i8] c"\0A\00\00"
+
+declare i32 @printf(i8*, ...)
+declare i32 @fprintf(%struct._IO_FILE*, i8*, ...)
+declare i32 @sprintf(i8*, i8*, ...)
+declare i32 @snprintf(i8*, i64, i8*, ...)
+declare i32 @puts(i8*)
+declare i32 @putchar(i32)
+
+define i32 @main() {
+  %buf = alloca [64 x i8]
+  %small = alloca [4 x i8]
+  %n = alloca i32
+  %b = getelementptr [64 x i8], [64 x i8]* %buf, i64 0, i64 0
+  %sm = getelementptr [4 x i8], [4 x i8]* %small, i64 0, i64 0
+  %p1 = getelementptr [21 x i8], [21 x i8]* @f1, i64 0, i64 0
+  %r1 = call i32 (i8*, ...) @printf(i8* %p1, i32 -42, i8* getelementptr ([3 x i8], [3 x i8]* @s1, i64 0, i64 0), i32 6, i32 7, i32 300)
+  %out = load %struct._IO_FILE*, %struct._IO_FILE** @stdout
+  %p2 = getelementptr [13 x i8], [13 x i8]* @f2, i64 0, i64 0
+  %r2 = call i32 (%struct._IO_FILE*, i8*, ...) @fprintf(%struct._IO_FILE* %out, i8* %p2, double 3.14159, i32 -1)
+  %p3 = getelementptr [11 x i8], [11 x i8]* @f3, i64 0, i64 0
+  %r3 = call i32 (i8*, i8*, ...) @sprintf(i8* %b, i8* %p3, i8* getelementptr ([6 x i8], [6 x i8]* @s2, i64 0, i64 0), i64 -9000000000, i32* %n)
+  %r4 = call i32 @puts(i8* %b)
+  %nv = load i32, i32* %n
+  %p4 = getelementptr [10 x i8], [10 x i8]* @f4, i64 0, i64 0
+  %r5 = call i32 (i8*, i64, i8*, ...) @snprintf(i8* %sm, i64 4, i8* %p4, i32 %nv, i32 %r3)
+  %p5 = getelementptr [5 x i8], [5 x i8]* @f5, i64 0, i64 0
+  %r6 = call i32 (i8*, ...) @printf(i8* %p5, i8* %sm)
+  %err = load %struct._IO_FILE*, %struct._IO_FILE** @stderr
+  %p6 = getelementptr [12 x i8], [12 x i8]* @f6, i64 0, i64 0
+  %r7 = call i32 (%struct._IO_FILE*, i8*, ...) @fprintf(%struct._IO_FILE* %err, i8* %p6, i8* %b)
+  %c = call i32 @putchar(i32 10)
+  %dyn = getelementptr [6 x i8], [6 x i8]* @dyn, i64 0, i64 0
+  %conv = getelementptr [6 x i8], [6 x i8]* @dyn, i64 0, i64 2
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %0 ], [ %i.next, %loop ]
+  %v = mul i32 %i, 100
+  call i32 (i8*, ...) @printf(i8* %dyn, i32 %v)
+  store i8 120, i8* %conv
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, 3
+  br i1 %done, label %built, label %loop
+
+built:
+  %p7 = getelementptr [7 x i8], [7 x i8]* @f7, i64 0, i64 0
+  call i32 (i8*, i8*, ...) @sprintf(i8* %b, i8* %p7, i32 6)
+  call i32 (i8*, ...) @printf(i8* %b, i32 42)
+  call i32 (i8*, i8*, ...) @sprintf(i8* %b, i8* %p7, i32 -3)
+  call i32 (i8*, ...) @printf(i8* %b, i32 7)
+  %p8 = getelementptr [3 x i8], [3 x i8]* @f8, i64 0, i64 0
+  call i32 (i8*, ...) @printf(i8* %p8)
+  %s = add i32 %r1, %r2
+  %s2 = add i32 %s, %r5
+  %s3 = add i32 %s2, %r6
+  ret i32 %s3
+}
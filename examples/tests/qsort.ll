@@ -0,0 +1,94 @@
+; qsort of 5000 pseudo-random ints with a guest comparator that allocates and, on its first call, sorts another array with qsort itself.
+; Then bsearch for a present and a missing key
+
+@fmt = private constant [25 x i8] c"ok=%d first=%d found=%d\0A\00"
+@nestedFmt = private constant [34 x i8] c"missing=%d nested=%d %d %d %d %d\0A\00"
+@nested = global [5 x i32] [i32 50, i32 -3, i32 20, i32 7, i32 0]
+@nestedDone = global i1 false
+declare i8* @malloc(i64)
+declare void @qsort(i8*, i64, i64, i32 (i8*, i8*)*)
+declare i8* @bsearch(i8*, i8*, i64, i64, i32 (i8*, i8*)*)
+declare i32 @printf(i8*, ...)
+
+define i32 @cmp(i8* %a, i8* %b) {
+entry:
+  %done = load i1, i1* @nestedDone
+  br i1 %done, label %compare, label %nest
+
+nest:
+  store i1 true, i1* @nestedDone
+  call void @qsort(i8* bitcast ([5 x i32]* @nested to i8*), i64 5, i64 4, i32 (i8*, i8*)* @cmp)
+  br label %compare
+
+compare:
+  %junk = call i8* @malloc(i64 64)
+  %pa = bitcast i8* %a to i32*
+  %pb = bitcast i8* %b to i32*
+  %x = load i32, i32* %pa
+  %y = load i32, i32* %pb
+  %lt = icmp slt i32 %x, %y
+  %gt = icmp sgt i32 %x, %y
+  %l = sext i1 %lt to i32
+  %g = zext i1 %gt to i32
+  %r = add i32 %l, %g
+  ret i32 %r
+}
+
+define i32 @main() {
+entry:
+  %n = add i64 5000, 0
+  %raw = call i8* @malloc(i64 20000)
+  %arr = bitcast i8* %raw to i32*
+  br label %fill
+fill:
+  %i = phi i64 [0, %entry], [%i2, %fill]
+  %s = phi i32 [12345, %entry], [%s2, %fill]
+  %s1 = mul i32 %s, 1103515245
+  %s2 = add i32 %s1, 12345
+  %v = lshr i32 %s2, 8
+  %p = getelementptr i32, i32* %arr, i64 %i
+  store i32 %v, i32* %p
+  %i2 = add i64 %i, 1
+  %d = icmp eq i64 %i2, %n
+  br i1 %d, label %sort, label %fill
+sort:
+  %key = alloca i32
+  %p7 = getelementptr i32, i32* %arr, i64 777
+  %k = load i32, i32* %p7
+  store i32 %k, i32* %key
+  call void @qsort(i8* %raw, i64 %n, i64 4, i32 (i8*, i8*)* @cmp)
+  br label %check
+check:
+  %j = phi i64 [1, %sort], [%j2, %check]
+  %ok = phi i32 [1, %sort], [%ok2, %check]
+  %pj = getelementptr i32, i32* %arr, i64 %j
+  %jm = sub i64 %j, 1
+  %pjm = getelementptr i32, i32* %arr, i64 %jm
+  %a = load i32, i32* %pjm
+  %b = load i32, i32* %pj
+  %bad = icmp sgt i32 %a, %b
+  %ok2 = select i1 %bad, i32 0, i32 %ok
+  %j2 = add i64 %j, 1
+  %dd = icmp eq i64 %j2, %n
+  br i1 %dd, label %out, label %check
+out:
+  %f = load i32, i32* %arr
+  %kp = bitcast i32* %key to i8*
+  %hit = call i8* @bsearch(i8* %kp, i8* %raw, i64 %n, i64 4, i32 (i8*, i8*)* @cmp)
+  %hp = bitcast i8* %hit to i32*
+  %hv = load i32, i32* %hp
+  %same = icmp eq i32 %hv, %k
+  %sz = zext i1 %same to i32
+  call i32 (i8*, ...) @printf(i8* getelementptr ([25 x i8], [25 x i8]* @fmt, i64 0, i64 0), i32 %ok2, i32 %f, i32 %sz)
+  store i32 1, i32* %key
+  %miss = call i8* @bsearch(i8* %kp, i8* %raw, i64 %n, i64 4, i32 (i8*, i8*)* @cmp)
+  %missNull = icmp eq i8* %miss, null
+  %missNull32 = zext i1 %missNull to i32
+  %n0 = load i32, i32* getelementptr ([5 x i32], [5 x i32]* @nested, i64 0, i64 0)
+  %n1 = load i32, i32* getelementptr ([5 x i32], [5 x i32]* @nested, i64 0, i64 1)
+  %n2 = load i32, i32* getelementptr ([5 x i32], [5 x i32]* @nested, i64 0, i64 2)
+  %n3 = load i32, i32* getelementptr ([5 x i32], [5 x i32]* @nested, i64 0, i64 3)
+  %n4 = load i32, i32* getelementptr ([5 x i32], [5 x i32]* @nested, i64 0, i64 4)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([34 x i8], [34 x i8]* @nestedFmt, i64 0, i64 0), i32 %missNull32, i32 %n0, i32 %n1, i32 %n2, i32 %n3, i32 %n4)
+  ret i32 0
+}
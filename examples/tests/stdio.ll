@@ -0,0 +1,95 @@
+; Buffered guest stdio: a file written with fputs, fwrite and fputc and read back with fgets, fread and fgetc, stdin read to its end with getchar,
+; and a few kilobytes of stdout from printf, puts and putchar, with fflush in between. The file is argv[1]
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+%FILE = type opaque
+@stdout = external global %FILE*
+@w = private constant [2 x i8] c"w\00"
+@r = private constant [2 x i8] c"r\00"
+@text = private constant [7 x i8] c"line1\0A\00"
+@fileFmt = private constant [21 x i8] c"file: %s|%d|%.5s|%d\0A\00"
+@stdinFmt = private constant [20 x i8] c"stdin: %d bytes %d\0A\00"
+@lineFmt = private constant [33 x i8] c"%05d abcdefghijklmnopqrstuvwxyz\0A\00"
+@done = private constant [5 x i8] c"done\00"
+
+declare %FILE* @fopen(i8*, i8*)
+declare i32 @fclose(%FILE*)
+declare i32 @fputs(i8*, %FILE*)
+declare i32 @fputc(i32, %FILE*)
+declare i64 @fwrite(i8*, i64, i64, %FILE*)
+declare i64 @fread(i8*, i64, i64, %FILE*)
+declare i8* @fgets(i8*, i32, %FILE*)
+declare i32 @fgetc(%FILE*)
+declare i32 @getchar()
+declare i32 @printf(i8*, ...)
+declare i32 @puts(i8*)
+declare i32 @putchar(i32)
+declare i32 @fflush(%FILE*)
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %lineBuf = alloca [32 x i8]
+  %dataBuf = alloca [32 x i8]
+  %lb = getelementptr [32 x i8], [32 x i8]* %lineBuf, i64 0, i64 0
+  %db = getelementptr [32 x i8], [32 x i8]* %dataBuf, i64 0, i64 0
+  %pathp = getelementptr i8*, i8** %argv, i64 1
+  %path = load i8*, i8** %pathp
+  %f = call %FILE* @fopen(i8* %path, i8* getelementptr ([2 x i8], [2 x i8]* @w, i64 0, i64 0))
+  %t = getelementptr [7 x i8], [7 x i8]* @text, i64 0, i64 0
+  call i32 @fputs(i8* %t, %FILE* %f)
+  call i64 @fwrite(i8* %t, i64 2, i64 3, %FILE* %f)
+  call i32 @fputc(i32 90, %FILE* %f)
+  call i32 @fclose(%FILE* %f)
+  %g = call %FILE* @fopen(i8* %path, i8* getelementptr ([2 x i8], [2 x i8]* @r, i64 0, i64 0))
+  %s = call i8* @fgets(i8* %lb, i32 32, %FILE* %g)
+  %n = call i64 @fread(i8* %db, i64 2, i64 10, %FILE* %g)
+  %n32 = trunc i64 %n to i32
+  %c = call i32 @fgetc(%FILE* %g)
+  call i32 @fclose(%FILE* %g)
+  %ff = getelementptr [21 x i8], [21 x i8]* @fileFmt, i64 0, i64 0
+  call i32 (i8*, ...) @printf(i8* %ff, i8* %s, i32 %n32, i8* %db, i32 %c)
+  br label %read
+
+read:
+  %count = phi i32 [ 0, %entry ], [ %count.next, %byte ]
+  %sum = phi i32 [ 0, %entry ], [ %sum.next, %byte ]
+  %ch = call i32 @getchar()
+  %eof = icmp slt i32 %ch, 0
+  br i1 %eof, label %lines, label %byte
+
+byte:
+  %count.next = add i32 %count, 1
+  %sum.next = add i32 %sum, %ch
+  br label %read
+
+lines:
+  %sf = getelementptr [20 x i8], [20 x i8]* @stdinFmt, i64 0, i64 0
+  call i32 (i8*, ...) @printf(i8* %sf, i32 %count, i32 %sum)
+  %out = load %FILE*, %FILE** @stdout
+  br label %line
+
+line:
+  %i = phi i32 [ 0, %lines ], [ %i.next, %line.next ]
+  %lf = getelementptr [33 x i8], [33 x i8]* @lineFmt, i64 0, i64 0
+  call i32 (i8*, ...) @printf(i8* %lf, i32 %i)
+  %every = and i32 %i, 15
+  %flush = icmp eq i32 %every, 15
+  br i1 %flush, label %line.flush, label %line.next
+
+line.flush:
+  call i32 @fflush(%FILE* %out)
+  call i32 @putchar(i32 42)
+  call i32 @putchar(i32 10)
+  br label %line.next
+
+line.next:
+  %i.next = add i32 %i, 1
+  %end = icmp eq i32 %i.next, 100
+  br i1 %end, label %finish, label %line
+
+finish:
+  call i32 @puts(i8* getelementptr ([5 x i8], [5 x i8]* @done, i64 0, i64 0))
+  ret i32 0
+}
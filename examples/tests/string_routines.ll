@@ -0,0 +1,91 @@
+; libc string and memory routines on short strings, and on 1000-byte heap buffers where the match or difference is far from the start.
+; Results that are pointers are printed as strings or offsets
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+@hay = private constant [20 x i8] c"the quick brown fox\00"
+@qu = private constant [3 x i8] c"qu\00"
+@br = private constant [6 x i8] c"brown\00"
+@brz = private constant [6 x i8] c"browz\00"
+@fmt = private constant [39 x i8] c"%ld %d %d %d %d %s %s %s %d %s %d %s|\0A\00"
+@longFmt = private constant [29 x i8] c"%ld %d %d %d %ld %ld %ld %d\0A\00"
+declare i64 @strlen(i8*)
+declare i32 @strcmp(i8*, i8*)
+declare i32 @strncmp(i8*, i8*, i64)
+declare i8* @strchr(i8*, i32)
+declare i8* @strstr(i8*, i8*)
+declare i8* @strcpy(i8*, i8*)
+declare i32 @memcmp(i8*, i8*, i64)
+declare i8* @memchr(i8*, i32, i64)
+declare i8* @memmove(i8*, i8*, i64)
+declare i32 @printf(i8*, ...)
+declare i8* @malloc(i64)
+declare i8* @memset(i8*, i32, i64)
+declare i8* @memcpy(i8*, i8*, i64)
+define i32 @main() {
+  %buf = alloca [32 x i8]
+  %b = getelementptr [32 x i8], [32 x i8]* %buf, i64 0, i64 0
+  %h = getelementptr [20 x i8], [20 x i8]* @hay, i64 0, i64 0
+  %q = getelementptr [3 x i8], [3 x i8]* @qu, i64 0, i64 0
+  %r = getelementptr [6 x i8], [6 x i8]* @br, i64 0, i64 0
+  %z = getelementptr [6 x i8], [6 x i8]* @brz, i64 0, i64 0
+  %l = call i64 @strlen(i8* %h)
+  %c1 = call i32 @strcmp(i8* %r, i8* %z)
+  %c1s = icmp slt i32 %c1, 0
+  %c1i = zext i1 %c1s to i32
+  %c2 = call i32 @strncmp(i8* %r, i8* %z, i64 4)
+  %c3 = call i32 @memcmp(i8* %r, i8* %r, i64 6)
+  %s = call i8* @strstr(i8* %h, i8* %r)
+  %sq = call i8* @strstr(i8* %h, i8* %q)
+  %ch = call i8* @strchr(i8* %h, i32 102)
+  %none = call i8* @strchr(i8* %h, i32 122)
+  %isnull = icmp eq i8* %none, null
+  %in = zext i1 %isnull to i32
+  %cp = call i8* @strcpy(i8* %b, i8* %h)
+  %b2 = getelementptr i8, i8* %b, i64 4
+  %mv = call i8* @memmove(i8* %b2, i8* %b, i64 9)
+  %mc = call i8* @memchr(i8* %b, i32 107, i64 32)
+  %mco = ptrtoint i8* %mc to i64
+  %bo = ptrtoint i8* %b to i64
+  %d = sub i64 %mco, %bo
+  %d32 = trunc i64 %d to i32
+  %term = call i8* @strchr(i8* %h, i32 0)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([39 x i8], [39 x i8]* @fmt, i64 0, i64 0), i64 %l, i32 %c1i, i32 %c2, i32 %c3, i32 %in, i8* %s, i8* %sq, i8* %ch, i32 %d32, i8* %cp, i32 0, i8* %term)
+  call void @long()
+  ret i32 0
+}
+
+define void @long() {
+  %a = call i8* @malloc(i64 1001)
+  %b = call i8* @malloc(i64 1001)
+  call i8* @memset(i8* %a, i32 120, i64 1000)
+  %aEnd = getelementptr i8, i8* %a, i64 1000
+  store i8 0, i8* %aEnd
+  call i8* @memcpy(i8* %b, i8* %a, i64 1001)
+  %b997 = getelementptr i8, i8* %b, i64 997
+  store i8 121, i8* %b997
+  %len = call i64 @strlen(i8* %a)
+  %cmp = call i32 @strcmp(i8* %a, i8* %b)
+  %less = icmp slt i32 %cmp, 0
+  %less32 = zext i1 %less to i32
+  %ncmp = call i32 @strncmp(i8* %a, i8* %b, i64 997)
+  %mcmp = call i32 @memcmp(i8* %b, i8* %a, i64 1000)
+  %greater = icmp sgt i32 %mcmp, 0
+  %greater32 = zext i1 %greater to i32
+  %found = call i8* @memchr(i8* %b, i32 121, i64 1000)
+  %foundAt = ptrtoint i8* %found to i64
+  %bAt = ptrtoint i8* %b to i64
+  %off = sub i64 %foundAt, %bAt
+  %chr = call i8* @strchr(i8* %b, i32 121)
+  %chrAt = ptrtoint i8* %chr to i64
+  %chrOff = sub i64 %chrAt, %bAt
+  %needle = getelementptr i8, i8* %b, i64 990
+  %str = call i8* @strstr(i8* %b, i8* %needle)
+  %strAt = ptrtoint i8* %str to i64
+  %strOff = sub i64 %strAt, %bAt
+  %missing = call i8* @memchr(i8* %a, i32 121, i64 1000)
+  %isNull = icmp eq i8* %missing, null
+  %isNull32 = zext i1 %isNull to i32
+  call i32 (i8*, ...) @printf(i8* getelementptr ([29 x i8], [29 x i8]* @longFmt, i64 0, i64 0), i64 %len, i32 %less32, i32 %ncmp, i32 %greater32, i64 %off, i64 %chrOff, i64 %strOff, i32 %isNull32)
+  ret void
+}
@@ -0,0 +1,82 @@
+; Four guest threads incrementing shared counters with atomicrmw, under a mutex and with a cmpxchg loop. Each returns its own count through pthread_join
+
+%union.pthread_mutex_t = type { [40 x i8] }
+
+@counter = global i64 0
+@locked = global i64 0
+@casctr = global i32 0
+@mtx = global %union.pthread_mutex_t zeroinitializer
+@fmt = private constant [36 x i8] c"atomic=%ld locked=%ld cas=%d r=%ld\0A\00"
+
+declare i32 @pthread_create(i64*, i8*, i8* (i8*)*, i8*)
+declare i32 @pthread_join(i64, i8**)
+declare i32 @pthread_mutex_lock(%union.pthread_mutex_t*)
+declare i32 @pthread_mutex_unlock(%union.pthread_mutex_t*)
+declare i32 @printf(i8*, ...)
+
+define i8* @worker(i8* %arg) {
+entry:
+  %local = alloca i64, align 8
+  store i64 0, i64* %local
+  br label %loop
+loop:
+  %i = phi i32 [0, %entry], [%inext, %cont]
+  %old = atomicrmw add i64* @counter, i64 1 seq_cst
+  call i32 @pthread_mutex_lock(%union.pthread_mutex_t* @mtx)
+  %v = load i64, i64* @locked
+  %v1 = add i64 %v, 1
+  store i64 %v1, i64* @locked
+  call i32 @pthread_mutex_unlock(%union.pthread_mutex_t* @mtx)
+  %l = load i64, i64* %local
+  %l1 = add i64 %l, 1
+  store i64 %l1, i64* %local
+  br label %cas
+cas:
+  %cur = load atomic i32, i32* @casctr seq_cst, align 4
+  %new = add i32 %cur, 1
+  %pair = cmpxchg i32* @casctr, i32 %cur, i32 %new seq_cst seq_cst
+  %ok = extractvalue { i32, i1 } %pair, 1
+  br i1 %ok, label %cont, label %cas
+cont:
+  %inext = add i32 %i, 1
+  %done = icmp eq i32 %inext, 5000
+  br i1 %done, label %exit, label %loop
+exit:
+  %lv = load i64, i64* %local
+  %r = inttoptr i64 %lv to i8*
+  ret i8* %r
+}
+
+define i32 @main() {
+entry:
+  %tids = alloca [4 x i64], align 8
+  %ret = alloca i8*, align 8
+  br label %spawn
+spawn:
+  %i = phi i32 [0, %entry], [%inext, %spawn]
+  %p = getelementptr [4 x i64], [4 x i64]* %tids, i32 0, i32 %i
+  call i32 @pthread_create(i64* %p, i8* null, i8* (i8*)* @worker, i8* null)
+  %inext = add i32 %i, 1
+  %d = icmp eq i32 %inext, 4
+  br i1 %d, label %joinl, label %spawn
+joinl:
+  %j = phi i32 [0, %spawn], [%jnext, %joinl]
+  %acc = phi i64 [0, %spawn], [%acc1, %joinl]
+  %q = getelementptr [4 x i64], [4 x i64]* %tids, i32 0, i32 %j
+  %tid = load i64, i64* %q
+  call i32 @pthread_join(i64 %tid, i8** %ret)
+  %rv = load i8*, i8** %ret
+  %rvi = ptrtoint i8* %rv to i64
+  %acc1 = add i64 %acc, %rvi
+  %jnext = add i32 %j, 1
+  %jd = icmp eq i32 %jnext, 4
+  br i1 %jd, label %out, label %joinl
+out:
+  %c = load i64, i64* @counter
+  %lk = load i64, i64* @locked
+  %cs = load i32, i32* @casctr
+  %f = getelementptr [36 x i8], [36 x i8]* @fmt, i32 0, i32 0
+  call i32 (i8*, ...) @printf(i8* %f, i64 %c, i64 %lk, i32 %cs, i64 %acc1)
+  fence seq_cst
+  ret i32 0
+}
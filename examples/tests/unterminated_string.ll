@@ -0,0 +1,11 @@
+; puts of a heap buffer with no terminating NUL is a guest fault, not a read past the end of guest memory
+
+declare i8* @malloc(i64)
+declare i32 @puts(i8*)
+declare void @llvm.memset.p0i8.i64(i8*, i8, i64, i1)
+define i32 @main() {
+  %p = call i8* @malloc(i64 64)
+  call void @llvm.memset.p0i8.i64(i8* %p, i8 97, i64 64, i1 false)
+  call i32 @puts(i8* %p)
+  ret i32 0
+}
@@ -0,0 +1,38 @@
+; Targets whose va_list is a plain pointer: va_arg, va_copy and a va_list handed on to vprintf
+
+declare void @llvm.va_start(i8*)
+declare void @llvm.va_copy(i8*, i8*)
+declare i32 @vprintf(i8*, i8*)
+@fmt = private constant [12 x i8] c"%d %s %.1f\0A\00"
+@str = private constant [3 x i8] c"hi\00"
+define double @vinst(i32 %n, ...) {
+  %ap = alloca i8*
+  %cp = alloca i8*
+  %ap8 = bitcast i8** %ap to i8*
+  %cp8 = bitcast i8** %cp to i8*
+  call void @llvm.va_start(i8* %ap8)
+  %a = va_arg i8** %ap, i32
+  call void @llvm.va_copy(i8* %cp8, i8* %ap8)
+  %b = va_arg i8** %ap, double
+  %b2 = va_arg i8** %cp, double
+  %af = sitofp i32 %a to double
+  %r = fadd double %af, %b
+  %r2 = fadd double %r, %b2
+  ret double %r2
+}
+define i32 @logf(i8* %f, ...) {
+  %ap = alloca i8*
+  %ap8 = bitcast i8** %ap to i8*
+  call void @llvm.va_start(i8* %ap8)
+  %v = load i8*, i8** %ap
+  %r = call i32 @vprintf(i8* %f, i8* %v)
+  ret i32 %r
+}
+define i32 @main() {
+  %d = call double (i32, ...) @vinst(i32 0, i32 5, double 1.25)
+  %di = fptosi double %d to i32
+  %f = getelementptr [12 x i8], [12 x i8]* @fmt, i32 0, i32 0
+  %hs = getelementptr [3 x i8], [3 x i8]* @str, i32 0, i32 0
+  call i32 (i8*, ...) @logf(i8* %f, i32 %di, i8* %hs, double 2.5)
+  ret i32 %di
+}
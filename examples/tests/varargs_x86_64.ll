@@ -0,0 +1,119 @@
+; x86-64 va_lists: va_arg inlined by clang over the register save area and the overflow area, the va_arg instruction, va_copy, vprintf and a byval struct among the variadic arguments
+
+target triple = "x86_64-unknown-linux-gnu"
+%struct.__va_list_tag = type { i32, i32, i8*, i8* }
+%struct.S = type { i64, i64, i64 }
+@fmt = private constant [16 x i8] c"sum=%ld d=%.2f\0A\00"
+@fmt2 = private constant [17 x i8] c"v: %d %s %ld %c\0A\00"
+@fmt3 = private constant [11 x i8] c"S=%ld %ld\0A\00"
+@str = private constant [3 x i8] c"hi\00"
+declare void @llvm.va_start(i8*)
+declare void @llvm.va_end(i8*)
+declare void @llvm.va_copy(i8*, i8*)
+declare i32 @vprintf(i8*, %struct.__va_list_tag*)
+declare i32 @printf(i8*, ...)
+
+; clang -O1 style inline va_arg of longs (gp path / overflow path)
+define i64 @sumi(i32 %n, ...) {
+entry:
+  %ap = alloca [1 x %struct.__va_list_tag]
+  %ap8 = bitcast [1 x %struct.__va_list_tag]* %ap to i8*
+  call void @llvm.va_start(i8* %ap8)
+  %gpp = getelementptr [1 x %struct.__va_list_tag], [1 x %struct.__va_list_tag]* %ap, i64 0, i64 0, i32 0
+  %ovp = getelementptr [1 x %struct.__va_list_tag], [1 x %struct.__va_list_tag]* %ap, i64 0, i64 0, i32 2
+  %rsp = getelementptr [1 x %struct.__va_list_tag], [1 x %struct.__va_list_tag]* %ap, i64 0, i64 0, i32 3
+  br label %loop
+loop:
+  %i = phi i32 [0, %entry], [%i1, %next]
+  %s = phi i64 [0, %entry], [%s1, %next]
+  %c = icmp slt i32 %i, %n
+  br i1 %c, label %body, label %done
+body:
+  %gp = load i32, i32* %gpp
+  %fits = icmp ult i32 %gp, 41
+  br i1 %fits, label %inreg, label %inmem
+inreg:
+  %rs = load i8*, i8** %rsp
+  %a1 = getelementptr i8, i8* %rs, i32 %gp
+  %gp1 = add i32 %gp, 8
+  store i32 %gp1, i32* %gpp
+  br label %got
+inmem:
+  %ov = load i8*, i8** %ovp
+  %ov1 = getelementptr i8, i8* %ov, i64 8
+  store i8* %ov1, i8** %ovp
+  br label %got
+got:
+  %ap1 = phi i8* [%a1, %inreg], [%ov, %inmem]
+  %lp = bitcast i8* %ap1 to i64*
+  %v = load i64, i64* %lp
+  %s1 = add i64 %s, %v
+  br label %next
+next:
+  %i1 = add i32 %i, 1
+  br label %loop
+done:
+  call void @llvm.va_end(i8* %ap8)
+  ret i64 %s
+}
+
+; va_arg instruction + va_copy
+define double @vinst(i32 %n, ...) {
+  %ap = alloca %struct.__va_list_tag
+  %cp = alloca %struct.__va_list_tag
+  %ap8 = bitcast %struct.__va_list_tag* %ap to i8*
+  %cp8 = bitcast %struct.__va_list_tag* %cp to i8*
+  call void @llvm.va_start(i8* %ap8)
+  %a = va_arg i8* %ap8, i32
+  call void @llvm.va_copy(i8* %cp8, i8* %ap8)
+  %b = va_arg i8* %ap8, double
+  %b2 = va_arg i8* %cp8, double
+  %af = sitofp i32 %a to double
+  %r = fadd double %af, %b
+  %r2 = fadd double %r, %b2
+  ret double %r2
+}
+
+define i32 @logf(i8* %f, ...) {
+  %ap = alloca %struct.__va_list_tag
+  %ap8 = bitcast %struct.__va_list_tag* %ap to i8*
+  call void @llvm.va_start(i8* %ap8)
+  %r = call i32 @vprintf(i8* %f, %struct.__va_list_tag* %ap)
+  call void @llvm.va_end(i8* %ap8)
+  ret i32 %r
+}
+
+define i64 @bv(i32 %n, ...) {
+  %ap = alloca %struct.__va_list_tag
+  %ap8 = bitcast %struct.__va_list_tag* %ap to i8*
+  call void @llvm.va_start(i8* %ap8)
+  %x = va_arg i8* %ap8, i64
+  %y = va_arg i8* %ap8, i64
+  %z = va_arg i8* %ap8, i64
+  %w = va_arg i8* %ap8, i64
+  %s = add i64 %x, %y
+  %s2 = add i64 %s, %z
+  %s3 = mul i64 %s2, %w
+  ret i64 %s3
+}
+
+define i32 @main() {
+  %s = call i64 (i32, ...) @sumi(i32 10, i64 1, i64 2, i64 3, i64 4, i64 5, i64 6, i64 7, i64 8, i64 9, i64 10)
+  %d = call double (i32, ...) @vinst(i32 0, i32 5, double 1.25)
+  %f = getelementptr [16 x i8], [16 x i8]* @fmt, i32 0, i32 0
+  call i32 (i8*, ...) @printf(i8* %f, i64 %s, double %d)
+  %f2 = getelementptr [17 x i8], [17 x i8]* @fmt2, i32 0, i32 0
+  %hs = getelementptr [3 x i8], [3 x i8]* @str, i32 0, i32 0
+  call i32 (i8*, ...) @logf(i8* %f2, i32 42, i8* %hs, i64 1234567890123, i32 65)
+  %st = alloca %struct.S
+  %p0 = getelementptr %struct.S, %struct.S* %st, i32 0, i32 0
+  store i64 2, i64* %p0
+  %p1 = getelementptr %struct.S, %struct.S* %st, i32 0, i32 1
+  store i64 3, i64* %p1
+  %p2 = getelementptr %struct.S, %struct.S* %st, i32 0, i32 2
+  store i64 4, i64* %p2
+  %r = call i64 (i32, ...) @bv(i32 0, %struct.S* byval(%struct.S) align 8 %st, i64 10)
+  %f3 = getelementptr [11 x i8], [11 x i8]* @fmt3, i32 0, i32 0
+  call i32 (i8*, ...) @printf(i8* %f3, i64 %r, i64 0)
+  ret i32 0
+}
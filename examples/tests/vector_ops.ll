@@ -0,0 +1,32 @@
+; Integer and floating-point vector arithmetic, compares, select, shuffles, lane inserts and extracts, and bitcasts between vector shapes
+
+declare i32 @printf(i8*, ...)
+@fmt = private constant [16 x i8] c"%d %d %d %d %f\0A\00"
+@g = global <4 x i32> <i32 1, i32 2, i32 3, i32 4>
+
+define i32 @main() {
+  %p = alloca <4 x i32>
+  %a = load <4 x i32>, <4 x i32>* @g
+  %b = add <4 x i32> %a, <i32 10, i32 20, i32 30, i32 40>
+  %m = mul <4 x i32> %b, %a
+  %c = icmp sgt <4 x i32> %m, <i32 50, i32 50, i32 50, i32 50>
+  %s = select <4 x i1> %c, <4 x i32> %m, <4 x i32> zeroinitializer
+  %sh = shufflevector <4 x i32> %s, <4 x i32> %a, <4 x i32> <i32 3, i32 2, i32 5, i32 0>
+  %ins = insertelement <4 x i32> %sh, i32 -7, i32 1
+  store <4 x i32> %ins, <4 x i32>* %p
+  %r = load <4 x i32>, <4 x i32>* %p
+  %e0 = extractelement <4 x i32> %r, i32 0
+  %e1 = extractelement <4 x i32> %r, i32 1
+  %e2 = extractelement <4 x i32> %r, i32 2
+  %e3 = extractelement <4 x i32> %r, i32 3
+  %f = sitofp <4 x i32> %r to <4 x double>
+  %fa = fadd <4 x double> %f, <double 0.5, double 0.5, double 0.5, double 0.5>
+  %fn = fneg <4 x double> %fa
+  %fe = extractelement <4 x double> %fn, i32 0
+  %bc = bitcast <4 x i32> %r to <2 x i64>
+  %bc2 = bitcast <2 x i64> %bc to <4 x i32>
+  %ee = extractelement <4 x i32> %bc2, i32 3
+  %fp = getelementptr [16 x i8], [16 x i8]* @fmt, i32 0, i32 0
+  call i32 (i8*, ...) @printf(i8* %fp, i32 %e0, i32 %e1, i32 %e2, i32 %ee, double %fe)
+  ret i32 0
+}
@@ -0,0 +1,33 @@
+#ifndef DYNPTS_BATCH_H
+#define DYNPTS_BATCH_H
+
+#include "Prepass.h"
+
+#include <functional>
+#include <string>
+
+namespace llvm_interpreter
+{
+
+class Interpreter;
+
+// How the entries of a batch are run
+struct BatchOptions
+{
+	PrepassLevel prepass = PrepassLevel::NONE;
+	// Passed to ModuleImage::load()
+	unsigned inlineThreshold = 0;
+	// Number of worker threads. Every worker has an LLVMContext and a module cache of its own, since inlining modifies the context of a module while it runs
+	unsigned numJobs = 1;
+	// Applied to the interpreter of every entry before its globals are evaluated
+	std::function<void(Interpreter&)> configure;
+};
+
+// Run every entry of the manifest at (manifestPath) and write one JSON object per entry to (resultsPath), in manifest order ("-" is stdout, which the entries write to as well).
+// A manifest line is "<module> <function> [<arg>...] [=> <expected>]", separated by whitespace. Blank lines and lines starting with '#' are skipped. main is run with the module path as argv[0] and the args after it; any other function takes integer and floating point arguments only. An entry passes if its result, printed as the driver prints it, equals (expected). Floating point results are compared by value.
+// Modules are parsed once per worker and path, and parsed again only if the contents of the file change. Returns true if no entry failed or could not be run. Throws std::runtime_error if the manifest cannot be read or the results cannot be written
+bool runBatch(const std::string& manifestPath, const std::string& resultsPath, const BatchOptions& opts);
+
+}
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef DYNPTS_CALL_LOG_H
+#define DYNPTS_CALL_LOG_H
+
+#include "DynamicValue.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm_interpreter
+{
+
+// One effect of an external call on the interpreter state, other than its result
+struct CallEffect
+{
+	enum class Kind: std::uint8_t
+	{
+		// A heap block of (size) bytes aligned to (align) was allocated at (addr)
+		ALLOCATE,
+		// The heap block at (addr) was freed
+		FREE,
+		// (size) bytes were written to guest memory at (addr)
+		WRITE,
+	};
+	Kind kind;
+	PointerAddressSpace space;
+	Address addr;
+	uint64_t size, align;
+	// The bytes of a WRITE. For a call being logged this points to the guest memory that was written, for a call read from a log into the log
+	const char* data;
+};
+
+// An external call read from a log
+struct CallRecord
+{
+	uint64_t nameHash;
+	// The arguments, encoded by encodeCallValues()
+	llvm::StringRef args;
+	std::vector<CallEffect> effects;
+	DynamicValue result = DynamicValue::getUndefValue();
+};
+
+// The hash that identifies the callee of a logged call
+uint64_t hashCallName(llvm::StringRef name);
+// Append the compact encoding of (values) to (out). Integers, floats and pointers are encoded with their type, anything else as a placeholder
+void encodeCallValues(const std::vector<DynamicValue>& values, std::string& out);
+
+// CallLogWriter - Writes the external calls of an execution to a log file that CallLogReader can replay. The file is a header, one entry per call in the order the calls were made, and an index of the entry offsets at the end, which the header points to. Numbers are stored in host byte order, so a log is only read on the kind of host that wrote it
+class CallLogWriter
+{
+private:
+	std::unique_ptr<llvm::raw_fd_ostream> out;
+	std::vector<uint64_t> offsets;
+	uint64_t offset;
+	// The entry being put together
+	std::string entry;
+
+public:
+	// Throws std::runtime_error if (path) cannot be created
+	explicit CallLogWriter(const std::string& path);
+	// Write the index and the final header. A log that is not closed this way cannot be read
+	~CallLogWriter();
+
+	void append(llvm::StringRef name, const std::vector<DynamicValue>& args, const std::vector<CallEffect>& effects, const DynamicValue& result);
+};
+
+// CallLogReader - A log written by CallLogWriter. Large logs are memory-mapped rather than read, so that several replays of the same log share its pages, and any call can be looked up through the index
+class CallLogReader
+{
+private:
+	std::unique_ptr<llvm::MemoryBuffer> buffer;
+	uint64_t numCalls;
+	uint64_t indexOffset;
+
+public:
+	// Throws std::runtime_error if (path) cannot be read or is not a complete log
+	explicit CallLogReader(const std::string& path);
+
+	uint64_t getNumCalls() const { return numCalls; }
+	// Decode call number (idx). The bytes of its writes stay in the mapped log
+	CallRecord readCall(uint64_t idx) const;
+};
+
+}
+
+#endif
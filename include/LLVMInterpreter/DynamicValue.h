@@ -6,6 +6,7 @@
 #include <cstdint>
 #include <map>
 #include <string>
+#include <vector>
 
 namespace llvm_interpreter
 {
@@ -19,6 +20,7 @@ enum class DynamicValueType
 	POINTER_VALUE,
 	ARRAY_VALUE,
 	STRUCT_VALUE,
+	VECTOR_VALUE,
 	UNDEF_VALUE
 };
 
@@ -127,6 +129,56 @@ public:
 	friend class DynamicValue;
 };
 
+// Vector value
+enum class VectorLaneType: std::uint8_t
+{
+	INT,
+	FLOAT,
+	DOUBLE
+};
+
+class VectorValue
+{
+private:
+	VectorLaneType laneType;
+	unsigned laneBits;
+	unsigned numLanes;
+	// Lanes are stored unboxed and packed in host byte order, each in the smallest of 1/2/4/8 bytes that fits it, so that element-wise operations can run as plain loops over native arrays. Integer lanes narrower than their container are kept zero-extended
+	std::vector<uint64_t> storage;
+
+	VectorValue(VectorLaneType t, unsigned bits, unsigned n);
+
+	std::string toString() const;
+public:
+	VectorLaneType getLaneType() const { return laneType; }
+	unsigned getLaneBits() const { return laneBits; }
+	unsigned getNumLanes() const { return numLanes; }
+	unsigned getLaneBytes() const;
+	size_t getRawSize() const { return numLanes * getLaneBytes(); }
+
+	template <typename T> T* getLanes() { return reinterpret_cast<T*>(storage.data()); }
+	template <typename T> const T* getLanes() const { return reinterpret_cast<const T*>(storage.data()); }
+	void* getRawData() { return storage.data(); }
+	const void* getRawData() const { return storage.data(); }
+
+	// Per-lane accessors. Integer lanes are zero-extended to 64 bits
+	uint64_t getIntLane(unsigned idx) const;
+	void setIntLane(unsigned idx, uint64_t val);
+	double getFloatLane(unsigned idx) const;
+	void setFloatLane(unsigned idx, double val);
+
+	// Lanes as scalar DynamicValues
+	DynamicValue getLane(unsigned idx) const;
+	void setLane(unsigned idx, const DynamicValue& val);
+
+	// The memory image of integer lanes that are not a whole number of bytes wide (e.g. <8 x i1>): the lanes packed into consecutive bits, lane 0 in the least significant ones, like a bitcast to an integer
+	size_t getPackedSize() const { return (size_t(numLanes) * laneBits + 7) / 8; }
+	void packLanes(void* dst) const;
+	void unpackLanes(const void* src);
+
+	friend class DynamicValue;
+};
+
 // We have two choices to make DynamicValue a polymorphic value type: using union, or using concept-based polymorphism. We choose the former here because of its efficiency
 class DynamicValue
 {
@@ -142,6 +194,7 @@ private:
 		PointerValue ptrVal;
 		ArrayValue arrayVal;
 		StructValue structVal;
+		VectorValue vectorVal;
 		uint8_t placeHolder;
 
 		ValueData(): placeHolder(0) {}
@@ -157,6 +210,7 @@ private:
 	DynamicValue(PointerValue&& ptrVal);	// Pointer constructor
 	DynamicValue(ArrayValue&& arrayVal);	// Array constructor
 	DynamicValue(StructValue&& structVal);	// Struct constructor
+	DynamicValue(VectorValue&& vectorVal);	// Vector constructor
 
 	inline void copyFrom(const DynamicValue& other);
 	inline void moveFrom(DynamicValue&& other);
@@ -198,6 +252,10 @@ public:
 	{
 		return isArrayValue() || isStructValue();
 	}
+	bool isVectorValue() const
+	{
+		return type == DynamicValueType::VECTOR_VALUE;
+	}
 
 	const IntValue& getAsIntValue() const;
 	const FloatValue& getAsFloatValue() const;
@@ -206,6 +264,8 @@ public:
 	const ArrayValue& getAsArrayValue() const;
 	StructValue& getAsStructValue();
 	const StructValue& getAsStructValue() const;
+	VectorValue& getAsVectorValue();
+	const VectorValue& getAsVectorValue() const;
 
 	static DynamicValue getUndefValue();
 	static DynamicValue getIntValue(const llvm::APInt& i);
@@ -213,6 +273,8 @@ public:
 	static DynamicValue getPointerValue(PointerAddressSpace s, Address a);
 	static DynamicValue getArrayValue(unsigned elemCnt, unsigned elemSize);
 	static DynamicValue getStructValue(unsigned sz);
+	// All lanes of the new vector are zero
+	static DynamicValue getVectorValue(VectorLaneType t, unsigned laneBits, unsigned numLanes);
 };
 
 }
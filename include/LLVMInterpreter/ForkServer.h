@@ -0,0 +1,22 @@
+#ifndef DYNPTS_FORK_SERVER_H
+#define DYNPTS_FORK_SERVER_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace llvm_interpreter
+{
+
+// A fork server lets a module that is run many times be parsed and set up only once. The server listens on a Unix socket and forks a child for every client that connects. The child shares the prepared interpreter with the server copy-on-write, takes over the stdin, stdout and stderr of the client, runs the request and sends the result back.
+// A request is the length of its payload as a uint32_t followed by the payload, the NUL-terminated program arguments (argv[0] first). The client's descriptors 0, 1 and 2 come along with the length as SCM_RIGHTS. The reply is the int32_t that the run returned. Both are in host byte order. A child that dies before replying closes the connection without a reply
+
+// Serve requests on a Unix socket at (socketPath) forever, calling (runRequest) with the arguments of each one in a child of its own. The caller must not have started any threads. Throws std::runtime_error if the socket cannot be set up
+void runForkServer(const std::string& socketPath, const std::function<int(const std::vector<std::string>&)>& runRequest);
+
+// Have the fork server at (socketPath) run (args) with the stdin, stdout and stderr of this process, and return the result. Throws std::runtime_error if the server cannot be reached or the child dies without a result
+int runForkClient(const std::string& socketPath, const std::vector<std::string>& args);
+
+}
+
+#endif
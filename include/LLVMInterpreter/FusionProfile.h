@@ -0,0 +1,38 @@
+#ifndef DYNPTS_FUSION_PROFILE_H
+#define DYNPTS_FUSION_PROFILE_H
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+namespace llvm
+{
+	class BasicBlock;
+	class raw_ostream;
+}
+
+namespace llvm_interpreter
+{
+
+// Execution counts of basic blocks, used to find the instruction sequences worth turning into superinstructions.
+// Blocks always run from their first to their last instruction, so counting blocks is enough to know how often every adjacent pair and triple of instructions executed
+class FusionProfile
+{
+private:
+	std::unordered_map<const llvm::BasicBlock*, uint64_t> blockCounts;
+	// Guest threads record their blocks concurrently
+	std::mutex countsMutex;
+public:
+	void recordBlock(const llvm::BasicBlock* bb)
+	{
+		auto lock = std::lock_guard<std::mutex>(countsMutex);
+		++blockCounts[bb];
+	}
+
+	// Print the (topN) most frequently executed opcode pairs and triples in which each instruction uses the result of the previous one. The "fusable" column only counts sequences where those intermediate results have no other use
+	void print(llvm::raw_ostream& os, unsigned topN) const;
+};
+
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef DYNPTS_GUEST_STDIO_H
+#define DYNPTS_GUEST_STDIO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm_interpreter
+{
+
+// GuestStdio - The FILE streams of a guest. Every stream is a host file descriptor with buffers owned by the interpreter, so that a guest doing millions of small writes makes a few large syscalls. The pending output and a write that does not fit next to it go out together in one writev().
+// Streams are numbered by their slot in a table, and the slots of closed streams are reused. Numbers 0, 1 and 2 are stdin, stdout and stderr. GuestStdio does no locking of its own
+class GuestStdio
+{
+public:
+	static constexpr int END_OF_FILE = -1;
+	static constexpr size_t DEFAULT_BUFFER_SIZE = size_t(1) << 20;
+
+private:
+	struct Stream
+	{
+		int fd;
+		bool readable, writable;
+		// Whether the stream owns fd and closes it
+		bool ownsFd;
+		// Whether a newline flushes the output, which is how a stream on a terminal behaves
+		bool lineBuffered;
+		// How much output is held back. Zero makes the stream unbuffered
+		size_t capacity;
+		// Output that has not reached fd yet
+		std::string outBuf;
+		// Input read from fd that the guest has not consumed yet
+		std::vector<char> inBuf;
+		size_t inPos;
+		bool eof, error;
+	};
+	std::vector<std::unique_ptr<Stream>> streams;
+	size_t bufferSize;
+
+	Stream& getStream(int stream);
+	int addStream(std::unique_ptr<Stream> s);
+	// Write the pending output of (s) followed by (size) bytes of (data)
+	bool writeOut(Stream& s, const char* data, size_t size);
+	// Replace the consumed input of (s) with the next chunk read from its fd. Returns false at the end of the file or on an error
+	bool fillInput(Stream& s);
+
+public:
+	GuestStdio();
+	// Like a process that exits, flush every stream
+	~GuestStdio();
+
+	// The buffer size of stdout and of the streams opened from now on
+	void setBufferSize(size_t size);
+	// Start stdin, stdout and stderr over on whatever file descriptors 0, 1 and 2 refer to now, e.g. in a forked child that has replaced them with dup2(). Anything buffered on them is dropped
+	void resetStdStreams();
+	bool isOpen(int stream) const;
+
+	// Open (path) the way fopen() does with (mode). Returns the number of the new stream, or -1
+	int open(const char* path, const char* mode);
+	// Returns 0, or END_OF_FILE if the pending output could not be written
+	int close(int stream);
+	// Returns the number of bytes written or read
+	size_t write(int stream, const char* data, size_t size);
+	size_t read(int stream, char* data, size_t size);
+	// Read at most (size) bytes, stopping after a newline
+	size_t readLine(int stream, char* data, size_t size);
+	// Returns the next byte, or END_OF_FILE
+	int getChar(int stream);
+	// The host file descriptor of a stream, for fileno()
+	int getFd(int stream);
+	// For reads that would rather map the file than copy it: if (stream) reads a regular file and has no input or output buffered, return its fd, its file position and the number of bytes left in the file. skipInput() then moves the position past what was mapped
+	bool getMappableInput(int stream, int& fd, uint64_t& offset, uint64_t& available);
+	void skipInput(int stream, uint64_t size);
+	// Return 0, or END_OF_FILE if some output could not be written
+	int flush(int stream);
+	int flushAll();
+};
+
+}
+
+#endif
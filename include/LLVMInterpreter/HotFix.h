@@ -2,6 +2,8 @@
 #define DYNPTS_HOTFIX_H
 
 #include "Interpreter.h"
+#include "ModuleCache.h"
+#include "Prepass.h"
 #include "DynamicValue.h"
 
 #include "llvm/IR/LLVMContext.h"
@@ -39,6 +41,15 @@ private:
     std::unique_ptr<llvm::Module> module;
     std::unique_ptr<Interpreter> interpreter;
     bool initialized;
+    bool lazyGlobals;
+    PrepassLevel prepassLevel;
+    unsigned inlineThreshold;
+
+    std::unique_ptr<ModuleCache> moduleCache;
+
+    // Create the interpreter for the freshly loaded module and set up its globals
+    // (prepared) modules have been through the prepasses already
+    void createInterpreter(bool prepared = false);
 
     // Convert C++ value to DynamicValue based on type info
     DynamicValue convertToDynamicValue(const void* value, const TypeInfo& typeInfo);
@@ -50,6 +61,22 @@ public:
     HotFix();
     ~HotFix();
 
+    // Defer global initialization until first use (see Interpreter::setLazyGlobals)
+    // Takes effect on the next load
+    void setLazyGlobals(bool lazy) { lazyGlobals = lazy; }
+
+    // Run the pre-execution pass pipeline at this level on loaded modules (see runPrepasses)
+    // Takes effect on the next load
+    void setPrepassLevel(PrepassLevel level) { prepassLevel = level; }
+
+    // Inline small callees at call time (see Interpreter::setInlineThreshold)
+    // Takes effect on the next load
+    void setInlineThreshold(unsigned threshold) { inlineThreshold = threshold; }
+
+    // Keep the modules loaded by loadBitcodeFromFile() parsed and prepared in directory (dir), so that loading them again skips parsing
+    // Throws std::runtime_error if the directory cannot be created
+    void setModuleCacheDir(const std::string& dir) { moduleCache = std::make_unique<ModuleCache>(dir); }
+
     // Load bitcode from memory buffer
     bool loadBitcode(const char* bitcodeData, size_t bitcodeSize);
     
@@ -59,6 +86,11 @@ public:
     // Load bitcode from string (LLVM IR text format)
     bool loadBitcodeFromString(const std::string& irString);
 
+    // Replace the bodies of the functions that (irString) (LLVM IR text format) defines, keeping the memory of the loaded module
+    // Every function and global the patch defines or declares must exist in the loaded module with the same type. Initializers of patch globals are ignored
+    // Returns false and leaves the module as it was if the patch does not fit. Must not be called while guest code is running
+    bool replaceFunctions(const std::string& irString);
+
     // Execute a function with arbitrary arguments
     // Args: array of void* pointers to argument values
     // ArgTypes: array of TypeInfo describing each argument
@@ -90,6 +122,11 @@ public:
     // Unregister an external function
     void unregisterExternalFunction(const std::string& name);
     
+    // Snapshot the interpreter's memory right after loading, and reset to it between calls
+    // Both return false if no module is loaded
+    bool takeSnapshot();
+    bool restoreSnapshot();
+
     // Get the underlying interpreter (for advanced usage)
     Interpreter* getInterpreter() { return interpreter.get(); }
 };
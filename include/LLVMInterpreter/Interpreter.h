@@ -1,46 +1,282 @@
 #ifndef DYNPTS_INTERPRETER_H
 #define DYNPTS_INTERPRETER_H
 
+#include "CallLog.h"
+#include "FusionProfile.h"
+#include "GuestStdio.h"
+#include "MathLibrary.h"
 #include "Memory.h"
+#include "ModuleImage.h"
 #include "StackFrame.h"
 
 #include "llvm/IR/DataLayout.h"
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/Intrinsics.h"
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <string>
+#include <ucontext.h>
 
 namespace llvm
 {
 	class Module;
 	class ConstantExpr;
 	class CallBase;
+	class LoadInst;
+	class GetElementPtrInst;
+	class ICmpInst;
+	class AtomicRMWInst;
+	class AtomicCmpXchgInst;
+	class raw_ostream;
 }
 
 namespace llvm_interpreter
 {
 
+// Interpreter - One execution context of a module. The layout of the module and its decoded code live in a ModuleImage that several interpreters may share; everything that running guest code modifies lives here
 class Interpreter
 {
 private:
+	friend class ModuleImage;
+
+	std::shared_ptr<ModuleImage> image;
 	llvm::Module* module;
+	// DataLayout caches struct layouts as they are queried, without locking, so every context keeps its own copy. Guest threads use the copies in their GuestThread; this one serves code that runs outside of them
 	llvm::DataLayout dataLayout;
 
-	// The global environment
-	std::unordered_map<const llvm::GlobalValue*, Address> globalEnv;
 	// The global memory
 	MemorySection globalMem;
-	// Mapping from function pointer to function
-	std::unordered_map<Address, const llvm::Function*> funPtrMap;
+	// In lazy mode, globals get their storage up front but their initializers are only written to globalMem the first time their address is taken
+	bool lazyGlobals;
+	std::unordered_set<const llvm::GlobalVariable*> pendingGlobals;
+	// Lazily initialized globals and lazily assigned function pointers since the last snapshot, so that restoreSnapshot() can undo them
+	std::vector<const llvm::GlobalVariable*> globalsInitializedSinceSnapshot;
+	std::vector<const llvm::Function*> functionsAddressedSinceSnapshot;
+
+	// A GEP decoded into a constant byte offset plus one (index operand, scale) term per non-constant array index, so that executing it never has to consult the DataLayout
+	struct GEPPlan
+	{
+		int64_t constOffset;
+		std::vector<std::pair<const llvm::Value*, int64_t>> varTerms;
+	};
+
+	// Superinstructions: dependent sequences whose intermediate results have no other use are executed by one handler, and only their last instruction gets a binding
+	enum class FusedOp: std::uint8_t
+	{
+		NONE,
+		GEP_LOAD,
+		GEP_STORE,
+		ADD_ICMP,
+		LOAD_ADD_STORE,
+		// Not a sequence: a load from read-only global memory, which just binds the value it loads (see foldConstantLoad())
+		FOLDED_LOAD,
+	};
+	struct DecodedInst
+	{
+		const llvm::Instruction* first;
+		const llvm::Instruction* last;
+		FusedOp op;
+		// Index of the value of a FOLDED_LOAD in foldedValues of the block plan
+		unsigned foldedIndex;
+	};
+	// The phi-free, terminator-free body of a basic block with fused sequences collapsed
+	struct BlockPlan
+	{
+		std::vector<DecodedInst> insts;
+		std::vector<DynamicValue> foldedValues;
+		// An icmp used only as the condition of the conditional branch terminator. It is evaluated as part of the branch, so it is not in insts
+		const llvm::ICmpInst* fusedCond;
+	};
+	bool fusionEnabled;
+	// Block counts for mining fusion candidates, or nullptr when not profiling
+	std::unique_ptr<FusionProfile> fusionProfile;
+
+	// The argument a printf conversion consumes
+	enum class FormatArgKind: std::uint8_t
+	{
+		NONE,
+		SIGNED,
+		UNSIGNED,
+		DOUBLE,
+		CHAR,
+		STRING,
+		POINTER,
+		// %n, which stores the number of characters written so far
+		COUNT,
+	};
+	// A piece of a parsed printf format string: literal text followed by at most one conversion
+	struct FormatDirective
+	{
+		std::string literal;
+		// The conversion as a host printf format, with integers always widened to long long (e.g. "%-8lld"). Empty for trailing text
+		std::string hostFormat;
+		FormatArgKind argKind;
+		// The width in bits of the integer that the length modifier asks for
+		unsigned intBits;
+		// Whether the field width and the precision are passed as int arguments
+		bool widthArg, precisionArg;
+	};
+	struct FormatPlan
+	{
+		// Encoded guest address of the format string that was parsed
+		uint64_t formatAddr = 0;
+		std::vector<FormatDirective> directives;
+	};
+
+	// What a green thread is blocked on
+	enum class GreenWait: std::uint8_t
+	{
+		NONE,
+		JOIN,
+		MUTEX,
+		COND,
+		// The main thread waiting for the other threads to finish before the interpreter goes away
+		DRAIN,
+	};
+
+	// A guest thread. Every thread has its own runtime stack, stack memory and execution caches, so that threads never contend on them. Global and heap memory are shared
+	struct GuestThread
+	{
+		Interpreter* owner;
+		unsigned index;
+		// The runtime stack of executing code.  The top of the stack is the current function record.
+		StackFrames stack;
+		// The stack memory
+		MemorySection stackMem;
+		std::unordered_map<const llvm::BasicBlock*, BlockPlan> blockPlans;
+		std::unordered_map<const llvm::GetElementPtrInst*, GEPPlan> gepPlans;
+		// The executable bodies this thread has already looked up, so that only the first lookup takes the inliner lock of the image
+		std::unordered_map<const llvm::Function*, const llvm::Function*> executableBodies;
+		// Parsed constant format strings of printf-like calls, and the buffer their output is formatted into
+		std::unordered_map<const llvm::CallBase*, FormatPlan> formatPlans;
+		std::string formatBuffer;
+		// The data layout of the module, copied so that guest threads on different host threads never fill the same struct layout cache
+		llvm::DataLayout dataLayout;
+
+		std::thread hostThread;
+		DynamicValue retVal;
+		// A guest fault that ended the thread, rethrown by pthread_join()
+		std::exception_ptr failure;
+		bool finished, detached;
+
+		// Green threads only. The host context of the thread is saved here while it is switched out. Every thread but the main one runs on a host stack of its own
+		ucontext_t context;
+		void* hostStack;
+		const llvm::Function* startFn;
+		DynamicValue startArg;
+		GreenWait wait;
+		// The thread blocked in pthread_join() on this one
+		GuestThread* joiner;
+		// The mutex a condition wait has to reacquire, whether the wait is timed, when it started, and the result it returns
+		uint64_t condMutex;
+		bool timedWait;
+		uint64_t waitTicket;
+		int waitResult;
+		// The effects on guest memory of the external call this thread is recording, if any
+		std::vector<CallEffect>* callEffects;
+
+		GuestThread(Interpreter* i, unsigned idx): owner(i), index(idx), dataLayout(i->dataLayout), retVal(DynamicValue::getUndefValue()), finished(false), detached(false), hostStack(nullptr), startFn(nullptr), startArg(DynamicValue::getUndefValue()), wait(GreenWait::NONE), joiner(nullptr), condMutex(0), timedWait(false), waitTicket(0), waitResult(0), callEffects(nullptr) {}
+		~GuestThread();
+	};
+	// Slot 0 is the main thread. A slot is reused once its thread has been joined
+	static const unsigned MAX_GUEST_THREADS = 4096;
+	std::array<std::unique_ptr<GuestThread>, MAX_GUEST_THREADS> threads;
+	std::mutex threadsMutex;
+	// Notified whenever a detached thread exits and gives up its slot
+	std::condition_variable detachedThreadExited;
+	// The guest thread run by the calling host thread
+	static thread_local GuestThread* currentThread;
+	// The data layout to use on the calling host thread
+	const llvm::DataLayout& getDataLayout() const
+	{
+		return (currentThread != nullptr && currentThread->owner == this) ? currentThread->dataLayout : dataLayout;
+	}
+	// Set when the first guest thread is created. From then on global, heap and stack memory never move, and the global environment is read-only
+	bool multiThreaded;
+	// Serializes heap allocation and host output across guest threads
+	std::mutex hostMutex;
+
+	// Green threads: every guest thread runs on the host thread that runs the main thread, and the scheduler switches between them at basic block boundaries once the current one has used up its instruction budget. The next thread is drawn from a seeded generator, so a given seed always produces the same interleaving
+	bool greenThreads;
+	// Set once the first green thread is created
+	bool greenThreadsStarted;
+	std::mt19937_64 greenRng;
+	unsigned greenQuantum;
+	int64_t greenSliceLeft;
+	// The threads that can run, including the one that is running
+	std::vector<GuestThread*> greenRunnable;
+	// A guest mutex or condition variable, keyed by its encoded guest address. The owner is only used by mutexes. Absent entries are unlocked mutexes and condition variables nobody waits on
+	struct GreenSyncObject
+	{
+		GuestThread* owner = nullptr;
+		std::deque<GuestThread*> waiters;
+	};
+	std::map<uint64_t, GreenSyncObject> greenSyncObjects;
+	// Numbers condition waits in the order they start, so that timed ones time out first come first served
+	uint64_t greenWaitTickets;
+	// A finished thread whose host stack can only be unmapped once another thread has been switched to
+	GuestThread* greenZombie;
+	// An exception that escaped a green thread, rethrown in the main thread
+	std::exception_ptr greenFailure;
+	// The first exception that escaped a detached host thread, which nobody can join. Rethrown in the main thread once main returns. Guarded by threadsMutex
+	std::exception_ptr detachedFailure;
+	void rethrowDetachedFailure();
+
+	// Makes the calling host thread execute guest code as the main thread, unless it already is a guest thread of this interpreter
+	class MainThreadScope
+	{
+	private:
+		GuestThread* savedThread;
+	public:
+		MainThreadScope(Interpreter& interp): savedThread(currentThread)
+		{
+			if (currentThread == nullptr || currentThread->owner != &interp)
+				currentThread = interp.threads[0].get();
+		}
+		~MainThreadScope() { currentThread = savedThread; }
+	};
+	// Thrown by pthread_exit() and caught where the thread started
+	struct GuestThreadExit
+	{
+		DynamicValue retVal;
+	};
+
+	// Stack addresses carry the index of the owning thread above STACK_THREAD_SHIFT, so that a thread can access the stack of another one. The main thread has index 0, so its addresses are plain offsets
+	static const unsigned STACK_THREAD_SHIFT = 40;
+	MemorySection& getStackSection(Address addr) { return threads[addr >> STACK_THREAD_SHIFT]->stackMem; }
+	static Address getStackOffset(Address addr) { return addr & ((Address(1) << STACK_THREAD_SHIFT) - 1); }
 
-	// The runtime stack of executing code.  The top of the stack is the current function record.
-	StackFrames stack;
-	// The stack memory
-	MemorySection stackMem;
 	// The heap memory
 	MemorySection heapMem;
+	// Address range reserved for the heap once host pointers into it must stay valid: when there is more than one thread, or when files are mapped into it. Pages are only committed when touched
+	static const size_t HEAP_RESERVE_SIZE = size_t(1) << 38;
+	// Heap blocks at least this large start on a host page, and fread()s at least this large into them map the file instead of copying it
+	static const size_t MAPPED_READ_MIN_SIZE = size_t(1) << 20;
+	// The FILE streams of the guest. Guarded by hostMutex
+	GuestStdio stdio;
 
-	Address allocateStackMem(StackFrame& frame, unsigned size);
+	Address allocateStackMem(StackFrame& frame, uint64_t size, uint64_t align);
 	Address allocateGlobalMem(llvm::Type* type);
+	// Write the initializer of a global into globalMem, copying plain constant data in bulk
+	void initializeGlobal(Address addr, const llvm::Constant* init);
+	// Return the address of a global variable, writing its initializer first if that has been deferred
+	Address getGlobalAddress(const llvm::GlobalVariable* gv);
+	// Return the address of a function, assigning one on first use
+	Address getFunctionAddress(const llvm::Function* f);
+	static bool isReadOnlyGlobal(const llvm::GlobalVariable* gv);
+	bool isReadOnlyGlobalRange(Address addr, uint64_t size) const;
+	// Return the value of a scalar load from read-only global memory at a constant address, or undef if the load has to go through memory
+	DynamicValue foldConstantLoad(const llvm::LoadInst* loadInst);
 
 	DynamicValue readFromPointer(const PointerValue& ptr, llvm::Type* type);
 	DynamicValue loadValue(MemorySection& mem, Address addr, llvm::Type* type);
@@ -50,28 +286,200 @@ private:
 	DynamicValue evaluateConstant(const llvm::Constant*);
 	DynamicValue evaluateConstantExpr(const llvm::ConstantExpr*);
 
-	// Setting up the stack frame and execute f
-	DynamicValue callFunction(const llvm::Function* f, std::vector<DynamicValue>&& argValues);
+	// Return the body to execute for f, reading it from bitcode and inlining its small callees the first time it is asked for
+	const llvm::Function* getExecutableBody(const llvm::Function* f);
+	const llvm::Function* createInlinedBody(const llvm::Function* f);
+	// Read the body of f if the module is loaded lazily and it has not been read yet. Called with the inline mutex of the image held
+	void materializeBody(const llvm::Function* f);
+	bool isInlineCandidate(const llvm::Function* callee) const;
+
+	// Setting up the stack frame and execute f. (cs) is the call site, if there is one
+	DynamicValue callFunction(const llvm::Function* f, std::vector<DynamicValue>&& argValues, const llvm::CallBase* cs = nullptr);
 	// Assuming that the stack frame is set up, go ahead and execute f
 	DynamicValue runFunction(StackFrame& frame);
 	// External call handler
 	DynamicValue callExternalFunction(const llvm::CallBase* cs, const llvm::Function* f, std::vector<DynamicValue>&& argValues);
+	// Intrinsic call handler. Intrinsics without a native implementation are passed on to callExternalFunction()
+	DynamicValue callIntrinsic(const llvm::CallBase* cs, const llvm::Function* f, std::vector<DynamicValue>&& argValues);
+	// Intrinsics that have no effect on execution (debug info, lifetime markers, assumptions). Calls to them are skipped without evaluating their operands
+	static bool isNoOpIntrinsic(llvm::Intrinsic::ID id);
+	// Host pointers into guest memory for external calls. Use getWritablePointer() for every pointer that is written through, so that snapshots see the write. It throws std::runtime_error for read-only global memory, whose loads may have been folded
+	void* getRawPointer(const PointerValue& ptr);
+	void* getWritablePointer(const PointerValue& ptr, size_t size);
+	// The number of allocated bytes from (ptr) to the end of its section
+	uint64_t getSectionExtent(const PointerValue& ptr);
+	// Host pointer to (size) bytes of guest memory at (ptr) for the native libc routines. Throws std::out_of_range unless they are all allocated
+	const char* getCheckedPointer(const PointerValue& ptr, uint64_t size);
+	// Host pointer to the NUL-terminated guest string at (ptr), of which at most (maxLen) bytes are looked at. The length goes to (len). Throws std::out_of_range if the string runs past its section
+	const char* getGuestString(const PointerValue& ptr, uint64_t& len, uint64_t maxLen = UINT64_MAX);
 	// Pop the last stack frame off of the stack before returning to the caller
 	void popStack();
+	// Pop the frames that a guest fault left above (depth), so that the interpreter can run guest code again once the fault has been handled
+	void unwindStack(size_t depth);
 
 	DynamicValue evaluateOperand(const StackFrame& frame, const llvm::Value* v);
+	bool evaluateScalarICmp(llvm::CmpInst::Predicate pred, const DynamicValue& val0, const DynamicValue& val1) const;
+	DynamicValue evaluateICmp(llvm::CmpInst::Predicate pred, const DynamicValue& val0, const DynamicValue& val1) const;
+	const GEPPlan& getGEPPlan(const llvm::GetElementPtrInst* gepInst);
+	DynamicValue evaluateGEP(const StackFrame& frame, const llvm::GetElementPtrInst* gepInst);
 	void evaluateInstruction(StackFrame& frame, const llvm::Instruction* inst);
+	const BlockPlan& getBlockPlan(const llvm::BasicBlock* bb);
+	void evaluateFusedInstruction(StackFrame& frame, const DecodedInst& decoded);
+
+	// The va_list layout of the target. The register save areas are always marked as used up, so every argument is read from the overflow area, where callFunction() lays out the variadic arguments the way the target passes arguments on the stack
+	enum class VaListKind: std::uint8_t
+	{
+		// A plain pointer to the next argument (i386, Windows, Darwin AArch64, and modules without a target triple)
+		POINTER,
+		// struct { i32 gp_offset; i32 fp_offset; i8* overflow_arg_area; i8* reg_save_area; } of the x86-64 System V ABI
+		X86_64_SYSV,
+		// struct { i8* stack; i8* gr_top; i8* vr_top; i32 gr_offs; i32 vr_offs; } of the AArch64 procedure call standard
+		AARCH64,
+	};
+	VaListKind vaListKind;
+	// i8*, looked up once because creating types is not thread-safe
+	llvm::Type* bytePtrType;
+
+	// Variadic arguments
+	void layOutVarArgs(StackFrame& frame, std::vector<DynamicValue>& argValues, unsigned firstVarArg, const llvm::CallBase* cs);
+	uint64_t getVaListSize() const;
+	// The pointer to the pointer inside (vaList) that points to the next argument
+	DynamicValue getVaListCursor(const PointerValue& vaList) const;
+	void startVaList(const StackFrame& frame, const PointerValue& vaList);
+	// Read the argument of (type) at (cursor) and advance the cursor past it
+	DynamicValue readVarArg(DynamicValue& cursor, llvm::Type* type);
+	DynamicValue evaluateVAArg(const PointerValue& vaList, llvm::Type* type);
+
+	// printf family
+	void parseFormat(const char* fmt, std::vector<FormatDirective>& directives) const;
+	// The parsed format string at (fmtPtr). Format strings in read-only memory are parsed once per call site, others into (scratch) on every call
+	const std::vector<FormatDirective>& getFormatDirectives(const llvm::CallBase* cs, const PointerValue& fmtPtr, std::vector<FormatDirective>& scratch);
+	template <typename NextArg>
+	void formatDirectives(const std::vector<FormatDirective>& directives, std::string& out, NextArg&& nextArg);
+	// Format the format string argument (fmtIdx) with the arguments that follow it or, for the v* functions, with the va_list that follows it. The result stays valid until the next call on the same thread
+	const std::string& formatGuestString(const llvm::CallBase* cs, const std::vector<DynamicValue>& argValues, unsigned fmtIdx, bool fromVaList);
+	// Write (str) into the guest buffer at (dest) of (size) bytes with a terminating NUL, truncating it if needed
+	void copyFormattedString(const PointerValue& dest, uint64_t size, const std::string& str);
+
+	// qsort() and bsearch(), with the guest comparator (cmp) called through callGuestFunction()
+	void sortGuestArray(const PointerValue& base, uint64_t count, uint64_t size, const PointerValue& cmp);
+	DynamicValue searchGuestArray(const PointerValue& key, const PointerValue& base, uint64_t count, uint64_t size, const PointerValue& cmp);
+
+	// <math.h> functions. Element-wise ones are evaluated by evaluateMathFunction(), the others write their second results through guest pointers
+	DynamicValue callMathFunction(const MathFunction& fn, const std::vector<DynamicValue>& argValues);
+
+	// Guest heap and memory mappings. These expect hostMutex to be held
+	Address allocateHeapMem(uint64_t size);
+	// Reserve the heap so that files can be mapped into it. Returns false if the heap is file-backed, in which case they cannot
+	bool reserveHeapForMapping();
+	// void* mmap(void* addr, size_t len, int prot, int flags, int fd, off_t offset)
+	DynamicValue mapGuestMemory(const std::vector<DynamicValue>& argValues);
+	int unmapGuestMemory(const PointerValue& ptr, uint64_t size);
+
+	// Guest stdio. A guest FILE is a stand-in that holds the number of its stream: those of stdin, stdout and stderr are in global memory, those of fopen() on the heap
+	void initializeStdStreams();
+	int getStreamNumber(const PointerValue& file);
+	void writeToStream(int stream, llvm::StringRef str);
+	// Read (size) bytes of (stream) into guest memory at (buf). Expects hostMutex to be held
+	size_t readFromStream(int stream, const PointerValue& buf, size_t size);
+	DynamicValue openGuestFile(const PointerValue& path, const PointerValue& mode);
+	int closeGuestFile(const PointerValue& file);
+
+	// Guest threads and atomics
+	void enterMultiThreadedMode();
+	DynamicValue runThreadStart(const llvm::Function* f, DynamicValue arg);
+	void runGuestThread(GuestThread* thread, const llvm::Function* f, DynamicValue arg);
+	DynamicValue createGuestThread(const std::vector<DynamicValue>& argValues);
+	DynamicValue joinGuestThread(const std::vector<DynamicValue>& argValues);
+	DynamicValue detachGuestThread(const std::vector<DynamicValue>& argValues);
+	void* getAtomicPointer(const PointerValue& ptr, uint64_t size);
+	DynamicValue evaluateAtomicLoad(const PointerValue& ptr, llvm::Type* type);
+	void evaluateAtomicStore(const PointerValue& ptr, const DynamicValue& val, llvm::Type* type);
+	DynamicValue evaluateAtomicRMW(const StackFrame& frame, const llvm::AtomicRMWInst* rmwInst);
+	DynamicValue evaluateCmpXchg(const StackFrame& frame, const llvm::AtomicCmpXchgInst* cxInst);
+
+	// Green threads
+	static void greenThreadEntry();
+	void startGreenThread(GuestThread* thread);
+	void finishGreenThread(GuestThread* thread);
+	void switchGreenThread(GuestThread* next);
+	// Give the rest of the time slice up to a thread picked by the scheduler, possibly the current one
+	void yieldGreenThread();
+	void blockGreenThread(GreenWait wait);
+	void wakeGreenThread(GuestThread* thread);
+	// Pick the next thread to run. When every thread is blocked, timed condition waits time out first; after that it is a deadlock
+	GuestThread* pickGreenThread();
+	GuestThread* resumeMainThread();
+	void reclaimGreenZombie();
+	void drainGreenThreads();
+	void reacquireGreenMutex(GuestThread* thread);
+	int resetGreenSyncObject(const PointerValue& ptr);
+	int lockGreenMutex(const PointerValue& mutex, bool block);
+	int unlockGreenMutex(const PointerValue& mutex);
+	int waitGreenCond(const PointerValue& cond, const PointerValue& mutex, bool timed);
+	int signalGreenCond(const PointerValue& cond, bool broadcast);
 	
 	// External function callback type
 	// Callback receives function signature and arguments, returns result
 	using ExternalFunctionCallback = std::function<DynamicValue(const llvm::Function*, const std::vector<DynamicValue>&)>;
 	std::unordered_map<std::string, ExternalFunctionCallback> externalCallbacks;
-	
+
+	// Record/replay of the external calls that reach the host. At most one of the two is set. Logged calls are made one at a time under callLogMutex, so that the log has them in the order they happened
+	std::unique_ptr<CallLogWriter> callRecorder;
+	std::unique_ptr<CallLogReader> callReplayer;
+	uint64_t nextReplayedCall;
+	std::mutex callLogMutex;
+
+	// Whether an external call that reaches the host has to be recorded or replayed rather than just made
+	bool isLoggingCalls() const { return (callRecorder != nullptr || callReplayer != nullptr) && currentThread->callEffects == nullptr; }
+	DynamicValue logExternalCall(const llvm::CallBase* cs, const llvm::Function* f, std::vector<DynamicValue>&& argValues);
+	DynamicValue replayExternalCall(const llvm::Function* f, const std::vector<DynamicValue>& argValues);
+	// Add an effect to the external call being recorded on this thread, if there is one
+	void noteCallEffect(CallEffect::Kind kind, const PointerValue& ptr, uint64_t size, uint64_t align = 0)
+	{
+		if (currentThread != nullptr && currentThread->callEffects != nullptr)
+			currentThread->callEffects->push_back({ kind, ptr.getAddressSpace(), ptr.getAddress(), size, align, nullptr });
+	}
+
 public:
+	// Create an interpreter with an image of its own. Call evaluateGlobals() before running anything
 	Interpreter(llvm::Module*);
+	// Create an interpreter from a shared image. If the image is loaded (see ModuleImage::load()), global memory starts out as a copy-on-write mapping of its initialized globals and evaluateGlobals() has nothing left to do
+	Interpreter(std::shared_ptr<ModuleImage> img);
 	~Interpreter();
 
+	// Defer global initialization until first use. Must be set before evaluateGlobals()
+	void setLazyGlobals(bool lazy) { lazyGlobals = lazy; }
+
+	// Inline callees of at most (threshold) instructions into their callers at call time. 0 (the default) disables inlining
+	void setInlineThreshold(unsigned threshold) { image->inlineThreshold = threshold; }
+	// Call right before or after replacing the body of f. Drops the executable bodies of f and of every function that has f inlined, and every execution plan, so that the new body is picked up. Must be called while no guest function is executing, and not on a shared image
+	void invalidateFunction(const llvm::Function* f);
+
+	// Execute common instruction sequences as superinstructions (on by default). Must be set before any code runs
+	void setFusion(bool enable) { fusionEnabled = enable; }
+
+	// Hold back up to (size) bytes of guest output to stdout and to files the guest opens (1 MiB by default). Guest stderr is unbuffered
+	void setStdioBufferSize(size_t size);
+	// Point guest stdin, stdout and stderr at the current host file descriptors 0, 1 and 2, for a process that has replaced them since the interpreter was created
+	void resetStdStreams();
+	// Count block executions so that printFusionProfile() can report the most frequent instruction sequences. Disables fusion
+	void enableFusionProfile();
+	void printFusionProfile(llvm::raw_ostream& os, unsigned topN) const;
+
+	// Run guest threads as green threads on the calling host thread instead of on host threads of their own. The running thread is preempted after about (quantum) instructions, and the next one is picked by a generator seeded with (seed), so the same seed always gives the same interleaving. Must be set before any guest thread is created
+	void setGreenThreads(uint64_t seed, unsigned quantum);
+
 	void evaluateGlobals();
+
+	// Record the state of guest memory so that it can be cheaply reset between runs. Must be called while no guest function is executing
+	void takeSnapshot();
+	// Reset guest memory to the last snapshot. The cost is proportional to the number of pages written since then
+	void restoreSnapshot();
+
+	// Back the guest heap with a sparse file in directory (dir) so that heaps larger than physical memory can be paged out. Throws std::runtime_error on failure
+	void mapHeapToFile(const std::string& dir) { heapMem.mapToFile(dir); }
+	MemorySection::PagingStats getHeapPagingStats() const { return heapMem.getPagingStats(); }
 	int runMain(const llvm::Function* mainFn, const std::vector< std::string>& mainArgs);
 
 	DynamicValue runFunction(const llvm::Function* func, const std::vector<DynamicValue>& args);
@@ -82,6 +490,14 @@ public:
 	
 	// Unregister an external function
 	void unregisterExternalFunction(const std::string& name);
+
+	// Log every external call that reaches the host (stdio, file descriptors, file mappings and registered callbacks) to the file (path): its arguments, its result and what it did to guest memory. Throws std::runtime_error if the file cannot be created. Must be called before any code runs
+	void recordExternalCalls(const std::string& path);
+	// Take the results of those calls from a log written by recordExternalCalls() instead of making them, so that a re-execution neither reads its input nor writes any output. The guest has to make the same calls in the same order as the recorded run, which host threads generally do not; green threads with the same seed do. A call that does not match the log throws std::runtime_error. Registered callbacks that call back into guest code cannot be replayed, since that code would not run. Must be called before any code runs
+	void replayExternalCalls(const std::string& path);
+
+	// Call the guest function that (fnPtr) points to, from inside an external call such as a registered callback. The callee runs on top of the frame that made the external call, as if that frame had called it directly, so callbacks can nest
+	DynamicValue callGuestFunction(const PointerValue& fnPtr, std::vector<DynamicValue>&& args);
 };
 
 }
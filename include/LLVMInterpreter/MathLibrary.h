@@ -0,0 +1,67 @@
+#ifndef DYNPTS_MATH_LIBRARY_H
+#define DYNPTS_MATH_LIBRARY_H
+
+#include "DynamicValue.h"
+
+#include "llvm/ADT/StringRef.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace llvm_interpreter
+{
+
+// Native bindings of the C99 <math.h> functions, both the double and the float variants. The guest was compiled against the same ABI as the host, so they call straight into the host libm
+
+// The prototype of a math function, where T is double or float
+enum class MathSignature: std::uint8_t
+{
+	// T f(T), T f(T, T) and T f(T, T, T)
+	UNARY,
+	BINARY,
+	TERNARY,
+	// T f(T, int) and T f(T, long), like ldexp() and scalbln()
+	SCALE_INT,
+	SCALE_LONG,
+	// int f(T), long f(T) and long long f(T), like ilogb(), lround() and llround()
+	TO_INT,
+	TO_LONG,
+	TO_LONG_LONG,
+	// The functions from here on take pointers, so they cannot be applied to vector lanes
+	// T frexp(T, int*)
+	FREXP,
+	// T modf(T, T*)
+	MODF,
+	// T remquo(T, T, int*)
+	REMQUO,
+	// void sincos(T, T*, T*), the GNU extension that compilers merge sin() and cos() of the same argument into
+	SINCOS,
+	// T nan(const char*)
+	NAN_STRING,
+};
+
+struct MathFunction
+{
+	MathSignature signature;
+	bool isDouble;
+	// The host function, to be cast back to the type given by (signature) and (isDouble)
+	void (*fn)();
+
+	// Whether the arguments and the result are all numbers, so that the function can be applied lane by lane
+	bool isElementWise() const { return signature < MathSignature::FREXP; }
+	unsigned getNumArgs() const;
+};
+
+// Look up the math function that the guest calls as (name). Besides the plain names this accepts the unmasked variants of the x86 vector function ABI (_ZGVdN4v_sin, _ZGVbN4vv_powf, ...) that the loop vectorizer calls with -fveclib=libmvec. They are the scalar function applied to vector lanes. Returns nullptr for any other name
+const MathFunction* findMathFunction(llvm::StringRef name);
+
+// The batch entry point: apply the element-wise (fn) to (count) sets of arguments in one host loop. args[i] points to the (count) packed native values of the i-th argument, and the (count) results are written to (result)
+void evaluateMathBatch(const MathFunction& fn, size_t count, const void* const* args, void* result);
+
+// Apply the element-wise (fn) to scalar arguments, or to the lanes of vector arguments with a single evaluateMathBatch() call. Undef scalar arguments give an undef result
+DynamicValue evaluateMathFunction(const MathFunction& fn, const std::vector<DynamicValue>& args);
+
+}
+
+#endif
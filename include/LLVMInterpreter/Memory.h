@@ -6,7 +6,10 @@
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <memory>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 namespace llvm_interpreter
 {
@@ -29,48 +32,126 @@ private:
 	static const uint64_t StackAddressSpaceTag = 0x4000000000000000;
 	static const uint64_t HeapAddressSpaceTag = 0x8000000000000000;
 
+	// Allocations at least this large get sequential access advice when the section is file-backed; everything else is advised as random access
+	static const size_t SEQUENTIAL_ADVICE_THRESHOLD = 0x400000;
+
 	size_t totalSize, usedSize;
 	uint8_t* mem;
+	// Size of the address range reserved by reserve(), or 0 if the section may still move when it grows
+	size_t reservedSize;
+	// Set when mem is a private copy-on-write mapping of the backing file of another section (see mapCopyOnWrite())
+	bool copyOnWrite;
+
+	// Descriptor of the (already unlinked) sparse file backing the section, or -1 if the section lives in an ordinary host buffer
+	int backingFd;
+	// Process-wide page fault counters at the time the section was mapped to a file
+	long baseMajorFaults, baseMinorFaults;
+
+	// Snapshot state. While a snapshot exists, every write below snapshotSize marks the written snapshot pages dirty, so that restoreSnapshot() only has to copy those pages back
+	static const unsigned SNAPSHOT_PAGE_SHIFT = 12;
+	std::unique_ptr<uint8_t[]> snapshotMem;
+	size_t snapshotSize;
+	std::vector<bool> dirtyBitmap;
+	std::vector<size_t> dirtyPages;
+
+	// Page-aligned ranges of a reserved section that map host files instead of the memory of the section (see mapFile())
+	struct FileMapping
+	{
+		Address addr;
+		size_t size;
+		bool shared;
+	};
+	std::vector<FileMapping> fileMappings;
 
-	void grow()
+	void markDirty(Address addr, size_t size);
+	void touch(Address addr, size_t size)
 	{
-		auto newSize = totalSize * 2;
-		auto newMem = new uint8_t[newSize];
-		std::memcpy(newMem, mem, totalSize);
-		delete[] mem;
-		mem = newMem;
+		if (addr < snapshotSize)
+			markDirty(addr, size);
 	}
 
+	// Keep doubling the section until (minSize) bytes fit
+	void grow(size_t minSize);
+	// Map (size) bytes of the backing file
+	uint8_t* mapBackingFile(size_t size);
+	// Move the contents of the section into the (empty) file (fd), which the section takes ownership of
+	void moveToBackingFile(int fd);
+	void releaseMemory();
+	// Free mem when it is an ordinary host buffer or a copy-on-write mapping
+	void releaseHostBuffer();
+	// Give the kernel an access pattern hint for a freshly allocated range of a file-backed section
+	void adviseAllocation(Address addr, size_t size);
+
 	bool isAddressLegal(Address addr) const
 	{
 		return (addr < usedSize) && (addr != 0);
 	}
+	bool isRangeLegal(Address addr, size_t size) const
+	{
+		return (addr != 0) && (addr <= usedSize) && (size <= usedSize - addr);
+	}
 public:
-	MemorySection(): totalSize(DEFAULT_SIZE), usedSize(1), mem(nullptr)
+	MemorySection(): totalSize(DEFAULT_SIZE), usedSize(1), mem(nullptr), reservedSize(0), copyOnWrite(false), backingFd(-1), baseMajorFaults(0), baseMinorFaults(0), snapshotSize(0)
 	{
 		// We use a little trick here: set usedSize = 1 so that valid address starts at 1. Address 0 is reserved for NULL pointer
 		mem = new uint8_t[DEFAULT_SIZE];
 	}
 	~MemorySection()
 	{
-		delete[] mem;
+		releaseMemory();
 	}
 
-	// Allocate (size) bypes of memory and return the allocated addr
-	Address allocate(unsigned size)
+	MemorySection(const MemorySection&) = delete;
+	MemorySection& operator=(const MemorySection&) = delete;
+
+	// Move the section into a memory-mapped sparse file created in directory (dir), so that the kernel can page cold data out to disk. Existing contents are preserved. Throws std::runtime_error on failure
+	void mapToFile(const std::string& dir);
+	bool isFileBacked() const { return backingFd != -1; }
+	// Move the section into anonymous shared memory, so that other sections can map it with mapCopyOnWrite(). Existing contents are preserved
+	void mapToSharedMemory();
+	// Replace the contents of the section with a copy-on-write mapping of (src), which must be file-backed and must not change anymore. Pages are only copied once they are written, so sections mapped from the same source share all the pages they only read
+	void mapCopyOnWrite(const MemorySection& src);
+	void swap(MemorySection& other);
+
+	// Move the section into an address range of (capacity) bytes that is reserved up front, so that it never moves again and host pointers into it stay valid while other threads allocate. Allocating past (capacity) throws std::runtime_error. Not supported on file-backed sections
+	void reserve(size_t capacity);
+	bool isReserved() const { return reservedSize != 0; }
+
+	// Back the allocated range [addr, addr + size) with the host file (fd) from (offset) on, so that the file is accessed in place instead of being copied. All three must be multiples of the host page size, and the section must be reserved. A private mapping is copy-on-write, while writes to a shared one go to the file
+	void mapFile(Address addr, size_t size, int fd, uint64_t offset, bool shared);
+	// Turn [addr, addr + size) of a reserved section back into zero-filled memory of its own, dropping any file mapped there
+	void unmapFile(Address addr, size_t size);
+	// Whether writes to some range of the section go to a host file. Such a section cannot be snapshotted, because restoring it would write the old contents back to the file
+	bool hasSharedFileMappings() const;
+	static size_t getPageSize();
+
+	// Record the current contents and allocation state of the section. Replaces any previous snapshot. Throws std::runtime_error while a host file is mapped shared into the section
+	void takeSnapshot();
+	// Bring the section back to the state recorded by takeSnapshot(). Only the pages written since the snapshot (or the last restore) are copied
+	void restoreSnapshot();
+	bool hasSnapshot() const { return snapshotMem != nullptr; }
+
+	// Allocate (size) bypes of memory aligned to (align) bytes and return the allocated addr
+	Address allocate(size_t size, size_t align = 1)
 	{
-		if (usedSize + size >= totalSize)
-			grow();
+		auto retAddr = (usedSize + align - 1) / align * align;
+		if (retAddr + size >= totalSize)
+			grow(retAddr + size);
 
-		assert(usedSize + size < totalSize);
+		assert(retAddr + size < totalSize);
 
-		auto retAddr = usedSize;
-		usedSize += size;
+		usedSize = retAddr + size;
+		if (backingFd != -1)
+			adviseAllocation(retAddr, size);
 		return retAddr;
 	}
 
+	size_t getUsedSize() const { return usedSize; }
+	// The number of allocated bytes from (addr) to the end of the section, or 0 if (addr) is not allocated
+	size_t getExtent(Address addr) const { return isAddressLegal(addr) ? usedSize - addr : 0; }
+
 	// Deallocate (size) bytes of allocated memory. This function is used to model stack deallocation
-	void deallocate(unsigned size)
+	void deallocate(size_t size)
 	{
 		usedSize -= size;
 	}
@@ -80,14 +161,54 @@ public:
 	{
 	}
 
+	// Pointers are stored in memory as their address with the address space in the tag bits
+	static uint64_t encodePointer(const PointerValue& ptrVal)
+	{
+		auto ptrAddr = ptrVal.getAddress();
+		switch (ptrVal.getAddressSpace())
+		{
+			case PointerAddressSpace::GLOBAL_SPACE:
+				ptrAddr |= GlobalAddressSpaceTag;
+				break;
+			case PointerAddressSpace::STACK_SPACE:
+				ptrAddr |= StackAddressSpaceTag;
+				break;
+			case PointerAddressSpace::HEAP_SPACE:
+				ptrAddr |= HeapAddressSpaceTag;
+				break;
+		}
+		return ptrAddr;
+	}
+	static DynamicValue decodePointer(uint64_t ptrAddr)
+	{
+		auto addrSpace = PointerAddressSpace::GLOBAL_SPACE;
+		switch (ptrAddr & AddressSpaceMask)
+		{
+			case GlobalAddressSpaceTag:
+				addrSpace = PointerAddressSpace::GLOBAL_SPACE;
+				break;
+			case StackAddressSpaceTag:
+				addrSpace = PointerAddressSpace::STACK_SPACE;
+				break;
+			case HeapAddressSpaceTag:
+				addrSpace = PointerAddressSpace::HEAP_SPACE;
+				break;
+			default:
+				throw std::runtime_error("decodePointer() reads illegal pointer tag");
+		}
+
+		return DynamicValue::getPointerValue(addrSpace, ptrAddr & ~AddressSpaceMask);
+	}
+
 	// Reads an integer from memory at address (addr).
 	DynamicValue readAsInt(Address addr, unsigned bitWidth) const
 	{
 		assert(bitWidth <= 64 && "No support for >64-bit int read");
 		if (!isAddressLegal(addr))
 			throw std::out_of_range("readAsInt() accesses unallocated memory");
+		// Integers that are not a whole number of bytes, like i1, take up their store size
 		uint64_t val = 0;
-		std::memcpy(&val, mem + addr, bitWidth / 8u);
+		std::memcpy(&val, mem + addr, (bitWidth + 7) / 8u);
 		return DynamicValue::getIntValue(llvm::APInt(bitWidth, val));
 	}
 
@@ -115,24 +236,15 @@ public:
 			throw std::out_of_range("readAsPointer() accesses unallocated memory");
 		Address retAddr = 0;
 		std::memcpy(&retAddr, mem + addr, PointerValue::getPointerSize());
-		
-		auto addrSpace = PointerAddressSpace::GLOBAL_SPACE;
-		switch (retAddr & AddressSpaceMask)
-		{
-			case GlobalAddressSpaceTag:
-				addrSpace = PointerAddressSpace::GLOBAL_SPACE;
-				break;
-			case StackAddressSpaceTag:
-				addrSpace = PointerAddressSpace::STACK_SPACE;
-				break;
-			case HeapAddressSpaceTag:
-				addrSpace = PointerAddressSpace::HEAP_SPACE;
-				break;
-			default:
-				throw std::runtime_error("readAsPointer() reads illegal pointer tag");
-		}
+		return decodePointer(retAddr);
+	}
 
-		return DynamicValue::getPointerValue(addrSpace, retAddr & ~AddressSpaceMask);
+	// Reads (size) raw bytes from memory at address (addr) into (dst)
+	void readRaw(Address addr, void* dst, size_t size) const
+	{
+		if (!isRangeLegal(addr, size))
+			throw std::out_of_range("readRaw() accesses unallocated memory");
+		std::memcpy(dst, mem + addr, size);
 	}
 
 	void write(Address addr, const DynamicValue& val)
@@ -146,7 +258,9 @@ public:
 				auto& intVal = val.getAsIntValue().getInt();
 				assert(intVal.getBitWidth() <= 64 && ">64-bit integer write not supported");
 				auto rawData = intVal.getRawData();
-				std::memcpy(mem + addr, rawData, intVal.getBitWidth() / 8);
+				auto size = (intVal.getBitWidth() + 7) / 8;
+				touch(addr, size);
+				std::memcpy(mem + addr, rawData, size);
 				break;
 			}
 			case DynamicValueType::FLOAT_VALUE:
@@ -155,31 +269,21 @@ public:
 				if (fpVal.isDouble())
 				{
 					double f = fpVal.getFloat();
+					touch(addr, sizeof(double));
 					std::memcpy(mem + addr, &f, sizeof(double));
 				}
 				else
 				{
 					float f = fpVal.getFloat();
+					touch(addr, sizeof(float));
 					std::memcpy(mem + addr, &f, sizeof(float));
 				}
 				break;
 			}
 			case DynamicValueType::POINTER_VALUE:
 			{
-				auto& ptrVal = val.getAsPointerValue();
-				auto ptrAddr = ptrVal.getAddress();
-				switch (ptrVal.getAddressSpace())
-				{
-					case PointerAddressSpace::GLOBAL_SPACE:
-						ptrAddr |= GlobalAddressSpaceTag;
-						break;
-					case PointerAddressSpace::STACK_SPACE:
-						ptrAddr |= StackAddressSpaceTag;
-						break;
-					case PointerAddressSpace::HEAP_SPACE:
-						ptrAddr |= HeapAddressSpaceTag;
-						break;
-				}
+				auto ptrAddr = encodePointer(val.getAsPointerValue());
+				touch(addr, PointerValue::getPointerSize());
 				std::memcpy(mem + addr, &ptrAddr, PointerValue::getPointerSize());
 				break;
 			}
@@ -203,17 +307,70 @@ public:
 				}
 				break;
 			}
+			case DynamicValueType::VECTOR_VALUE:
+			{
+				auto& vecVal = val.getAsVectorValue();
+				if (vecVal.getLaneBits() != vecVal.getLaneBytes() * 8)
+				{
+					if (!isRangeLegal(addr, vecVal.getPackedSize()))
+						throw std::out_of_range("write() accesses unallocated memory");
+					touch(addr, vecVal.getPackedSize());
+					vecVal.packLanes(mem + addr);
+					break;
+				}
+				touch(addr, vecVal.getRawSize());
+				std::memcpy(mem + addr, vecVal.getRawData(), vecVal.getRawSize());
+				break;
+			}
 			case DynamicValueType::UNDEF_VALUE:
 				//throw std::runtime_error("Writing an undef value to memory?");
 				break;
 		}
 	}
 
+	// Copy (size) raw bytes into memory at address (addr). Used to bulk-initialize memory from constant data without going through DynamicValue
+	void writeRaw(Address addr, const void* src, size_t size)
+	{
+		if (size == 0)
+			return;
+		if (!isRangeLegal(addr, size))
+			throw std::out_of_range("writeRaw() accesses unallocated memory");
+		touch(addr, size);
+		std::memcpy(mem + addr, src, size);
+	}
+
+	// Set (size) bytes of memory at address (addr) to (byte)
+	void fill(Address addr, uint8_t byte, size_t size)
+	{
+		if (size == 0)
+			return;
+		if (!isRangeLegal(addr, size))
+			throw std::out_of_range("fill() accesses unallocated memory");
+		touch(addr, size);
+		std::memset(mem + addr, byte, size);
+	}
+
 	// Be very careful when calling this function!
 	void* getRawPointerAtAddress(Address addr)
 	{
 		return mem + addr;	
 	}
+	// Same as above, for callers that are about to write (size) bytes through the returned pointer
+	void* getWritablePointerAtAddress(Address addr, size_t size)
+	{
+		touch(addr, size);
+		return mem + addr;
+	}
+
+	// Paging statistics of a file-backed section. Fault counts are process-wide and measured from the time the section was mapped to its file
+	struct PagingStats
+	{
+		size_t mappedBytes;
+		size_t residentBytes;
+		long majorFaults;
+		long minorFaults;
+	};
+	PagingStats getPagingStats() const;
 
 	void dumpMemory(Address startAddr = 1u, unsigned size = 0) const;
 };
@@ -0,0 +1,40 @@
+#ifndef DYNPTS_MODULE_CACHE_H
+#define DYNPTS_MODULE_CACHE_H
+
+#include "Prepass.h"
+
+#include <memory>
+#include <string>
+
+namespace llvm
+{
+	class LLVMContext;
+	class Module;
+	class SMDiagnostic;
+}
+
+namespace llvm_interpreter
+{
+
+// ModuleCache - A directory of modules that have already been parsed and run through the prepasses, stored as bitcode under a hash of the source contents and the prepass level.
+// Reading a module back from the cache skips the IR parser and the prepasses. The cache file is memory-mapped and only the globals and declarations are read up front; the body of a function is read from the mapping the first time the interpreter calls it, so a run pays only for the code it executes
+class ModuleCache
+{
+private:
+	std::string dir;
+
+	std::string getCachePath(uint64_t contentHash, PrepassLevel level) const;
+	// Write (module) to (cachePath) atomically. A cache that cannot be written is only a missed speedup, so failures are ignored
+	void store(const llvm::Module& module, const std::string& cachePath) const;
+
+public:
+	// Use (dir) as the cache directory, creating it if needed. Throws std::runtime_error if it cannot be created
+	explicit ModuleCache(const std::string& dir);
+
+	// Return the module in (path) after runPrepasses(level), from the cache if it has been loaded before and from (path) otherwise. The bodies of a cached module are read lazily. Returns nullptr and fills (err) if (path) cannot be read or parsed
+	std::unique_ptr<llvm::Module> loadModule(const std::string& path, PrepassLevel level, llvm::LLVMContext& context, llvm::SMDiagnostic& err) const;
+};
+
+}
+
+#endif
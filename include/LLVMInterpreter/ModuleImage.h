@@ -0,0 +1,69 @@
+#ifndef DYNPTS_MODULE_IMAGE_H
+#define DYNPTS_MODULE_IMAGE_H
+
+#include "Memory.h"
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace llvm
+{
+	class Function;
+	class GlobalValue;
+	class Module;
+}
+
+namespace llvm_interpreter
+{
+
+// ModuleImage - The part of an interpreted module that does not change while it runs: the address of every global and function, the initial contents of global memory, and the executable bodies produced by the inliner.
+// An image can be shared by any number of Interpreters, which are then independent execution contexts of the same module: each one owns its stack, heap and the pages of global memory it writes, and they can run on different host threads at the same time
+class ModuleImage
+{
+private:
+	friend class Interpreter;
+
+	llvm::Module* module;
+
+	// The global environment
+	std::unordered_map<const llvm::GlobalValue*, Address> globalEnv;
+	// Mapping from function pointer to function
+	std::unordered_map<Address, const llvm::Function*> funPtrMap;
+	// Constant globals are packed together into [readOnlyBegin, readOnlyEnd) of global memory. Guest stores into this range are rejected
+	Address readOnlyBegin, readOnlyEnd;
+
+	// Global memory with every initializer written, mapped copy-on-write by the interpreters created from the image. Only set up by load(); an image that is not loaded gets laid out by the one interpreter using it
+	MemorySection initialGlobals;
+	bool loaded;
+
+	// Callees of at most this many instructions are inlined into the bodies that get executed. 0 disables inlining
+	unsigned inlineThreshold;
+	// Private copies of executed functions with their small callees inlined. The interpreted module itself is never modified
+	std::unique_ptr<llvm::Module> inlineModule;
+	// Mapping from function to the body that is actually executed for it: either an inlined copy or the function itself
+	std::unordered_map<const llvm::Function*, const llvm::Function*> executableBodies;
+	// Mapping from callee to the functions whose executable bodies have it inlined
+	std::unordered_map<const llvm::Function*, std::vector<const llvm::Function*>> inlinedInto;
+	// Whether function bodies are still to be read from bitcode on their first call (see ModuleCache)
+	bool lazyBodies;
+	// Guards the inliner state above and the reading of lazy bodies. Creating the copies and reading bodies both modify the LLVMContext of the module, which is not thread-safe
+	std::mutex inlineMutex;
+public:
+	ModuleImage(llvm::Module* m);
+	~ModuleImage();
+
+	ModuleImage(const ModuleImage&) = delete;
+	ModuleImage& operator=(const ModuleImage&) = delete;
+
+	// Lay out and initialize the globals of (m) once, so that interpreters created from the returned image can start running right away. Callees of at most (inlineThreshold) instructions are inlined
+	static std::shared_ptr<ModuleImage> load(llvm::Module* m, unsigned inlineThreshold = 0);
+
+	llvm::Module* getModule() const { return module; }
+	bool isLoaded() const { return loaded; }
+};
+
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef DYNPTS_PREPASS_H
+#define DYNPTS_PREPASS_H
+
+#include <string>
+
+namespace llvm
+{
+	class Module;
+}
+
+namespace llvm_interpreter
+{
+
+// Levels of the pre-execution pass pipeline. Every level includes everything the levels below it do
+enum class PrepassLevel: unsigned
+{
+	// Run nothing
+	NONE = 0,
+	// Only lower the constructs the interpreter cannot execute (invoke)
+	LOWER = 1,
+	// Also promote allocas to registers and do cheap local cleanups (SROA, mem2reg, EarlyCSE, instcombine, simplifycfg)
+	BASIC = 2,
+	// Also run the more expensive scalar optimizations (SCCP, LICM, GVN, ADCE)
+	FULL = 3,
+};
+
+// Rewrite (module) into a form that is cheaper to interpret. Meant to run right after parsing, before an Interpreter is created for the module. optnone attributes (as emitted by clang -O0) are dropped so that unoptimized IR gets the full benefit
+void runPrepasses(llvm::Module& module, PrepassLevel level);
+// A description of everything runPrepasses(level) does, which changes whenever what it produces may change
+std::string getPrepassPipeline(PrepassLevel level);
+
+}
+
+#endif
@@ -18,12 +18,12 @@ private:
 	unsigned allocSize;
 
 	std::unordered_map<const llvm::Value*, DynamicValue> vRegs;
-	std::vector<DynamicValue> varArgs; // Values passed through an ellipsis
+	// Stack address of the values passed through an ellipsis, laid out the way the target passes stack arguments
+	Address varArgArea;
 public:
-	using const_vararg_iterator = decltype(varArgs)::const_iterator;
 	using const_iterator = decltype(vRegs)::const_iterator;
 
-	StackFrame(const llvm::Function* f): curFunction(f), allocSize(0) {}
+	StackFrame(const llvm::Function* f): curFunction(f), allocSize(0), varArgArea(0) {}
 
 	StackFrame(StackFrame&& rhs) = default;
 	StackFrame& operator=(StackFrame&& rhs) = default;
@@ -56,20 +56,12 @@ public:
 		return itr != vRegs.end();
 	}
 
-	void insertVararg(DynamicValue&& val)
-	{
-		varArgs.push_back(std::move(val));
-	}
+	Address getVarArgArea() const { return varArgArea; }
+	void setVarArgArea(Address addr) { varArgArea = addr; }
 
 	const_iterator begin() const { return vRegs.begin(); }
 	const_iterator end() const { return vRegs.end(); }
 
-	const_vararg_iterator vararg_begin() const { return varArgs.begin(); }
-	const_vararg_iterator vararg_end() const { return varArgs.end(); }
-	llvm::iterator_range<const_vararg_iterator> varargs() const
-	{
-		return llvm::iterator_range<const_vararg_iterator>(vararg_begin(), vararg_end());
-	}
 
 	void dumpFrame() const;
 };
@@ -98,6 +90,9 @@ public:
 		frames.pop_back();
 	}
 
+	bool empty() const { return frames.empty(); }
+	size_t size() const { return frames.size(); }
+
 	void dumpContext() const;
 };
 
@@ -0,0 +1,37 @@
+#ifndef DYNPTS_VECTOR_OPS_H
+#define DYNPTS_VECTOR_OPS_H
+
+#include "DynamicValue.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/IR/InstrTypes.h"
+
+namespace llvm
+{
+	class Type;
+}
+
+namespace llvm_interpreter
+{
+
+// Element-wise kernels for vector values. Each kernel runs one tight loop over the unboxed lanes of its operands so that the host compiler can turn it into SIMD code
+
+// Create an all-zero vector value of the given fixed vector type
+DynamicValue createVectorValue(const llvm::Type* vecType);
+
+// Integer and floating point binary operators (Add ... Xor, FAdd ... FRem)
+DynamicValue evaluateVectorBinOp(unsigned opcode, const VectorValue& v0, const VectorValue& v1);
+// FNeg
+DynamicValue evaluateVectorFNeg(const VectorValue& v);
+// ICmp and FCmp. The result is a vector of i1
+DynamicValue evaluateVectorCmp(llvm::CmpInst::Predicate pred, const VectorValue& v0, const VectorValue& v1);
+// Cast instructions where the source and/or the destination is a vector
+DynamicValue evaluateVectorCast(unsigned opcode, const DynamicValue& srcVal, const llvm::Type* srcType, const llvm::Type* dstType);
+// Select with either a scalar i1 or a vector of i1 as condition
+DynamicValue evaluateVectorSelect(const DynamicValue& cond, const DynamicValue& trueVal, const DynamicValue& falseVal);
+// ShuffleVector. Negative mask elements produce zero lanes
+DynamicValue evaluateShuffleVector(const VectorValue& v0, const VectorValue& v1, llvm::ArrayRef<int> mask);
+
+}
+
+#endif
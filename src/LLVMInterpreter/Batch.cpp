@@ -0,0 +1,284 @@
+#include "Batch.h"
+#include "Interpreter.h"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/xxhash.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+using namespace llvm;
+using namespace llvm_interpreter;
+
+// This file contains the batch mode of the driver, which runs the entries of a manifest in one process so that a sweep over many modules and entry points pays for process startup only once
+
+namespace
+{
+
+struct BatchEntry
+{
+	unsigned line;
+	std::string module;
+	std::string function;
+	std::vector<std::string> args;
+	bool hasExpected;
+	std::string expected;
+};
+
+struct BatchResult
+{
+	// "pass", "fail", "error", or "done" for an entry without an expected result
+	const char* status = "error";
+	std::string result;
+	std::string error;
+	bool cached = false;
+	double loadSeconds = 0;
+	double runSeconds = 0;
+};
+
+std::vector<BatchEntry> readManifest(const std::string& path)
+{
+	auto buffer = MemoryBuffer::getFileOrSTDIN(path);
+	if (!buffer)
+		throw std::runtime_error("Cannot read batch manifest " + path + ": " + buffer.getError().message());
+
+	auto entries = std::vector<BatchEntry>();
+	auto lines = SmallVector<StringRef, 0>();
+	(*buffer)->getBuffer().split(lines, '\n');
+	for (auto i = 0u; i < lines.size(); ++i)
+	{
+		auto line = lines[i].trim();
+		if (line.empty() || line.startswith("#"))
+			continue;
+
+		auto fields = SmallVector<StringRef, 8>();
+		SplitString(line, fields);
+		auto entry = BatchEntry { i + 1, "", "", {}, false, "" };
+		auto numArgs = fields.size();
+		if (numArgs >= 2 && fields[numArgs - 2] == "=>")
+		{
+			entry.hasExpected = true;
+			entry.expected = fields[numArgs - 1].str();
+			numArgs -= 2;
+		}
+		if (numArgs < 2)
+			throw std::runtime_error(path + ":" + std::to_string(i + 1) + ": expected <module> <function> [<arg>...] [=> <expected>]");
+		entry.module = fields[0].str();
+		entry.function = fields[1].str();
+		for (auto j = 2u; j < numArgs; ++j)
+			entry.args.push_back(fields[j].str());
+		entries.push_back(std::move(entry));
+	}
+	return entries;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The state of one worker. Modules are kept for the lifetime of the worker, since the images refer to them
+class BatchWorker
+{
+private:
+	struct CachedModule
+	{
+		uint64_t contentHash;
+		std::unique_ptr<Module> module;
+		std::shared_ptr<ModuleImage> image;
+	};
+
+	const BatchOptions& opts;
+	LLVMContext context;
+	std::unordered_map<std::string, CachedModule> modules;
+
+	// Return the module at (path), parsing it again if its contents are not those of the cached one
+	const CachedModule& loadModule(const std::string& path, BatchResult& res)
+	{
+		auto buffer = MemoryBuffer::getFile(path);
+		if (!buffer)
+			throw std::runtime_error("Cannot read " + path + ": " + buffer.getError().message());
+		auto hash = xxHash64((*buffer)->getBuffer());
+
+		auto& cached = modules[path];
+		if (cached.image != nullptr && cached.contentHash == hash)
+		{
+			res.cached = true;
+			return cached;
+		}
+
+		SMDiagnostic err;
+		auto module = parseIR((*buffer)->getMemBufferRef(), err, context);
+		if (!module)
+		{
+			auto msg = std::string();
+			raw_string_ostream os(msg);
+			err.print(path.c_str(), os, false);
+			throw std::runtime_error(os.str());
+		}
+		runPrepasses(*module, opts.prepass);
+		cached.image = ModuleImage::load(module.get(), opts.inlineThreshold);
+		cached.module = std::move(module);
+		cached.contentHash = hash;
+		return cached;
+	}
+
+	static std::vector<DynamicValue> convertArguments(const Function* fn, const std::vector<std::string>& args)
+	{
+		auto funcType = fn->getFunctionType();
+		if (funcType->getNumParams() != args.size())
+			throw std::runtime_error(fn->getName().str() + " takes " + std::to_string(funcType->getNumParams()) + " arguments, not " + std::to_string(args.size()));
+
+		auto values = std::vector<DynamicValue>();
+		for (auto i = 0u; i < args.size(); ++i)
+		{
+			auto paramType = funcType->getParamType(i);
+			if (auto intType = dyn_cast<IntegerType>(paramType))
+			{
+				auto val = int64_t(0);
+				if (StringRef(args[i]).getAsInteger(10, val))
+					throw std::runtime_error("Not an integer: " + args[i]);
+				values.push_back(DynamicValue::getIntValue(APInt(intType->getBitWidth(), val, true)));
+			}
+			else if (paramType->isFloatTy() || paramType->isDoubleTy())
+				values.push_back(DynamicValue::getFloatValue(std::stod(args[i]), paramType->isDoubleTy()));
+			else
+				throw std::runtime_error("Unsupported parameter type for function " + fn->getName().str());
+		}
+		return values;
+	}
+
+	static bool matchesExpected(const DynamicValue& retVal, const std::string& result, const std::string& expected)
+	{
+		if (result == expected)
+			return true;
+		// Floating point results are compared by value, so that "2.5" matches as well as "2.500000e+00"
+		auto expectedVal = 0.0;
+		return retVal.isFloatValue() && !StringRef(expected).getAsDouble(expectedVal) && expectedVal == retVal.getAsFloatValue().getFloat();
+	}
+
+public:
+	BatchWorker(const BatchOptions& o): opts(o) {}
+
+	BatchResult run(const BatchEntry& entry)
+	{
+		auto res = BatchResult();
+		try
+		{
+			auto start = std::chrono::steady_clock::now();
+			auto& cached = loadModule(entry.module, res);
+			res.loadSeconds = secondsSince(start);
+
+			auto fn = cached.module->getFunction(entry.function);
+			if (fn == nullptr || fn->isDeclaration())
+				throw std::runtime_error("Function '" + entry.function + "' not found in module");
+
+			start = std::chrono::steady_clock::now();
+			Interpreter interpreter(cached.image);
+			if (opts.configure)
+				opts.configure(interpreter);
+			interpreter.evaluateGlobals();
+			auto retVal = DynamicValue::getUndefValue();
+			if (entry.function == "main")
+			{
+				auto mainArgs = entry.args;
+				mainArgs.insert(mainArgs.begin(), entry.module);
+				retVal = DynamicValue::getIntValue(APInt(32, interpreter.runMain(fn, mainArgs), true));
+			}
+			else
+				retVal = interpreter.runFunction(fn, convertArguments(fn, entry.args));
+			res.runSeconds = secondsSince(start);
+
+			if (retVal.isUndefValue())
+				res.result = "void";
+			else if (retVal.isIntValue())
+				res.result = std::to_string(retVal.getAsIntValue().getInt().getSExtValue());
+			else if (retVal.isFloatValue())
+			{
+				raw_string_ostream os(res.result);
+				os << retVal.getAsFloatValue().getFloat();
+			}
+			else
+				res.result = retVal.toString();
+
+			if (!entry.hasExpected)
+				res.status = "done";
+			else
+				res.status = matchesExpected(retVal, res.result, entry.expected) ? "pass" : "fail";
+		}
+		catch (const std::exception& e)
+		{
+			res.status = "error";
+			res.error = e.what();
+		}
+		return res;
+	}
+};
+
+}
+
+bool llvm_interpreter::runBatch(const std::string& manifestPath, const std::string& resultsPath, const BatchOptions& opts)
+{
+	auto entries = readManifest(manifestPath);
+
+	std::error_code ec;
+	raw_fd_ostream out(resultsPath, ec, sys::fs::OF_Text);
+	if (ec)
+		throw std::runtime_error("Cannot create " + resultsPath + ": " + ec.message());
+
+	// Workers take the next entry that nobody has taken yet, so a slow entry does not hold up the ones after it
+	auto results = std::vector<BatchResult>(entries.size());
+	auto nextEntry = std::atomic<size_t>(0);
+	auto work = [&] ()
+	{
+		BatchWorker worker(opts);
+		for (auto i = nextEntry++; i < entries.size(); i = nextEntry++)
+			results[i] = worker.run(entries[i]);
+	};
+	auto numJobs = std::max(1u, std::min<unsigned>(opts.numJobs, entries.size()));
+	auto workers = std::vector<std::thread>();
+	for (auto i = 1u; i < numJobs; ++i)
+		workers.emplace_back(work);
+	work();
+	for (auto& t: workers)
+		t.join();
+
+	auto allPassed = true;
+	for (auto i = 0u; i < entries.size(); ++i)
+	{
+		auto& entry = entries[i];
+		auto& res = results[i];
+		auto obj = json::Object {
+			{ "line", entry.line },
+			{ "module", entry.module },
+			{ "function", entry.function },
+			{ "args", json::Array(entry.args) },
+			{ "status", res.status },
+			{ "cached", res.cached },
+			{ "load_seconds", res.loadSeconds },
+			{ "run_seconds", res.runSeconds },
+		};
+		if (entry.hasExpected)
+			obj["expected"] = entry.expected;
+		if (!res.error.empty())
+			obj["error"] = res.error;
+		else
+			obj["result"] = res.result;
+		out << json::Value(std::move(obj)) << "\n";
+		allPassed &= (StringRef(res.status) == "pass" || StringRef(res.status) == "done");
+	}
+	out.flush();
+	if (out.has_error())
+		throw std::runtime_error("Cannot write " + resultsPath + ": " + out.error().message());
+	return allPassed;
+}
@@ -0,0 +1,339 @@
+#include "Interpreter.h"
+
+#include "llvm/IR/Function.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/xxhash.h"
+
+#include <cstring>
+#include <stdexcept>
+
+using namespace llvm;
+using namespace llvm_interpreter;
+
+// This file contains record and replay of external calls. A recorded run logs every call that reaches the host together with what it did to guest memory, and a replayed run applies the same effects from the log instead of making the call, which makes re-executions hermetic and spares them the I/O
+
+namespace
+{
+
+const char LOG_MAGIC[8] = { 'L', 'L', 'I', 'C', 'A', 'L', 'L', '1' };
+// The magic, the number of calls and the offset of the index
+const uint64_t LOG_HEADER_SIZE = sizeof(LOG_MAGIC) + 2 * sizeof(uint64_t);
+
+enum class LoggedValueKind: std::uint8_t
+{
+	OTHER,
+	INT,
+	FLOAT,
+	POINTER,
+};
+
+template <typename T>
+void appendRaw(std::string& out, T val)
+{
+	out.append(reinterpret_cast<const char*>(&val), sizeof(T));
+}
+
+void encodeCallValue(const DynamicValue& val, std::string& out)
+{
+	if (val.isIntValue() && val.getAsIntValue().getInt().getBitWidth() <= 64)
+	{
+		auto& intVal = val.getAsIntValue().getInt();
+		appendRaw(out, LoggedValueKind::INT);
+		appendRaw(out, uint32_t(intVal.getBitWidth()));
+		appendRaw(out, intVal.getZExtValue());
+	}
+	else if (val.isFloatValue())
+	{
+		appendRaw(out, LoggedValueKind::FLOAT);
+		appendRaw(out, uint8_t(val.getAsFloatValue().isDouble()));
+		appendRaw(out, val.getAsFloatValue().getFloat());
+	}
+	else if (val.isPointerValue())
+	{
+		appendRaw(out, LoggedValueKind::POINTER);
+		appendRaw(out, val.getAsPointerValue().getAddressSpace());
+		appendRaw(out, val.getAsPointerValue().getAddress());
+	}
+	else
+		appendRaw(out, LoggedValueKind::OTHER);
+}
+
+// Reads a log with bounds checks, so that a truncated or damaged log is reported instead of read past
+class LogCursor
+{
+private:
+	const char* pos;
+	const char* end;
+
+public:
+	LogCursor(const char* b, const char* e): pos(b), end(e) {}
+
+	const char* skip(uint64_t size)
+	{
+		if (uint64_t(end - pos) < size)
+			throw std::runtime_error("Call log is truncated or damaged");
+		auto ret = pos;
+		pos += size;
+		return ret;
+	}
+
+	template <typename T>
+	T read()
+	{
+		auto val = T();
+		std::memcpy(&val, skip(sizeof(T)), sizeof(T));
+		return val;
+	}
+
+	PointerAddressSpace readAddressSpace()
+	{
+		auto space = read<PointerAddressSpace>();
+		if (space > PointerAddressSpace::HEAP_SPACE)
+			throw std::runtime_error("Call log is truncated or damaged");
+		return space;
+	}
+
+	DynamicValue readValue()
+	{
+		switch (read<LoggedValueKind>())
+		{
+			case LoggedValueKind::OTHER:
+				return DynamicValue::getUndefValue();
+			case LoggedValueKind::INT:
+			{
+				auto bitWidth = read<uint32_t>();
+				if (bitWidth == 0 || bitWidth > 64)
+					break;
+				return DynamicValue::getIntValue(APInt(bitWidth, read<uint64_t>()));
+			}
+			case LoggedValueKind::FLOAT:
+			{
+				auto isDouble = read<uint8_t>() != 0;
+				return DynamicValue::getFloatValue(read<double>(), isDouble);
+			}
+			case LoggedValueKind::POINTER:
+			{
+				auto space = readAddressSpace();
+				return DynamicValue::getPointerValue(space, read<Address>());
+			}
+		}
+		throw std::runtime_error("Call log is truncated or damaged");
+	}
+};
+
+}
+
+uint64_t llvm_interpreter::hashCallName(StringRef name)
+{
+	return xxHash64(name);
+}
+
+void llvm_interpreter::encodeCallValues(const std::vector<DynamicValue>& values, std::string& out)
+{
+	for (auto& val: values)
+		encodeCallValue(val, out);
+}
+
+CallLogWriter::CallLogWriter(const std::string& path): offset(LOG_HEADER_SIZE)
+{
+	auto ec = std::error_code();
+	out = std::make_unique<raw_fd_ostream>(path, ec, sys::fs::OF_None);
+	if (ec)
+		throw std::runtime_error("Cannot create call log " + path + ": " + ec.message());
+	// The header is written again with the real numbers once the log is complete
+	out->write(LOG_MAGIC, sizeof(LOG_MAGIC));
+	auto zero = uint64_t(0);
+	out->write(reinterpret_cast<const char*>(&zero), sizeof(zero));
+	out->write(reinterpret_cast<const char*>(&zero), sizeof(zero));
+}
+
+CallLogWriter::~CallLogWriter()
+{
+	auto numCalls = uint64_t(offsets.size());
+	out->write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+	out->seek(sizeof(LOG_MAGIC));
+	out->write(reinterpret_cast<const char*>(&numCalls), sizeof(numCalls));
+	out->write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+	out->close();
+	if (out->has_error())
+	{
+		errs() << "Cannot write call log: " << out->error().message() << "\n";
+		out->clear_error();
+	}
+}
+
+void CallLogWriter::append(StringRef name, const std::vector<DynamicValue>& args, const std::vector<CallEffect>& effects, const DynamicValue& result)
+{
+	entry.clear();
+	appendRaw(entry, hashCallName(name));
+	auto argsSizePos = entry.size();
+	appendRaw(entry, uint32_t(0));
+	encodeCallValues(args, entry);
+	auto argsSize = uint32_t(entry.size() - argsSizePos - sizeof(uint32_t));
+	std::memcpy(&entry[argsSizePos], &argsSize, sizeof(argsSize));
+
+	appendRaw(entry, uint32_t(effects.size()));
+	for (auto& effect: effects)
+	{
+		appendRaw(entry, effect.kind);
+		switch (effect.kind)
+		{
+			case CallEffect::Kind::ALLOCATE:
+				appendRaw(entry, effect.addr);
+				appendRaw(entry, effect.size);
+				appendRaw(entry, effect.align);
+				break;
+			case CallEffect::Kind::FREE:
+				appendRaw(entry, effect.addr);
+				break;
+			case CallEffect::Kind::WRITE:
+				appendRaw(entry, effect.space);
+				appendRaw(entry, effect.addr);
+				appendRaw(entry, effect.size);
+				entry.append(effect.data, effect.size);
+				break;
+		}
+	}
+	encodeCallValue(result, entry);
+
+	offsets.push_back(offset);
+	out->write(entry.data(), entry.size());
+	offset += entry.size();
+}
+
+CallLogReader::CallLogReader(const std::string& path)
+{
+	auto bufOrError = MemoryBuffer::getFile(path, false, false);
+	if (!bufOrError)
+		throw std::runtime_error("Cannot read call log " + path + ": " + bufOrError.getError().message());
+	buffer = std::move(*bufOrError);
+
+	auto cursor = LogCursor(buffer->getBufferStart(), buffer->getBufferEnd());
+	if (buffer->getBufferSize() < LOG_HEADER_SIZE || std::memcmp(cursor.skip(sizeof(LOG_MAGIC)), LOG_MAGIC, sizeof(LOG_MAGIC)) != 0)
+		throw std::runtime_error(path + " is not a call log");
+	numCalls = cursor.read<uint64_t>();
+	indexOffset = cursor.read<uint64_t>();
+	if (indexOffset < LOG_HEADER_SIZE || indexOffset > buffer->getBufferSize() || (buffer->getBufferSize() - indexOffset) / sizeof(uint64_t) < numCalls)
+		throw std::runtime_error("Call log " + path + " is incomplete");
+}
+
+CallRecord CallLogReader::readCall(uint64_t idx) const
+{
+	assert(idx < numCalls);
+	auto entryOffset = uint64_t(0);
+	std::memcpy(&entryOffset, buffer->getBufferStart() + indexOffset + idx * sizeof(uint64_t), sizeof(entryOffset));
+	if (entryOffset < LOG_HEADER_SIZE || entryOffset > indexOffset)
+		throw std::runtime_error("Call log is truncated or damaged");
+
+	// Entries end where the index begins at the latest
+	auto cursor = LogCursor(buffer->getBufferStart() + entryOffset, buffer->getBufferStart() + indexOffset);
+	auto record = CallRecord();
+	record.nameHash = cursor.read<uint64_t>();
+	auto argsSize = cursor.read<uint32_t>();
+	record.args = StringRef(cursor.skip(argsSize), argsSize);
+
+	auto numEffects = cursor.read<uint32_t>();
+	for (auto i = 0u; i < numEffects; ++i)
+	{
+		auto effect = CallEffect { cursor.read<CallEffect::Kind>(), PointerAddressSpace::HEAP_SPACE, 0, 0, 0, nullptr };
+		switch (effect.kind)
+		{
+			case CallEffect::Kind::ALLOCATE:
+				effect.addr = cursor.read<Address>();
+				effect.size = cursor.read<uint64_t>();
+				effect.align = cursor.read<uint64_t>();
+				break;
+			case CallEffect::Kind::FREE:
+				effect.addr = cursor.read<Address>();
+				break;
+			case CallEffect::Kind::WRITE:
+				effect.space = cursor.readAddressSpace();
+				effect.addr = cursor.read<Address>();
+				effect.size = cursor.read<uint64_t>();
+				effect.data = cursor.skip(effect.size);
+				break;
+			default:
+				throw std::runtime_error("Call log is truncated or damaged");
+		}
+		record.effects.push_back(effect);
+	}
+	record.result = cursor.readValue();
+	return record;
+}
+
+void Interpreter::recordExternalCalls(const std::string& path)
+{
+	callReplayer.reset();
+	callRecorder = std::make_unique<CallLogWriter>(path);
+}
+
+void Interpreter::replayExternalCalls(const std::string& path)
+{
+	callRecorder.reset();
+	callReplayer = std::make_unique<CallLogReader>(path);
+	nextReplayedCall = 0;
+}
+
+DynamicValue Interpreter::logExternalCall(const CallBase* cs, const Function* f, std::vector<DynamicValue>&& argValues)
+{
+	auto logLock = std::lock_guard<std::mutex>(callLogMutex);
+	if (callReplayer != nullptr)
+		return replayExternalCall(f, argValues);
+
+	// The call itself runs with the effects collected on this thread, which also keeps it from being logged a second time
+	auto effects = std::vector<CallEffect>();
+	currentThread->callEffects = &effects;
+	auto result = DynamicValue::getUndefValue();
+	try
+	{
+		result = callExternalFunction(cs, f, std::vector<DynamicValue>(argValues));
+	}
+	catch (...)
+	{
+		currentThread->callEffects = nullptr;
+		throw;
+	}
+	currentThread->callEffects = nullptr;
+
+	// Writes are logged with what guest memory holds after the call
+	for (auto& effect: effects)
+		if (effect.kind == CallEffect::Kind::WRITE)
+			effect.data = static_cast<const char*>(getRawPointer(DynamicValue::getPointerValue(effect.space, effect.addr).getAsPointerValue()));
+	callRecorder->append(f->getName(), argValues, effects, result);
+	return result;
+}
+
+DynamicValue Interpreter::replayExternalCall(const Function* f, const std::vector<DynamicValue>& argValues)
+{
+	if (nextReplayedCall == callReplayer->getNumCalls())
+		throw std::runtime_error("Replay made more external calls than the log holds, the first extra one to " + f->getName().str());
+	auto record = callReplayer->readCall(nextReplayedCall);
+	auto args = std::string();
+	encodeCallValues(argValues, args);
+	if (record.nameHash != hashCallName(f->getName()) || record.args != args)
+		throw std::runtime_error("Replay diverged from the call log at call " + std::to_string(nextReplayedCall) + " to " + f->getName().str());
+	++nextReplayedCall;
+
+	auto lock = std::lock_guard<std::mutex>(hostMutex);
+	for (auto& effect: record.effects)
+	{
+		switch (effect.kind)
+		{
+			case CallEffect::Kind::ALLOCATE:
+				if (heapMem.allocate(effect.size, effect.align) != effect.addr)
+					throw std::runtime_error("Replay diverged from the call log: a heap block of " + f->getName().str() + " is not where it was recorded");
+				break;
+			case CallEffect::Kind::FREE:
+				heapMem.free(effect.addr);
+				break;
+			case CallEffect::Kind::WRITE:
+			{
+				auto ptr = DynamicValue::getPointerValue(effect.space, effect.addr);
+				getCheckedPointer(ptr.getAsPointerValue(), effect.size);
+				std::memcpy(getWritablePointer(ptr.getAsPointerValue(), effect.size), effect.data, effect.size);
+				break;
+			}
+		}
+	}
+	return record.result;
+}
@@ -0,0 +1,83 @@
+#include "Interpreter.h"
+
+#include "llvm/IR/Function.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+using namespace llvm;
+using namespace llvm_interpreter;
+
+// This file contains native library routines that call back into the guest. A callback is an ordinary recursive call of the interpreter made from inside the external call, so only the routine itself runs natively and the guest pays for nothing but the callbacks
+
+DynamicValue Interpreter::callGuestFunction(const PointerValue& fnPtr, std::vector<DynamicValue>&& args)
+{
+	auto itr = image->funPtrMap.find(fnPtr.getAddress());
+	if (fnPtr.getAddressSpace() != PointerAddressSpace::GLOBAL_SPACE || itr == image->funPtrMap.end())
+		throw std::runtime_error("Callback does not point to a function");
+
+	auto f = itr->second;
+	if (f->isIntrinsic())
+		throw std::runtime_error("Callback points to intrinsic " + f->getName().str());
+	if (f->isDeclaration())
+		return callExternalFunction(nullptr, f, std::move(args));
+	return callFunction(f, std::move(args));
+}
+
+void Interpreter::sortGuestArray(const PointerValue& base, uint64_t count, uint64_t size, const PointerValue& cmp)
+{
+	if (size != 0 && count > UINT64_MAX / size)
+		throw std::out_of_range("qsort() array size overflows");
+	auto totalSize = count * size;
+	getCheckedPointer(base, totalSize);
+	if (count < 2 || size == 0)
+		return;
+
+	// Indices are sorted instead of the elements, so the comparator always sees the elements where they were. Guest code it runs may allocate and move sections around, so no host pointer is held across a callback. Merge sort stays within bounds even if the comparator is inconsistent
+	auto elementPtr = [&base, size] (uint64_t i)
+	{
+		return DynamicValue::getPointerValue(base.getAddressSpace(), base.getAddress() + i * size);
+	};
+	auto order = std::vector<uint64_t>(count);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [this, &cmp, &elementPtr] (uint64_t lhs, uint64_t rhs)
+	{
+		auto args = std::vector<DynamicValue>();
+		args.push_back(elementPtr(lhs));
+		args.push_back(elementPtr(rhs));
+		return callGuestFunction(cmp, std::move(args)).getAsIntValue().getInt().isNegative();
+	});
+
+	auto sorted = std::vector<char>(totalSize);
+	auto elements = getCheckedPointer(base, totalSize);
+	for (auto i = uint64_t(0); i < count; ++i)
+		std::memcpy(sorted.data() + i * size, elements + order[i] * size, size);
+	std::memcpy(getWritablePointer(base, totalSize), sorted.data(), totalSize);
+}
+
+DynamicValue Interpreter::searchGuestArray(const PointerValue& key, const PointerValue& base, uint64_t count, uint64_t size, const PointerValue& cmp)
+{
+	if (size != 0 && count > UINT64_MAX / size)
+		throw std::out_of_range("bsearch() array size overflows");
+	getCheckedPointer(base, count * size);
+
+	auto lo = uint64_t(0), hi = count;
+	while (lo < hi)
+	{
+		auto mid = lo + (hi - lo) / 2;
+		auto midPtr = DynamicValue::getPointerValue(base.getAddressSpace(), base.getAddress() + mid * size);
+		auto args = std::vector<DynamicValue>();
+		args.push_back(DynamicValue::getPointerValue(key.getAddressSpace(), key.getAddress()));
+		args.push_back(midPtr);
+		auto result = callGuestFunction(cmp, std::move(args));
+		auto& order = result.getAsIntValue().getInt();
+		if (order.isNegative())
+			hi = mid;
+		else if (!order.isNullValue())
+			lo = mid + 1;
+		else
+			return midPtr;
+	}
+	return DynamicValue::getPointerValue(PointerAddressSpace::GLOBAL_SPACE, 0);
+}
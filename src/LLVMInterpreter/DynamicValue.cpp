@@ -1,8 +1,11 @@
 #include "DynamicValue.h"
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/ErrorHandling.h"
 
+#include <cstring>
 #include <iterator>
 
 using namespace llvm;
@@ -45,6 +48,96 @@ unsigned StructValue::getOffsetAtNum(unsigned num) const
 	return std::next(structMap.begin(), num)->first;
 }
 
+VectorValue::VectorValue(VectorLaneType t, unsigned bits, unsigned n): laneType(t), laneBits(bits), numLanes(n)
+{
+	assert(laneBits <= 64 && "No support for >64-bit vector lanes");
+	storage.assign((getRawSize() + sizeof(uint64_t) - 1) / sizeof(uint64_t), 0);
+}
+
+unsigned VectorValue::getLaneBytes() const
+{
+	if (laneBits <= 8)
+		return 1;
+	else if (laneBits <= 16)
+		return 2;
+	else if (laneBits <= 32)
+		return 4;
+	else
+		return 8;
+}
+
+uint64_t VectorValue::getIntLane(unsigned idx) const
+{
+	assert(idx < numLanes);
+	uint64_t val = 0;
+	std::memcpy(&val, reinterpret_cast<const uint8_t*>(storage.data()) + idx * getLaneBytes(), getLaneBytes());
+	return val;
+}
+
+void VectorValue::setIntLane(unsigned idx, uint64_t val)
+{
+	assert(idx < numLanes);
+	if (laneBits < 64)
+		val &= (uint64_t(1) << laneBits) - 1;
+	std::memcpy(reinterpret_cast<uint8_t*>(storage.data()) + idx * getLaneBytes(), &val, getLaneBytes());
+}
+
+double VectorValue::getFloatLane(unsigned idx) const
+{
+	assert(idx < numLanes);
+	if (laneType == VectorLaneType::FLOAT)
+		return getLanes<float>()[idx];
+	else
+		return getLanes<double>()[idx];
+}
+
+void VectorValue::setFloatLane(unsigned idx, double val)
+{
+	assert(idx < numLanes);
+	if (laneType == VectorLaneType::FLOAT)
+		getLanes<float>()[idx] = val;
+	else
+		getLanes<double>()[idx] = val;
+}
+
+void VectorValue::packLanes(void* dst) const
+{
+	assert(laneType == VectorLaneType::INT);
+	auto bits = APInt(numLanes * laneBits, 0);
+	for (auto i = 0u; i < numLanes; ++i)
+		bits.insertBits(getIntLane(i), i * laneBits, laneBits);
+	std::memcpy(dst, bits.getRawData(), getPackedSize());
+}
+
+void VectorValue::unpackLanes(const void* src)
+{
+	assert(laneType == VectorLaneType::INT);
+	auto words = SmallVector<uint64_t, 4>((size_t(numLanes) * laneBits + 63) / 64, 0);
+	std::memcpy(words.data(), src, getPackedSize());
+	auto bits = APInt(numLanes * laneBits, ArrayRef<uint64_t>(words));
+	for (auto i = 0u; i < numLanes; ++i)
+		setIntLane(i, bits.extractBitsAsZExtValue(laneBits, i * laneBits));
+}
+
+DynamicValue VectorValue::getLane(unsigned idx) const
+{
+	if (laneType == VectorLaneType::INT)
+		return DynamicValue::getIntValue(llvm::APInt(laneBits, getIntLane(idx)));
+	else
+		return DynamicValue::getFloatValue(getFloatLane(idx), laneType == VectorLaneType::DOUBLE);
+}
+
+void VectorValue::setLane(unsigned idx, const DynamicValue& val)
+{
+	// Undef lanes are left as they are
+	if (val.isIntValue())
+		setIntLane(idx, val.getAsIntValue().getInt().getZExtValue());
+	else if (val.isFloatValue())
+		setFloatLane(idx, val.getAsFloatValue().getFloat());
+	else if (!val.isUndefValue())
+		llvm_unreachable("Only int and float vector lanes are supported");
+}
+
 DynamicValue::DynamicValue(): type(DynamicValueType::UNDEF_VALUE) {}
 DynamicValue::DynamicValue(IntValue&& intVal): type(DynamicValueType::INT_VALUE)
 {
@@ -66,6 +159,10 @@ DynamicValue::DynamicValue(StructValue&& structVal): type(DynamicValueType::STRU
 {
 	new (&data.structVal) StructValue(std::move(structVal));
 }
+DynamicValue::DynamicValue(VectorValue&& vectorVal): type(DynamicValueType::VECTOR_VALUE)
+{
+	new (&data.vectorVal) VectorValue(std::move(vectorVal));
+}
 DynamicValue::~DynamicValue() { clear(); }
 
 void DynamicValue::clear()
@@ -87,6 +184,9 @@ void DynamicValue::clear()
 		case DynamicValueType::STRUCT_VALUE:
 			data.structVal.~StructValue();
 			break;
+		case DynamicValueType::VECTOR_VALUE:
+			data.vectorVal.~VectorValue();
+			break;
 		case DynamicValueType::UNDEF_VALUE:
 			break;
 	}
@@ -112,6 +212,9 @@ void DynamicValue::copyFrom(const DynamicValue& other)
 		case DynamicValueType::STRUCT_VALUE:
 			new (&data.structVal) StructValue(other.data.structVal);
 			break;
+		case DynamicValueType::VECTOR_VALUE:
+			new (&data.vectorVal) VectorValue(other.data.vectorVal);
+			break;
 		case DynamicValueType::UNDEF_VALUE:
 			break;
 	}
@@ -137,6 +240,9 @@ void DynamicValue::moveFrom(DynamicValue&& other)
 		case DynamicValueType::STRUCT_VALUE:
 			new (&data.structVal) StructValue(std::move(other.data.structVal));
 			break;
+		case DynamicValueType::VECTOR_VALUE:
+			new (&data.vectorVal) VectorValue(std::move(other.data.vectorVal));
+			break;
 		case DynamicValueType::UNDEF_VALUE:
 			break;
 	}
@@ -148,9 +254,12 @@ DynamicValue::DynamicValue(const DynamicValue& other)
 }
 DynamicValue& DynamicValue::operator=(const DynamicValue& other)
 {
-	if (type != other.type)
+	// The old value has to be destroyed even if the types match, otherwise types that own heap memory (arrays, structs, vectors, wide ints) leak it
+	if (this != &other)
+	{
 		clear();
-	copyFrom(other);
+		copyFrom(other);
+	}
 	return *this;
 }
 
@@ -160,9 +269,11 @@ DynamicValue::DynamicValue(DynamicValue&& other)
 }
 DynamicValue& DynamicValue::operator=(DynamicValue&& other)
 {
-	if (type != other.type)
+	if (this != &other)
+	{
 		clear();
-	moveFrom(std::move(other));
+		moveFrom(std::move(other));
+	}
 	return *this;
 }
 
@@ -208,6 +319,18 @@ const StructValue& DynamicValue::getAsStructValue() const
 	return data.structVal;
 }
 
+VectorValue& DynamicValue::getAsVectorValue()
+{
+	assert(type == DynamicValueType::VECTOR_VALUE);
+	return data.vectorVal;
+}
+
+const VectorValue& DynamicValue::getAsVectorValue() const
+{
+	assert(type == DynamicValueType::VECTOR_VALUE);
+	return data.vectorVal;
+}
+
 DynamicValue DynamicValue::getUndefValue()
 {
 	return DynamicValue();
@@ -237,3 +360,8 @@ DynamicValue DynamicValue::getStructValue(unsigned sz)
 {
 	return DynamicValue(StructValue(sz));
 }
+
+DynamicValue DynamicValue::getVectorValue(VectorLaneType t, unsigned laneBits, unsigned numLanes)
+{
+	return DynamicValue(VectorValue(t, laneBits, numLanes));
+}
\ No newline at end of file
@@ -1,8 +1,12 @@
 #include "Interpreter.h"
+#include "VectorOps.h"
 
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/GlobalAlias.h"
+#include "llvm/IR/GetElementPtrTypeIterator.h"
+#include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Operator.h"
 #include "llvm/IR/PatternMatch.h"
 #include "llvm/Support/raw_ostream.h"
@@ -31,8 +35,116 @@ static Value* findBasePointer(const Value* val)
 			return srcValue->stripPointerCasts();
 		}
 	}
-	
-	llvm_unreachable("Unhandled case for findBasePointer()");
+
+	// A plain integer, e.g. a value smuggled through a void* thread argument or return value
+	return nullptr;
+}
+
+// Round the integer straight to the destination type, so that a float result is rounded once and not through double
+static DynamicValue convertIntToFP(const APInt& intVal, bool isSigned, const Type* dstType)
+{
+	auto isDouble = dstType->isDoubleTy();
+	auto fpVal = APFloat(isDouble ? APFloat::IEEEdouble() : APFloat::IEEEsingle());
+	fpVal.convertFromAPInt(intVal, isSigned, APFloat::rmNearestTiesToEven);
+	return DynamicValue::getFloatValue(isDouble ? fpVal.convertToDouble() : fpVal.convertToFloat(), isDouble);
+}
+
+static bool evaluateICmpPredicate(CmpInst::Predicate pred, const APInt& i0, const APInt& i1)
+{
+	switch (pred)
+	{
+		case CmpInst::ICMP_EQ:
+			return i0 == i1;
+		case CmpInst::ICMP_NE:
+			return i0 != i1;
+		case CmpInst::ICMP_UGT:
+			return i0.ugt(i1);
+		case CmpInst::ICMP_UGE:
+			return i0.uge(i1);
+		case CmpInst::ICMP_ULT:
+			return i0.ult(i1);
+		case CmpInst::ICMP_ULE:
+			return i0.ule(i1);
+		case CmpInst::ICMP_SGT:
+			return i0.sgt(i1);
+		case CmpInst::ICMP_SGE:
+			return i0.sge(i1);
+		case CmpInst::ICMP_SLT:
+			return i0.slt(i1);
+		case CmpInst::ICMP_SLE:
+			return i0.sle(i1);
+		default:
+			llvm_unreachable("Illegal icmp predicate");
+	}
+}
+
+static bool evaluateFCmpPredicate(CmpInst::Predicate pred, double f0, double f1)
+{
+	auto isF0Nan = std::isnan(f0);
+	auto isF1Nan = std::isnan(f1);
+	auto bothNotNan = !isF0Nan && !isF1Nan;
+	auto eitherIsNan = isF0Nan || isF1Nan;
+
+	switch (pred)
+	{
+		case CmpInst::FCMP_FALSE:
+			return false;
+		case CmpInst::FCMP_OEQ:
+			return bothNotNan && f0 == f1;
+		case CmpInst::FCMP_OGT:
+			return bothNotNan && f0 > f1;
+		case CmpInst::FCMP_OGE:
+			return bothNotNan && f0 >= f1;
+		case CmpInst::FCMP_OLT:
+			return bothNotNan && f0 < f1;
+		case CmpInst::FCMP_OLE:
+			return bothNotNan && f0 <= f1;
+		case CmpInst::FCMP_ONE:
+			return bothNotNan && f0 != f1;
+		case CmpInst::FCMP_ORD:
+			return bothNotNan;
+		case CmpInst::FCMP_UEQ:
+			return eitherIsNan || f0 == f1;
+		case CmpInst::FCMP_UGT:
+			return eitherIsNan || f0 > f1;
+		case CmpInst::FCMP_UGE:
+			return eitherIsNan || f0 >= f1;
+		case CmpInst::FCMP_ULT:
+			return eitherIsNan || f0 < f1;
+		case CmpInst::FCMP_ULE:
+			return eitherIsNan || f0 <= f1;
+		case CmpInst::FCMP_UNE:
+			return eitherIsNan || f0 != f1;
+		case CmpInst::FCMP_UNO:
+			return eitherIsNan;
+		case CmpInst::FCMP_TRUE:
+			return true;
+		default:
+			llvm_unreachable("Illegal fcmp predicate");
+	}
+}
+
+bool Interpreter::evaluateScalarICmp(CmpInst::Predicate pred, const DynamicValue& val0, const DynamicValue& val1) const
+{
+	// ICmp can compare both integers and pointers
+	if (val0.isIntValue() && val1.isIntValue())
+		return evaluateICmpPredicate(pred, val0.getAsIntValue().getInt(), val1.getAsIntValue().getInt());
+	else if (val0.isPointerValue() && val1.isPointerValue())
+	{
+		auto ptrSize = getDataLayout().getPointerSizeInBits();
+		auto addr0 = val0.getAsPointerValue().getAddress();
+		auto addr1 = val1.getAsPointerValue().getAddress();
+		return evaluateICmpPredicate(pred, APInt(ptrSize, addr0), APInt(ptrSize, addr1));
+	}
+	else
+		llvm_unreachable("Illegal icmp compare types");
+}
+
+DynamicValue Interpreter::evaluateICmp(CmpInst::Predicate pred, const DynamicValue& val0, const DynamicValue& val1) const
+{
+	if (val0.isVectorValue() && val1.isVectorValue())
+		return evaluateVectorCmp(pred, val0.getAsVectorValue(), val1.getAsVectorValue());
+	return DynamicValue::getIntValue(APInt(1, evaluateScalarICmp(pred, val0, val1)));
 }
 
 DynamicValue Interpreter::loadValue(MemorySection& mem, Address addr, Type* loadType)
@@ -45,9 +157,9 @@ DynamicValue Interpreter::loadValue(MemorySection& mem, Address addr, Type* load
 		return mem.readAsFloat(addr, loadType->isDoubleTy());
 	else if (auto stType = dyn_cast<StructType>(loadType))
 	{
-		auto stLayout = dataLayout.getStructLayout(stType);
+		auto stLayout = getDataLayout().getStructLayout(stType);
 
-		auto retVal = DynamicValue::getStructValue(dataLayout.getTypeAllocSize(stType));
+		auto retVal = DynamicValue::getStructValue(getDataLayout().getTypeAllocSize(stType));
 		auto& structVal = retVal.getAsStructValue();
 		for (auto i = 0u, e = stType->getNumElements(); i < e; ++i)
 		{
@@ -60,7 +172,7 @@ DynamicValue Interpreter::loadValue(MemorySection& mem, Address addr, Type* load
 	else if (auto arrayType = dyn_cast<ArrayType>(loadType))
 	{
 		auto elemType = arrayType->getElementType();
-		auto elemSize = dataLayout.getTypeAllocSize(elemType);
+		auto elemSize = getDataLayout().getTypeAllocSize(elemType);
 		auto arraySize = arrayType->getNumElements();
 
 		auto retVal = DynamicValue::getArrayValue(arraySize, elemSize);
@@ -72,6 +184,20 @@ DynamicValue Interpreter::loadValue(MemorySection& mem, Address addr, Type* load
 		}
 		return retVal;
 	}
+	else if (loadType->isVectorTy())
+	{
+		auto retVal = createVectorValue(loadType);
+		auto& vecVal = retVal.getAsVectorValue();
+		if (vecVal.getLaneBits() != vecVal.getLaneBytes() * 8)
+		{
+			auto packed = SmallVector<uint8_t, 16>(vecVal.getPackedSize());
+			mem.readRaw(addr, packed.data(), packed.size());
+			vecVal.unpackLanes(packed.data());
+			return retVal;
+		}
+		mem.readRaw(addr, vecVal.getRawData(), vecVal.getRawSize());
+		return retVal;
+	}
 	else
 		llvm_unreachable("Load type not supported");
 };
@@ -83,20 +209,42 @@ DynamicValue Interpreter::readFromPointer(const PointerValue& ptr, Type* loadTyp
 		case PointerAddressSpace::GLOBAL_SPACE:
 			return loadValue(globalMem, ptr.getAddress(), loadType);
 		case PointerAddressSpace::STACK_SPACE:
-			return loadValue(stackMem, ptr.getAddress(), loadType);
+			return loadValue(getStackSection(ptr.getAddress()), getStackOffset(ptr.getAddress()), loadType);
 		case PointerAddressSpace::HEAP_SPACE:
 			return loadValue(heapMem, ptr.getAddress(), loadType);
 	}
 }
 
+DynamicValue Interpreter::foldConstantLoad(const LoadInst* loadInst)
+{
+	auto ptrOp = loadInst->getPointerOperand();
+	auto loadType = loadInst->getType();
+	auto isScalarLoad = loadType->isIntegerTy() || loadType->isPointerTy() || loadType->isFloatTy() || loadType->isDoubleTy();
+	if (!isa<Constant>(ptrOp) || !isScalarLoad || loadInst->isVolatile())
+		return DynamicValue::getUndefValue();
+
+	auto offset = APInt(getDataLayout().getIndexTypeSizeInBits(ptrOp->getType()), 0);
+	auto baseGlobal = dyn_cast<GlobalVariable>(ptrOp->stripAndAccumulateConstantOffsets(getDataLayout(), offset, true));
+	if (baseGlobal == nullptr || !isReadOnlyGlobal(baseGlobal))
+		return DynamicValue::getUndefValue();
+
+	auto ptrVal = evaluateConstant(cast<Constant>(ptrOp));
+	auto& loadPtr = ptrVal.getAsPointerValue();
+	if (loadPtr.getAddressSpace() != PointerAddressSpace::GLOBAL_SPACE || !isReadOnlyGlobalRange(loadPtr.getAddress(), getDataLayout().getTypeStoreSize(loadType)))
+		return DynamicValue::getUndefValue();
+	return loadValue(globalMem, loadPtr.getAddress(), loadType);
+}
+
 void Interpreter::writeToPointer(const PointerValue& ptr, const DynamicValue& val)
 {
 	switch (ptr.getAddressSpace())
 	{
 		case PointerAddressSpace::GLOBAL_SPACE:
+			if (isReadOnlyGlobalRange(ptr.getAddress(), 1))
+				throw std::runtime_error("writeToPointer() writes to read-only global memory");
 			return globalMem.write(ptr.getAddress(), val);
 		case PointerAddressSpace::STACK_SPACE:
-			return stackMem.write(ptr.getAddress(), val);
+			return getStackSection(ptr.getAddress()).write(getStackOffset(ptr.getAddress()), val);
 		case PointerAddressSpace::HEAP_SPACE:
 			return heapMem.write(ptr.getAddress(), val);
 	}
@@ -107,14 +255,15 @@ DynamicValue Interpreter::evaluateConstant(const llvm::Constant* cv)
 	switch (cv->getValueID())
 	{
 		case Value::UndefValueVal:
+		case Value::PoisonValueVal:
 		{
 			auto type = cv->getType();
 			if (type->isStructTy())
 			{
 				auto stType = cast<StructType>(type);
-				auto stLayout = dataLayout.getStructLayout(stType);
+				auto stLayout = getDataLayout().getStructLayout(stType);
 
-				auto retVal = DynamicValue::getStructValue(dataLayout.getTypeAllocSize(stType));
+				auto retVal = DynamicValue::getStructValue(getDataLayout().getTypeAllocSize(stType));
 				auto& structVal = retVal.getAsStructValue();
 				for (auto i = 0u, e = stType->getNumElements(); i < e; ++i)
 				{
@@ -133,7 +282,7 @@ DynamicValue Interpreter::evaluateConstant(const llvm::Constant* cv)
 				auto elemType = arrayType->getElementType();
 				auto arraySize = arrayType->getNumElements();
 
-				auto retVal = DynamicValue::getArrayValue(arraySize, dataLayout.getTypeAllocSize(elemType));
+				auto retVal = DynamicValue::getArrayValue(arraySize, getDataLayout().getTypeAllocSize(elemType));
 				auto& arrayVal = retVal.getAsArrayValue();
 				for (unsigned i = 0; i < arraySize; ++i)
 				{
@@ -143,7 +292,7 @@ DynamicValue Interpreter::evaluateConstant(const llvm::Constant* cv)
 				return std::move(retVal);
 			}
 			else if (type->isVectorTy())
-				llvm_unreachable("Vector type not supported");
+				return createVectorValue(type);
 			else
 				return DynamicValue::getUndefValue();
 		}
@@ -154,8 +303,8 @@ DynamicValue Interpreter::evaluateConstant(const llvm::Constant* cv)
 		}
 		case Value::GlobalVariableVal:
 		{
-			auto glbVar = cast<GlobalValue>(cv);
-			auto globalAddr = globalEnv.at(glbVar);
+			auto glbVar = cast<GlobalVariable>(cv);
+			auto globalAddr = getGlobalAddress(glbVar);
 			return DynamicValue::getPointerValue(PointerAddressSpace::GLOBAL_SPACE, globalAddr);
 		}
 		case Value::ConstantAggregateZeroVal:
@@ -165,9 +314,9 @@ DynamicValue Interpreter::evaluateConstant(const llvm::Constant* cv)
 			if (type->isStructTy())
 			{
 				auto stType = cast<StructType>(type);
-				auto stLayout = dataLayout.getStructLayout(stType);
+				auto stLayout = getDataLayout().getStructLayout(stType);
 
-				auto retVal = DynamicValue::getStructValue(dataLayout.getTypeAllocSize(stType));
+				auto retVal = DynamicValue::getStructValue(getDataLayout().getTypeAllocSize(stType));
 				auto& structVal = retVal.getAsStructValue();
 				for (auto i = 0u, e = stType->getNumElements(); i < e; ++i)
 				{
@@ -182,7 +331,7 @@ DynamicValue Interpreter::evaluateConstant(const llvm::Constant* cv)
 				auto elemType = arrayType->getElementType();
 				auto arraySize = arrayType->getNumElements();
 
-				auto retVal = DynamicValue::getArrayValue(arraySize, dataLayout.getTypeAllocSize(elemType));
+				auto retVal = DynamicValue::getArrayValue(arraySize, getDataLayout().getTypeAllocSize(elemType));
 				auto& arrayVal = retVal.getAsArrayValue();
 				for (unsigned i = 0; i < arraySize; ++i)
 				{
@@ -190,20 +339,41 @@ DynamicValue Interpreter::evaluateConstant(const llvm::Constant* cv)
 				}
 				return std::move(retVal);
 			}
+			else if (type->isVectorTy())
+				return createVectorValue(type);
 			else
-				llvm_unreachable("ConstantAggregateZero not an array or a struct?");
+				llvm_unreachable("ConstantAggregateZero not an array, a struct or a vector?");
 		}
 		case Value::ConstantDataArrayVal:
 		{
 			auto cda = cast<ConstantDataArray>(cv);
 			auto arraySize = cda->getNumElements();
 
-			auto retVal = DynamicValue::getArrayValue(arraySize, dataLayout.getTypeAllocSize(cda->getType()->getElementType()));
+			auto retVal = DynamicValue::getArrayValue(arraySize, getDataLayout().getTypeAllocSize(cda->getType()->getElementType()));
 			auto& arrayVal = retVal.getAsArrayValue();
 			for (unsigned i = 0; i < arraySize; ++i)
 				arrayVal.setElementAtIndex(i, evaluateConstant(cda->getElementAsConstant(i)));
 			return retVal;
 		}
+		case Value::ConstantDataVectorVal:
+		{
+			auto cdv = cast<ConstantDataVector>(cv);
+			auto retVal = createVectorValue(cdv->getType());
+			auto& vecVal = retVal.getAsVectorValue();
+			auto rawData = cdv->getRawDataValues();
+			assert(rawData.size() == vecVal.getRawSize());
+			std::memcpy(vecVal.getRawData(), rawData.data(), rawData.size());
+			return retVal;
+		}
+		case Value::ConstantVectorVal:
+		{
+			auto cVector = cast<ConstantVector>(cv);
+			auto retVal = createVectorValue(cVector->getType());
+			auto& vecVal = retVal.getAsVectorValue();
+			for (auto i = 0u, e = cVector->getNumOperands(); i < e; ++i)
+				vecVal.setLane(i, evaluateConstant(cVector->getOperand(i)));
+			return retVal;
+		}
 		case Value::ConstantIntVal:
 		{
 			auto cInt = cast<ConstantInt>(cv);
@@ -219,7 +389,7 @@ DynamicValue Interpreter::evaluateConstant(const llvm::Constant* cv)
 			auto cArray = cast<ConstantArray>(cv);
 			auto arraySize = cArray->getType()->getNumElements();
 
-			auto retVal = DynamicValue::getArrayValue(arraySize, dataLayout.getTypeAllocSize(cArray->getType()->getElementType()));
+			auto retVal = DynamicValue::getArrayValue(arraySize, getDataLayout().getTypeAllocSize(cArray->getType()->getElementType()));
 			auto& arrayVal = retVal.getAsArrayValue();
 			for (unsigned i = 0; i < arraySize; ++i)
 				arrayVal.setElementAtIndex(i, evaluateConstant(cArray->getOperand(i)));
@@ -229,9 +399,9 @@ DynamicValue Interpreter::evaluateConstant(const llvm::Constant* cv)
 		{
 			auto cStruct = cast<ConstantStruct>(cv);
 			auto stSize = cStruct->getType()->getNumElements();
-			auto stLayout = dataLayout.getStructLayout(cStruct->getType());
+			auto stLayout = getDataLayout().getStructLayout(cStruct->getType());
 
-			auto retVal = DynamicValue::getStructValue(dataLayout.getTypeAllocSize(cStruct->getType()));
+			auto retVal = DynamicValue::getStructValue(getDataLayout().getTypeAllocSize(cStruct->getType()));
 			auto& structVal = retVal.getAsStructValue();
 			for (unsigned i = 0; i < stSize; ++i)
 			{
@@ -250,7 +420,7 @@ DynamicValue Interpreter::evaluateConstant(const llvm::Constant* cv)
 		case Value::FunctionVal:
 		{
 			auto fun = cast<Function>(cv);
-			auto funAddr = globalEnv.at(fun);
+			auto funAddr = getFunctionAddress(fun);
 			return DynamicValue::getPointerValue(PointerAddressSpace::GLOBAL_SPACE, funAddr);
 		}
 	}
@@ -352,7 +522,7 @@ DynamicValue Interpreter::evaluateConstantExpr(const llvm::ConstantExpr* cexpr)
 		case Instruction::SIToFP:
 		{
 			auto srcVal = evaluateConstant(cexpr->getOperand(0));
-			return DynamicValue::getFloatValue(APIntOps::RoundAPIntToDouble(srcVal.getAsIntValue().getInt()), cexpr->getType()->isDoubleTy());
+			return convertIntToFP(srcVal.getAsIntValue().getInt(), cexpr->getOpcode() == Instruction::SIToFP, cexpr->getType());
 		}
 		case Instruction::FPToUI:
 		case Instruction::FPToSI:
@@ -371,7 +541,7 @@ DynamicValue Interpreter::evaluateConstantExpr(const llvm::ConstantExpr* cexpr)
 		case Instruction::IntToPtr:
 		{
 			auto srcVal = evaluateConstant(cexpr->getOperand(0));
-			auto ptrSize = dataLayout.getPointerSizeInBits();
+			auto ptrSize = getDataLayout().getPointerSizeInBits();
 			return DynamicValue::getPointerValue(PointerAddressSpace::GLOBAL_SPACE, srcVal.getAsIntValue().getInt().zextOrTrunc(ptrSize).getZExtValue());
 		}
 		case Instruction::BitCast:
@@ -545,54 +715,9 @@ DynamicValue Interpreter::evaluateConstantExpr(const llvm::ConstantExpr* cexpr)
 		}
 		case Instruction::ICmp:
 		{
-			auto cmp = [cexpr] (const APInt& i0, const APInt& i1)
-			{
-				switch (cast<ICmpInst>(cexpr)->getPredicate())
-				{
-					case CmpInst::ICMP_EQ:
-						return APInt(1, i0 == i1);
-					case CmpInst::ICMP_NE:
-						return APInt(1, i0 != i1);
-					case CmpInst::ICMP_UGT:
-						return APInt(1, i0.ugt(i1));
-					case CmpInst::ICMP_UGE:
-						return APInt(1, i0.uge(i1));
-					case CmpInst::ICMP_ULT:
-						return APInt(1, i0.ult(i1));
-					case CmpInst::ICMP_ULE:
-						return APInt(1, i0.ule(i1));
-					case CmpInst::ICMP_SGT:
-						return APInt(1, i0.sgt(i1));
-					case CmpInst::ICMP_SGE:
-						return APInt(1, i0.sge(i1));
-					case CmpInst::ICMP_SLT:
-						return APInt(1, i0.slt(i1));
-					case CmpInst::ICMP_SLE:
-						return APInt(1, i0.sle(i1));
-					default:
-						llvm_unreachable("Illegal icmp predicate");
-				}
-			};
-
-			// ICmp can compare both integers and pointers, so we cannot just use evaluateIntBinOp
 			auto val0 = evaluateConstant(cexpr->getOperand(0));
 			auto val1 = evaluateConstant(cexpr->getOperand(1));
-			if (val0.isIntValue() && val1.isIntValue())
-			{
-				auto& intVal0 = val0.getAsIntValue();
-				auto res = cmp(intVal0.getInt(), val1.getAsIntValue().getInt());
-				return DynamicValue::getIntValue(res);
-			}
-			else if (val0.isPointerValue() && val1.isPointerValue())
-			{
-				auto ptrSize = dataLayout.getPointerSizeInBits();
-				auto addr0 = val0.getAsPointerValue().getAddress();
-				auto addr1 = val1.getAsPointerValue().getAddress();
-				auto res = cmp(APInt(ptrSize, addr0), APInt(ptrSize, addr1));
-				return DynamicValue::getIntValue(res);
-			}
-			else
-				llvm_unreachable("Illegal icmp compare types");
+			return evaluateICmp(cast<ICmpInst>(cexpr)->getPredicate(), val0, val1);
 		}
 		case Instruction::FAdd:
 		{
@@ -644,50 +769,8 @@ DynamicValue Interpreter::evaluateConstantExpr(const llvm::ConstantExpr* cexpr)
 			auto srcVal0 = evaluateConstant(cexpr->getOperand(0));
 			auto srcVal1 = evaluateConstant(cexpr->getOperand(1));
 
-			auto f0 = srcVal0.getAsFloatValue().getFloat();
-			auto f1 = srcVal1.getAsFloatValue().getFloat();
-			auto isF0Nan = std::isnan(f0);
-			auto isF1Nan = std::isnan(f1);
-			auto bothNotNan = !isF0Nan && !isF1Nan;
-			auto eitherIsNan = isF0Nan || isF1Nan;
-
-			switch (cast<FCmpInst>(cexpr)->getPredicate())
-			{
-				case CmpInst::FCMP_FALSE:
-					return DynamicValue::getIntValue(APInt(1, false));
-				case CmpInst::FCMP_OEQ:
-					return DynamicValue::getIntValue(APInt(1, bothNotNan && f0 == f1));
-				case CmpInst::FCMP_OGT:
-					return DynamicValue::getIntValue(APInt(1, bothNotNan && f0 > f1));
-				case CmpInst::FCMP_OGE:
-					return DynamicValue::getIntValue(APInt(1, bothNotNan && f0 >= f1));
-				case CmpInst::FCMP_OLT:
-					return DynamicValue::getIntValue(APInt(1, bothNotNan && f0 < f1));
-				case CmpInst::FCMP_OLE:
-					return DynamicValue::getIntValue(APInt(1, bothNotNan && f0 <= f1));
-				case CmpInst::FCMP_ONE:
-					return DynamicValue::getIntValue(APInt(1, bothNotNan && f0 != f1));
-				case CmpInst::FCMP_ORD:
-					return DynamicValue::getIntValue(APInt(1, bothNotNan));
-				case CmpInst::FCMP_UEQ:
-					return DynamicValue::getIntValue(APInt(1, eitherIsNan || f0 == f1));
-				case CmpInst::FCMP_UGT:
-					return DynamicValue::getIntValue(APInt(1, eitherIsNan || f0 > f1));
-				case CmpInst::FCMP_UGE:
-					return DynamicValue::getIntValue(APInt(1, eitherIsNan || f0 >= f1));
-				case CmpInst::FCMP_ULT:
-					return DynamicValue::getIntValue(APInt(1, eitherIsNan || f0 < f1));
-				case CmpInst::FCMP_ULE:
-					return DynamicValue::getIntValue(APInt(1, eitherIsNan || f0 <= f1));
-				case CmpInst::FCMP_UNE:
-					return DynamicValue::getIntValue(APInt(1, eitherIsNan || f0 != f1));
-				case CmpInst::FCMP_UNO:
-					return DynamicValue::getIntValue(APInt(1, eitherIsNan));
-				case CmpInst::FCMP_TRUE:
-					return DynamicValue::getIntValue(APInt(1, false));
-				default:
-					llvm_unreachable("Illegal fcmp predicate");
-			}
+			auto res = evaluateFCmpPredicate(static_cast<CmpInst::Predicate>(cexpr->getPredicate()), srcVal0.getAsFloatValue().getFloat(), srcVal1.getAsFloatValue().getFloat());
+			return DynamicValue::getIntValue(APInt(1, res));
 		}
 		case Instruction::Select:
 		{
@@ -701,8 +784,8 @@ DynamicValue Interpreter::evaluateConstantExpr(const llvm::ConstantExpr* cexpr)
 		case Instruction::GetElementPtr:
 		{
 			auto baseVal = evaluateConstant(cexpr->getOperand(0));
-			auto offsetInt = APInt(dataLayout.getPointerSizeInBits(), 0);
-			cast<GEPOperator>(cexpr)->accumulateConstantOffset(dataLayout, offsetInt);
+			auto offsetInt = APInt(getDataLayout().getPointerSizeInBits(), 0);
+			cast<GEPOperator>(cexpr)->accumulateConstantOffset(getDataLayout(), offsetInt);
 
 			auto& basePtrVal = baseVal.getAsPointerValue();
 			return DynamicValue::getPointerValue(basePtrVal.getAddressSpace(), basePtrVal.getAddress() + offsetInt.getZExtValue());
@@ -772,6 +855,52 @@ DynamicValue Interpreter::evaluateOperand(const StackFrame& frame, const llvm::V
 		return frame.lookup(v);
 }
 
+const Interpreter::GEPPlan& Interpreter::getGEPPlan(const GetElementPtrInst* gepInst)
+{
+	auto& gepPlans = currentThread->gepPlans;
+	auto itr = gepPlans.find(gepInst);
+	if (itr != gepPlans.end())
+		return itr->second;
+
+	auto plan = GEPPlan();
+	plan.constOffset = 0;
+	for (auto gti = gep_type_begin(gepInst), gte = gep_type_end(gepInst); gti != gte; ++gti)
+	{
+		auto idx = gti.getOperand();
+		if (auto structType = gti.getStructTypeOrNull())
+		{
+			auto fieldNum = cast<ConstantInt>(idx)->getZExtValue();
+			plan.constOffset += getDataLayout().getStructLayout(structType)->getElementOffset(fieldNum);
+			continue;
+		}
+
+		// The first index steps over whole objects of the source element type, the others over elements of the array or vector indexed so far
+		int64_t scale = getDataLayout().getTypeAllocSize(gti.getIndexedType()).getFixedSize();
+		if (auto constIdx = dyn_cast<ConstantInt>(idx))
+			plan.constOffset += constIdx->getSExtValue() * scale;
+		else
+			plan.varTerms.push_back(std::make_pair(idx, scale));
+	}
+
+	return gepPlans.insert(std::make_pair(gepInst, std::move(plan))).first->second;
+}
+
+DynamicValue Interpreter::evaluateGEP(const StackFrame& frame, const GetElementPtrInst* gepInst)
+{
+	auto baseVal = evaluateOperand(frame, gepInst->getPointerOperand());
+	auto& basePtrVal = baseVal.getAsPointerValue();
+
+	auto& plan = getGEPPlan(gepInst);
+	auto baseAddr = basePtrVal.getAddress() + plan.constOffset;
+	for (auto const& term: plan.varTerms)
+	{
+		auto idxVal = evaluateOperand(frame, term.first);
+		baseAddr += idxVal.getAsIntValue().getInt().getSExtValue() * term.second;
+	}
+
+	return DynamicValue::getPointerValue(basePtrVal.getAddressSpace(), baseAddr);
+}
+
 void Interpreter::evaluateInstruction(StackFrame& frame, const llvm::Instruction* inst)
 {
 	//errs() << "Eval " << *inst << "\n";
@@ -779,6 +908,11 @@ void Interpreter::evaluateInstruction(StackFrame& frame, const llvm::Instruction
 	{
 		auto val0 = evaluateOperand(frame, inst->getOperand(0));
 		auto val1 = evaluateOperand(frame, inst->getOperand(1));
+		if (val0.isVectorValue())
+		{
+			frame.insertBinding(inst, evaluateVectorBinOp(inst->getOpcode(), val0.getAsVectorValue(), val1.getAsVectorValue()));
+			return;
+		}
 		auto& intVal0 = val0.getAsIntValue();
 		auto& intVal1 = val1.getAsIntValue();
 
@@ -789,6 +923,11 @@ void Interpreter::evaluateInstruction(StackFrame& frame, const llvm::Instruction
 	{
 		auto val0 = evaluateOperand(frame, inst->getOperand(0));
 		auto val1 = evaluateOperand(frame, inst->getOperand(1));
+		if (val0.isVectorValue())
+		{
+			frame.insertBinding(inst, evaluateVectorBinOp(inst->getOpcode(), val0.getAsVectorValue(), val1.getAsVectorValue()));
+			return;
+		}
 		auto& fpVal0 = val0.getAsFloatValue();
 		auto& fpVal1 = val1.getAsFloatValue();
 		assert(fpVal0.isDouble() == fpVal1.isDouble());
@@ -804,6 +943,14 @@ void Interpreter::evaluateInstruction(StackFrame& frame, const llvm::Instruction
 		frame.insertBinding(inst, DynamicValue::getIntValue(unOp(srcIntVal.getInt())));
 	};
 
+	// Casts from or to vectors all go through the vector kernels
+	if (isa<CastInst>(inst) && (inst->getType()->isVectorTy() || inst->getOperand(0)->getType()->isVectorTy()))
+	{
+		auto srcVal = evaluateOperand(frame, inst->getOperand(0));
+		frame.insertBinding(inst, evaluateVectorCast(inst->getOpcode(), srcVal, inst->getOperand(0)->getType(), inst->getType()));
+		return;
+	}
+
 	switch (inst->getOpcode())
 	{
 		// Standard binary operators...
@@ -927,6 +1074,15 @@ void Interpreter::evaluateInstruction(StackFrame& frame, const llvm::Instruction
 			);
 			break;
 		}
+		case Instruction::FNeg:
+		{
+			auto srcVal = evaluateOperand(frame, inst->getOperand(0));
+			if (srcVal.isVectorValue())
+				frame.insertBinding(inst, evaluateVectorFNeg(srcVal.getAsVectorValue()));
+			else
+				frame.insertBinding(inst, DynamicValue::getFloatValue(-srcVal.getAsFloatValue().getFloat(), srcVal.getAsFloatValue().isDouble()));
+			break;
+		}
 		// Logical operators...
 		case Instruction::And:
 		{
@@ -1005,54 +1161,9 @@ void Interpreter::evaluateInstruction(StackFrame& frame, const llvm::Instruction
 		}
 		case Instruction::ICmp:
 		{
-			auto cmp = [inst] (const APInt& i0, const APInt& i1)
-			{
-				switch (cast<CmpInst>(inst)->getPredicate())
-				{
-					case CmpInst::ICMP_EQ:
-						return APInt(1, i0 == i1);
-					case CmpInst::ICMP_NE:
-						return APInt(1, i0 != i1);
-					case CmpInst::ICMP_UGT:
-						return APInt(1, i0.ugt(i1));
-					case CmpInst::ICMP_UGE:
-						return APInt(1, i0.uge(i1));
-					case CmpInst::ICMP_ULT:
-						return APInt(1, i0.ult(i1));
-					case CmpInst::ICMP_ULE:
-						return APInt(1, i0.ule(i1));
-					case CmpInst::ICMP_SGT:
-						return APInt(1, i0.sgt(i1));
-					case CmpInst::ICMP_SGE:
-						return APInt(1, i0.sge(i1));
-					case CmpInst::ICMP_SLT:
-						return APInt(1, i0.slt(i1));
-					case CmpInst::ICMP_SLE:
-						return APInt(1, i0.sle(i1));
-					default:
-						llvm_unreachable("Illegal icmp predicate");
-				}
-			};
-
-			// ICmp can compare both integers and pointers, so we cannot just use evaluateIntBinOp
 			auto val0 = evaluateOperand(frame, inst->getOperand(0));
 			auto val1 = evaluateOperand(frame, inst->getOperand(1));
-			if (val0.isIntValue() && val1.isIntValue())
-			{
-				auto& intVal0 = val0.getAsIntValue();
-				auto res = cmp(intVal0.getInt(), val1.getAsIntValue().getInt());
-				frame.insertBinding(inst, DynamicValue::getIntValue(res));
-			}
-			else if (val0.isPointerValue() && val1.isPointerValue())
-			{
-				auto ptrSize = dataLayout.getPointerSizeInBits();
-				auto addr0 = val0.getAsPointerValue().getAddress();
-				auto addr1 = val1.getAsPointerValue().getAddress();
-				auto res = cmp(APInt(ptrSize, addr0), APInt(ptrSize, addr1));
-				frame.insertBinding(inst, DynamicValue::getIntValue(res));
-			}
-			else
-				llvm_unreachable("Illegal icmp compare types");
+			frame.insertBinding(inst, evaluateICmp(cast<ICmpInst>(inst)->getPredicate(), val0, val1));
 
 			break;
 		}
@@ -1060,50 +1171,14 @@ void Interpreter::evaluateInstruction(StackFrame& frame, const llvm::Instruction
 		{
 			auto srcVal0 = evaluateOperand(frame, inst->getOperand(0));
 			auto srcVal1 = evaluateOperand(frame, inst->getOperand(1));
+			auto pred = cast<CmpInst>(inst)->getPredicate();
 
-			auto f0 = srcVal0.getAsFloatValue().getFloat();
-			auto f1 = srcVal1.getAsFloatValue().getFloat();
-			auto isF0Nan = std::isnan(f0);
-			auto isF1Nan = std::isnan(f1);
-			auto bothNotNan = !isF0Nan && !isF1Nan;
-			auto eitherIsNan = isF0Nan || isF1Nan;
-
-			switch (cast<CmpInst>(inst)->getPredicate())
+			if (srcVal0.isVectorValue())
+				frame.insertBinding(inst, evaluateVectorCmp(pred, srcVal0.getAsVectorValue(), srcVal1.getAsVectorValue()));
+			else
 			{
-				case CmpInst::FCMP_FALSE:
-					frame.insertBinding(inst, DynamicValue::getIntValue(APInt(1, false)));
-				case CmpInst::FCMP_OEQ:
-					frame.insertBinding(inst, DynamicValue::getIntValue(APInt(1, bothNotNan && f0 == f1)));
-				case CmpInst::FCMP_OGT:
-					frame.insertBinding(inst, DynamicValue::getIntValue(APInt(1, bothNotNan && f0 > f1)));
-				case CmpInst::FCMP_OGE:
-					frame.insertBinding(inst, DynamicValue::getIntValue(APInt(1, bothNotNan && f0 >= f1)));
-				case CmpInst::FCMP_OLT:
-					frame.insertBinding(inst, DynamicValue::getIntValue(APInt(1, bothNotNan && f0 < f1)));
-				case CmpInst::FCMP_OLE:
-					frame.insertBinding(inst, DynamicValue::getIntValue(APInt(1, bothNotNan && f0 <= f1)));
-				case CmpInst::FCMP_ONE:
-					frame.insertBinding(inst, DynamicValue::getIntValue(APInt(1, bothNotNan && f0 != f1)));
-				case CmpInst::FCMP_ORD:
-					frame.insertBinding(inst, DynamicValue::getIntValue(APInt(1, bothNotNan)));
-				case CmpInst::FCMP_UEQ:
-					frame.insertBinding(inst, DynamicValue::getIntValue(APInt(1, eitherIsNan || f0 == f1)));
-				case CmpInst::FCMP_UGT:
-					frame.insertBinding(inst, DynamicValue::getIntValue(APInt(1, eitherIsNan || f0 > f1)));
-				case CmpInst::FCMP_UGE:
-					frame.insertBinding(inst, DynamicValue::getIntValue(APInt(1, eitherIsNan || f0 >= f1)));
-				case CmpInst::FCMP_ULT:
-					frame.insertBinding(inst, DynamicValue::getIntValue(APInt(1, eitherIsNan || f0 < f1)));
-				case CmpInst::FCMP_ULE:
-					frame.insertBinding(inst, DynamicValue::getIntValue(APInt(1, eitherIsNan || f0 <= f1)));
-				case CmpInst::FCMP_UNE:
-					frame.insertBinding(inst, DynamicValue::getIntValue(APInt(1, eitherIsNan || f0 != f1)));
-				case CmpInst::FCMP_UNO:
-					frame.insertBinding(inst, DynamicValue::getIntValue(APInt(1, eitherIsNan)));
-				case CmpInst::FCMP_TRUE:
-					frame.insertBinding(inst, DynamicValue::getIntValue(APInt(1, false)));
-				default:
-					llvm_unreachable("Illegal fcmp predicate");
+				auto res = evaluateFCmpPredicate(pred, srcVal0.getAsFloatValue().getFloat(), srcVal1.getAsFloatValue().getFloat());
+				frame.insertBinding(inst, DynamicValue::getIntValue(APInt(1, res)));
 			}
 
 			break;
@@ -1185,14 +1260,14 @@ void Interpreter::evaluateInstruction(StackFrame& frame, const llvm::Instruction
 		case Instruction::SIToFP:
 		{
 			auto srcVal = evaluateOperand(frame, inst->getOperand(0));
-			auto resVal = DynamicValue::getFloatValue(APIntOps::RoundAPIntToDouble(srcVal.getAsIntValue().getInt()), inst->getType()->isDoubleTy());
+			auto resVal = convertIntToFP(srcVal.getAsIntValue().getInt(), inst->getOpcode() == Instruction::SIToFP, inst->getType());
 			frame.insertBinding(inst, resVal);
 			break;
 		}
 		case Instruction::IntToPtr:
 		{
 			auto srcVal = evaluateOperand(frame, inst->getOperand(0));
-			auto ptrSize = dataLayout.getPointerSizeInBits();
+			auto ptrSize = getDataLayout().getPointerSizeInBits();
 
 			// Look for matching ptrtoint to decide what the address space should be
 			auto addrSpace = PointerAddressSpace::GLOBAL_SPACE;
@@ -1275,10 +1350,8 @@ void Interpreter::evaluateInstruction(StackFrame& frame, const llvm::Instruction
 				allocElems = sizeVal.getAsIntValue().getInt().getZExtValue();
 			}
 
-			auto allocSize = dataLayout.getTypeAllocSize(allocInst->getAllocatedType());
-			auto retAddr = allocateStackMem(frame, allocSize);
-			for (auto i = 1; i < allocElems; ++i)
-				allocateStackMem(frame, allocSize);
+			auto allocSize = getDataLayout().getTypeAllocSize(allocInst->getAllocatedType());
+			auto retAddr = allocateStackMem(frame, allocSize * allocElems, allocInst->getAlign().value());
 
 			frame.insertBinding(inst, DynamicValue::getPointerValue(PointerAddressSpace::STACK_SPACE, retAddr));
 
@@ -1292,7 +1365,7 @@ void Interpreter::evaluateInstruction(StackFrame& frame, const llvm::Instruction
 			auto loadSrc = evaluateOperand(frame, loadInst->getPointerOperand());
 			auto& loadPtr = loadSrc.getAsPointerValue();
 
-			auto resVal = readFromPointer(loadPtr, loadType);
+			auto resVal = loadInst->isAtomic() ? evaluateAtomicLoad(loadPtr, loadType) : readFromPointer(loadPtr, loadType);
 
 			frame.insertBinding(inst, resVal);
 
@@ -1306,62 +1379,16 @@ void Interpreter::evaluateInstruction(StackFrame& frame, const llvm::Instruction
 			auto storeVal = evaluateOperand(frame, storeInst->getValueOperand());
 			auto& storePtr = storeSrc.getAsPointerValue();
 
-			writeToPointer(storePtr, storeVal);
+			if (storeInst->isAtomic())
+				evaluateAtomicStore(storePtr, storeVal, storeInst->getValueOperand()->getType());
+			else
+				writeToPointer(storePtr, storeVal);
 
 			break;
 		}
 		case Instruction::GetElementPtr:
 		{
-			auto gepInst = cast<GetElementPtrInst>(inst);
-
-			auto baseVal = evaluateOperand(frame, gepInst->getPointerOperand());
-			auto& basePtrVal = baseVal.getAsPointerValue();
-			auto baseAddr = basePtrVal.getAddress();
-
-			Type* curType = gepInst->getSourceElementType();
-			for (unsigned i = 0, e = gepInst->getNumIndices(); i < e; ++i)
-			{
-				auto idxVal = evaluateOperand(frame, gepInst->getOperand(i + 1));
-				auto seqNum = idxVal.getAsIntValue().getInt().getSExtValue();
-
-				if (auto structType = dyn_cast<StructType>(curType))
-				{
-					baseAddr += dataLayout.getStructLayout(structType)->getElementOffset(seqNum);
-					curType = structType->getElementType(seqNum);
-				}
-				else if (curType->isArrayTy() || curType->isVectorTy())
-				{
-					baseAddr += seqNum * dataLayout.getTypeAllocSize(curType->getArrayElementType());
-					curType = curType->getArrayElementType();
-				}
-				else if (curType->isPointerTy())
-				{
-					// Handle pointer arithmetic: ptr + index
-					// In LLVM 20 with opaque pointers, we need to handle this case
-					auto ptrSize = dataLayout.getPointerSize();
-					baseAddr += seqNum * ptrSize;
-					// For opaque pointers, we can't determine the pointee type
-					// This is typically the last index, so we keep curType as pointer
-				}
-				else if (i == 0 && seqNum == 0)
-				{
-					// First index with value 0 on a non-aggregate type
-					// This is valid for opaque pointers - just skip this index
-					// The type remains the same
-				}
-				else
-				{
-					// For basic types (i32, i64, etc.), if this is not the first index,
-					// it means we're trying to do pointer arithmetic
-					// Calculate offset based on type size
-					auto typeSize = dataLayout.getTypeAllocSize(curType);
-					baseAddr += seqNum * typeSize;
-					// Type remains the same for basic types
-				}
-			}
-
-			frame.insertBinding(inst, DynamicValue::getPointerValue(basePtrVal.getAddressSpace(), baseAddr));
-
+			frame.insertBinding(inst, evaluateGEP(frame, cast<GetElementPtrInst>(inst)));
 			break;
 		}
 
@@ -1424,6 +1451,14 @@ void Interpreter::evaluateInstruction(StackFrame& frame, const llvm::Instruction
 			auto selInst = cast<SelectInst>(inst);
 
 			auto condVal = evaluateOperand(frame, selInst->getCondition());
+			if (selInst->getType()->isVectorTy())
+			{
+				auto trueVal = evaluateOperand(frame, selInst->getTrueValue());
+				auto falseVal = evaluateOperand(frame, selInst->getFalseValue());
+				frame.insertBinding(inst, evaluateVectorSelect(condVal, trueVal, falseVal));
+				break;
+			}
+
 			auto condInt = condVal.getAsIntValue().getInt().getBoolValue();
 			if (condInt)
 				frame.insertBinding(inst, evaluateOperand(frame, selInst->getTrueValue()));
@@ -1437,43 +1472,115 @@ void Interpreter::evaluateInstruction(StackFrame& frame, const llvm::Instruction
 			auto* callInst = cast<CallInst>(inst);
 			auto* cs = cast<CallBase>(callInst);
 
+			if (auto intrinsicInst = dyn_cast<IntrinsicInst>(callInst))
+			{
+				if (isNoOpIntrinsic(intrinsicInst->getIntrinsicID()))
+					break;
+			}
+
 			auto callTgt = cs->getCalledFunction();
 			if (callTgt == nullptr)
 			{
 				auto funPtr = evaluateOperand(frame, cs->getCalledOperand());
 				auto funAddr = funPtr.getAsPointerValue().getAddress();
-				callTgt = const_cast<Function*>(cast<const Function>(funPtrMap.at(funAddr)));
+				callTgt = const_cast<Function*>(cast<const Function>(image->funPtrMap.at(funAddr)));
 			}
 
 			auto argVals = std::vector<DynamicValue>();
 			for (auto itr = cs->arg_begin(), ite = cs->arg_end(); itr != ite; ++itr)
 				argVals.push_back(evaluateOperand(frame, *itr));
 
-			auto retVal = (callTgt->isDeclaration()) ? callExternalFunction(cs, callTgt, std::move(argVals)) : callFunction(callTgt, std::move(argVals));
+			auto retVal = DynamicValue::getUndefValue();
+			if (callTgt->isIntrinsic())
+				retVal = callIntrinsic(cs, callTgt, std::move(argVals));
+			else if (callTgt->isDeclaration())
+				retVal = callExternalFunction(cs, callTgt, std::move(argVals));
+			else
+				retVal = callFunction(callTgt, std::move(argVals), cs);
 			if (!callTgt->getReturnType()->isVoidTy())
 				frame.insertBinding(inst, std::move(retVal));
 
 			break;
 		}
 
+		// Vector instructions...
+		case Instruction::ExtractElement:
+		{
+			auto eeInst = cast<ExtractElementInst>(inst);
+
+			auto vecVal = evaluateOperand(frame, eeInst->getVectorOperand());
+			auto idxVal = evaluateOperand(frame, eeInst->getIndexOperand());
+			auto idx = idxVal.getAsIntValue().getInt().getZExtValue();
+
+			auto& vec = vecVal.getAsVectorValue();
+			// An out-of-range index yields poison
+			if (idx < vec.getNumLanes())
+				frame.insertBinding(inst, vec.getLane(idx));
+			else
+				frame.insertBinding(inst, DynamicValue::getUndefValue());
+			break;
+		}
+		case Instruction::InsertElement:
+		{
+			auto ieInst = cast<InsertElementInst>(inst);
+
+			auto vecVal = evaluateOperand(frame, ieInst->getOperand(0));
+			auto eltVal = evaluateOperand(frame, ieInst->getOperand(1));
+			auto idxVal = evaluateOperand(frame, ieInst->getOperand(2));
+			auto idx = idxVal.getAsIntValue().getInt().getZExtValue();
+
+			auto& vec = vecVal.getAsVectorValue();
+			if (idx < vec.getNumLanes())
+				vec.setLane(idx, eltVal);
+			frame.insertBinding(inst, std::move(vecVal));
+			break;
+		}
+		case Instruction::ShuffleVector:
+		{
+			auto svInst = cast<ShuffleVectorInst>(inst);
+
+			auto vecVal0 = evaluateOperand(frame, svInst->getOperand(0));
+			auto vecVal1 = evaluateOperand(frame, svInst->getOperand(1));
+			frame.insertBinding(inst, evaluateShuffleVector(vecVal0.getAsVectorValue(), vecVal1.getAsVectorValue(), svInst->getShuffleMask()));
+			break;
+		}
+
+		// Atomic instructions
+		case Instruction::AtomicRMW:
+		{
+			frame.insertBinding(inst, evaluateAtomicRMW(frame, cast<AtomicRMWInst>(inst)));
+			break;
+		}
+		case Instruction::AtomicCmpXchg:
+		{
+			frame.insertBinding(inst, evaluateCmpXchg(frame, cast<AtomicCmpXchgInst>(inst)));
+			break;
+		}
+		case Instruction::Fence:
+		{
+			__atomic_thread_fence(__ATOMIC_SEQ_CST);
+			break;
+		}
+
 		// Instructions that should not be here
 		case Instruction::PHI:
 			llvm_unreachable("Illegal instruction type!");
 
-		// Unimplemented instructions
 		case Instruction::VAArg:
+		{
+			auto vaInst = cast<VAArgInst>(inst);
+			auto vaList = evaluateOperand(frame, vaInst->getPointerOperand());
+			frame.insertBinding(inst, evaluateVAArg(vaList.getAsPointerValue(), vaInst->getType()));
+			break;
+		}
+
+		// Unimplemented instructions
 		case Instruction::Invoke:
 		case Instruction::LandingPad:
 			llvm_unreachable("Unimplemented instruction type!");
 
 		// Unsupported instructions
 		case Instruction::AddrSpaceCast:
-		case Instruction::AtomicCmpXchg:
-		case Instruction::AtomicRMW:
-		case Instruction::Fence:
-		case Instruction::ExtractElement:
-		case Instruction::InsertElement:
-		case Instruction::ShuffleVector:
 			llvm_unreachable("Unsupported instruction type!");
 	}
 }
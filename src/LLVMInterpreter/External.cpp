@@ -4,7 +4,13 @@
 #include "llvm/IR/Constants.h"
 #include "llvm/Support/raw_ostream.h"
 
-#include <boost/format.hpp>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
 #include <unordered_map>
 
 using namespace llvm;
@@ -16,39 +22,329 @@ enum class ExternalCallType
 {
 	NOOP,
 	PRINTF,
+	VPRINTF,
+	FPRINTF,
+	VFPRINTF,
+	SPRINTF,
+	VSPRINTF,
+	SNPRINTF,
+	VSNPRINTF,
+	PUTS,
+	PUTCHAR,
+	FOPEN,
+	FCLOSE,
+	FREAD,
+	FWRITE,
+	FGETS,
+	FPUTS,
+	FGETC,
+	FPUTC,
+	GETCHAR,
+	FFLUSH,
+	FILENO,
+	OPEN,
+	CLOSE,
+	MMAP,
+	MUNMAP,
 	MEMCPY,
+	MEMMOVE,
 	MEMSET,
+	MEMCMP,
+	MEMCHR,
+	STRLEN,
+	STRCMP,
+	STRNCMP,
+	STRCHR,
+	STRCPY,
+	STRSTR,
+	QSORT,
+	BSEARCH,
 	MALLOC,
 	FREE,
+	PTHREAD_CREATE,
+	PTHREAD_JOIN,
+	PTHREAD_DETACH,
+	PTHREAD_SELF,
+	PTHREAD_EXIT,
+	PTHREAD_MUTEX_INIT,
+	PTHREAD_MUTEX_DESTROY,
+	PTHREAD_MUTEX_LOCK,
+	PTHREAD_MUTEX_TRYLOCK,
+	PTHREAD_MUTEX_UNLOCK,
+	PTHREAD_COND_INIT,
+	PTHREAD_COND_DESTROY,
+	PTHREAD_COND_WAIT,
+	PTHREAD_COND_TIMEDWAIT,
+	PTHREAD_COND_SIGNAL,
+	PTHREAD_COND_BROADCAST,
 };
 
+namespace
+{
+
+// Whether a call reaches the host: through stdio, file descriptors or file mappings. Only these are recorded and replayed, everything else only depends on guest memory and is simply made again
+bool isHostCall(ExternalCallType callType, const std::vector<DynamicValue>& argValues)
+{
+	switch (callType)
+	{
+		case ExternalCallType::PRINTF:
+		case ExternalCallType::VPRINTF:
+		case ExternalCallType::FPRINTF:
+		case ExternalCallType::VFPRINTF:
+		case ExternalCallType::PUTS:
+		case ExternalCallType::PUTCHAR:
+		case ExternalCallType::FOPEN:
+		case ExternalCallType::FCLOSE:
+		case ExternalCallType::FREAD:
+		case ExternalCallType::FWRITE:
+		case ExternalCallType::FGETS:
+		case ExternalCallType::FPUTS:
+		case ExternalCallType::FGETC:
+		case ExternalCallType::FPUTC:
+		case ExternalCallType::GETCHAR:
+		case ExternalCallType::FFLUSH:
+		case ExternalCallType::FILENO:
+		case ExternalCallType::OPEN:
+		case ExternalCallType::CLOSE:
+			return true;
+		case ExternalCallType::MMAP:
+			return (argValues.at(3).getAsIntValue().getInt().getSExtValue() & MAP_ANONYMOUS) == 0;
+		default:
+			return false;
+	}
+}
+
+// The guest pointer to (found), which points into the same guest memory as the host pointer (base) of (ptr). A null (found) gives a null pointer
+DynamicValue offsetGuestPointer(const PointerValue& ptr, const char* base, const char* found)
+{
+	if (found == nullptr)
+		return DynamicValue::getPointerValue(PointerAddressSpace::GLOBAL_SPACE, 0);
+	return DynamicValue::getPointerValue(ptr.getAddressSpace(), ptr.getAddress() + (found - base));
+}
+
+}
+
+void* Interpreter::getRawPointer(const PointerValue& ptr)
+{
+	switch (ptr.getAddressSpace())
+	{
+		case PointerAddressSpace::GLOBAL_SPACE:
+			return globalMem.getRawPointerAtAddress(ptr.getAddress());
+		case PointerAddressSpace::STACK_SPACE:
+			return getStackSection(ptr.getAddress()).getRawPointerAtAddress(getStackOffset(ptr.getAddress()));
+		case PointerAddressSpace::HEAP_SPACE:
+			return heapMem.getRawPointerAtAddress(ptr.getAddress());
+	}
+	llvm_unreachable("Illegal address space");
+}
+
+void* Interpreter::getWritablePointer(const PointerValue& ptr, size_t size)
+{
+	// Loads from read-only memory may have been folded into block plans, which a native write would leave stale
+	if (ptr.getAddressSpace() == PointerAddressSpace::GLOBAL_SPACE && size != 0 && ptr.getAddress() < image->readOnlyEnd && ptr.getAddress() + size > image->readOnlyBegin)
+		throw std::runtime_error("Native library call writes to read-only global memory");
+
+	noteCallEffect(CallEffect::Kind::WRITE, ptr, size);
+	switch (ptr.getAddressSpace())
+	{
+		case PointerAddressSpace::GLOBAL_SPACE:
+			return globalMem.getWritablePointerAtAddress(ptr.getAddress(), size);
+		case PointerAddressSpace::STACK_SPACE:
+			return getStackSection(ptr.getAddress()).getWritablePointerAtAddress(getStackOffset(ptr.getAddress()), size);
+		case PointerAddressSpace::HEAP_SPACE:
+			return heapMem.getWritablePointerAtAddress(ptr.getAddress(), size);
+	}
+	llvm_unreachable("Illegal address space");
+}
+
+uint64_t Interpreter::getSectionExtent(const PointerValue& ptr)
+{
+	switch (ptr.getAddressSpace())
+	{
+		case PointerAddressSpace::GLOBAL_SPACE:
+			return globalMem.getExtent(ptr.getAddress());
+		case PointerAddressSpace::STACK_SPACE:
+			return getStackSection(ptr.getAddress()).getExtent(getStackOffset(ptr.getAddress()));
+		case PointerAddressSpace::HEAP_SPACE:
+			return heapMem.getExtent(ptr.getAddress());
+	}
+	llvm_unreachable("Illegal address space");
+}
+
+const char* Interpreter::getCheckedPointer(const PointerValue& ptr, uint64_t size)
+{
+	if (size != 0 && getSectionExtent(ptr) < size)
+		throw std::out_of_range("Native library call accesses unallocated guest memory");
+	return static_cast<const char*>(getRawPointer(ptr));
+}
+
+const char* Interpreter::getGuestString(const PointerValue& ptr, uint64_t& len, uint64_t maxLen)
+{
+	auto extent = getSectionExtent(ptr);
+	if (extent == 0 && maxLen != 0)
+		throw std::out_of_range("Native library call reads a string from unallocated guest memory");
+	auto str = static_cast<const char*>(getRawPointer(ptr));
+	// strnlen() stops at the end of the section, so it never reads past what the host has mapped
+	len = strnlen(str, std::min(extent, maxLen));
+	if (len == extent && extent < maxLen)
+		throw std::out_of_range("Native library call reads a string that is not terminated inside its guest memory section");
+	return str;
+}
+
+DynamicValue Interpreter::callMathFunction(const MathFunction& fn, const std::vector<DynamicValue>& argValues)
+{
+	if (fn.isElementWise())
+		return evaluateMathFunction(fn, argValues);
+
+	auto ptrArg = [&argValues] (unsigned i) -> const PointerValue&
+	{
+		return argValues.at(i).getAsPointerValue();
+	};
+	// Store the second result of a math function through a guest pointer
+	auto writeResult = [this] (const PointerValue& ptr, auto val)
+	{
+		getCheckedPointer(ptr, sizeof(val));
+		std::memcpy(getWritablePointer(ptr, sizeof(val)), &val, sizeof(val));
+	};
+	auto call = [&] (auto tag)
+	{
+		using T = decltype(tag);
+		auto floatArg = [&argValues] (unsigned i)
+		{
+			return static_cast<T>(argValues.at(i).getAsFloatValue().getFloat());
+		};
+		switch (fn.signature)
+		{
+			case MathSignature::FREXP:
+			{
+				auto exp = 0;
+				auto ret = reinterpret_cast<T (*)(T, int*)>(fn.fn)(floatArg(0), &exp);
+				writeResult(ptrArg(1), exp);
+				return DynamicValue::getFloatValue(ret, fn.isDouble);
+			}
+			case MathSignature::MODF:
+			{
+				auto intPart = T();
+				auto ret = reinterpret_cast<T (*)(T, T*)>(fn.fn)(floatArg(0), &intPart);
+				writeResult(ptrArg(1), intPart);
+				return DynamicValue::getFloatValue(ret, fn.isDouble);
+			}
+			case MathSignature::REMQUO:
+			{
+				auto quo = 0;
+				auto ret = reinterpret_cast<T (*)(T, T, int*)>(fn.fn)(floatArg(0), floatArg(1), &quo);
+				writeResult(ptrArg(2), quo);
+				return DynamicValue::getFloatValue(ret, fn.isDouble);
+			}
+			case MathSignature::SINCOS:
+			{
+				auto sinVal = T(), cosVal = T();
+				reinterpret_cast<void (*)(T, T*, T*)>(fn.fn)(floatArg(0), &sinVal, &cosVal);
+				writeResult(ptrArg(1), sinVal);
+				writeResult(ptrArg(2), cosVal);
+				return DynamicValue::getUndefValue();
+			}
+			case MathSignature::NAN_STRING:
+			{
+				auto len = uint64_t(0);
+				auto str = getGuestString(ptrArg(0), len);
+				return DynamicValue::getFloatValue(reinterpret_cast<T (*)(const char*)>(fn.fn)(str), fn.isDouble);
+			}
+			default:
+				llvm_unreachable("Element-wise math function");
+		}
+	};
+	return fn.isDouble ? call(double()) : call(float());
+}
+
 DynamicValue Interpreter::callExternalFunction(const CallBase* cs, const llvm::Function* f, std::vector<DynamicValue>&& argValues)
 {
 	static std::unordered_map<std::string, ExternalCallType> externalFuncMap =
 	{
 		{ "printf", ExternalCallType::PRINTF },
+		{ "vprintf", ExternalCallType::VPRINTF },
+		{ "fprintf", ExternalCallType::FPRINTF },
+		{ "vfprintf", ExternalCallType::VFPRINTF },
+		{ "sprintf", ExternalCallType::SPRINTF },
+		{ "vsprintf", ExternalCallType::VSPRINTF },
+		{ "snprintf", ExternalCallType::SNPRINTF },
+		{ "vsnprintf", ExternalCallType::VSNPRINTF },
+		{ "puts", ExternalCallType::PUTS },
+		{ "putchar", ExternalCallType::PUTCHAR },
+		{ "fopen", ExternalCallType::FOPEN },
+		{ "fopen64", ExternalCallType::FOPEN },
+		{ "fclose", ExternalCallType::FCLOSE },
+		{ "fread", ExternalCallType::FREAD },
+		{ "fwrite", ExternalCallType::FWRITE },
+		{ "fgets", ExternalCallType::FGETS },
+		{ "fputs", ExternalCallType::FPUTS },
+		{ "fgetc", ExternalCallType::FGETC },
+		{ "getc", ExternalCallType::FGETC },
+		{ "fputc", ExternalCallType::FPUTC },
+		{ "putc", ExternalCallType::FPUTC },
+		{ "getchar", ExternalCallType::GETCHAR },
+		{ "fflush", ExternalCallType::FFLUSH },
+		{ "fileno", ExternalCallType::FILENO },
+		{ "open", ExternalCallType::OPEN },
+		{ "open64", ExternalCallType::OPEN },
+		{ "close", ExternalCallType::CLOSE },
+		{ "mmap", ExternalCallType::MMAP },
+		{ "mmap64", ExternalCallType::MMAP },
+		{ "munmap", ExternalCallType::MUNMAP },
 		{ "memcpy", ExternalCallType::MEMCPY },
-		{ "memmove", ExternalCallType::MEMCPY },
-		{ "llvm.memcpy.p0i8.p0i8.i32", ExternalCallType::MEMCPY },
-		{ "llvm.memcpy.p0i8.p0i8.i64", ExternalCallType::MEMCPY },
+		{ "memmove", ExternalCallType::MEMMOVE },
 		{ "memset", ExternalCallType::MEMSET },
-		{ "llvm.memset.p0i8.i32", ExternalCallType::MEMSET },
-		{ "llvm.memset.p0i8.i64", ExternalCallType::MEMSET },
+		{ "memcmp", ExternalCallType::MEMCMP },
+		{ "bcmp", ExternalCallType::MEMCMP },
+		{ "memchr", ExternalCallType::MEMCHR },
+		{ "strlen", ExternalCallType::STRLEN },
+		{ "strcmp", ExternalCallType::STRCMP },
+		{ "strncmp", ExternalCallType::STRNCMP },
+		{ "strchr", ExternalCallType::STRCHR },
+		{ "strcpy", ExternalCallType::STRCPY },
+		{ "strstr", ExternalCallType::STRSTR },
+		{ "qsort", ExternalCallType::QSORT },
+		{ "bsearch", ExternalCallType::BSEARCH },
 		{ "malloc", ExternalCallType::MALLOC },
 		{ "free", ExternalCallType::FREE },
+		{ "pthread_create", ExternalCallType::PTHREAD_CREATE },
+		{ "pthread_join", ExternalCallType::PTHREAD_JOIN },
+		{ "pthread_detach", ExternalCallType::PTHREAD_DETACH },
+		{ "pthread_self", ExternalCallType::PTHREAD_SELF },
+		{ "pthread_exit", ExternalCallType::PTHREAD_EXIT },
+		{ "pthread_mutex_init", ExternalCallType::PTHREAD_MUTEX_INIT },
+		{ "pthread_mutex_destroy", ExternalCallType::PTHREAD_MUTEX_DESTROY },
+		{ "pthread_mutex_lock", ExternalCallType::PTHREAD_MUTEX_LOCK },
+		{ "pthread_mutex_trylock", ExternalCallType::PTHREAD_MUTEX_TRYLOCK },
+		{ "pthread_mutex_unlock", ExternalCallType::PTHREAD_MUTEX_UNLOCK },
+		{ "pthread_cond_init", ExternalCallType::PTHREAD_COND_INIT },
+		{ "pthread_cond_destroy", ExternalCallType::PTHREAD_COND_DESTROY },
+		{ "pthread_cond_wait", ExternalCallType::PTHREAD_COND_WAIT },
+		{ "pthread_cond_timedwait", ExternalCallType::PTHREAD_COND_TIMEDWAIT },
+		{ "pthread_cond_signal", ExternalCallType::PTHREAD_COND_SIGNAL },
+		{ "pthread_cond_broadcast", ExternalCallType::PTHREAD_COND_BROADCAST },
 	};
 
-	auto getRawPointer = [this] (const PointerValue& ptr)
+	// Guest mutexes and condition variables are operated on in place by the host pthread library. The guest was compiled against the same ABI, so it agrees on their layout, and the all-zero static initializers work too
+	auto mutexArg = [this, &argValues] (unsigned i)
 	{
-		switch (ptr.getAddressSpace())
-		{
-			case PointerAddressSpace::GLOBAL_SPACE:
-				return globalMem.getRawPointerAtAddress(ptr.getAddress());
-			case PointerAddressSpace::STACK_SPACE:
-				return stackMem.getRawPointerAtAddress(ptr.getAddress());
-			case PointerAddressSpace::HEAP_SPACE:
-				return heapMem.getRawPointerAtAddress(ptr.getAddress());
-		}
+		return static_cast<pthread_mutex_t*>(getWritablePointer(argValues.at(i).getAsPointerValue(), sizeof(pthread_mutex_t)));
+	};
+	auto condArg = [this, &argValues] (unsigned i)
+	{
+		return static_cast<pthread_cond_t*>(getWritablePointer(argValues.at(i).getAsPointerValue(), sizeof(pthread_cond_t)));
+	};
+	// Attribute and timeout arguments are only read, and may be NULL
+	auto optionalArg = [this, &argValues] (unsigned i, uint64_t size) -> const void*
+	{
+		auto& ptr = argValues.at(i).getAsPointerValue();
+		if (ptr.getAddressSpace() == PointerAddressSpace::GLOBAL_SPACE && ptr.getAddress() == 0)
+			return nullptr;
+		return getCheckedPointer(ptr, size);
+	};
+	auto errorCode = [] (int err)
+	{
+		return DynamicValue::getIntValue(APInt(32, err));
 	};
 
 	// First check if there's a registered callback for this function
@@ -56,6 +352,8 @@ DynamicValue Interpreter::callExternalFunction(const CallBase* cs, const llvm::F
 	auto callbackItr = externalCallbacks.find(funcName);
 	if (callbackItr != externalCallbacks.end())
 	{
+		if (isLoggingCalls())
+			return logExternalCall(cs, f, std::move(argValues));
 		// Use registered callback
 		return callbackItr->second(f, argValues);
 	}
@@ -64,9 +362,45 @@ DynamicValue Interpreter::callExternalFunction(const CallBase* cs, const llvm::F
 	auto itr = externalFuncMap.find(funcName);
 	if (itr == externalFuncMap.end())
 	{
-		errs() << "Unknown external function: " << funcName << "\n";
-		errs() << "Hint: Register this function using registerExternalFunction()\n";
-		llvm_unreachable("");
+		if (auto mathFn = findMathFunction(funcName))
+			return callMathFunction(*mathFn, argValues);
+		// An unsupported call is a fault of the guest, like a bad memory access, so that a host running many guests can report it and go on
+		throw std::runtime_error("Unknown external function: " + funcName + " (register it using registerExternalFunction())");
+	}
+	if (isLoggingCalls() && isHostCall(itr->second, argValues))
+		return logExternalCall(cs, f, std::move(argValues));
+
+	// Green threads all run on this host thread, so they must never block in the host pthread library. The scheduler keeps their mutexes and condition variables instead
+	if (greenThreads)
+	{
+		auto ptrArg = [&argValues] (unsigned i) -> const PointerValue&
+		{
+			return argValues.at(i).getAsPointerValue();
+		};
+		switch (itr->second)
+		{
+			case ExternalCallType::PTHREAD_MUTEX_INIT:
+			case ExternalCallType::PTHREAD_MUTEX_DESTROY:
+			case ExternalCallType::PTHREAD_COND_INIT:
+			case ExternalCallType::PTHREAD_COND_DESTROY:
+				return errorCode(resetGreenSyncObject(ptrArg(0)));
+			case ExternalCallType::PTHREAD_MUTEX_LOCK:
+				return errorCode(lockGreenMutex(ptrArg(0), true));
+			case ExternalCallType::PTHREAD_MUTEX_TRYLOCK:
+				return errorCode(lockGreenMutex(ptrArg(0), false));
+			case ExternalCallType::PTHREAD_MUTEX_UNLOCK:
+				return errorCode(unlockGreenMutex(ptrArg(0)));
+			case ExternalCallType::PTHREAD_COND_WAIT:
+				return errorCode(waitGreenCond(ptrArg(0), ptrArg(1), false));
+			case ExternalCallType::PTHREAD_COND_TIMEDWAIT:
+				return errorCode(waitGreenCond(ptrArg(0), ptrArg(1), true));
+			case ExternalCallType::PTHREAD_COND_SIGNAL:
+				return errorCode(signalGreenCond(ptrArg(0), false));
+			case ExternalCallType::PTHREAD_COND_BROADCAST:
+				return errorCode(signalGreenCond(ptrArg(0), true));
+			default:
+				break;
+		}
 	}
 
 	switch (itr->second)
@@ -74,32 +408,146 @@ DynamicValue Interpreter::callExternalFunction(const CallBase* cs, const llvm::F
 		case ExternalCallType::NOOP:
 			return DynamicValue::getUndefValue();
 		case ExternalCallType::PRINTF:
+		case ExternalCallType::VPRINTF:
 		{
-			assert(argValues.size() >= 1);
-
-			// Use boost::format to output the format string
-			auto fmtStrPtr = argValues.at(0).getAsPointerValue();
-			auto fmt = boost::format(static_cast<const char*>(getRawPointer(fmtStrPtr)));
-			for (auto i = std::size_t(1), e = argValues.size(); i < e; ++i)
-			{
-				auto& argVal = argValues[i];
-				if (argVal.isUndefValue())
-					llvm_unreachable("Passing undef value into printf?");
-				else if (argVal.isIntValue())
-					fmt % argVal.getAsIntValue().getInt().getZExtValue();
-				else if (argVal.isFloatValue())
-					fmt % argVal.getAsFloatValue().getFloat();
-				else if (argVal.isPointerValue())
-					fmt % static_cast<const char*>(getRawPointer(argVal.getAsPointerValue()));
-				else
-					llvm_unreachable("Passing an array or struct to printf?");
-			}
+			auto& str = formatGuestString(cs, argValues, 0, itr->second == ExternalCallType::VPRINTF);
+			writeToStream(1, str);
+			return DynamicValue::getIntValue(APInt(32, str.size()));
+		}
+		case ExternalCallType::FPRINTF:
+		case ExternalCallType::VFPRINTF:
+		{
+			auto stream = getStreamNumber(argValues.at(0).getAsPointerValue());
+			auto& str = formatGuestString(cs, argValues, 1, itr->second == ExternalCallType::VFPRINTF);
+			writeToStream(stream, str);
+			return DynamicValue::getIntValue(APInt(32, str.size()));
+		}
+		case ExternalCallType::SPRINTF:
+		case ExternalCallType::VSPRINTF:
+		{
+			auto& str = formatGuestString(cs, argValues, 1, itr->second == ExternalCallType::VSPRINTF);
+			copyFormattedString(argValues.at(0).getAsPointerValue(), str.size() + 1, str);
+			return DynamicValue::getIntValue(APInt(32, str.size()));
+		}
+		case ExternalCallType::SNPRINTF:
+		case ExternalCallType::VSNPRINTF:
+		{
+			// Like the C library, return the length the whole output would have had
+			auto size = argValues.at(1).getAsIntValue().getInt().getZExtValue();
+			auto& str = formatGuestString(cs, argValues, 2, itr->second == ExternalCallType::VSNPRINTF);
+			copyFormattedString(argValues.at(0).getAsPointerValue(), size, str);
+			return DynamicValue::getIntValue(APInt(32, str.size()));
+		}
+		case ExternalCallType::PUTS:
+		{
+			auto len = uint64_t(0);
+			auto guestStr = getGuestString(argValues.at(0).getAsPointerValue(), len);
+			auto& str = currentThread->formatBuffer;
+			str.assign(guestStr, len);
+			str += '\n';
+			writeToStream(1, str);
+			return DynamicValue::getIntValue(APInt(32, str.size()));
+		}
+		case ExternalCallType::PUTCHAR:
+		{
+			auto ch = static_cast<char>(argValues.at(0).getAsIntValue().getInt().getZExtValue());
+			writeToStream(1, StringRef(&ch, 1));
+			return DynamicValue::getIntValue(APInt(32, static_cast<unsigned char>(ch)));
+		}
+		case ExternalCallType::FOPEN:
+			return openGuestFile(argValues.at(0).getAsPointerValue(), argValues.at(1).getAsPointerValue());
+		case ExternalCallType::FCLOSE:
+			return DynamicValue::getIntValue(APInt(32, closeGuestFile(argValues.at(0).getAsPointerValue()), true));
+		case ExternalCallType::FREAD:
+		case ExternalCallType::FWRITE:
+		{
+			// size_t fread(void* ptr, size_t size, size_t n, FILE* file). Both count whole items
+			auto itemSize = argValues.at(1).getAsIntValue().getInt().getZExtValue();
+			auto size = itemSize * argValues.at(2).getAsIntValue().getInt().getZExtValue();
+			auto stream = getStreamNumber(argValues.at(3).getAsPointerValue());
+			auto& bufPtr = argValues.at(0).getAsPointerValue();
 
-			outs() << fmt.str();
+			auto lock = std::lock_guard<std::mutex>(hostMutex);
+			auto done = (itr->second == ExternalCallType::FREAD) ?
+				readFromStream(stream, bufPtr, size) :
+				stdio.write(stream, getCheckedPointer(bufPtr, size), size);
+			return DynamicValue::getIntValue(APInt(getDataLayout().getPointerSizeInBits(), itemSize == 0 ? 0 : done / itemSize));
+		}
+		case ExternalCallType::FGETS:
+		{
+			// char* fgets(char* buf, int size, FILE* file) reads at most size - 1 bytes, and returns NULL if there were none
+			auto size = argValues.at(1).getAsIntValue().getInt().getSExtValue();
+			auto stream = getStreamNumber(argValues.at(2).getAsPointerValue());
+			if (size <= 0)
+				return DynamicValue::getPointerValue(PointerAddressSpace::GLOBAL_SPACE, 0);
 
-			return DynamicValue::getIntValue(APInt(32, fmt.size()));
+			auto lock = std::lock_guard<std::mutex>(hostMutex);
+			auto buf = static_cast<char*>(getWritablePointer(argValues.at(0).getAsPointerValue(), size));
+			auto len = stdio.readLine(stream, buf, size - 1);
+			if (len == 0)
+				return DynamicValue::getPointerValue(PointerAddressSpace::GLOBAL_SPACE, 0);
+			buf[len] = '\0';
+			return argValues.at(0);
+		}
+		case ExternalCallType::FPUTS:
+		{
+			auto len = uint64_t(0);
+			auto guestStr = getGuestString(argValues.at(0).getAsPointerValue(), len);
+			auto str = StringRef(guestStr, len);
+			writeToStream(getStreamNumber(argValues.at(1).getAsPointerValue()), str);
+			return DynamicValue::getIntValue(APInt(32, str.size()));
+		}
+		case ExternalCallType::FGETC:
+		case ExternalCallType::GETCHAR:
+		{
+			auto stream = (itr->second == ExternalCallType::GETCHAR) ? 0 : getStreamNumber(argValues.at(0).getAsPointerValue());
+			auto lock = std::lock_guard<std::mutex>(hostMutex);
+			return DynamicValue::getIntValue(APInt(32, stdio.getChar(stream), true));
+		}
+		case ExternalCallType::FPUTC:
+		{
+			auto ch = static_cast<char>(argValues.at(0).getAsIntValue().getInt().getZExtValue());
+			writeToStream(getStreamNumber(argValues.at(1).getAsPointerValue()), StringRef(&ch, 1));
+			return DynamicValue::getIntValue(APInt(32, static_cast<unsigned char>(ch)));
+		}
+		case ExternalCallType::FFLUSH:
+		{
+			// fflush(NULL) flushes every stream
+			auto& filePtr = argValues.at(0).getAsPointerValue();
+			auto flushAll = (filePtr.getAddressSpace() == PointerAddressSpace::GLOBAL_SPACE && filePtr.getAddress() == 0);
+			auto stream = flushAll ? 0 : getStreamNumber(filePtr);
+			auto lock = std::lock_guard<std::mutex>(hostMutex);
+			return DynamicValue::getIntValue(APInt(32, flushAll ? stdio.flushAll() : stdio.flush(stream), true));
+		}
+		case ExternalCallType::FILENO:
+		{
+			auto stream = getStreamNumber(argValues.at(0).getAsPointerValue());
+			auto lock = std::lock_guard<std::mutex>(hostMutex);
+			return DynamicValue::getIntValue(APInt(32, stdio.getFd(stream), true));
+		}
+		case ExternalCallType::OPEN:
+		{
+			// int open(const char* path, int flags, ...). Guest file descriptors are host file descriptors
+			auto len = uint64_t(0);
+			auto path = getGuestString(argValues.at(0).getAsPointerValue(), len);
+			auto flags = int(argValues.at(1).getAsIntValue().getInt().getSExtValue());
+			auto mode = (argValues.size() > 2) ? unsigned(argValues[2].getAsIntValue().getInt().getZExtValue()) : 0u;
+			return DynamicValue::getIntValue(APInt(32, ::open(path, flags, mode), true));
+		}
+		case ExternalCallType::CLOSE:
+			return DynamicValue::getIntValue(APInt(32, ::close(argValues.at(0).getAsIntValue().getInt().getSExtValue()), true));
+		case ExternalCallType::MMAP:
+		{
+			auto lock = std::lock_guard<std::mutex>(hostMutex);
+			return mapGuestMemory(argValues);
+		}
+		case ExternalCallType::MUNMAP:
+		{
+			auto lock = std::lock_guard<std::mutex>(hostMutex);
+			return DynamicValue::getIntValue(APInt(32, unmapGuestMemory(argValues.at(0).getAsPointerValue(), argValues.at(1).getAsIntValue().getInt().getZExtValue()), true));
 		}
 		case ExternalCallType::MEMCPY:
+		case ExternalCallType::MEMMOVE:
 		{
 			assert(argValues.size() >= 3);
 
@@ -107,9 +555,12 @@ DynamicValue Interpreter::callExternalFunction(const CallBase* cs, const llvm::F
 			auto& srcPtr = argValues.at(1).getAsPointerValue();
 			auto size = argValues.at(2).getAsIntValue().getInt().getZExtValue();
 
-			std::memcpy(getRawPointer(destPtr), getRawPointer(srcPtr), size);
-			
-			return DynamicValue::getUndefValue();
+			auto src = getCheckedPointer(srcPtr, size);
+			getCheckedPointer(destPtr, size);
+			// memmove() must handle overlapping ranges, and memcpy() gets the same treatment since std::memmove costs next to nothing extra
+			std::memmove(getWritablePointer(destPtr, size), src, size);
+
+			return argValues.at(0);
 		}
 		case ExternalCallType::MEMSET:
 		{
@@ -118,18 +569,92 @@ DynamicValue Interpreter::callExternalFunction(const CallBase* cs, const llvm::F
 			auto& destPtr = argValues.at(0).getAsPointerValue();
 			auto fillInt = argValues.at(1).getAsIntValue().getInt().getZExtValue();
 			auto size = argValues.at(2).getAsIntValue().getInt().getZExtValue();
-			
-			std::memset(getRawPointer(destPtr), fillInt, size);
 
+			getCheckedPointer(destPtr, size);
+			std::memset(getWritablePointer(destPtr, size), fillInt, size);
+
+			return argValues.at(0);
+		}
+		case ExternalCallType::MEMCMP:
+		{
+			auto size = argValues.at(2).getAsIntValue().getInt().getZExtValue();
+			auto lhs = getCheckedPointer(argValues.at(0).getAsPointerValue(), size);
+			auto rhs = getCheckedPointer(argValues.at(1).getAsPointerValue(), size);
+			return DynamicValue::getIntValue(APInt(32, size == 0 ? 0 : std::memcmp(lhs, rhs, size), true));
+		}
+		case ExternalCallType::MEMCHR:
+		{
+			auto& strPtr = argValues.at(0).getAsPointerValue();
+			auto size = argValues.at(2).getAsIntValue().getInt().getZExtValue();
+			auto str = getCheckedPointer(strPtr, size);
+			auto found = (size == 0) ? nullptr : static_cast<const char*>(std::memchr(str, int(argValues.at(1).getAsIntValue().getInt().getZExtValue()), size));
+			return offsetGuestPointer(strPtr, str, found);
+		}
+		case ExternalCallType::STRLEN:
+		{
+			auto len = uint64_t(0);
+			getGuestString(argValues.at(0).getAsPointerValue(), len);
+			return DynamicValue::getIntValue(APInt(getDataLayout().getPointerSizeInBits(), len));
+		}
+		case ExternalCallType::STRCMP:
+		case ExternalCallType::STRNCMP:
+		{
+			// Both strings are only looked at up to their terminator, or up to n for strncmp()
+			auto maxLen = (itr->second == ExternalCallType::STRNCMP) ? argValues.at(2).getAsIntValue().getInt().getZExtValue() : UINT64_MAX;
+			auto lhsLen = uint64_t(0), rhsLen = uint64_t(0);
+			auto lhs = getGuestString(argValues.at(0).getAsPointerValue(), lhsLen, maxLen);
+			auto rhs = getGuestString(argValues.at(1).getAsPointerValue(), rhsLen, maxLen);
+			return DynamicValue::getIntValue(APInt(32, std::strncmp(lhs, rhs, maxLen), true));
+		}
+		case ExternalCallType::STRCHR:
+		{
+			auto& strPtr = argValues.at(0).getAsPointerValue();
+			auto len = uint64_t(0);
+			auto str = getGuestString(strPtr, len);
+			// The terminator counts as part of the string
+			auto found = static_cast<const char*>(std::memchr(str, static_cast<char>(argValues.at(1).getAsIntValue().getInt().getZExtValue()), len + 1));
+			return offsetGuestPointer(strPtr, str, found);
+		}
+		case ExternalCallType::STRCPY:
+		{
+			auto& destPtr = argValues.at(0).getAsPointerValue();
+			auto len = uint64_t(0);
+			auto src = getGuestString(argValues.at(1).getAsPointerValue(), len);
+			getCheckedPointer(destPtr, len + 1);
+			std::memcpy(getWritablePointer(destPtr, len + 1), src, len + 1);
+			return argValues.at(0);
+		}
+		case ExternalCallType::STRSTR:
+		{
+			auto& strPtr = argValues.at(0).getAsPointerValue();
+			auto strLen = uint64_t(0), needleLen = uint64_t(0);
+			auto str = getGuestString(strPtr, strLen);
+			auto needle = getGuestString(argValues.at(1).getAsPointerValue(), needleLen);
+			return offsetGuestPointer(strPtr, str, std::strstr(str, needle));
+		}
+		case ExternalCallType::QSORT:
+		{
+			// void qsort(void* base, size_t n, size_t size, int (*cmp)(const void*, const void*))
+			auto count = argValues.at(1).getAsIntValue().getInt().getZExtValue();
+			auto size = argValues.at(2).getAsIntValue().getInt().getZExtValue();
+			sortGuestArray(argValues.at(0).getAsPointerValue(), count, size, argValues.at(3).getAsPointerValue());
 			return DynamicValue::getUndefValue();
 		}
+		case ExternalCallType::BSEARCH:
+		{
+			// void* bsearch(const void* key, const void* base, size_t n, size_t size, int (*cmp)(const void*, const void*))
+			auto count = argValues.at(2).getAsIntValue().getInt().getZExtValue();
+			auto size = argValues.at(3).getAsIntValue().getInt().getZExtValue();
+			return searchGuestArray(argValues.at(0).getAsPointerValue(), argValues.at(1).getAsPointerValue(), count, size, argValues.at(4).getAsPointerValue());
+		}
 		case ExternalCallType::MALLOC:
 		{
 			assert(argValues.size() >= 1);
 
 			auto mallocSize = argValues.at(0).getAsIntValue().getInt().getZExtValue();
 
-			auto retAddr = heapMem.allocate(mallocSize);
+			auto lock = std::lock_guard<std::mutex>(hostMutex);
+			auto retAddr = allocateHeapMem(mallocSize);
 
 			return DynamicValue::getPointerValue(PointerAddressSpace::HEAP_SPACE, retAddr);
 		}
@@ -144,6 +669,38 @@ DynamicValue Interpreter::callExternalFunction(const CallBase* cs, const llvm::F
 			heapMem.free(ptrVal.getAddress());
 			return DynamicValue::getUndefValue();
 		}
+		case ExternalCallType::PTHREAD_CREATE:
+			return createGuestThread(argValues);
+		case ExternalCallType::PTHREAD_JOIN:
+			return joinGuestThread(argValues);
+		case ExternalCallType::PTHREAD_DETACH:
+			return detachGuestThread(argValues);
+		case ExternalCallType::PTHREAD_SELF:
+			return DynamicValue::getIntValue(APInt(64, currentThread->index));
+		case ExternalCallType::PTHREAD_EXIT:
+			throw GuestThreadExit { argValues.at(0) };
+		case ExternalCallType::PTHREAD_MUTEX_INIT:
+			return errorCode(pthread_mutex_init(mutexArg(0), static_cast<const pthread_mutexattr_t*>(optionalArg(1, sizeof(pthread_mutexattr_t)))));
+		case ExternalCallType::PTHREAD_MUTEX_DESTROY:
+			return errorCode(pthread_mutex_destroy(mutexArg(0)));
+		case ExternalCallType::PTHREAD_MUTEX_LOCK:
+			return errorCode(pthread_mutex_lock(mutexArg(0)));
+		case ExternalCallType::PTHREAD_MUTEX_TRYLOCK:
+			return errorCode(pthread_mutex_trylock(mutexArg(0)));
+		case ExternalCallType::PTHREAD_MUTEX_UNLOCK:
+			return errorCode(pthread_mutex_unlock(mutexArg(0)));
+		case ExternalCallType::PTHREAD_COND_INIT:
+			return errorCode(pthread_cond_init(condArg(0), static_cast<const pthread_condattr_t*>(optionalArg(1, sizeof(pthread_condattr_t)))));
+		case ExternalCallType::PTHREAD_COND_DESTROY:
+			return errorCode(pthread_cond_destroy(condArg(0)));
+		case ExternalCallType::PTHREAD_COND_WAIT:
+			return errorCode(pthread_cond_wait(condArg(0), mutexArg(1)));
+		case ExternalCallType::PTHREAD_COND_TIMEDWAIT:
+			return errorCode(pthread_cond_timedwait(condArg(0), mutexArg(1), static_cast<const timespec*>(optionalArg(2, sizeof(timespec)))));
+		case ExternalCallType::PTHREAD_COND_SIGNAL:
+			return errorCode(pthread_cond_signal(condArg(0)));
+		case ExternalCallType::PTHREAD_COND_BROADCAST:
+			return errorCode(pthread_cond_broadcast(condArg(0)));
 	}
 
 	llvm_unreachable("Should not reach here");
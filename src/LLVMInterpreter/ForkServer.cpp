@@ -0,0 +1,231 @@
+#include "ForkServer.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace llvm_interpreter;
+
+// This file contains the fork server, which runs the main function of an already prepared module in a forked child for each request, and its client
+
+namespace
+{
+
+const int NUM_PASSED_FDS = 3;
+
+// A server that goes away must not kill the client with SIGPIPE. Linux has a flag for this on each send, Darwin an option on the socket
+#ifdef MSG_NOSIGNAL
+const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+const int SEND_FLAGS = 0;
+#endif
+
+std::runtime_error makeSocketError(const std::string& what)
+{
+	return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+// SOCK_CLOEXEC, accept4() and MSG_CMSG_CLOEXEC are not available everywhere, so descriptors are marked close-on-exec after they are created
+int setCloseOnExec(int fd)
+{
+	if (fd >= 0)
+		::fcntl(fd, F_SETFD, FD_CLOEXEC);
+	return fd;
+}
+
+sockaddr_un makeSocketAddress(const std::string& socketPath)
+{
+	auto addr = sockaddr_un();
+	if (socketPath.size() >= sizeof(addr.sun_path))
+		throw std::runtime_error("Fork server socket path is too long: " + socketPath);
+	addr.sun_family = AF_UNIX;
+	std::memcpy(addr.sun_path, socketPath.c_str(), socketPath.size() + 1);
+	return addr;
+}
+
+// Read or write exactly (size) bytes. Returns false if the connection is closed first
+bool readFully(int fd, void* buf, size_t size)
+{
+	auto done = size_t(0);
+	while (done < size)
+	{
+		auto got = ::read(fd, static_cast<char*>(buf) + done, size - done);
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got <= 0)
+			return false;
+		done += got;
+	}
+	return true;
+}
+
+bool writeFully(int fd, const void* buf, size_t size)
+{
+	auto done = size_t(0);
+	while (done < size)
+	{
+		auto put = ::write(fd, static_cast<const char*>(buf) + done, size - done);
+		if (put < 0 && errno == EINTR)
+			continue;
+		if (put <= 0)
+			return false;
+		done += put;
+	}
+	return true;
+}
+
+// Receive the length of a request together with the descriptors that come with it
+bool receiveRequestHeader(int conn, uint32_t& payloadSize, int (&fds)[NUM_PASSED_FDS])
+{
+	char control[CMSG_SPACE(sizeof(fds))];
+	auto iov = iovec { &payloadSize, sizeof(payloadSize) };
+	auto msg = msghdr();
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	auto got = ssize_t(0);
+	do
+		got = ::recvmsg(conn, &msg, 0);
+	while (got < 0 && errno == EINTR);
+	if (got <= 0)
+		return false;
+
+	auto cmsg = CMSG_FIRSTHDR(&msg);
+	if (cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+		return false;
+	std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+	for (auto fd: fds)
+		setCloseOnExec(fd);
+	return readFully(conn, reinterpret_cast<char*>(&payloadSize) + got, sizeof(payloadSize) - got);
+}
+
+// The child side of a connection. Never returns
+[[noreturn]] void serveRequest(int conn, const std::function<int(const std::vector<std::string>&)>& runRequest)
+{
+	auto payloadSize = uint32_t(0);
+	int fds[NUM_PASSED_FDS];
+	if (!receiveRequestHeader(conn, payloadSize, fds))
+		_exit(1);
+	auto payload = std::string(payloadSize, '\0');
+	if (!readFully(conn, &payload[0], payloadSize))
+		_exit(1);
+
+	auto args = std::vector<std::string>();
+	for (auto pos = size_t(0); pos < payload.size(); )
+	{
+		auto end = payload.find('\0', pos);
+		if (end == std::string::npos)
+			end = payload.size();
+		args.push_back(payload.substr(pos, end - pos));
+		pos = end + 1;
+	}
+
+	for (auto i = 0; i < NUM_PASSED_FDS; ++i)
+	{
+		::dup2(fds[i], i);
+		::close(fds[i]);
+	}
+
+	auto result = int32_t(runRequest(args));
+	writeFully(conn, &result, sizeof(result));
+	_exit(0);
+}
+
+}
+
+void llvm_interpreter::runForkServer(const std::string& socketPath, const std::function<int(const std::vector<std::string>&)>& runRequest)
+{
+	auto addr = makeSocketAddress(socketPath);
+	auto listenFd = setCloseOnExec(::socket(AF_UNIX, SOCK_STREAM, 0));
+	if (listenFd < 0)
+		throw makeSocketError("Cannot create fork server socket");
+	// A socket left behind by an earlier server is replaced, anything else at that path is not
+	struct stat st;
+	if (::lstat(socketPath.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+		::unlink(socketPath.c_str());
+	if (::bind(listenFd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(listenFd, SOMAXCONN) != 0)
+		throw makeSocketError("Cannot listen on " + socketPath);
+
+	// Children are never waited for, and ignoring SIGCHLD keeps them from turning into zombies
+	std::signal(SIGCHLD, SIG_IGN);
+	while (true)
+	{
+		auto conn = setCloseOnExec(::accept(listenFd, nullptr, nullptr));
+		if (conn < 0)
+		{
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			throw makeSocketError("Fork server cannot accept a connection");
+		}
+
+		auto pid = ::fork();
+		if (pid == 0)
+		{
+			::close(listenFd);
+			std::signal(SIGCHLD, SIG_DFL);
+			serveRequest(conn, runRequest);
+		}
+		::close(conn);
+		if (pid < 0)
+			throw makeSocketError("Fork server cannot fork");
+	}
+}
+
+int llvm_interpreter::runForkClient(const std::string& socketPath, const std::vector<std::string>& args)
+{
+	auto addr = makeSocketAddress(socketPath);
+	auto conn = setCloseOnExec(::socket(AF_UNIX, SOCK_STREAM, 0));
+	if (conn < 0)
+		throw makeSocketError("Cannot create fork client socket");
+#ifdef SO_NOSIGPIPE
+	auto noSigPipe = 1;
+	::setsockopt(conn, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+#endif
+	if (::connect(conn, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0)
+	{
+		auto err = makeSocketError("Cannot connect to the fork server at " + socketPath);
+		::close(conn);
+		throw err;
+	}
+
+	auto payload = std::string();
+	for (auto& arg: args)
+		payload.append(arg.c_str(), arg.size() + 1);
+	auto payloadSize = uint32_t(payload.size());
+
+	int fds[NUM_PASSED_FDS] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+	char control[CMSG_SPACE(sizeof(fds))];
+	auto iov = iovec { &payloadSize, sizeof(payloadSize) };
+	auto msg = msghdr();
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	auto cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	auto sent = ssize_t(0);
+	do
+		sent = ::sendmsg(conn, &msg, SEND_FLAGS);
+	while (sent < 0 && errno == EINTR);
+	auto result = int32_t(0);
+	auto ok = sent > 0
+		&& writeFully(conn, reinterpret_cast<const char*>(&payloadSize) + sent, sizeof(payloadSize) - sent)
+		&& writeFully(conn, payload.data(), payload.size())
+		&& readFully(conn, &result, sizeof(result));
+	::close(conn);
+	if (!ok)
+		throw std::runtime_error("The fork server did not return a result");
+	return result;
+}
@@ -0,0 +1,319 @@
+#include "Interpreter.h"
+
+#include "llvm/IR/Function.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace llvm;
+using namespace llvm_interpreter;
+
+// This file contains the green-thread scheduler. Guest threads are multiplexed on the host thread that runs the main thread, and switch only at basic block boundaries or when they block, under a seeded scheduler, so that a run can be reproduced exactly. Calls are evaluated recursively on the host stack, so every green thread runs on a host stack of its own, which is reserved up front and only committed as it is touched
+
+namespace
+{
+
+const size_t GREEN_STACK_SIZE = size_t(8) << 20;
+
+}
+
+Interpreter::GuestThread::~GuestThread()
+{
+	if (hostStack != nullptr)
+		::munmap(hostStack, GREEN_STACK_SIZE);
+}
+
+void Interpreter::setGreenThreads(uint64_t seed, unsigned quantum)
+{
+	if (multiThreaded || greenThreadsStarted)
+		throw std::runtime_error("setGreenThreads() called after guest threads have been created");
+
+	greenThreads = true;
+	greenRng.seed(seed);
+	greenQuantum = std::max(quantum, 1u);
+	greenSliceLeft = greenQuantum;
+	greenRunnable.assign(1, threads[0].get());
+}
+
+void Interpreter::greenThreadEntry()
+{
+	auto thread = currentThread;
+	auto interp = thread->owner;
+	interp->reclaimGreenZombie();
+
+	try
+	{
+		thread->retVal = interp->runThreadStart(thread->startFn, std::move(thread->startArg));
+	}
+	catch (...)
+	{
+		// Unwinding must not leave this host stack, so the exception is handed to the main thread
+		if (interp->greenFailure == nullptr)
+			interp->greenFailure = std::current_exception();
+		while (!thread->stack.empty())
+			interp->popStack();
+	}
+	interp->finishGreenThread(thread);
+}
+
+void Interpreter::startGreenThread(GuestThread* thread)
+{
+	auto stack = ::mmap(nullptr, GREEN_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+	if (stack == MAP_FAILED)
+		throw std::runtime_error("Cannot allocate the host stack of a green thread");
+	thread->hostStack = stack;
+	// A guard page turns a host stack overflow into a crash instead of memory corruption
+	::mprotect(stack, ::sysconf(_SC_PAGESIZE), PROT_NONE);
+
+	::getcontext(&thread->context);
+	thread->context.uc_stack.ss_sp = stack;
+	thread->context.uc_stack.ss_size = GREEN_STACK_SIZE;
+	thread->context.uc_link = nullptr;
+	::makecontext(&thread->context, &Interpreter::greenThreadEntry, 0);
+
+	greenThreadsStarted = true;
+	greenRunnable.push_back(thread);
+}
+
+void Interpreter::finishGreenThread(GuestThread* thread)
+{
+	thread->finished = true;
+	if (thread->joiner != nullptr)
+		wakeGreenThread(thread->joiner);
+	greenRunnable.erase(std::find(greenRunnable.begin(), greenRunnable.end(), thread));
+
+	// This is still running on the host stack of the thread, so it can only be unmapped by whoever runs next
+	greenZombie = thread;
+	switchGreenThread(greenFailure != nullptr ? resumeMainThread() : pickGreenThread());
+	llvm_unreachable("A finished green thread was switched back to");
+}
+
+void Interpreter::switchGreenThread(GuestThread* next)
+{
+	greenSliceLeft = greenQuantum;
+	auto prev = currentThread;
+	if (next != prev)
+	{
+		currentThread = next;
+		::swapcontext(&prev->context, &next->context);
+		reclaimGreenZombie();
+	}
+
+	if (currentThread == threads[0].get() && greenFailure != nullptr)
+	{
+		auto failure = greenFailure;
+		greenFailure = nullptr;
+		std::rethrow_exception(failure);
+	}
+}
+
+void Interpreter::yieldGreenThread()
+{
+	greenSliceLeft = greenQuantum;
+	if (greenRunnable.size() > 1)
+		switchGreenThread(greenRunnable[greenRng() % greenRunnable.size()]);
+}
+
+void Interpreter::blockGreenThread(GreenWait wait)
+{
+	auto thread = currentThread;
+	thread->wait = wait;
+	greenRunnable.erase(std::find(greenRunnable.begin(), greenRunnable.end(), thread));
+	switchGreenThread(pickGreenThread());
+}
+
+void Interpreter::wakeGreenThread(GuestThread* thread)
+{
+	thread->wait = GreenWait::NONE;
+	greenRunnable.push_back(thread);
+}
+
+Interpreter::GuestThread* Interpreter::pickGreenThread()
+{
+	// Timed waits do not look at the clock, which would make runs irreproducible. They time out when nothing else can run, earliest waiter first
+	while (greenRunnable.empty())
+	{
+		auto oldest = greenSyncObjects.end();
+		auto oldestWaiter = std::deque<GuestThread*>::iterator();
+		for (auto itr = greenSyncObjects.begin(); itr != greenSyncObjects.end(); ++itr)
+		{
+			auto& waiters = itr->second.waiters;
+			for (auto waiter = waiters.begin(); waiter != waiters.end(); ++waiter)
+			{
+				if ((*waiter)->wait != GreenWait::COND || !(*waiter)->timedWait)
+					continue;
+				if (oldest == greenSyncObjects.end() || (*waiter)->waitTicket < (*oldestWaiter)->waitTicket)
+				{
+					oldest = itr;
+					oldestWaiter = waiter;
+				}
+			}
+		}
+		if (oldest == greenSyncObjects.end())
+			break;
+
+		auto thread = *oldestWaiter;
+		oldest->second.waiters.erase(oldestWaiter);
+		if (oldest->second.waiters.empty())
+			greenSyncObjects.erase(oldest);
+		thread->waitResult = ETIMEDOUT;
+		reacquireGreenMutex(thread);
+	}
+
+	if (!greenRunnable.empty())
+		return greenRunnable[greenRng() % greenRunnable.size()];
+
+	auto mainThread = threads[0].get();
+	if (mainThread->wait == GreenWait::DRAIN)
+		return resumeMainThread();
+
+	auto deadlock = std::runtime_error("Deadlock: every guest thread is blocked");
+	if (currentThread == mainThread)
+	{
+		wakeGreenThread(mainThread);
+		throw deadlock;
+	}
+	greenFailure = std::make_exception_ptr(deadlock);
+	return resumeMainThread();
+}
+
+Interpreter::GuestThread* Interpreter::resumeMainThread()
+{
+	auto mainThread = threads[0].get();
+	if (mainThread->wait != GreenWait::NONE)
+		wakeGreenThread(mainThread);
+	return mainThread;
+}
+
+void Interpreter::reclaimGreenZombie()
+{
+	if (greenZombie == nullptr)
+		return;
+
+	auto thread = greenZombie;
+	greenZombie = nullptr;
+	::munmap(thread->hostStack, GREEN_STACK_SIZE);
+	thread->hostStack = nullptr;
+	if (thread->detached)
+		threads[thread->index].reset();
+}
+
+void Interpreter::drainGreenThreads()
+{
+	// Like a process that returns from main, keep running the other threads until they are all done. Threads that are still blocked once nothing can run are abandoned
+	auto threadScope = MainThreadScope(*this);
+	auto mainThread = threads[0].get();
+	try
+	{
+		while (std::any_of(greenRunnable.begin(), greenRunnable.end(), [mainThread] (const GuestThread* t) { return t != mainThread; }))
+			blockGreenThread(GreenWait::DRAIN);
+	}
+	catch (const std::exception& e)
+	{
+		errs() << "Guest thread failed: " << e.what() << "\n";
+	}
+}
+
+void Interpreter::reacquireGreenMutex(GuestThread* thread)
+{
+	auto& mutex = greenSyncObjects[thread->condMutex];
+	if (mutex.owner == nullptr)
+	{
+		mutex.owner = thread;
+		wakeGreenThread(thread);
+	}
+	else
+	{
+		thread->wait = GreenWait::MUTEX;
+		mutex.waiters.push_back(thread);
+	}
+}
+
+int Interpreter::resetGreenSyncObject(const PointerValue& ptr)
+{
+	auto itr = greenSyncObjects.find(MemorySection::encodePointer(ptr));
+	if (itr == greenSyncObjects.end())
+		return 0;
+	if (itr->second.owner != nullptr || !itr->second.waiters.empty())
+		return EBUSY;
+	greenSyncObjects.erase(itr);
+	return 0;
+}
+
+int Interpreter::lockGreenMutex(const PointerValue& mutexPtr, bool block)
+{
+	// Mutex attributes are not looked at: every mutex is an error-checking one
+	auto& mutex = greenSyncObjects[MemorySection::encodePointer(mutexPtr)];
+	if (mutex.owner == nullptr)
+	{
+		mutex.owner = currentThread;
+		return 0;
+	}
+	if (mutex.owner == currentThread)
+		return block ? EDEADLK : EBUSY;
+	if (!block)
+		return EBUSY;
+
+	// The unlocking thread hands the mutex over before waking us up
+	mutex.waiters.push_back(currentThread);
+	blockGreenThread(GreenWait::MUTEX);
+	return 0;
+}
+
+int Interpreter::unlockGreenMutex(const PointerValue& mutexPtr)
+{
+	auto itr = greenSyncObjects.find(MemorySection::encodePointer(mutexPtr));
+	if (itr == greenSyncObjects.end() || itr->second.owner != currentThread)
+		return EPERM;
+
+	auto& mutex = itr->second;
+	if (mutex.waiters.empty())
+	{
+		greenSyncObjects.erase(itr);
+		return 0;
+	}
+	mutex.owner = mutex.waiters.front();
+	mutex.waiters.pop_front();
+	wakeGreenThread(mutex.owner);
+	return 0;
+}
+
+int Interpreter::waitGreenCond(const PointerValue& condPtr, const PointerValue& mutexPtr, bool timed)
+{
+	auto err = unlockGreenMutex(mutexPtr);
+	if (err != 0)
+		return err;
+
+	auto thread = currentThread;
+	thread->condMutex = MemorySection::encodePointer(mutexPtr);
+	thread->timedWait = timed;
+	thread->waitTicket = greenWaitTickets++;
+	thread->waitResult = 0;
+	greenSyncObjects[MemorySection::encodePointer(condPtr)].waiters.push_back(thread);
+	// By the time we run again, the mutex is ours
+	blockGreenThread(GreenWait::COND);
+	return thread->waitResult;
+}
+
+int Interpreter::signalGreenCond(const PointerValue& condPtr, bool broadcast)
+{
+	auto itr = greenSyncObjects.find(MemorySection::encodePointer(condPtr));
+	if (itr == greenSyncObjects.end())
+		return 0;
+
+	auto& waiters = itr->second.waiters;
+	auto count = broadcast ? waiters.size() : std::min<size_t>(waiters.size(), 1);
+	for (auto i = size_t(0); i < count; ++i)
+	{
+		auto thread = waiters.front();
+		waiters.pop_front();
+		reacquireGreenMutex(thread);
+	}
+	if (waiters.empty())
+		greenSyncObjects.erase(itr);
+	return 0;
+}
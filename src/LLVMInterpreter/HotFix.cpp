@@ -5,6 +5,8 @@
 #include "llvm/IR/Type.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/DataLayout.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
 
 #include <cstring>
 #include <cassert>
@@ -12,7 +14,7 @@
 using namespace llvm;
 using namespace llvm_interpreter;
 
-HotFix::HotFix() : context(std::make_unique<LLVMContext>()), initialized(false) {
+HotFix::HotFix() : context(std::make_unique<LLVMContext>()), initialized(false), lazyGlobals(false), prepassLevel(PrepassLevel::NONE), inlineThreshold(0) {
 }
 
 HotFix::~HotFix() {
@@ -21,6 +23,16 @@ HotFix::~HotFix() {
     context.reset();
 }
 
+void HotFix::createInterpreter(bool prepared) {
+    if (!prepared)
+        runPrepasses(*module, prepassLevel);
+    interpreter = std::make_unique<Interpreter>(module.get());
+    interpreter->setLazyGlobals(lazyGlobals);
+    interpreter->setInlineThreshold(inlineThreshold);
+    interpreter->evaluateGlobals();
+    initialized = true;
+}
+
 bool HotFix::loadBitcode(const char* bitcodeData, size_t bitcodeSize) {
     if (!bitcodeData || bitcodeSize == 0) {
         errs() << "HotFix: Invalid bitcode data\n";
@@ -41,24 +53,21 @@ bool HotFix::loadBitcode(const char* bitcodeData, size_t bitcodeSize) {
         return false;
     }
 
-    interpreter = std::make_unique<Interpreter>(module.get());
-    interpreter->evaluateGlobals();
-    initialized = true;
+    createInterpreter();
     
     return true;
 }
 
 bool HotFix::loadBitcodeFromFile(const std::string& filename) {
     SMDiagnostic err;
-    module = parseIRFile(filename, err, *context);
+    // A cached module reads each function body on its first call, like the driver does
+    module = moduleCache ? moduleCache->loadModule(filename, prepassLevel, *context, err) : parseIRFile(filename, err, *context);
     if (!module) {
         err.print("HotFix", errs());
         return false;
     }
 
-    interpreter = std::make_unique<Interpreter>(module.get());
-    interpreter->evaluateGlobals();
-    initialized = true;
+    createInterpreter(moduleCache != nullptr);
     
     return true;
 }
@@ -72,13 +81,69 @@ bool HotFix::loadBitcodeFromString(const std::string& irString) {
         return false;
     }
 
-    interpreter = std::make_unique<Interpreter>(module.get());
-    interpreter->evaluateGlobals();
-    initialized = true;
+    createInterpreter();
     
     return true;
 }
 
+bool HotFix::replaceFunctions(const std::string& irString) {
+    if (!initialized || !interpreter) {
+        errs() << "HotFix: Not initialized. Call loadBitcode first.\n";
+        return false;
+    }
+
+    SMDiagnostic err;
+    auto memBuffer = MemoryBuffer::getMemBufferCopy(irString, "hotfix_patch");
+    auto patch = parseIR(memBuffer->getMemBufferRef(), err, *context);
+    if (!patch) {
+        err.print("HotFix", errs());
+        return false;
+    }
+    runPrepasses(*patch, prepassLevel);
+
+    // Everything the patch refers to is mapped to the value of the same name in the loaded module, and checked before anything is changed
+    ValueToValueMapTy valueMap;
+    auto replaced = std::vector<std::pair<Function*, Function*>>();
+    for (auto& gv : patch->global_values()) {
+        auto target = module->getNamedValue(gv.getName());
+        if (!target || target->getValueType() != gv.getValueType() || isa<Function>(target) != isa<Function>(gv)) {
+            errs() << "HotFix: The loaded module has no " << (isa<Function>(gv) ? "function" : "global") << " @" << gv.getName() << " of the type the patch uses\n";
+            return false;
+        }
+        valueMap[&gv] = target;
+        auto f = dyn_cast<Function>(&gv);
+        if (f && !f->isDeclaration())
+            replaced.emplace_back(cast<Function>(target), f);
+    }
+    for (auto& entry : replaced) {
+        if (auto materializeErr = entry.first->materialize()) {
+            errs() << "HotFix: " << toString(std::move(materializeErr)) << "\n";
+            return false;
+        }
+    }
+
+    // Executable bodies and execution plans of the old bodies are rebuilt on their next call
+    try {
+        for (auto& entry : replaced)
+            interpreter->invalidateFunction(entry.first);
+    } catch (const std::runtime_error& e) {
+        errs() << "HotFix: " << e.what() << "\n";
+        return false;
+    }
+
+    for (auto& entry : replaced) {
+        auto target = entry.first;
+        auto newBody = entry.second;
+        target->deleteBody();
+        auto targetArg = target->arg_begin();
+        for (auto& arg : newBody->args())
+            valueMap[&arg] = &*targetArg++;
+        auto returns = SmallVector<ReturnInst*, 8>();
+        CloneFunctionInto(target, newBody, valueMap, CloneFunctionChangeType::DifferentModule, returns);
+    }
+    return true;
+}
+
 DynamicValue HotFix::convertToDynamicValue(const void* value, const TypeInfo& typeInfo) {
     if (!value) {
         return DynamicValue::getUndefValue();
@@ -215,8 +280,14 @@ bool HotFix::executeFunction(
         dynamicArgs.push_back(convertToDynamicValue(args[i], argTypes[i]));
     }
 
-    // Execute function
-    auto retVal = interpreter->runFunction(func, dynamicArgs);
+    // Execute function. A guest fault fails the call; the interpreter has unwound it and can be used again
+    auto retVal = DynamicValue::getUndefValue();
+    try {
+        retVal = interpreter->runFunction(func, dynamicArgs);
+    } catch (const std::exception& e) {
+        errs() << "HotFix: " << e.what() << "\n";
+        return false;
+    }
 
     // Convert return value
     if (returnType && returnValue) {
@@ -257,3 +328,31 @@ void HotFix::unregisterExternalFunction(const std::string& name) {
     interpreter->unregisterExternalFunction(name);
 }
 
+
+bool HotFix::takeSnapshot() {
+    if (!initialized || !interpreter) {
+        errs() << "HotFix: Not initialized. Call loadBitcode first.\n";
+        return false;
+    }
+    try {
+        interpreter->takeSnapshot();
+    } catch (const std::runtime_error& e) {
+        errs() << "HotFix: " << e.what() << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool HotFix::restoreSnapshot() {
+    if (!initialized || !interpreter) {
+        errs() << "HotFix: Not initialized. Call loadBitcode first.\n";
+        return false;
+    }
+    try {
+        interpreter->restoreSnapshot();
+    } catch (const std::runtime_error& e) {
+        errs() << "HotFix: " << e.what() << "\n";
+        return false;
+    }
+    return true;
+}
@@ -71,6 +71,16 @@ std::string StructValue::toString() const
 	return ss.str();
 }
 
+std::string VectorValue::toString() const
+{
+	std::ostringstream ss;
+	ss << "< ";
+	for (auto i = 0u; i < numLanes; ++i)
+		ss << getLane(i).toString() << " ";
+	ss << ">";
+	return ss.str();
+}
+
 std::string DynamicValue::toString() const
 {
 	switch (type)
@@ -85,6 +95,8 @@ std::string DynamicValue::toString() const
 			return data.arrayVal.toString();
 		case DynamicValueType::STRUCT_VALUE:
 			return data.structVal.toString();
+		case DynamicValueType::VECTOR_VALUE:
+			return data.vectorVal.toString();
 		case DynamicValueType::UNDEF_VALUE:
 			return "<undef>";
 	}
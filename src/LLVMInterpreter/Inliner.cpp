@@ -0,0 +1,164 @@
+#include "Interpreter.h"
+
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+#include <stdexcept>
+
+using namespace llvm;
+using namespace llvm_interpreter;
+
+// This file contains the call-time inliner. The first time a function is called, small callees are spliced into a private copy of its body, and that copy is what gets executed from then on. The copies live in a module owned by the module image, so the module being interpreted is never modified. The bodies of a module read lazily from the module cache are read here as well, on the first call
+
+bool Interpreter::isInlineCandidate(const Function* callee) const
+{
+	if (callee->isDeclaration() || callee->isVarArg())
+		return false;
+
+	auto size = 0u;
+	for (auto const& bb: *callee)
+	{
+		for (auto const& inst: bb)
+		{
+			if (isa<DbgInfoIntrinsic>(inst))
+				continue;
+			if (++size > image->inlineThreshold)
+				return false;
+
+			// Dynamic allocas would need stacksave/stackrestore around the inlined body
+			if (auto allocaInst = dyn_cast<AllocaInst>(&inst))
+			{
+				if (!allocaInst->isStaticAlloca())
+					return false;
+			}
+			else if (auto cs = dyn_cast<CallBase>(&inst))
+			{
+				if (cs->getCalledFunction() == callee)
+					return false;
+			}
+			else if (isa<IndirectBrInst>(inst))
+				return false;
+		}
+	}
+	return true;
+}
+
+const Function* Interpreter::getExecutableBody(const Function* f)
+{
+	if (image->inlineThreshold == 0 && !image->lazyBodies)
+		return f;
+
+	auto& threadBodies = currentThread->executableBodies;
+	auto threadItr = threadBodies.find(f);
+	if (threadItr != threadBodies.end())
+		return threadItr->second;
+
+	auto lock = std::lock_guard<std::mutex>(image->inlineMutex);
+	auto& executableBodies = image->executableBodies;
+	auto itr = executableBodies.find(f);
+	if (itr == executableBodies.end())
+	{
+		materializeBody(f);
+		auto body = (image->inlineThreshold == 0) ? f : createInlinedBody(f);
+		itr = executableBodies.insert(std::make_pair(f, body)).first;
+	}
+	threadBodies.insert(std::make_pair(f, itr->second));
+	return itr->second;
+}
+
+void Interpreter::materializeBody(const Function* f)
+{
+	if (!f->isMaterializable())
+		return;
+	if (auto err = module->materialize(const_cast<Function*>(f)))
+		throw std::runtime_error("Cannot read the body of " + f->getName().str() + ": " + toString(std::move(err)));
+}
+
+const Function* Interpreter::createInlinedBody(const Function* f)
+{
+	// Only the call sites of the original body are considered: callees are inlined one level deep, so recursion through several functions cannot make the copy grow without bound
+	auto callSites = std::vector<const CallInst*>();
+	for (auto const& bb: *f)
+	{
+		for (auto const& inst: bb)
+		{
+			auto callInst = dyn_cast<CallInst>(&inst);
+			if (callInst == nullptr || callInst->isMustTailCall())
+				continue;
+			auto callee = callInst->getCalledFunction();
+			if (callee == nullptr || callee == f)
+				continue;
+			materializeBody(callee);
+			if (isInlineCandidate(callee))
+				callSites.push_back(callInst);
+		}
+	}
+	if (callSites.empty())
+		return f;
+
+	auto& inlineModule = image->inlineModule;
+	if (inlineModule == nullptr)
+	{
+		inlineModule = std::make_unique<Module>("llvm-interpreter.inlined", module->getContext());
+		inlineModule->setDataLayout(module->getDataLayout());
+	}
+
+	// Globals and functions are not in the value map, so the copy keeps referring to the ones of the original module
+	auto copy = Function::Create(f->getFunctionType(), GlobalValue::ExternalLinkage, f->getName(), inlineModule.get());
+	auto valueMap = ValueToValueMapTy();
+	auto copyArgItr = copy->arg_begin();
+	for (auto const& arg: f->args())
+	{
+		copyArgItr->setName(arg.getName());
+		valueMap[&arg] = &*copyArgItr;
+		++copyArgItr;
+	}
+	auto returns = SmallVector<ReturnInst*, 8>();
+	CloneFunctionInto(copy, f, valueMap, CloneFunctionChangeType::DifferentModule, returns);
+
+	for (auto callInst: callSites)
+	{
+		auto copiedCall = cast<CallInst>(valueMap[callInst]);
+		auto callee = copiedCall->getCalledFunction();
+		auto inlineInfo = InlineFunctionInfo();
+		// Lifetime markers are no-ops for the interpreter, so don't bother inserting them
+		if (InlineFunction(*copiedCall, inlineInfo, nullptr, false).isSuccess())
+			image->inlinedInto[callee].push_back(f);
+	}
+
+	return copy;
+}
+
+void Interpreter::invalidateFunction(const Function* f)
+{
+	if (!threads[0]->stack.empty())
+		throw std::runtime_error("invalidateFunction() called while guest code is running");
+	if (multiThreaded || greenThreadsStarted)
+		throw std::runtime_error("invalidateFunction() called after guest threads have been created");
+	if (image.use_count() > 1)
+		throw std::runtime_error("invalidateFunction() called on a module image shared with other interpreters");
+
+	// Plans are keyed by blocks and instructions. Those of the old body of f are freed along with it, and new code may reuse their addresses. Plans are cheap to rebuild, so all of them go
+	auto& mainThread = *threads[0];
+	mainThread.blockPlans.clear();
+	mainThread.gepPlans.clear();
+	mainThread.formatPlans.clear();
+	auto& executableBodies = image->executableBodies;
+	executableBodies.erase(f);
+	mainThread.executableBodies.erase(f);
+	auto& inlinedInto = image->inlinedInto;
+	auto itr = inlinedInto.find(f);
+	if (itr != inlinedInto.end())
+	{
+		for (auto caller: itr->second)
+		{
+			executableBodies.erase(caller);
+			mainThread.executableBodies.erase(caller);
+		}
+		inlinedInto.erase(itr);
+	}
+}
@@ -1,79 +1,300 @@
 #include "Interpreter.h"
 
+#include "llvm/ADT/Triple.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <utility>
+
 using namespace llvm;
 using namespace llvm_interpreter;
 
-Interpreter::Interpreter(llvm::Module* m): module(m), dataLayout(m->getDataLayout())
+Interpreter::Interpreter(llvm::Module* m): Interpreter(std::make_shared<ModuleImage>(m))
 {
 }
 
-Interpreter::~Interpreter() {}
+Interpreter::Interpreter(std::shared_ptr<ModuleImage> img): image(std::move(img)), module(image->getModule()), dataLayout(module->getDataLayout()), lazyGlobals(false), fusionEnabled(true), multiThreaded(false), greenThreads(false), greenThreadsStarted(false), greenQuantum(0), greenSliceLeft(0), greenWaitTickets(0), greenZombie(nullptr), vaListKind(VaListKind::POINTER), nextReplayedCall(0)
+{
+	threads[0] = std::make_unique<GuestThread>(this, 0);
+
+	bytePtrType = Type::getInt8PtrTy(module->getContext());
+	auto triple = Triple(module->getTargetTriple());
+	if (triple.getArch() == Triple::x86_64 && !triple.isOSWindows())
+		vaListKind = VaListKind::X86_64_SYSV;
+	else if (triple.isAArch64() && !triple.isOSDarwin() && !triple.isOSWindows())
+		vaListKind = VaListKind::AARCH64;
+
+	if (image->isLoaded())
+	{
+		PointerValue::setPointerSize(getDataLayout().getPointerSize());
+		globalMem.mapCopyOnWrite(image->initialGlobals);
+	}
+}
 
-Address Interpreter::allocateStackMem(StackFrame& frame, unsigned size)
+namespace
 {
-	frame.increaseAllocationSize(size);
-	return stackMem.allocate(size);
+
+// Nobody is left to rethrow the failure of a thread that ends while the interpreter is destroyed, and a destructor must not throw, so report it instead
+void reportThreadFailure(std::exception_ptr failure)
+{
+	if (failure == nullptr)
+		return;
+	try
+	{
+		std::rethrow_exception(failure);
+	}
+	catch (const std::exception& e)
+	{
+		errs() << "A guest thread failed: " << e.what() << "\n";
+	}
+	catch (...)
+	{
+		errs() << "A guest thread failed\n";
+	}
+}
+
+}
+
+Interpreter::~Interpreter()
+{
+	// Green threads never got host threads, so run them from here instead
+	if (greenThreads)
+	{
+		drainGreenThreads();
+		return;
+	}
+
+	// Like a process that returns from main, wait for the guest threads still running. Detached threads cannot be joined, so wait for them to give up their slots
+	// A thread that is waited for may itself create threads in slots that were already visited, so keep going until a whole pass finds nothing to wait for
+	auto lock = std::unique_lock<std::mutex>(threadsMutex);
+	for (auto waited = true; waited; )
+	{
+		waited = false;
+		for (auto i = 1u; i < MAX_GUEST_THREADS; ++i)
+		{
+			if (threads[i] != nullptr && threads[i]->detached)
+			{
+				detachedThreadExited.wait(lock, [this, i] { return threads[i] == nullptr; });
+				waited = true;
+			}
+			else if (threads[i] != nullptr && threads[i]->hostThread.joinable())
+			{
+				lock.unlock();
+				threads[i]->hostThread.join();
+				lock.lock();
+				waited = true;
+				reportThreadFailure(std::exchange(threads[i]->failure, nullptr));
+			}
+		}
+	}
+	reportThreadFailure(std::exchange(detachedFailure, nullptr));
+}
+
+Address Interpreter::allocateStackMem(StackFrame& frame, uint64_t size, uint64_t align)
+{
+	// Alignment padding is accounted to the frame as well, so that popping the frame gives it back
+	auto& stackMem = currentThread->stackMem;
+	auto usedSize = stackMem.getUsedSize();
+	auto addr = stackMem.allocate(size, align);
+	frame.increaseAllocationSize(stackMem.getUsedSize() - usedSize);
+	return (Address(currentThread->index) << STACK_THREAD_SHIFT) | addr;
 }
 
 Address Interpreter::allocateGlobalMem(Type* type)
 {
-	if (type->isVectorTy())
-		llvm_unreachable("Vector type not supported");
+	// Host atomics and futex-based host mutexes operate on guest globals in place, so they need their natural alignment
+	auto globalSize = getDataLayout().getTypeAllocSize(type);
+	return globalMem.allocate(globalSize, getDataLayout().getPrefTypeAlign(type).value());
+}
+
+void Interpreter::initializeGlobal(Address addr, const Constant* init)
+{
+	// Zero-initialized aggregates and null pointers are all-zero bytes
+	if (isa<ConstantAggregateZero>(init) || isa<ConstantPointerNull>(init))
+	{
+		globalMem.fill(addr, 0, getDataLayout().getTypeAllocSize(init->getType()));
+		return;
+	}
+
+	// Arrays of plain ints/floats (including string literals) are stored contiguously in host byte order, which is exactly what the memory section expects
+	if (auto cds = dyn_cast<ConstantDataSequential>(init))
+	{
+		auto rawData = cds->getRawDataValues();
+		globalMem.writeRaw(addr, rawData.data(), rawData.size());
+		return;
+	}
+
+	// Undef leaves the memory untouched, just like MemorySection::write() does
+	if (isa<UndefValue>(init))
+		return;
 
-	auto globalSize = dataLayout.getTypeAllocSize(type);
-	return globalMem.allocate(globalSize);
+	// Recurse into aggregates so that only the leaves that actually need it go through evaluateConstant()
+	if (auto cArray = dyn_cast<ConstantArray>(init))
+	{
+		auto elemSize = getDataLayout().getTypeAllocSize(cArray->getType()->getElementType());
+		for (auto i = 0u, e = cArray->getNumOperands(); i < e; ++i)
+			initializeGlobal(addr + i * elemSize, cArray->getOperand(i));
+		return;
+	}
+	if (auto cStruct = dyn_cast<ConstantStruct>(init))
+	{
+		auto stLayout = getDataLayout().getStructLayout(cStruct->getType());
+		for (auto i = 0u, e = cStruct->getNumOperands(); i < e; ++i)
+			initializeGlobal(addr + stLayout->getElementOffset(i), cStruct->getOperand(i));
+		return;
+	}
+
+	globalMem.write(addr, evaluateConstant(init));
 }
 
 void Interpreter::evaluateGlobals()
 {
-	PointerValue::setPointerSize(dataLayout.getPointerSize());
+	PointerValue::setPointerSize(getDataLayout().getPointerSize());
+
+	// A loaded image comes with its globals initialized
+	if (image->isLoaded())
+		return;
+	if (!image->globalEnv.empty())
+		throw std::runtime_error("evaluateGlobals() called twice on the same module image");
+
+	auto& globalEnv = image->globalEnv;
 
+	auto allocateGlobal = [this, &globalEnv] (const GlobalVariable& globalVal)
+	{
+		// The value type is known with opaque pointers too, and external declarations (e.g. stdout) need storage of their full size
+		auto globalAddr = allocateGlobalMem(globalVal.getValueType());
+		globalEnv.insert(std::make_pair(&globalVal, globalAddr));
+	};
+
+	// Pack all constant globals together first so that they form one read-only region at the start of globalMem
+	auto& readOnlyBegin = image->readOnlyBegin;
+	auto& readOnlyEnd = image->readOnlyEnd;
+	readOnlyBegin = readOnlyEnd = globalMem.allocate(0);
 	for (auto const& globalVal: module->globals())
 	{
-		// In LLVM 20, pointers are opaque, so we need to get the element type differently
-		// For globals, the type is the pointer type, and we need to get the pointee type
-		// Since opaque pointers don't store element type, we'll need to handle this differently
-		// For now, try to get it from the initializer if available
-		Type* elemType = nullptr;
-		if (globalVal.hasInitializer()) {
-			elemType = globalVal.getInitializer()->getType();
-		} else {
-			// Fallback: assume it's a pointer to the default type
-			// This is a workaround for opaque pointers
-			elemType = Type::getInt8Ty(module->getContext());
+		if (isReadOnlyGlobal(&globalVal))
+			allocateGlobal(globalVal);
+	}
+	readOnlyEnd = globalMem.allocate(0);
+
+	for (auto const& globalVal: module->globals())
+	{
+		if (!isReadOnlyGlobal(&globalVal))
+			allocateGlobal(globalVal);
+	}
+	initializeStdStreams();
+
+	// In lazy mode, initializers are written by getGlobalAddress() and function pointers are handed out by getFunctionAddress(), both on first use
+	if (lazyGlobals)
+	{
+		for (auto const& globalVal: module->globals())
+		{
+			if (globalVal.hasInitializer())
+				pendingGlobals.insert(&globalVal);
 		}
-		auto globalAddr = allocateGlobalMem(elemType);
-		globalEnv.insert(std::make_pair(&globalVal, globalAddr));
+		return;
 	}
 
 	for (auto const& globalVal: module->globals())
 	{
 		auto globalAddr = globalEnv.at(&globalVal);
 		if (globalVal.hasInitializer())
-			globalMem.write(globalAddr, evaluateConstant(globalVal.getInitializer()));
+			initializeGlobal(globalAddr, globalVal.getInitializer());
 	}
 
 	// Give each function a corresponding pointer
 	for (auto const& f: *module)
+		getFunctionAddress(&f);
+}
+
+bool Interpreter::isReadOnlyGlobal(const GlobalVariable* gv)
+{
+	return gv->isConstant() && gv->hasDefinitiveInitializer();
+}
+
+bool Interpreter::isReadOnlyGlobalRange(Address addr, uint64_t size) const
+{
+	return addr >= image->readOnlyBegin && addr < image->readOnlyEnd && size <= image->readOnlyEnd - addr;
+}
+
+Address Interpreter::getGlobalAddress(const GlobalVariable* gv)
+{
+	auto globalAddr = image->globalEnv.at(gv);
+
+	// A global's initializer may refer to the global itself, so it must leave the pending set before being initialized
+	if (!pendingGlobals.empty() && pendingGlobals.erase(gv))
+	{
+		if (globalMem.hasSnapshot())
+			globalsInitializedSinceSnapshot.push_back(gv);
+		initializeGlobal(globalAddr, gv->getInitializer());
+	}
+
+	return globalAddr;
+}
+
+Address Interpreter::getFunctionAddress(const Function* f)
+{
+	auto itr = image->globalEnv.find(f);
+	if (itr != image->globalEnv.end())
+		return itr->second;
+
+	// Only reached for an image that belongs to this interpreter alone: a loaded image has every function addressed
+	auto funAddr = allocateGlobalMem(f->getType());
+	image->globalEnv.insert(std::make_pair(f, funAddr));
+	image->funPtrMap.insert(std::make_pair(funAddr, f));
+	if (globalMem.hasSnapshot())
+		functionsAddressedSinceSnapshot.push_back(f);
+	return funAddr;
+}
+
+void Interpreter::takeSnapshot()
+{
+	if (!threads[0]->stack.empty())
+		throw std::runtime_error("takeSnapshot() called while guest code is running");
+	if (multiThreaded || greenThreadsStarted)
+		throw std::runtime_error("takeSnapshot() called after guest threads have been created");
+	// A restore would write to the mapped file, which is not part of the guest's memory
+	if (heapMem.hasSharedFileMappings())
+		throw std::runtime_error("takeSnapshot() called while the guest has a file mapped with MAP_SHARED");
+
+	globalMem.takeSnapshot();
+	threads[0]->stackMem.takeSnapshot();
+	heapMem.takeSnapshot();
+	globalsInitializedSinceSnapshot.clear();
+	functionsAddressedSinceSnapshot.clear();
+}
+
+void Interpreter::restoreSnapshot()
+{
+	if (!threads[0]->stack.empty())
+		throw std::runtime_error("restoreSnapshot() called while guest code is running");
+
+	globalMem.restoreSnapshot();
+	threads[0]->stackMem.restoreSnapshot();
+	heapMem.restoreSnapshot();
+
+	// Memory of the globals that were lazily initialized after the snapshot has just been rolled back, so they are pending again. Function slots allocated after the snapshot no longer exist
+	for (auto gv: globalsInitializedSinceSnapshot)
+		pendingGlobals.insert(gv);
+	globalsInitializedSinceSnapshot.clear();
+	for (auto f: functionsAddressedSinceSnapshot)
 	{
-		auto funAddr = allocateGlobalMem(f.getType());
-		globalEnv.insert(std::make_pair(&f, funAddr));
-		funPtrMap.insert(std::make_pair(funAddr, &f));
+		image->funPtrMap.erase(image->globalEnv.at(f));
+		image->globalEnv.erase(f);
 	}
+	functionsAddressedSinceSnapshot.clear();
 }
 
-DynamicValue Interpreter::callFunction(const llvm::Function* f, std::vector<DynamicValue>&& argValues)
+DynamicValue Interpreter::callFunction(const llvm::Function* f, std::vector<DynamicValue>&& argValues, const CallBase* cs)
 {
 	assert(f && "f is NULL in runFunction()!");
 	assert(!f->isDeclaration() && "callFunction() does not handle external function!");
 
 	// Make a new stack frame... and fill it in
-	auto& calleeFrame = stack.createFrame(f);
+	auto body = getExecutableBody(f);
+	auto& calleeFrame = currentThread->stack.createFrame(body);
 	assert(
 		(argValues.size() == f->arg_size() ||
 		(argValues.size() > f->arg_size() && f->getFunctionType()->isVarArg())) ||
@@ -84,28 +305,31 @@ DynamicValue Interpreter::callFunction(const llvm::Function* f, std::vector<Dyna
 
 	// Handle non-varargs arguments...
 	unsigned i = 0;
-	for (auto itr = f->arg_begin(), ite = f->arg_end(); itr != ite; ++itr, ++i)
+	for (auto itr = body->arg_begin(), ite = body->arg_end(); itr != ite; ++itr, ++i)
 	{
 		calleeFrame.insertBinding(itr, std::move(argValues[i]));
 	}
 
-	// If this is the main function and we don't have enough formal arg, just ignore the remaining actual arg
-	if (f->getName() != "main")
-	{
-		// Otherwise, handle varargs arguments...
-		for (auto itr = argValues.begin() + i, ite = argValues.end(); itr != ite; ++itr)
-			calleeFrame.insertVararg(std::move(*itr));
-	}
+	// Handle varargs arguments... Extra arguments of a function that is not variadic (main declared without argc and argv) are just ignored
+	if (f->isVarArg())
+		layOutVarArgs(calleeFrame, argValues, i, cs);
 
 	return runFunction(calleeFrame);
 }
 
+void Interpreter::unwindStack(size_t depth)
+{
+	while (currentThread->stack.size() > depth)
+		popStack();
+}
+
 void Interpreter::popStack()
 {
 	//stack.getCurrentFrame().dumpFrame();
 	//stackMem.dumpMemory();
 	// Cleanup all the allocated memories in this frame
-	stackMem.deallocate(stack.getCurrentFrame().getAllocationSize());
+	auto& stack = currentThread->stack;
+	currentThread->stackMem.deallocate(stack.getCurrentFrame().getAllocationSize());
 	stack.popFrame();
 }
 
@@ -143,19 +367,22 @@ DynamicValue Interpreter::runFunction(StackFrame& frame)
 
 	while (true)
 	{
-		// Skip all the phi nodes first
-		auto instItr = curBB->begin();
-		while (isa<PHINode>(instItr))
-			++instItr;
+		if (fusionProfile != nullptr)
+			fusionProfile->recordBlock(curBB);
 
-		// Evaluate non-terminator instructions.
+		// Evaluate non-terminator instructions. Phi nodes have already been taken care of by switchToNewBasicBlock().
 		// Those instructions won't alter control flows
-		for (auto instIte = curBB->end(); instItr != instIte; ++instItr)
+		auto& plan = getBlockPlan(curBB);
+		if (greenThreads && (greenSliceLeft -= plan.insts.size() + 1) <= 0)
+			yieldGreenThread();
+		for (auto const& decoded: plan.insts)
 		{
-			if (instItr->isTerminator())
-				break;
-
-			evaluateInstruction(frame, &*instItr);
+			if (decoded.op == FusedOp::NONE)
+				evaluateInstruction(frame, decoded.first);
+			else if (decoded.op == FusedOp::FOLDED_LOAD)
+				frame.insertBinding(decoded.first, plan.foldedValues[decoded.foldedIndex]);
+			else
+				evaluateFusedInstruction(frame, decoded);
 		}
 
 		auto termInst = curBB->getTerminator();
@@ -166,7 +393,14 @@ DynamicValue Interpreter::runFunction(StackFrame& frame)
 				auto brInst = cast<BranchInst>(termInst);
 
 				auto destBB = brInst->getSuccessor(0);
-				if (brInst->isConditional())
+				if (auto cmpInst = plan.fusedCond)
+				{
+					auto val0 = evaluateOperand(frame, cmpInst->getOperand(0));
+					auto val1 = evaluateOperand(frame, cmpInst->getOperand(1));
+					if (!evaluateScalarICmp(cmpInst->getPredicate(), val0, val1))
+						destBB = brInst->getSuccessor(1);
+				}
+				else if (brInst->isConditional())
 				{
 					auto condVal = evaluateOperand(frame, brInst->getCondition());
 					if (!condVal.getAsIntValue().getInt().getBoolValue())
@@ -231,7 +465,7 @@ std::vector<DynamicValue> Interpreter::createArgvArray(const std::vector<std::st
 	retVec.push_back(DynamicValue::getIntValue(APInt(32, mainArgs.size())));
 
 	// Allocate the argv array in the global memory section
-	auto ptrSize = dataLayout.getPointerSize();
+	auto ptrSize = getDataLayout().getPointerSize();
 	auto argvPtrAddr = globalMem.allocate(mainArgs.size() * ptrSize);
 
 	// Push the argv pointer
@@ -262,9 +496,34 @@ std::vector<DynamicValue> Interpreter::createArgvArray(const std::vector<std::st
 
 int Interpreter::runMain(const Function* mainFn, const std::vector< std::string>& mainArgs)
 {
+	auto threadScope = MainThreadScope(*this);
 	auto args = createArgvArray(mainArgs);
 
-	auto retVal = callFunction(mainFn, std::move(args));
+	auto depth = currentThread->stack.size();
+	auto retVal = DynamicValue::getUndefValue();
+	try
+	{
+		retVal = callFunction(mainFn, std::move(args));
+	}
+	catch (const GuestThreadExit&)
+	{
+		// pthread_exit() in main ends the main thread only. The process exits with 0 once the other threads are done, which the destructor waits for
+		while (!currentThread->stack.empty())
+			popStack();
+	}
+	catch (...)
+	{
+		unwindStack(depth);
+		throw;
+	}
+	rethrowDetachedFailure();
+
+	// Returning from main flushes the guest streams, as exit() does
+	{
+		auto lock = std::lock_guard<std::mutex>(hostMutex);
+		stdio.flushAll();
+	}
+
 	if (retVal.isUndefValue())
 		return 0;
 	else
@@ -279,9 +538,29 @@ DynamicValue Interpreter::runFunction(const llvm::Function* func, const std::vec
 		return DynamicValue::getUndefValue();
 	}
 	
+	auto threadScope = MainThreadScope(*this);
 	// Convert const vector to moveable vector
 	std::vector<DynamicValue> argValues = args;
-	return callFunction(func, std::move(argValues));
+	auto depth = currentThread->stack.size();
+	auto retVal = DynamicValue::getUndefValue();
+	try
+	{
+		retVal = callFunction(func, std::move(argValues));
+	}
+	catch (...)
+	{
+		unwindStack(depth);
+		throw;
+	}
+	rethrowDetachedFailure();
+
+	// The host may print or exit between calls, so guest output does not wait for the interpreter to go away
+	{
+		auto lock = std::lock_guard<std::mutex>(hostMutex);
+		stdio.flushAll();
+	}
+
+	return retVal;
 }
 
 void Interpreter::registerExternalFunction(const std::string& name, ExternalFunctionCallback callback)
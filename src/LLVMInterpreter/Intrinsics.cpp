@@ -0,0 +1,382 @@
+#include "Interpreter.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/Support/ErrorHandling.h"
+
+#include <cmath>
+#include <cstring>
+
+using namespace llvm;
+using namespace llvm_interpreter;
+
+// This file contains native implementations of the LLVM intrinsics that optimized bitcode commonly calls. They are dispatched on Function::getIntrinsicID(), so overloaded names (llvm.memcpy.p0i8.p0i8.i64, llvm.memcpy.p0.p0.i64, ...) all land on the same handler
+
+namespace
+{
+
+DynamicValue makeFloat(double f, bool isDouble)
+{
+	// Single precision results have to be rounded to float again
+	return DynamicValue::getFloatValue(isDouble ? f : static_cast<double>(static_cast<float>(f)), isDouble);
+}
+
+// Apply (fn) to scalar operands, or lane by lane when the first operand is a vector. Only the first (numLaneOperands) operands are split into lanes; the remaining ones (e.g. the i1 flag of llvm.abs) are passed through unchanged. Undef operands give an undef result
+template <typename Fn>
+DynamicValue mapLanes(const std::vector<DynamicValue>& args, unsigned numLaneOperands, Fn&& fn)
+{
+	auto laneArgs = std::vector<DynamicValue>(args.begin(), args.end());
+	auto evalLane = [&laneArgs, numLaneOperands, &fn] ()
+	{
+		for (auto i = 0u; i < numLaneOperands; ++i)
+			if (laneArgs[i].isUndefValue())
+				return DynamicValue::getUndefValue();
+		return fn(laneArgs);
+	};
+
+	if (!args.at(0).isVectorValue())
+		return evalLane();
+
+	auto retVal = args[0];
+	auto& retVec = retVal.getAsVectorValue();
+	for (auto lane = 0u, e = retVec.getNumLanes(); lane < e; ++lane)
+	{
+		for (auto i = 0u; i < numLaneOperands; ++i)
+			laneArgs[i] = args[i].getAsVectorValue().getLane(lane);
+		retVec.setLane(lane, evalLane());
+	}
+	return retVal;
+}
+
+template <typename Fn>
+DynamicValue mapIntLanes(const std::vector<DynamicValue>& args, unsigned numLaneOperands, Fn&& fn)
+{
+	return mapLanes(args, numLaneOperands, [&fn] (const std::vector<DynamicValue>& ops)
+	{
+		return DynamicValue::getIntValue(fn(ops));
+	});
+}
+
+// Floating point intrinsics that are libm functions go through the math library bindings, so that vector operands are evaluated with one batch call. (name) is the double function, and the float variant has an f appended
+DynamicValue evaluateLibmIntrinsic(const Function* f, StringRef name, const std::vector<DynamicValue>& args)
+{
+	auto fnName = SmallString<16>(name);
+	if (f->getReturnType()->getScalarType()->isFloatTy())
+		fnName += "f";
+	auto mathFn = findMathFunction(fnName);
+	assert(mathFn != nullptr && "Intrinsic without a libm binding");
+	return evaluateMathFunction(*mathFn, args);
+}
+
+const APInt& intArg(const std::vector<DynamicValue>& ops, unsigned i)
+{
+	return ops[i].getAsIntValue().getInt();
+}
+
+APInt funnelShiftLeft(const APInt& hi, const APInt& lo, const APInt& amt)
+{
+	auto bitWidth = hi.getBitWidth();
+	auto shift = amt.urem(bitWidth);
+	if (shift == 0)
+		return hi;
+	return hi.shl(shift) | lo.lshr(bitWidth - shift);
+}
+
+APInt funnelShiftRight(const APInt& hi, const APInt& lo, const APInt& amt)
+{
+	auto bitWidth = hi.getBitWidth();
+	auto shift = amt.urem(bitWidth);
+	if (shift == 0)
+		return lo;
+	return hi.shl(bitWidth - shift) | lo.lshr(shift);
+}
+
+// Fold all lanes of an integer vector with (fn)
+template <typename Fn>
+DynamicValue reduceIntLanes(const DynamicValue& vecVal, Fn&& fn)
+{
+	auto& vec = vecVal.getAsVectorValue();
+	auto acc = vec.getLane(0).getAsIntValue().getInt();
+	for (auto lane = 1u, e = vec.getNumLanes(); lane < e; ++lane)
+		acc = fn(acc, vec.getLane(lane).getAsIntValue().getInt());
+	return DynamicValue::getIntValue(acc);
+}
+
+// Fold all lanes of a floating point vector with (fn), starting from (init). Lanes are visited in order, which is the strict (non-reassociated) semantics of the fadd/fmul reductions. Float lanes are rounded to float after every step, as native code does
+template <typename Fn>
+double reduceFloatLanes(const VectorValue& vec, double init, bool isDouble, Fn&& fn)
+{
+	auto acc = init;
+	for (auto lane = 0u, e = vec.getNumLanes(); lane < e; ++lane)
+	{
+		acc = fn(acc, vec.getFloatLane(lane));
+		if (!isDouble)
+			acc = float(acc);
+	}
+	return acc;
+}
+
+}
+
+bool Interpreter::isNoOpIntrinsic(Intrinsic::ID id)
+{
+	switch (id)
+	{
+		case Intrinsic::dbg_declare:
+		case Intrinsic::dbg_value:
+		case Intrinsic::dbg_label:
+		case Intrinsic::dbg_addr:
+		case Intrinsic::lifetime_start:
+		case Intrinsic::lifetime_end:
+		case Intrinsic::assume:
+		case Intrinsic::donothing:
+		case Intrinsic::sideeffect:
+		case Intrinsic::experimental_noalias_scope_decl:
+		case Intrinsic::pseudoprobe:
+		case Intrinsic::var_annotation:
+			return true;
+		default:
+			return false;
+	}
+}
+
+DynamicValue Interpreter::callIntrinsic(const CallBase* cs, const Function* f, std::vector<DynamicValue>&& argValues)
+{
+	switch (f->getIntrinsicID())
+	{
+		// Memory intrinsics
+		case Intrinsic::memcpy:
+		case Intrinsic::memcpy_inline:
+		case Intrinsic::memmove:
+		{
+			auto size = argValues.at(2).getAsIntValue().getInt().getZExtValue();
+			if (size == 0)
+				return DynamicValue::getUndefValue();
+
+			auto& destPtr = argValues.at(0).getAsPointerValue();
+			auto& srcPtr = argValues.at(1).getAsPointerValue();
+			std::memmove(getWritablePointer(destPtr, size), getCheckedPointer(srcPtr, size), size);
+			return DynamicValue::getUndefValue();
+		}
+		case Intrinsic::memset:
+		{
+			auto size = argValues.at(2).getAsIntValue().getInt().getZExtValue();
+			if (size == 0)
+				return DynamicValue::getUndefValue();
+
+			auto& destPtr = argValues.at(0).getAsPointerValue();
+			auto fillInt = argValues.at(1).getAsIntValue().getInt().getZExtValue();
+			std::memset(getWritablePointer(destPtr, size), fillInt, size);
+			return DynamicValue::getUndefValue();
+		}
+
+		// Variadic arguments. va_end has nothing to release
+		case Intrinsic::vastart:
+			startVaList(currentThread->stack.getCurrentFrame(), argValues.at(0).getAsPointerValue());
+			return DynamicValue::getUndefValue();
+		case Intrinsic::vacopy:
+		{
+			auto size = getVaListSize();
+			std::memcpy(getWritablePointer(argValues.at(0).getAsPointerValue(), size), getCheckedPointer(argValues.at(1).getAsPointerValue(), size), size);
+			return DynamicValue::getUndefValue();
+		}
+		case Intrinsic::vaend:
+			return DynamicValue::getUndefValue();
+
+		// Hints whose result is just their first operand
+		case Intrinsic::expect:
+		case Intrinsic::expect_with_probability:
+		case Intrinsic::ssa_copy:
+		case Intrinsic::launder_invariant_group:
+		case Intrinsic::strip_invariant_group:
+			return std::move(argValues.at(0));
+
+		case Intrinsic::trap:
+		case Intrinsic::debugtrap:
+			throw std::runtime_error("Guest program executed llvm.trap");
+
+		// Integer intrinsics
+		case Intrinsic::smax:
+			return mapIntLanes(argValues, 2, [] (const std::vector<DynamicValue>& ops) { return APIntOps::smax(intArg(ops, 0), intArg(ops, 1)); });
+		case Intrinsic::smin:
+			return mapIntLanes(argValues, 2, [] (const std::vector<DynamicValue>& ops) { return APIntOps::smin(intArg(ops, 0), intArg(ops, 1)); });
+		case Intrinsic::umax:
+			return mapIntLanes(argValues, 2, [] (const std::vector<DynamicValue>& ops) { return APIntOps::umax(intArg(ops, 0), intArg(ops, 1)); });
+		case Intrinsic::umin:
+			return mapIntLanes(argValues, 2, [] (const std::vector<DynamicValue>& ops) { return APIntOps::umin(intArg(ops, 0), intArg(ops, 1)); });
+		case Intrinsic::abs:
+			return mapIntLanes(argValues, 1, [] (const std::vector<DynamicValue>& ops) { return intArg(ops, 0).abs(); });
+		case Intrinsic::ctpop:
+		{
+			return mapIntLanes(argValues, 1, [] (const std::vector<DynamicValue>& ops)
+			{
+				auto& i = intArg(ops, 0);
+				return APInt(i.getBitWidth(), i.countPopulation());
+			});
+		}
+		case Intrinsic::ctlz:
+		{
+			return mapIntLanes(argValues, 1, [] (const std::vector<DynamicValue>& ops)
+			{
+				auto& i = intArg(ops, 0);
+				return APInt(i.getBitWidth(), i.countLeadingZeros());
+			});
+		}
+		case Intrinsic::cttz:
+		{
+			return mapIntLanes(argValues, 1, [] (const std::vector<DynamicValue>& ops)
+			{
+				auto& i = intArg(ops, 0);
+				return APInt(i.getBitWidth(), i.countTrailingZeros());
+			});
+		}
+		case Intrinsic::bswap:
+			return mapIntLanes(argValues, 1, [] (const std::vector<DynamicValue>& ops) { return intArg(ops, 0).byteSwap(); });
+		case Intrinsic::bitreverse:
+			return mapIntLanes(argValues, 1, [] (const std::vector<DynamicValue>& ops) { return intArg(ops, 0).reverseBits(); });
+		case Intrinsic::fshl:
+			return mapIntLanes(argValues, 3, [] (const std::vector<DynamicValue>& ops) { return funnelShiftLeft(intArg(ops, 0), intArg(ops, 1), intArg(ops, 2)); });
+		case Intrinsic::fshr:
+			return mapIntLanes(argValues, 3, [] (const std::vector<DynamicValue>& ops) { return funnelShiftRight(intArg(ops, 0), intArg(ops, 1), intArg(ops, 2)); });
+		case Intrinsic::sadd_sat:
+			return mapIntLanes(argValues, 2, [] (const std::vector<DynamicValue>& ops) { return intArg(ops, 0).sadd_sat(intArg(ops, 1)); });
+		case Intrinsic::uadd_sat:
+			return mapIntLanes(argValues, 2, [] (const std::vector<DynamicValue>& ops) { return intArg(ops, 0).uadd_sat(intArg(ops, 1)); });
+		case Intrinsic::ssub_sat:
+			return mapIntLanes(argValues, 2, [] (const std::vector<DynamicValue>& ops) { return intArg(ops, 0).ssub_sat(intArg(ops, 1)); });
+		case Intrinsic::usub_sat:
+			return mapIntLanes(argValues, 2, [] (const std::vector<DynamicValue>& ops) { return intArg(ops, 0).usub_sat(intArg(ops, 1)); });
+
+		// Arithmetic with overflow. The result is a {iN, i1} struct
+		case Intrinsic::sadd_with_overflow:
+		case Intrinsic::uadd_with_overflow:
+		case Intrinsic::ssub_with_overflow:
+		case Intrinsic::usub_with_overflow:
+		case Intrinsic::smul_with_overflow:
+		case Intrinsic::umul_with_overflow:
+		{
+			auto& lhs = argValues.at(0).getAsIntValue().getInt();
+			auto& rhs = argValues.at(1).getAsIntValue().getInt();
+			auto overflow = false;
+			auto result = APInt();
+			switch (f->getIntrinsicID())
+			{
+				case Intrinsic::sadd_with_overflow:
+					result = lhs.sadd_ov(rhs, overflow);
+					break;
+				case Intrinsic::uadd_with_overflow:
+					result = lhs.uadd_ov(rhs, overflow);
+					break;
+				case Intrinsic::ssub_with_overflow:
+					result = lhs.ssub_ov(rhs, overflow);
+					break;
+				case Intrinsic::usub_with_overflow:
+					result = lhs.usub_ov(rhs, overflow);
+					break;
+				case Intrinsic::smul_with_overflow:
+					result = lhs.smul_ov(rhs, overflow);
+					break;
+				default:
+					result = lhs.umul_ov(rhs, overflow);
+					break;
+			}
+
+			auto stType = cast<StructType>(cs->getType());
+			auto stLayout = getDataLayout().getStructLayout(stType);
+			auto retVal = DynamicValue::getStructValue(getDataLayout().getTypeAllocSize(stType));
+			auto& structVal = retVal.getAsStructValue();
+			structVal.addField(stLayout->getElementOffset(0), DynamicValue::getIntValue(result));
+			structVal.addField(stLayout->getElementOffset(1), DynamicValue::getIntValue(APInt(1, overflow)));
+			return retVal;
+		}
+
+		// Floating point intrinsics
+		case Intrinsic::fmuladd:
+		case Intrinsic::fma:
+			return evaluateLibmIntrinsic(f, "fma", argValues);
+		case Intrinsic::sqrt:
+			return evaluateLibmIntrinsic(f, "sqrt", argValues);
+		case Intrinsic::fabs:
+			return evaluateLibmIntrinsic(f, "fabs", argValues);
+		case Intrinsic::copysign:
+			return evaluateLibmIntrinsic(f, "copysign", argValues);
+		case Intrinsic::minnum:
+			return evaluateLibmIntrinsic(f, "fmin", argValues);
+		case Intrinsic::maxnum:
+			return evaluateLibmIntrinsic(f, "fmax", argValues);
+		case Intrinsic::floor:
+			return evaluateLibmIntrinsic(f, "floor", argValues);
+		case Intrinsic::ceil:
+			return evaluateLibmIntrinsic(f, "ceil", argValues);
+		case Intrinsic::trunc:
+			return evaluateLibmIntrinsic(f, "trunc", argValues);
+		case Intrinsic::round:
+			return evaluateLibmIntrinsic(f, "round", argValues);
+		case Intrinsic::rint:
+		case Intrinsic::nearbyint:
+			return evaluateLibmIntrinsic(f, "nearbyint", argValues);
+		case Intrinsic::pow:
+			return evaluateLibmIntrinsic(f, "pow", argValues);
+		case Intrinsic::exp:
+			return evaluateLibmIntrinsic(f, "exp", argValues);
+		case Intrinsic::exp2:
+			return evaluateLibmIntrinsic(f, "exp2", argValues);
+		case Intrinsic::log:
+			return evaluateLibmIntrinsic(f, "log", argValues);
+		case Intrinsic::log2:
+			return evaluateLibmIntrinsic(f, "log2", argValues);
+		case Intrinsic::log10:
+			return evaluateLibmIntrinsic(f, "log10", argValues);
+		case Intrinsic::sin:
+			return evaluateLibmIntrinsic(f, "sin", argValues);
+		case Intrinsic::cos:
+			return evaluateLibmIntrinsic(f, "cos", argValues);
+
+		// Vector reductions, as emitted by the loop vectorizer
+		case Intrinsic::vector_reduce_add:
+			return reduceIntLanes(argValues.at(0), [] (const APInt& a, const APInt& b) { return a + b; });
+		case Intrinsic::vector_reduce_mul:
+			return reduceIntLanes(argValues.at(0), [] (const APInt& a, const APInt& b) { return a * b; });
+		case Intrinsic::vector_reduce_and:
+			return reduceIntLanes(argValues.at(0), [] (const APInt& a, const APInt& b) { return a & b; });
+		case Intrinsic::vector_reduce_or:
+			return reduceIntLanes(argValues.at(0), [] (const APInt& a, const APInt& b) { return a | b; });
+		case Intrinsic::vector_reduce_xor:
+			return reduceIntLanes(argValues.at(0), [] (const APInt& a, const APInt& b) { return a ^ b; });
+		case Intrinsic::vector_reduce_smax:
+			return reduceIntLanes(argValues.at(0), [] (const APInt& a, const APInt& b) { return APIntOps::smax(a, b); });
+		case Intrinsic::vector_reduce_smin:
+			return reduceIntLanes(argValues.at(0), [] (const APInt& a, const APInt& b) { return APIntOps::smin(a, b); });
+		case Intrinsic::vector_reduce_umax:
+			return reduceIntLanes(argValues.at(0), [] (const APInt& a, const APInt& b) { return APIntOps::umax(a, b); });
+		case Intrinsic::vector_reduce_umin:
+			return reduceIntLanes(argValues.at(0), [] (const APInt& a, const APInt& b) { return APIntOps::umin(a, b); });
+		case Intrinsic::vector_reduce_fadd:
+		case Intrinsic::vector_reduce_fmul:
+		{
+			auto& startVal = argValues.at(0).getAsFloatValue();
+			auto& vec = argValues.at(1).getAsVectorValue();
+			auto result = (f->getIntrinsicID() == Intrinsic::vector_reduce_fadd)
+				? reduceFloatLanes(vec, startVal.getFloat(), startVal.isDouble(), [] (double a, double b) { return a + b; })
+				: reduceFloatLanes(vec, startVal.getFloat(), startVal.isDouble(), [] (double a, double b) { return a * b; });
+			return makeFloat(result, startVal.isDouble());
+		}
+		case Intrinsic::vector_reduce_fmax:
+		case Intrinsic::vector_reduce_fmin:
+		{
+			auto& vec = argValues.at(0).getAsVectorValue();
+			auto isDouble = vec.getLaneType() == VectorLaneType::DOUBLE;
+			auto result = (f->getIntrinsicID() == Intrinsic::vector_reduce_fmax)
+				? reduceFloatLanes(vec, -HUGE_VAL, isDouble, [] (double a, double b) { return std::fmax(a, b); })
+				: reduceFloatLanes(vec, HUGE_VAL, isDouble, [] (double a, double b) { return std::fmin(a, b); });
+			return makeFloat(result, isDouble);
+		}
+
+		default:
+			// Everything else is treated like any other external function, so that it can still be provided through registerExternalFunction()
+			return callExternalFunction(cs, f, std::move(argValues));
+	}
+}
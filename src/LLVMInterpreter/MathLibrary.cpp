@@ -0,0 +1,298 @@
+#include "MathLibrary.h"
+
+#include "llvm/ADT/APInt.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/ErrorHandling.h"
+
+#include <cmath>
+#include <math.h>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+using namespace llvm;
+using namespace llvm_interpreter;
+
+// This file contains the bindings of the host libm. The batch entry point is compiled with full optimization (see CMakeLists.txt) like the vector lane kernels, so that its loops call the host functions back to back without touching DynamicValues
+
+namespace
+{
+
+using GenericFunction = void (*)();
+
+// The host function type of (S) over T
+template <MathSignature S, typename T>
+struct HostFunction;
+template <typename T>
+struct HostFunction<MathSignature::UNARY, T> { using Type = T(T); };
+template <typename T>
+struct HostFunction<MathSignature::BINARY, T> { using Type = T(T, T); };
+template <typename T>
+struct HostFunction<MathSignature::TERNARY, T> { using Type = T(T, T, T); };
+template <typename T>
+struct HostFunction<MathSignature::SCALE_INT, T> { using Type = T(T, int); };
+template <typename T>
+struct HostFunction<MathSignature::SCALE_LONG, T> { using Type = T(T, long); };
+template <typename T>
+struct HostFunction<MathSignature::TO_INT, T> { using Type = int(T); };
+template <typename T>
+struct HostFunction<MathSignature::TO_LONG, T> { using Type = long(T); };
+template <typename T>
+struct HostFunction<MathSignature::TO_LONG_LONG, T> { using Type = long long(T); };
+template <typename T>
+struct HostFunction<MathSignature::FREXP, T> { using Type = T(T, int*); };
+template <typename T>
+struct HostFunction<MathSignature::MODF, T> { using Type = T(T, T*); };
+template <typename T>
+struct HostFunction<MathSignature::REMQUO, T> { using Type = T(T, T, int*); };
+template <typename T>
+struct HostFunction<MathSignature::SINCOS, T> { using Type = void(T, T*, T*); };
+template <typename T>
+struct HostFunction<MathSignature::NAN_STRING, T> { using Type = T(const char*); };
+
+// Taking (fn) as the exact host function type picks the right overload out of <cmath>
+template <MathSignature S, typename T>
+std::pair<StringRef, MathFunction> makeMathFunction(StringRef name, typename HostFunction<S, T>::Type* fn)
+{
+	return { name, MathFunction { S, std::is_same<T, double>::value, reinterpret_cast<GenericFunction>(fn) } };
+}
+
+// The double function (name) and its float variant (name)f
+#define MATH_FUNCTION(name, signature) \
+	makeMathFunction<MathSignature::signature, double>(#name, ::name), \
+	makeMathFunction<MathSignature::signature, float>(#name "f", ::name##f)
+
+// long double variants are left out: the interpreter has no type to hold them
+const StringMap<MathFunction>& getMathFunctionTable()
+{
+	static const auto table = StringMap<MathFunction>(
+	{
+		// Trigonometric and hyperbolic functions
+		MATH_FUNCTION(acos, UNARY), MATH_FUNCTION(asin, UNARY), MATH_FUNCTION(atan, UNARY), MATH_FUNCTION(atan2, BINARY),
+		MATH_FUNCTION(cos, UNARY), MATH_FUNCTION(sin, UNARY), MATH_FUNCTION(tan, UNARY),
+		MATH_FUNCTION(acosh, UNARY), MATH_FUNCTION(asinh, UNARY), MATH_FUNCTION(atanh, UNARY),
+		MATH_FUNCTION(cosh, UNARY), MATH_FUNCTION(sinh, UNARY), MATH_FUNCTION(tanh, UNARY),
+		// Exponential and logarithmic functions
+		MATH_FUNCTION(exp, UNARY), MATH_FUNCTION(exp2, UNARY), MATH_FUNCTION(expm1, UNARY),
+		MATH_FUNCTION(frexp, FREXP), MATH_FUNCTION(ilogb, TO_INT), MATH_FUNCTION(ldexp, SCALE_INT),
+		MATH_FUNCTION(log, UNARY), MATH_FUNCTION(log10, UNARY), MATH_FUNCTION(log1p, UNARY), MATH_FUNCTION(log2, UNARY), MATH_FUNCTION(logb, UNARY),
+		MATH_FUNCTION(modf, MODF), MATH_FUNCTION(scalbn, SCALE_INT), MATH_FUNCTION(scalbln, SCALE_LONG),
+		// Power and absolute value functions
+		MATH_FUNCTION(cbrt, UNARY), MATH_FUNCTION(fabs, UNARY), MATH_FUNCTION(hypot, BINARY), MATH_FUNCTION(pow, BINARY), MATH_FUNCTION(sqrt, UNARY),
+		// Error and gamma functions
+		MATH_FUNCTION(erf, UNARY), MATH_FUNCTION(erfc, UNARY), MATH_FUNCTION(lgamma, UNARY), MATH_FUNCTION(tgamma, UNARY),
+		// Nearest integer functions
+		MATH_FUNCTION(ceil, UNARY), MATH_FUNCTION(floor, UNARY), MATH_FUNCTION(nearbyint, UNARY), MATH_FUNCTION(rint, UNARY),
+		MATH_FUNCTION(lrint, TO_LONG), MATH_FUNCTION(llrint, TO_LONG_LONG), MATH_FUNCTION(round, UNARY), MATH_FUNCTION(lround, TO_LONG), MATH_FUNCTION(llround, TO_LONG_LONG),
+		MATH_FUNCTION(trunc, UNARY),
+		// Remainder functions
+		MATH_FUNCTION(fmod, BINARY), MATH_FUNCTION(remainder, BINARY), MATH_FUNCTION(remquo, REMQUO),
+		// Manipulation functions
+		MATH_FUNCTION(copysign, BINARY), MATH_FUNCTION(nan, NAN_STRING), MATH_FUNCTION(nextafter, BINARY),
+		// Maximum, minimum and positive difference functions
+		MATH_FUNCTION(fdim, BINARY), MATH_FUNCTION(fmax, BINARY), MATH_FUNCTION(fmin, BINARY),
+		// Floating multiply-add
+		MATH_FUNCTION(fma, TERNARY),
+#ifdef __GLIBC__
+		// GNU extensions
+		MATH_FUNCTION(sincos, SINCOS), MATH_FUNCTION(exp10, UNARY),
+		// The classification macros expand to these in glibc
+		MATH_FUNCTION(__fpclassify, TO_INT), MATH_FUNCTION(__signbit, TO_INT), MATH_FUNCTION(__isinf, TO_INT), MATH_FUNCTION(__isnan, TO_INT), MATH_FUNCTION(__finite, TO_INT),
+#endif
+	});
+	return table;
+}
+
+#undef MATH_FUNCTION
+
+// The name of the scalar function behind a name mangled by the x86 vector function ABI: _ZGV, the ISA (b, c, d or e), N for unmasked, the number of lanes, a v for each vector parameter, and the scalar name after an underscore. Returns an empty name if (name) is not one of these
+StringRef getScalarMathName(StringRef name, unsigned& numParams)
+{
+	if (!name.consume_front("_ZGV") || name.size() < 2 || StringRef("bcde").find(name[0]) == StringRef::npos || name[1] != 'N')
+		return StringRef();
+	name = name.drop_front(2);
+	auto numLanes = 0u;
+	if (name.consumeInteger(10, numLanes) || numLanes == 0)
+		return StringRef();
+	auto params = name.take_while([] (char c) { return c == 'v'; });
+	name = name.drop_front(params.size());
+	if (!name.consume_front("_"))
+		return StringRef();
+	numParams = params.size();
+	return name;
+}
+
+// Call (visitor) with a null pointer of the host function type of the element-wise (sig) over T
+template <typename T, typename Visitor>
+void visitElementWiseFunction(MathSignature sig, Visitor&& visitor)
+{
+	switch (sig)
+	{
+		case MathSignature::UNARY:
+			visitor(static_cast<typename HostFunction<MathSignature::UNARY, T>::Type*>(nullptr));
+			break;
+		case MathSignature::BINARY:
+			visitor(static_cast<typename HostFunction<MathSignature::BINARY, T>::Type*>(nullptr));
+			break;
+		case MathSignature::TERNARY:
+			visitor(static_cast<typename HostFunction<MathSignature::TERNARY, T>::Type*>(nullptr));
+			break;
+		case MathSignature::SCALE_INT:
+			visitor(static_cast<typename HostFunction<MathSignature::SCALE_INT, T>::Type*>(nullptr));
+			break;
+		case MathSignature::SCALE_LONG:
+			visitor(static_cast<typename HostFunction<MathSignature::SCALE_LONG, T>::Type*>(nullptr));
+			break;
+		case MathSignature::TO_INT:
+			visitor(static_cast<typename HostFunction<MathSignature::TO_INT, T>::Type*>(nullptr));
+			break;
+		case MathSignature::TO_LONG:
+			visitor(static_cast<typename HostFunction<MathSignature::TO_LONG, T>::Type*>(nullptr));
+			break;
+		case MathSignature::TO_LONG_LONG:
+			visitor(static_cast<typename HostFunction<MathSignature::TO_LONG_LONG, T>::Type*>(nullptr));
+			break;
+		default:
+			llvm_unreachable("Math function is not element-wise");
+	}
+}
+
+template <typename Visitor>
+void visitElementWiseFunction(const MathFunction& fn, Visitor&& visitor)
+{
+	if (fn.isDouble)
+		visitElementWiseFunction<double>(fn.signature, visitor);
+	else
+		visitElementWiseFunction<float>(fn.signature, visitor);
+}
+
+template <typename R, typename... A, size_t... I>
+void applyBatch(GenericFunction fn, size_t count, const void* const* args, R* result, std::index_sequence<I...>)
+{
+	auto hostFn = reinterpret_cast<R (*)(A...)>(fn);
+	for (auto i = size_t(0); i < count; ++i)
+		result[i] = hostFn(static_cast<const A*>(args[I])[i]...);
+}
+
+template <typename R, typename... A>
+void applyBatch(R (*)(A...), GenericFunction fn, size_t count, const void* const* args, void* result)
+{
+	applyBatch<R, A...>(fn, count, args, static_cast<R*>(result), std::index_sequence_for<A...>());
+}
+
+template <typename T>
+T getNativeValue(const DynamicValue& val)
+{
+	if constexpr (std::is_floating_point<T>::value)
+		return static_cast<T>(val.getAsFloatValue().getFloat());
+	else
+		return static_cast<T>(val.getAsIntValue().getInt().getSExtValue());
+}
+
+template <typename T>
+DynamicValue getGuestValue(T val)
+{
+	if constexpr (std::is_floating_point<T>::value)
+		return DynamicValue::getFloatValue(val, std::is_same<T, double>::value);
+	else
+		return DynamicValue::getIntValue(APInt(sizeof(T) * 8, static_cast<uint64_t>(val), true));
+}
+
+template <typename T>
+bool hasLanesOf(const DynamicValue& val, unsigned numLanes)
+{
+	if (!val.isVectorValue())
+		return false;
+	auto& vec = val.getAsVectorValue();
+	auto laneType = VectorLaneType::INT;
+	if (std::is_floating_point<T>::value)
+		laneType = std::is_same<T, double>::value ? VectorLaneType::DOUBLE : VectorLaneType::FLOAT;
+	return vec.getNumLanes() == numLanes && vec.getLaneType() == laneType && vec.getLaneBytes() == sizeof(T);
+}
+
+template <typename R, typename... A, size_t... I>
+DynamicValue applyToValues(GenericFunction fn, const std::vector<DynamicValue>& args, std::index_sequence<I...>)
+{
+	constexpr auto numArgs = sizeof...(A);
+	if (args.size() < numArgs)
+		throw std::runtime_error("Math function called with too few arguments");
+
+	if (!args[0].isVectorValue())
+	{
+		for (auto i = 0u; i < numArgs; ++i)
+			if (args[i].isUndefValue())
+				return DynamicValue::getUndefValue();
+		return getGuestValue(reinterpret_cast<R (*)(A...)>(fn)(getNativeValue<A>(args[I])...));
+	}
+
+	auto numLanes = args[0].getAsVectorValue().getNumLanes();
+	if (!(hasLanesOf<A>(args[I], numLanes) && ...))
+		throw std::runtime_error("Vector math function called with mismatched vector arguments");
+	auto retVal = std::is_floating_point<R>::value
+		? DynamicValue::getVectorValue(std::is_same<R, double>::value ? VectorLaneType::DOUBLE : VectorLaneType::FLOAT, sizeof(R) * 8, numLanes)
+		: DynamicValue::getVectorValue(VectorLaneType::INT, sizeof(R) * 8, numLanes);
+	const void* lanes[] = { args[I].getAsVectorValue().getRawData()... };
+	applyBatch<R, A...>(fn, numLanes, lanes, retVal.getAsVectorValue().template getLanes<R>(), std::index_sequence<I...>());
+	return retVal;
+}
+
+template <typename R, typename... A>
+DynamicValue applyToValues(R (*)(A...), GenericFunction fn, const std::vector<DynamicValue>& args)
+{
+	return applyToValues<R, A...>(fn, args, std::index_sequence_for<A...>());
+}
+
+}
+
+unsigned MathFunction::getNumArgs() const
+{
+	switch (signature)
+	{
+		case MathSignature::UNARY:
+		case MathSignature::TO_INT:
+		case MathSignature::TO_LONG:
+		case MathSignature::TO_LONG_LONG:
+		case MathSignature::NAN_STRING:
+			return 1;
+		case MathSignature::BINARY:
+		case MathSignature::SCALE_INT:
+		case MathSignature::SCALE_LONG:
+		case MathSignature::FREXP:
+		case MathSignature::MODF:
+			return 2;
+		case MathSignature::TERNARY:
+		case MathSignature::REMQUO:
+		case MathSignature::SINCOS:
+			return 3;
+	}
+	llvm_unreachable("Illegal math signature");
+}
+
+const MathFunction* llvm_interpreter::findMathFunction(StringRef name)
+{
+	auto& table = getMathFunctionTable();
+	auto itr = table.find(name);
+	if (itr != table.end())
+		return &itr->second;
+
+	auto numParams = 0u;
+	auto scalarName = getScalarMathName(name, numParams);
+	if (scalarName.empty())
+		return nullptr;
+	itr = table.find(scalarName);
+	if (itr == table.end() || !itr->second.isElementWise() || itr->second.getNumArgs() != numParams)
+		return nullptr;
+	return &itr->second;
+}
+
+void llvm_interpreter::evaluateMathBatch(const MathFunction& fn, size_t count, const void* const* args, void* result)
+{
+	visitElementWiseFunction(fn, [&] (auto typeTag) { applyBatch(typeTag, fn.fn, count, args, result); });
+}
+
+DynamicValue llvm_interpreter::evaluateMathFunction(const MathFunction& fn, const std::vector<DynamicValue>& args)
+{
+	auto retVal = DynamicValue::getUndefValue();
+	visitElementWiseFunction(fn, [&] (auto typeTag) { retVal = applyToValues(typeTag, fn.fn, args); });
+	return retVal;
+}
@@ -0,0 +1,345 @@
+#include "Memory.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+using namespace llvm_interpreter;
+
+// This file contains the parts of MemorySection that deal with the host memory backing a section
+
+size_t MemorySection::getPageSize()
+{
+	static const size_t pageSize = sysconf(_SC_PAGESIZE);
+	return pageSize;
+}
+
+static std::runtime_error makeSystemError(const std::string& what)
+{
+	return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+void MemorySection::grow(size_t minSize)
+{
+	if (reservedSize != 0)
+		throw std::runtime_error("MemorySection::grow() runs out of the reserved address range");
+
+	auto newSize = totalSize * 2;
+	while (newSize <= minSize)
+		newSize *= 2;
+
+	if (backingFd != -1)
+	{
+		// The data lives in the file, so growing is just extending the (sparse) file and mapping more of it
+		if (ftruncate(backingFd, newSize) != 0)
+			throw makeSystemError("MemorySection::grow() cannot extend the backing file");
+		munmap(mem, totalSize);
+		mem = mapBackingFile(newSize);
+	}
+	else
+	{
+		auto newMem = new uint8_t[newSize];
+		std::memcpy(newMem, mem, usedSize);
+		releaseHostBuffer();
+		mem = newMem;
+	}
+	totalSize = newSize;
+}
+
+uint8_t* MemorySection::mapBackingFile(size_t size)
+{
+	auto addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, backingFd, 0);
+	if (addr == MAP_FAILED)
+		throw makeSystemError("MemorySection cannot map the backing file");
+
+	// Most of a large heap is touched through small, scattered objects. Large allocations override this in adviseAllocation()
+	madvise(addr, size, MADV_RANDOM);
+	return static_cast<uint8_t*>(addr);
+}
+
+void MemorySection::releaseMemory()
+{
+	if (backingFd != -1)
+	{
+		munmap(mem, totalSize);
+		close(backingFd);
+		backingFd = -1;
+	}
+	else if (reservedSize != 0)
+	{
+		// This takes the file mappings inside the range along
+		munmap(mem, reservedSize);
+		reservedSize = 0;
+		fileMappings.clear();
+	}
+	else
+		releaseHostBuffer();
+	mem = nullptr;
+}
+
+void MemorySection::releaseHostBuffer()
+{
+	if (copyOnWrite)
+	{
+		munmap(mem, totalSize);
+		copyOnWrite = false;
+	}
+	else
+		delete[] mem;
+}
+
+void MemorySection::mapToFile(const std::string& dir)
+{
+	if (backingFd != -1)
+		throw std::runtime_error("MemorySection::mapToFile() called on a section that is already file-backed");
+	if (reservedSize != 0 || copyOnWrite)
+		throw std::runtime_error("MemorySection::mapToFile() called on a reserved or copy-on-write section");
+
+	auto pathTemplate = std::vector<char>(dir.begin(), dir.end());
+	for (auto c: std::string("/llvm-interpreter-mem-XXXXXX"))
+		pathTemplate.push_back(c);
+	pathTemplate.push_back('\0');
+
+	auto fd = mkstemp(pathTemplate.data());
+	if (fd == -1)
+		throw makeSystemError("MemorySection::mapToFile() cannot create a backing file in " + dir);
+	// Nobody else needs to see the file. Unlinking it right away makes sure the disk space is reclaimed when the section goes away
+	unlink(pathTemplate.data());
+	moveToBackingFile(fd);
+}
+
+void MemorySection::mapToSharedMemory()
+{
+#ifdef __linux__
+	if (backingFd != -1 || reservedSize != 0 || copyOnWrite)
+		throw std::runtime_error("MemorySection::mapToSharedMemory() called on a file-backed, reserved or copy-on-write section");
+
+	auto fd = memfd_create("llvm-interpreter-mem", MFD_CLOEXEC);
+	if (fd == -1)
+		throw makeSystemError("MemorySection::mapToSharedMemory() cannot create shared memory");
+	moveToBackingFile(fd);
+#else
+	mapToFile(P_tmpdir);
+#endif
+}
+
+void MemorySection::moveToBackingFile(int fd)
+{
+	if (ftruncate(fd, totalSize) != 0)
+	{
+		close(fd);
+		throw makeSystemError("MemorySection cannot size the backing file");
+	}
+
+	auto oldMem = mem;
+	backingFd = fd;
+	try
+	{
+		mem = mapBackingFile(totalSize);
+	}
+	catch (...)
+	{
+		backingFd = -1;
+		close(fd);
+		throw;
+	}
+	std::memcpy(mem, oldMem, usedSize);
+	delete[] oldMem;
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	baseMajorFaults = usage.ru_majflt;
+	baseMinorFaults = usage.ru_minflt;
+}
+
+void MemorySection::mapCopyOnWrite(const MemorySection& src)
+{
+	if (src.backingFd == -1)
+		throw std::runtime_error("MemorySection::mapCopyOnWrite() needs a file-backed source section");
+	if (backingFd != -1 || reservedSize != 0 || hasSnapshot())
+		throw std::runtime_error("MemorySection::mapCopyOnWrite() called on a file-backed, reserved or snapshotted section");
+
+	auto addr = mmap(nullptr, src.totalSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, src.backingFd, 0);
+	if (addr == MAP_FAILED)
+		throw makeSystemError("MemorySection::mapCopyOnWrite() cannot map the source section");
+
+	releaseHostBuffer();
+	mem = static_cast<uint8_t*>(addr);
+	totalSize = src.totalSize;
+	usedSize = src.usedSize;
+	copyOnWrite = true;
+}
+
+void MemorySection::swap(MemorySection& other)
+{
+	std::swap(totalSize, other.totalSize);
+	std::swap(usedSize, other.usedSize);
+	std::swap(mem, other.mem);
+	std::swap(reservedSize, other.reservedSize);
+	std::swap(copyOnWrite, other.copyOnWrite);
+	std::swap(backingFd, other.backingFd);
+	std::swap(baseMajorFaults, other.baseMajorFaults);
+	std::swap(baseMinorFaults, other.baseMinorFaults);
+	std::swap(snapshotMem, other.snapshotMem);
+	std::swap(snapshotSize, other.snapshotSize);
+	std::swap(dirtyBitmap, other.dirtyBitmap);
+	std::swap(dirtyPages, other.dirtyPages);
+	std::swap(fileMappings, other.fileMappings);
+}
+
+void MemorySection::reserve(size_t capacity)
+{
+	if (reservedSize != 0)
+		return;
+	if (backingFd != -1)
+		throw std::runtime_error("MemorySection::reserve() called on a file-backed section");
+	if (capacity <= usedSize)
+		throw std::runtime_error("MemorySection::reserve() called with a capacity smaller than the section");
+
+	// Pages of the range are only committed once they are touched, so reserving far more than the guest ever uses is cheap
+	auto addr = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (addr == MAP_FAILED)
+		throw makeSystemError("MemorySection::reserve() cannot reserve the address range");
+
+	auto newMem = static_cast<uint8_t*>(addr);
+	std::memcpy(newMem, mem, usedSize);
+	releaseHostBuffer();
+	mem = newMem;
+	totalSize = capacity;
+	reservedSize = capacity;
+}
+
+void MemorySection::mapFile(Address addr, size_t size, int fd, uint64_t offset, bool shared)
+{
+	auto pageSize = getPageSize();
+	if (reservedSize == 0)
+		throw std::runtime_error("MemorySection::mapFile() called on a section that is not reserved");
+	if (!isRangeLegal(addr, size) || addr % pageSize != 0 || size % pageSize != 0 || offset % pageSize != 0)
+		throw std::out_of_range("MemorySection::mapFile() maps a range that is unallocated or not page-aligned");
+
+	// MAP_FIXED replaces the pages of the reserved range in place, so the section does not move and no other range is affected
+	auto flags = (shared ? MAP_SHARED : MAP_PRIVATE) | MAP_FIXED;
+	if (mmap(mem + addr, size, PROT_READ | PROT_WRITE, flags, fd, offset) == MAP_FAILED)
+		throw makeSystemError("MemorySection::mapFile() cannot map the file");
+	// The contents changed without a write, so a snapshot must bring them back too
+	touch(addr, size);
+	fileMappings.push_back(FileMapping { addr, size, shared });
+}
+
+void MemorySection::unmapFile(Address addr, size_t size)
+{
+	if (reservedSize == 0 || size == 0)
+		return;
+	if (!isRangeLegal(addr, size) || addr % getPageSize() != 0)
+		throw std::out_of_range("MemorySection::unmapFile() unmaps a range that is unallocated or not page-aligned");
+
+	if (mmap(mem + addr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED)
+		throw makeSystemError("MemorySection::unmapFile() cannot replace the mapping");
+	touch(addr, size);
+	fileMappings.erase(std::remove_if(fileMappings.begin(), fileMappings.end(), [addr, size] (const FileMapping& m)
+	{
+		return m.addr >= addr && m.addr + m.size <= addr + size;
+	}), fileMappings.end());
+}
+
+bool MemorySection::hasSharedFileMappings() const
+{
+	return std::any_of(fileMappings.begin(), fileMappings.end(), [] (const FileMapping& m) { return m.shared; });
+}
+
+void MemorySection::adviseAllocation(Address addr, size_t size)
+{
+	if (size < SEQUENTIAL_ADVICE_THRESHOLD)
+		return;
+
+	// madvise() works on whole pages. Only advise the pages that lie entirely inside the allocation so that neighbouring objects keep their advice
+	auto pageSize = getPageSize();
+	auto begin = (addr + pageSize - 1) / pageSize * pageSize;
+	auto end = (addr + size) / pageSize * pageSize;
+	if (begin < end)
+		madvise(mem + begin, end - begin, MADV_SEQUENTIAL);
+}
+
+MemorySection::PagingStats MemorySection::getPagingStats() const
+{
+	auto stats = PagingStats{ totalSize, 0, 0, 0 };
+	if (backingFd == -1)
+		return stats;
+
+	auto pageSize = getPageSize();
+	auto numPages = (totalSize + pageSize - 1) / pageSize;
+	auto residency = std::vector<unsigned char>(numPages);
+	if (mincore(mem, totalSize, residency.data()) == 0)
+	{
+		for (auto page: residency)
+		{
+			if (page & 1)
+				stats.residentBytes += pageSize;
+		}
+	}
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	stats.majorFaults = usage.ru_majflt - baseMajorFaults;
+	stats.minorFaults = usage.ru_minflt - baseMinorFaults;
+	return stats;
+}
+
+void MemorySection::takeSnapshot()
+{
+	if (hasSharedFileMappings())
+		throw std::runtime_error("MemorySection::takeSnapshot() called while a file is mapped shared");
+
+	snapshotMem.reset(new uint8_t[usedSize]);
+	std::memcpy(snapshotMem.get(), mem, usedSize);
+	snapshotSize = usedSize;
+
+	auto numPages = (snapshotSize >> SNAPSHOT_PAGE_SHIFT) + 1;
+	dirtyBitmap.assign(numPages, false);
+	dirtyPages.clear();
+}
+
+void MemorySection::markDirty(Address addr, size_t size)
+{
+	auto lastAddr = std::min<size_t>(addr + std::max<size_t>(size, 1), snapshotSize) - 1;
+	for (auto page = addr >> SNAPSHOT_PAGE_SHIFT, lastPage = lastAddr >> SNAPSHOT_PAGE_SHIFT; page <= lastPage; ++page)
+	{
+		if (!dirtyBitmap[page])
+		{
+			dirtyBitmap[page] = true;
+			dirtyPages.push_back(page);
+		}
+	}
+}
+
+void MemorySection::restoreSnapshot()
+{
+	if (!hasSnapshot())
+		throw std::runtime_error("MemorySection::restoreSnapshot() called without a snapshot");
+
+	// Everything allocated after the snapshot is simply dropped. Only the pages that existed at snapshot time need their contents back
+	for (auto page: dirtyPages)
+	{
+		auto pageBegin = page << SNAPSHOT_PAGE_SHIFT;
+		auto pageEnd = std::min<size_t>(pageBegin + (size_t(1) << SNAPSHOT_PAGE_SHIFT), snapshotSize);
+		std::memcpy(mem + pageBegin, snapshotMem.get() + pageBegin, pageEnd - pageBegin);
+		dirtyBitmap[page] = false;
+	}
+	dirtyPages.clear();
+
+	// Files mapped into memory that is dropped must not show up in what gets allocated there next
+	auto dropped = std::vector<FileMapping>();
+	for (auto& mapping: fileMappings)
+		if (mapping.addr >= snapshotSize)
+			dropped.push_back(mapping);
+	for (auto& mapping: dropped)
+		unmapFile(mapping.addr, mapping.size);
+
+	usedSize = snapshotSize;
+}
@@ -0,0 +1,150 @@
+#include "Interpreter.h"
+
+#include "llvm/Support/MathExtras.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace llvm;
+using namespace llvm_interpreter;
+
+// This file contains guest memory mappings. Files are mapped straight into the heap section with MAP_FIXED, so guest code reads them in place through the same host pointers as any other heap memory, and nothing is copied up front. The guest was compiled against the same ABI as the host, so the mmap() flags are passed through as they are
+
+namespace
+{
+
+DynamicValue getMapFailed()
+{
+	// MAP_FAILED is (void*)-1, which the guest compares against as a constant
+	return DynamicValue::getPointerValue(PointerAddressSpace::GLOBAL_SPACE, ~Address(0));
+}
+
+}
+
+bool Interpreter::reserveHeapForMapping()
+{
+	if (heapMem.isFileBacked())
+		return false;
+	heapMem.reserve(HEAP_RESERVE_SIZE);
+	return true;
+}
+
+Address Interpreter::allocateHeapMem(uint64_t size)
+{
+	if (size >= MAPPED_READ_MIN_SIZE && reserveHeapForMapping())
+		return heapMem.allocate(size, MemorySection::getPageSize());
+	return heapMem.allocate(size, 16);
+}
+
+DynamicValue Interpreter::mapGuestMemory(const std::vector<DynamicValue>& argValues)
+{
+	auto size = argValues.at(1).getAsIntValue().getInt().getZExtValue();
+	auto prot = int(argValues.at(2).getAsIntValue().getInt().getSExtValue());
+	auto flags = int(argValues.at(3).getAsIntValue().getInt().getSExtValue());
+	auto fd = int(argValues.at(4).getAsIntValue().getInt().getSExtValue());
+	auto offset = argValues.at(5).getAsIntValue().getInt().getZExtValue();
+	// The guest does not get to pick addresses in the heap
+	if (size == 0 || (flags & MAP_FIXED) != 0)
+		return getMapFailed();
+
+	auto pageSize = MemorySection::getPageSize();
+	auto mapSize = alignTo(size, pageSize);
+	if ((flags & MAP_ANONYMOUS) != 0)
+	{
+		auto addr = heapMem.allocate(mapSize, pageSize);
+		heapMem.fill(addr, 0, mapSize);
+		return DynamicValue::getPointerValue(PointerAddressSpace::HEAP_SPACE, addr);
+	}
+
+	// A recorded call logs the mapped file as written to guest memory, so that a replay has its contents without the file
+	auto allocate = [this, mapSize, pageSize] ()
+	{
+		auto addr = heapMem.allocate(mapSize, pageSize);
+		noteCallEffect(CallEffect::Kind::ALLOCATE, DynamicValue::getPointerValue(PointerAddressSpace::HEAP_SPACE, addr).getAsPointerValue(), mapSize, pageSize);
+		return addr;
+	};
+	auto mapped = [this, mapSize] (Address addr)
+	{
+		auto ptr = DynamicValue::getPointerValue(PointerAddressSpace::HEAP_SPACE, addr);
+		noteCallEffect(CallEffect::Kind::WRITE, ptr.getAsPointerValue(), mapSize);
+		return ptr;
+	};
+
+	// Guest memory is always mapped writable, which a file opened read-only only allows privately. Without PROT_WRITE the guest cannot tell the difference
+	auto shared = (flags & MAP_SHARED) != 0 && (prot & PROT_WRITE) != 0;
+	if (offset % pageSize != 0)
+		return getMapFailed();
+	if (reserveHeapForMapping())
+	{
+		auto addr = allocate();
+		try
+		{
+			heapMem.mapFile(addr, mapSize, fd, offset, shared);
+		}
+		catch (const std::runtime_error&)
+		{
+			return getMapFailed();
+		}
+		return mapped(addr);
+	}
+
+	// A file-backed heap cannot have other files mapped into it, so a private mapping falls back to reading the file. Writes to a shared one would be lost that way
+	if (shared)
+		return getMapFailed();
+	auto addr = allocate();
+	auto buf = static_cast<char*>(heapMem.getWritablePointerAtAddress(addr, mapSize));
+	auto done = uint64_t(0);
+	while (done < size)
+	{
+		auto got = ::pread(fd, buf + done, size - done, offset + done);
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got < 0)
+			return getMapFailed();
+		if (got == 0)
+			break;
+		done += got;
+	}
+	std::memset(buf + done, 0, mapSize - done);
+	return mapped(addr);
+}
+
+int Interpreter::unmapGuestMemory(const PointerValue& ptr, uint64_t size)
+{
+	auto pageSize = MemorySection::getPageSize();
+	if (ptr.getAddressSpace() != PointerAddressSpace::HEAP_SPACE || ptr.getAddress() % pageSize != 0)
+		return -1;
+
+	// Like heap blocks, the address range is not reused. Dropping the file gives its pages back, though
+	heapMem.unmapFile(ptr.getAddress(), alignTo(size, pageSize));
+	return 0;
+}
+
+size_t Interpreter::readFromStream(int stream, const PointerValue& buf, size_t size)
+{
+	// A large read of a regular file into whole heap pages maps the file over those pages instead of copying it. The mapping is private, so the guest can write to the buffer as usual
+	auto done = size_t(0);
+	auto pageSize = MemorySection::getPageSize();
+	auto fd = -1;
+	auto offset = uint64_t(0), available = uint64_t(0);
+	if (size >= MAPPED_READ_MIN_SIZE && buf.getAddressSpace() == PointerAddressSpace::HEAP_SPACE && buf.getAddress() % pageSize == 0 && heapMem.isReserved() && stdio.getMappableInput(stream, fd, offset, available) && offset % pageSize == 0)
+	{
+		auto mapSize = std::min<uint64_t>(size, available) / pageSize * pageSize;
+		if (mapSize != 0)
+		{
+			heapMem.mapFile(buf.getAddress(), mapSize, fd, offset, false);
+			noteCallEffect(CallEffect::Kind::WRITE, buf, mapSize);
+			stdio.skipInput(stream, mapSize);
+			done = mapSize;
+		}
+	}
+
+	if (done < size)
+	{
+		auto restPtr = DynamicValue::getPointerValue(buf.getAddressSpace(), buf.getAddress() + done);
+		done += stdio.read(stream, static_cast<char*>(getWritablePointer(restPtr.getAsPointerValue(), size - done)), size - done);
+	}
+	return done;
+}
@@ -0,0 +1,92 @@
+#include "ModuleCache.h"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+#include <stdexcept>
+
+using namespace llvm;
+using namespace llvm_interpreter;
+
+// This file contains the on-disk cache of prepared modules
+
+namespace
+{
+
+// Bump this when the layout of the cache files changes. Changes to the prepasses are picked up by getPrepassPipeline()
+const unsigned CACHE_FORMAT_VERSION = 1;
+
+}
+
+ModuleCache::ModuleCache(const std::string& d): dir(d)
+{
+	if (auto ec = sys::fs::create_directories(dir))
+		throw std::runtime_error("Cannot create module cache directory " + dir + ": " + ec.message());
+}
+
+std::string ModuleCache::getCachePath(uint64_t contentHash, PrepassLevel level) const
+{
+	// The bitcode format belongs to the LLVM version that wrote it
+	auto pipelineHash = xxHash64(getPrepassPipeline(level));
+	return dir + "/" + utohexstr(contentHash, true) + "-p" + std::to_string(unsigned(level)) + "-" + utohexstr(pipelineHash, true) + "-v" + std::to_string(CACHE_FORMAT_VERSION) + "-llvm" + std::to_string(LLVM_VERSION_MAJOR) + ".bc";
+}
+
+void ModuleCache::store(const Module& module, const std::string& cachePath) const
+{
+	// Written under a unique name and renamed into place, so that concurrent runs never see a partial file
+	auto fd = 0;
+	auto tmpPath = SmallString<128>();
+	if (sys::fs::createUniqueFile(dir + "/tmp-%%%%%%%%.bc", fd, tmpPath))
+		return;
+	{
+		raw_fd_ostream out(fd, true);
+		WriteBitcodeToFile(module, out);
+		out.close();
+		if (out.has_error())
+		{
+			out.clear_error();
+			sys::fs::remove(tmpPath);
+			return;
+		}
+	}
+	if (sys::fs::rename(tmpPath, cachePath))
+		sys::fs::remove(tmpPath);
+}
+
+std::unique_ptr<Module> ModuleCache::loadModule(const std::string& path, PrepassLevel level, LLVMContext& context, SMDiagnostic& err) const
+{
+	auto source = MemoryBuffer::getFileOrSTDIN(path);
+	if (!source)
+	{
+		err = SMDiagnostic(path, SourceMgr::DK_Error, "Could not open input file: " + source.getError().message());
+		return nullptr;
+	}
+	auto cachePath = getCachePath(xxHash64((*source)->getBuffer()), level);
+
+	// The mapping is owned by the module, which reads function bodies from it on demand
+	if (auto cached = MemoryBuffer::getFile(cachePath, false, false))
+	{
+		auto module = getOwningLazyBitcodeModule(std::move(*cached), context);
+		if (module)
+			return std::move(*module);
+		// A damaged entry is replaced below
+		consumeError(module.takeError());
+	}
+
+	auto module = parseIR((*source)->getMemBufferRef(), err, context);
+	if (!module)
+		return nullptr;
+	runPrepasses(*module, level);
+	store(*module, cachePath);
+	return module;
+}
@@ -0,0 +1,30 @@
+#include "Interpreter.h"
+
+#include "llvm/IR/Module.h"
+
+using namespace llvm;
+using namespace llvm_interpreter;
+
+// This file contains the module image: the state an interpreted module needs that is the same for every execution of it. Loading an image lays out and initializes the globals once; interpreters created from it then start from a copy-on-write mapping of that memory instead of evaluating every initializer again
+
+ModuleImage::ModuleImage(Module* m): module(m), readOnlyBegin(0), readOnlyEnd(0), loaded(false), inlineThreshold(0), lazyBodies(!m->isMaterialized())
+{
+}
+
+// Out of line, since the inlined copies are owned through a unique_ptr to Module
+ModuleImage::~ModuleImage() = default;
+
+std::shared_ptr<ModuleImage> ModuleImage::load(Module* m, unsigned inlineThreshold)
+{
+	auto image = std::make_shared<ModuleImage>(m);
+	image->inlineThreshold = inlineThreshold;
+
+	// Globals are evaluated eagerly, so every global and function has its address before the image is shared
+	auto builder = Interpreter(image);
+	builder.evaluateGlobals();
+
+	image->initialGlobals.swap(builder.globalMem);
+	image->initialGlobals.mapToSharedMemory();
+	image->loaded = true;
+	return image;
+}
@@ -0,0 +1,109 @@
+#include "Prepass.h"
+
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/InstCombine/InstCombine.h"
+#include "llvm/Transforms/Scalar/ADCE.h"
+#include "llvm/Transforms/Scalar/EarlyCSE.h"
+#include "llvm/Transforms/Scalar/GVN.h"
+#include "llvm/Transforms/Scalar/LICM.h"
+#include "llvm/Transforms/Scalar/LoopPassManager.h"
+#include "llvm/Transforms/Scalar/SCCP.h"
+#include "llvm/Transforms/Scalar/SimplifyCFG.h"
+#include "llvm/Transforms/Scalar/SROA.h"
+#include "llvm/Transforms/Utils/LowerInvoke.h"
+#include "llvm/Transforms/Utils/Mem2Reg.h"
+
+using namespace llvm;
+using namespace llvm_interpreter;
+
+// This file contains the pass pipeline that prepares a module for interpretation. Unlike a code generator, the interpreter pays for every instruction it executes, so the pipeline sticks to passes that remove instructions (mostly loads, stores and redundant computations) and avoids ones that trade instructions for native speed (unrolling, vectorization)
+
+namespace
+{
+
+SROAPass createSROAPass()
+{
+#if LLVM_VERSION_MAJOR >= 16
+	return SROAPass(SROAOptions::ModifyCFG);
+#else
+	return SROAPass();
+#endif
+}
+
+// The module cache keys its entries by getPrepassPipeline(), so adding, removing or reordering passes in buildPrepasses() makes it prepare modules again by itself. Bump this for changes that the printed pipeline does not show, such as the module edits in runPrepasses() or different pass options
+const unsigned PREPASS_REVISION = 1;
+
+void buildPrepasses(FunctionPassManager& fpm, PrepassLevel level)
+{
+	if (level >= PrepassLevel::BASIC)
+	{
+		fpm.addPass(createSROAPass());
+		fpm.addPass(PromotePass());
+		fpm.addPass(EarlyCSEPass());
+		fpm.addPass(InstCombinePass());
+		fpm.addPass(SimplifyCFGPass());
+	}
+	if (level >= PrepassLevel::FULL)
+	{
+		fpm.addPass(SCCPPass());
+		fpm.addPass(createFunctionToLoopPassAdaptor(LICMPass(), /*UseMemorySSA=*/true));
+		fpm.addPass(GVNPass());
+		fpm.addPass(InstCombinePass());
+		fpm.addPass(ADCEPass());
+		fpm.addPass(SimplifyCFGPass());
+	}
+
+	// The lowering goes last so that none of the cleanups above can reintroduce what it removes. Switches and atomics are executed natively, so there is no need to lower them
+	fpm.addPass(LowerInvokePass());
+}
+
+}
+
+void llvm_interpreter::runPrepasses(Module& module, PrepassLevel level)
+{
+	if (level == PrepassLevel::NONE)
+		return;
+
+	// clang -O0 marks every function optnone. Drop it so that no pass skips them
+	if (level >= PrepassLevel::BASIC)
+	{
+		for (auto& f: module)
+			f.removeFnAttr(Attribute::OptimizeNone);
+	}
+
+	LoopAnalysisManager lam;
+	FunctionAnalysisManager fam;
+	CGSCCAnalysisManager cgam;
+	ModuleAnalysisManager mam;
+
+	PassBuilder passBuilder;
+	passBuilder.registerModuleAnalyses(mam);
+	passBuilder.registerCGSCCAnalyses(cgam);
+	passBuilder.registerFunctionAnalyses(fam);
+	passBuilder.registerLoopAnalyses(lam);
+	passBuilder.crossRegisterProxies(lam, fam, cgam, mam);
+
+	FunctionPassManager fpm;
+	buildPrepasses(fpm, level);
+
+	ModulePassManager mpm;
+	mpm.addPass(createModuleToFunctionPassAdaptor(std::move(fpm)));
+	mpm.run(module, mam);
+}
+
+std::string llvm_interpreter::getPrepassPipeline(PrepassLevel level)
+{
+	auto pipeline = "r" + std::to_string(PREPASS_REVISION) + ":";
+	if (level == PrepassLevel::NONE)
+		return pipeline;
+
+	FunctionPassManager fpm;
+	buildPrepasses(fpm, level);
+	auto os = raw_string_ostream(pipeline);
+	fpm.printPipeline(os, [] (StringRef className) { return className; });
+	return os.str();
+}
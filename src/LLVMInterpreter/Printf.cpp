@@ -0,0 +1,312 @@
+#include "Interpreter.h"
+
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Module.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+using namespace llvm;
+using namespace llvm_interpreter;
+
+// This file contains the printf family. A format string is parsed into directives once, and each conversion is then handed to the host snprintf with an argument of the width the length modifier asks for. Format strings in read-only globals cannot change, so their directives are kept per call site
+
+namespace
+{
+
+// Append the output of the host snprintf to (out). (stars) are the field width and precision arguments that the format asks for
+template <typename T>
+void appendFormatted(std::string& out, const std::string& fmt, const int* stars, unsigned numStars, T val)
+{
+	auto print = [&fmt, stars, numStars, val] (char* buf, size_t size)
+	{
+		switch (numStars)
+		{
+			case 0:
+				return std::snprintf(buf, size, fmt.c_str(), val);
+			case 1:
+				return std::snprintf(buf, size, fmt.c_str(), stars[0], val);
+			default:
+				return std::snprintf(buf, size, fmt.c_str(), stars[0], stars[1], val);
+		}
+	};
+
+	// Most conversions are short, so try printing straight into the string before asking for the exact length
+	const size_t guessSize = 64;
+	auto oldSize = out.size();
+	out.resize(oldSize + guessSize);
+	auto len = print(&out[oldSize], guessSize);
+	if (len < 0)
+		throw std::runtime_error("Invalid printf conversion: " + fmt);
+	if (size_t(len) >= guessSize)
+	{
+		out.resize(oldSize + len + 1);
+		print(&out[oldSize], len + 1);
+	}
+	out.resize(oldSize + len);
+}
+
+}
+
+void Interpreter::parseFormat(const char* fmt, std::vector<FormatDirective>& directives) const
+{
+	auto longBits = getDataLayout().getPointerSizeInBits();
+	auto literal = std::string();
+	auto p = fmt;
+	while (*p != '\0')
+	{
+		if (*p != '%')
+		{
+			literal += *p++;
+			continue;
+		}
+		if (p[1] == '%')
+		{
+			literal += '%';
+			p += 2;
+			continue;
+		}
+
+		auto start = p++;
+		auto directive = FormatDirective { std::string(), "%", FormatArgKind::NONE, 32, false, false };
+		while (*p != '\0' && std::strchr("-+ #0'", *p) != nullptr)
+			directive.hostFormat += *p++;
+		if (*p == '*')
+		{
+			directive.widthArg = true;
+			directive.hostFormat += *p++;
+		}
+		else
+			while (std::isdigit(*p))
+				directive.hostFormat += *p++;
+		if (*p == '.')
+		{
+			directive.hostFormat += *p++;
+			if (*p == '*')
+			{
+				directive.precisionArg = true;
+				directive.hostFormat += *p++;
+			}
+			else
+				while (std::isdigit(*p))
+					directive.hostFormat += *p++;
+		}
+
+		switch (*p)
+		{
+			case 'h':
+				directive.intBits = (p[1] == 'h') ? 8 : 16;
+				p += (p[1] == 'h') ? 2 : 1;
+				break;
+			case 'l':
+				directive.intBits = (p[1] == 'l') ? 64 : longBits;
+				p += (p[1] == 'l') ? 2 : 1;
+				break;
+			case 'z':
+			case 't':
+				directive.intBits = longBits;
+				++p;
+				break;
+			case 'j':
+			case 'q':
+			case 'L':
+				directive.intBits = 64;
+				++p;
+				break;
+		}
+
+		auto conv = *p;
+		switch (conv)
+		{
+			case 'd':
+			case 'i':
+				directive.argKind = FormatArgKind::SIGNED;
+				break;
+			case 'u':
+			case 'o':
+			case 'x':
+			case 'X':
+				directive.argKind = FormatArgKind::UNSIGNED;
+				break;
+			case 'f':
+			case 'F':
+			case 'e':
+			case 'E':
+			case 'g':
+			case 'G':
+			case 'a':
+			case 'A':
+				directive.argKind = FormatArgKind::DOUBLE;
+				break;
+			case 'c':
+				directive.argKind = FormatArgKind::CHAR;
+				break;
+			case 's':
+				directive.argKind = FormatArgKind::STRING;
+				break;
+			case 'p':
+				directive.argKind = FormatArgKind::POINTER;
+				break;
+			case 'n':
+				directive.argKind = FormatArgKind::COUNT;
+				break;
+			default:
+				// Print what cannot be parsed as it is, the way glibc does
+				if (*p != '\0')
+					++p;
+				literal.append(start, p);
+				continue;
+		}
+		++p;
+
+		if (directive.argKind == FormatArgKind::SIGNED || directive.argKind == FormatArgKind::UNSIGNED)
+			directive.hostFormat += "ll";
+		directive.hostFormat += conv;
+		directive.literal = std::move(literal);
+		literal.clear();
+		directives.push_back(std::move(directive));
+	}
+
+	if (!literal.empty())
+		directives.push_back(FormatDirective { std::move(literal), std::string(), FormatArgKind::NONE, 0, false, false });
+}
+
+const std::vector<Interpreter::FormatDirective>& Interpreter::getFormatDirectives(const CallBase* cs, const PointerValue& fmtPtr, std::vector<FormatDirective>& scratch)
+{
+	auto cached = (cs != nullptr && fmtPtr.getAddressSpace() == PointerAddressSpace::GLOBAL_SPACE);
+	auto fmtAddr = cached ? MemorySection::encodePointer(fmtPtr) : 0;
+	if (cached)
+	{
+		// A call site that already parsed this format found it read-only then, and read-only memory does not change
+		auto itr = currentThread->formatPlans.find(cs);
+		if (itr != currentThread->formatPlans.end() && itr->second.formatAddr == fmtAddr)
+			return itr->second.directives;
+	}
+
+	auto fmtLen = uint64_t(0);
+	auto fmt = getGuestString(fmtPtr, fmtLen);
+	if (!cached || !isReadOnlyGlobalRange(fmtPtr.getAddress(), fmtLen + 1))
+	{
+		parseFormat(fmt, scratch);
+		return scratch;
+	}
+	auto& plan = currentThread->formatPlans[cs];
+	plan.formatAddr = fmtAddr;
+	plan.directives.clear();
+	parseFormat(fmt, plan.directives);
+	return plan.directives;
+}
+
+template <typename NextArg>
+void Interpreter::formatDirectives(const std::vector<FormatDirective>& directives, std::string& out, NextArg&& nextArg)
+{
+	for (auto const& directive: directives)
+	{
+		out += directive.literal;
+		if (directive.argKind == FormatArgKind::NONE)
+			continue;
+
+		int stars[2];
+		auto numStars = 0u;
+		if (directive.widthArg)
+			stars[numStars++] = nextArg(FormatArgKind::SIGNED, 32).getAsIntValue().getInt().getSExtValue();
+		if (directive.precisionArg)
+			stars[numStars++] = nextArg(FormatArgKind::SIGNED, 32).getAsIntValue().getInt().getSExtValue();
+
+		auto&& arg = nextArg(directive.argKind, directive.intBits);
+		switch (directive.argKind)
+		{
+			case FormatArgKind::SIGNED:
+			case FormatArgKind::UNSIGNED:
+			{
+				// Arguments narrower than int arrive promoted, so the value is cut back to the width the length modifier names before it is extended again
+				auto intVal = arg.isPointerValue() ? APInt(64, MemorySection::encodePointer(arg.getAsPointerValue())) : arg.getAsIntValue().getInt();
+				if (intVal.getBitWidth() > directive.intBits)
+					intVal = intVal.trunc(directive.intBits);
+				auto hostVal = (directive.argKind == FormatArgKind::SIGNED) ? intVal.getSExtValue() : static_cast<long long>(intVal.getZExtValue());
+				appendFormatted(out, directive.hostFormat, stars, numStars, static_cast<long long>(hostVal));
+				break;
+			}
+			case FormatArgKind::DOUBLE:
+				appendFormatted(out, directive.hostFormat, stars, numStars, arg.getAsFloatValue().getFloat());
+				break;
+			case FormatArgKind::CHAR:
+				appendFormatted(out, directive.hostFormat, stars, numStars, static_cast<int>(static_cast<unsigned char>(arg.getAsIntValue().getInt().getZExtValue())));
+				break;
+			case FormatArgKind::STRING:
+			{
+				auto& strPtr = arg.getAsPointerValue();
+				auto isNull = (strPtr.getAddressSpace() == PointerAddressSpace::GLOBAL_SPACE && strPtr.getAddress() == 0);
+				appendFormatted(out, directive.hostFormat, stars, numStars, isNull ? "(null)" : static_cast<const char*>(getRawPointer(strPtr)));
+				break;
+			}
+			case FormatArgKind::POINTER:
+			{
+				// Guest pointers print as they are stored in guest memory
+				auto& ptr = arg.getAsPointerValue();
+				auto isNull = (ptr.getAddressSpace() == PointerAddressSpace::GLOBAL_SPACE && ptr.getAddress() == 0);
+				appendFormatted(out, directive.hostFormat, stars, numStars, isNull ? nullptr : reinterpret_cast<const void*>(MemorySection::encodePointer(ptr)));
+				break;
+			}
+			case FormatArgKind::COUNT:
+				writeToPointer(arg.getAsPointerValue(), DynamicValue::getIntValue(APInt(directive.intBits, out.size())));
+				break;
+			case FormatArgKind::NONE:
+				break;
+		}
+	}
+}
+
+const std::string& Interpreter::formatGuestString(const CallBase* cs, const std::vector<DynamicValue>& argValues, unsigned fmtIdx, bool fromVaList)
+{
+	auto scratch = std::vector<FormatDirective>();
+	auto& directives = getFormatDirectives(cs, argValues.at(fmtIdx).getAsPointerValue(), scratch);
+	auto& out = currentThread->formatBuffer;
+	out.clear();
+
+	if (!fromVaList)
+	{
+		auto nextIdx = fmtIdx + 1;
+		formatDirectives(directives, out, [&argValues, &nextIdx] (FormatArgKind, unsigned) -> const DynamicValue&
+		{
+			if (nextIdx >= argValues.size())
+				throw std::runtime_error("Too few arguments for a printf format string");
+			return argValues[nextIdx++];
+		});
+		return out;
+	}
+
+	// The arguments are read off the va_list with the types the format string asks for. A va_list that is a plain pointer is passed by value, the others by address
+	auto cursor = argValues.at(fmtIdx + 1);
+	if (vaListKind != VaListKind::POINTER)
+		cursor = readFromPointer(getVaListCursor(cursor.getAsPointerValue()).getAsPointerValue(), bytePtrType);
+	auto& context = module->getContext();
+	formatDirectives(directives, out, [this, &cursor, &context] (FormatArgKind kind, unsigned intBits)
+	{
+		switch (kind)
+		{
+			case FormatArgKind::SIGNED:
+			case FormatArgKind::UNSIGNED:
+				return readVarArg(cursor, IntegerType::get(context, std::max(intBits, 32u)));
+			case FormatArgKind::DOUBLE:
+				return readVarArg(cursor, Type::getDoubleTy(context));
+			case FormatArgKind::CHAR:
+				return readVarArg(cursor, Type::getInt32Ty(context));
+			default:
+				return readVarArg(cursor, bytePtrType);
+		}
+	});
+	return out;
+}
+
+void Interpreter::copyFormattedString(const PointerValue& dest, uint64_t size, const std::string& str)
+{
+	if (size == 0)
+		return;
+
+	auto len = std::min<uint64_t>(str.size(), size - 1);
+	auto buf = static_cast<char*>(getWritablePointer(dest, len + 1));
+	std::memcpy(buf, str.data(), len);
+	buf[len] = '\0';
+}
@@ -0,0 +1,383 @@
+#include "GuestStdio.h"
+#include "Interpreter.h"
+
+#include "llvm/IR/Module.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace llvm;
+using namespace llvm_interpreter;
+
+// This file contains the guest stdio streams
+
+GuestStdio::GuestStdio(): bufferSize(DEFAULT_BUFFER_SIZE)
+{
+	streams.resize(3);
+	resetStdStreams();
+}
+
+void GuestStdio::resetStdStreams()
+{
+	for (auto fd: { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO })
+	{
+		auto s = std::make_unique<Stream>();
+		s->fd = fd;
+		s->readable = (fd == STDIN_FILENO);
+		s->writable = !s->readable;
+		s->ownsFd = false;
+		s->lineBuffered = (fd == STDOUT_FILENO && ::isatty(fd));
+		// stderr is unbuffered, as in C
+		s->capacity = (fd == STDERR_FILENO) ? 0 : bufferSize;
+		s->inPos = 0;
+		s->eof = s->error = false;
+		streams[fd] = std::move(s);
+	}
+}
+
+GuestStdio::~GuestStdio()
+{
+	flushAll();
+	for (auto& s: streams)
+		if (s != nullptr && s->ownsFd)
+			::close(s->fd);
+}
+
+void GuestStdio::setBufferSize(size_t size)
+{
+	bufferSize = size;
+	if (streams[STDOUT_FILENO] != nullptr)
+	{
+		flush(STDOUT_FILENO);
+		streams[STDOUT_FILENO]->capacity = size;
+	}
+}
+
+bool GuestStdio::isOpen(int stream) const
+{
+	return stream >= 0 && size_t(stream) < streams.size() && streams[stream] != nullptr;
+}
+
+GuestStdio::Stream& GuestStdio::getStream(int stream)
+{
+	if (!isOpen(stream))
+		throw std::runtime_error("Guest stream " + std::to_string(stream) + " is not open");
+	return *streams[stream];
+}
+
+int GuestStdio::addStream(std::unique_ptr<Stream> s)
+{
+	auto itr = std::find(streams.begin(), streams.end(), nullptr);
+	if (itr != streams.end())
+	{
+		*itr = std::move(s);
+		return itr - streams.begin();
+	}
+	streams.push_back(std::move(s));
+	return streams.size() - 1;
+}
+
+int GuestStdio::open(const char* path, const char* mode)
+{
+	auto flags = 0;
+	switch (mode[0])
+	{
+		case 'r':
+			flags = O_RDONLY;
+			break;
+		case 'w':
+			flags = O_WRONLY | O_CREAT | O_TRUNC;
+			break;
+		case 'a':
+			flags = O_WRONLY | O_CREAT | O_APPEND;
+			break;
+		default:
+			return -1;
+	}
+	for (auto p = mode + 1; *p != '\0'; ++p)
+	{
+		if (*p == '+')
+			flags = (flags & ~O_ACCMODE) | O_RDWR;
+		else if (*p == 'x')
+			flags |= O_EXCL;
+		else if (*p == 'e')
+			flags |= O_CLOEXEC;
+	}
+
+	auto fd = ::open(path, flags, 0666);
+	if (fd < 0)
+		return -1;
+
+	auto s = std::make_unique<Stream>();
+	s->fd = fd;
+	s->readable = ((flags & O_ACCMODE) != O_WRONLY);
+	s->writable = ((flags & O_ACCMODE) != O_RDONLY);
+	s->ownsFd = true;
+	s->lineBuffered = false;
+	s->capacity = bufferSize;
+	s->inPos = 0;
+	s->eof = s->error = false;
+	return addStream(std::move(s));
+}
+
+int GuestStdio::close(int stream)
+{
+	auto ret = flush(stream);
+	auto& s = streams[stream];
+	if (s->ownsFd && ::close(s->fd) != 0)
+		ret = END_OF_FILE;
+	s.reset();
+	return ret;
+}
+
+bool GuestStdio::writeOut(Stream& s, const char* data, size_t size)
+{
+	iovec iov[2] = { { &s.outBuf[0], s.outBuf.size() }, { const_cast<char*>(data), size } };
+	auto iovIdx = (iov[0].iov_len == 0) ? 1 : 0;
+	while (iovIdx < 2)
+	{
+		auto written = ::writev(s.fd, iov + iovIdx, 2 - iovIdx);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			s.error = true;
+			s.outBuf.clear();
+			return false;
+		}
+
+		// Skip what a partial write got through
+		for (; iovIdx < 2 && size_t(written) >= iov[iovIdx].iov_len; ++iovIdx)
+			written -= iov[iovIdx].iov_len;
+		if (iovIdx < 2)
+		{
+			iov[iovIdx].iov_base = static_cast<char*>(iov[iovIdx].iov_base) + written;
+			iov[iovIdx].iov_len -= written;
+		}
+	}
+	s.outBuf.clear();
+	return true;
+}
+
+size_t GuestStdio::write(int stream, const char* data, size_t size)
+{
+	auto& s = getStream(stream);
+	if (!s.writable)
+	{
+		s.error = true;
+		return 0;
+	}
+
+	if (s.outBuf.size() + size <= s.capacity)
+	{
+		s.outBuf.append(data, size);
+		if (s.lineBuffered && std::memchr(data, '\n', size) != nullptr && !writeOut(s, nullptr, 0))
+			return 0;
+		return size;
+	}
+	return writeOut(s, data, size) ? size : 0;
+}
+
+bool GuestStdio::fillInput(Stream& s)
+{
+	if (!s.readable)
+	{
+		s.error = true;
+		return false;
+	}
+	if (s.eof || s.error)
+		return false;
+
+	// Like the C library, make sure a prompt on the terminal shows before waiting for the input it asks for
+	if (&s == streams[STDIN_FILENO].get() && isOpen(STDOUT_FILENO) && streams[STDOUT_FILENO]->lineBuffered)
+		flush(STDOUT_FILENO);
+
+	s.inBuf.resize(std::max<size_t>(s.capacity, 4096));
+	auto got = ssize_t(0);
+	do
+		got = ::read(s.fd, s.inBuf.data(), s.inBuf.size());
+	while (got < 0 && errno == EINTR);
+
+	s.inBuf.resize(std::max<ssize_t>(got, 0));
+	s.inPos = 0;
+	if (got == 0)
+		s.eof = true;
+	else if (got < 0)
+		s.error = true;
+	return got > 0;
+}
+
+size_t GuestStdio::read(int stream, char* data, size_t size)
+{
+	auto& s = getStream(stream);
+	auto done = size_t(0);
+	while (done < size)
+	{
+		if (s.inPos == s.inBuf.size() && !fillInput(s))
+			break;
+		auto chunk = std::min(size - done, s.inBuf.size() - s.inPos);
+		std::memcpy(data + done, s.inBuf.data() + s.inPos, chunk);
+		s.inPos += chunk;
+		done += chunk;
+	}
+	return done;
+}
+
+size_t GuestStdio::readLine(int stream, char* data, size_t size)
+{
+	auto& s = getStream(stream);
+	auto done = size_t(0);
+	while (done < size)
+	{
+		if (s.inPos == s.inBuf.size() && !fillInput(s))
+			break;
+		auto begin = s.inBuf.data() + s.inPos;
+		auto chunk = std::min(size - done, s.inBuf.size() - s.inPos);
+		auto newline = static_cast<const char*>(std::memchr(begin, '\n', chunk));
+		if (newline != nullptr)
+			chunk = newline - begin + 1;
+		std::memcpy(data + done, begin, chunk);
+		s.inPos += chunk;
+		done += chunk;
+		if (newline != nullptr)
+			break;
+	}
+	return done;
+}
+
+int GuestStdio::getChar(int stream)
+{
+	auto& s = getStream(stream);
+	if (s.inPos == s.inBuf.size() && !fillInput(s))
+		return END_OF_FILE;
+	return static_cast<unsigned char>(s.inBuf[s.inPos++]);
+}
+
+int GuestStdio::getFd(int stream)
+{
+	return getStream(stream).fd;
+}
+
+bool GuestStdio::getMappableInput(int stream, int& fd, uint64_t& offset, uint64_t& available)
+{
+	auto& s = getStream(stream);
+	if (!s.readable || s.eof || s.error || s.inPos != s.inBuf.size() || !s.outBuf.empty())
+		return false;
+
+	struct stat st;
+	if (::fstat(s.fd, &st) != 0 || !S_ISREG(st.st_mode))
+		return false;
+	auto pos = ::lseek(s.fd, 0, SEEK_CUR);
+	if (pos < 0 || pos > st.st_size)
+		return false;
+
+	fd = s.fd;
+	offset = pos;
+	available = st.st_size - pos;
+	return true;
+}
+
+void GuestStdio::skipInput(int stream, uint64_t size)
+{
+	auto& s = getStream(stream);
+	if (::lseek(s.fd, size, SEEK_CUR) < 0)
+		s.error = true;
+}
+
+int GuestStdio::flush(int stream)
+{
+	auto& s = getStream(stream);
+	if (s.outBuf.empty())
+		return 0;
+	return writeOut(s, nullptr, 0) ? 0 : END_OF_FILE;
+}
+
+int GuestStdio::flushAll()
+{
+	auto ret = 0;
+	for (auto i = 0u; i < streams.size(); ++i)
+		if (streams[i] != nullptr && flush(i) != 0)
+			ret = END_OF_FILE;
+	return ret;
+}
+
+void Interpreter::initializeStdStreams()
+{
+	// The guest only ever hands these pointers back to stdio functions, so all a stand-in holds is the number of its stream
+	const char* streamNames[] = { "stdin", "stdout", "stderr" };
+	for (auto i = 0u; i < 3; ++i)
+	{
+		auto gv = module->getNamedGlobal(streamNames[i]);
+		if (gv == nullptr || gv->hasInitializer() || !gv->getValueType()->isPointerTy())
+			continue;
+
+		auto fileAddr = globalMem.allocate(4, 8);
+		globalMem.write(fileAddr, DynamicValue::getIntValue(APInt(32, i)));
+		globalMem.write(image->globalEnv.at(gv), DynamicValue::getPointerValue(PointerAddressSpace::GLOBAL_SPACE, fileAddr));
+	}
+}
+
+int Interpreter::getStreamNumber(const PointerValue& file)
+{
+	// Stand-ins of std streams are in global memory, those of fopen() on the heap
+	auto isNull = (file.getAddressSpace() == PointerAddressSpace::GLOBAL_SPACE && file.getAddress() == 0);
+	if (isNull || file.getAddressSpace() == PointerAddressSpace::STACK_SPACE)
+		throw std::runtime_error("Not a guest FILE");
+	auto stream = int(readFromPointer(file, Type::getInt32Ty(module->getContext())).getAsIntValue().getInt().getSExtValue());
+	if (!stdio.isOpen(stream))
+		throw std::runtime_error("Guest FILE used after fclose()");
+	return stream;
+}
+
+void Interpreter::writeToStream(int stream, StringRef str)
+{
+	// Output of different guest threads must not interleave
+	auto lock = std::lock_guard<std::mutex>(hostMutex);
+	stdio.write(stream, str.data(), str.size());
+}
+
+DynamicValue Interpreter::openGuestFile(const PointerValue& path, const PointerValue& mode)
+{
+	auto lock = std::lock_guard<std::mutex>(hostMutex);
+	auto pathLen = uint64_t(0);
+	auto modeLen = uint64_t(0);
+	auto stream = stdio.open(getGuestString(path, pathLen), getGuestString(mode, modeLen));
+	if (stream < 0)
+		return DynamicValue::getPointerValue(PointerAddressSpace::GLOBAL_SPACE, 0);
+
+	auto fileAddr = heapMem.allocate(4, 8);
+	heapMem.write(fileAddr, DynamicValue::getIntValue(APInt(32, stream)));
+	auto file = DynamicValue::getPointerValue(PointerAddressSpace::HEAP_SPACE, fileAddr);
+	noteCallEffect(CallEffect::Kind::ALLOCATE, file.getAsPointerValue(), 4, 8);
+	noteCallEffect(CallEffect::Kind::WRITE, file.getAsPointerValue(), 4);
+	return file;
+}
+
+int Interpreter::closeGuestFile(const PointerValue& file)
+{
+	auto stream = getStreamNumber(file);
+	auto lock = std::lock_guard<std::mutex>(hostMutex);
+	if (file.getAddressSpace() == PointerAddressSpace::HEAP_SPACE)
+	{
+		heapMem.free(file.getAddress());
+		noteCallEffect(CallEffect::Kind::FREE, file, 0);
+	}
+	return stdio.close(stream);
+}
+
+void Interpreter::resetStdStreams()
+{
+	auto lock = std::lock_guard<std::mutex>(hostMutex);
+	stdio.resetStdStreams();
+}
+
+void Interpreter::setStdioBufferSize(size_t size)
+{
+	auto lock = std::lock_guard<std::mutex>(hostMutex);
+	stdio.setBufferSize(size);
+}
@@ -0,0 +1,255 @@
+#include "Interpreter.h"
+#include "FusionProfile.h"
+
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+
+using namespace llvm;
+using namespace llvm_interpreter;
+
+// This file contains the superinstructions: short dependent instruction sequences that are executed by a single handler. The intermediate values of a fused sequence never go through the stack frame, which saves a binding and a lookup per fused instruction on top of a dispatch
+
+namespace
+{
+
+bool usesValue(const Instruction* user, const Value* v)
+{
+	return std::find(user->op_begin(), user->op_end(), v) != user->op_end();
+}
+
+// The intermediate result of a fused sequence must not be needed anywhere but in the next instruction of the sequence
+bool feedsOnly(const Instruction* inst, const Instruction* user)
+{
+	return inst->hasOneUse() && *inst->user_begin() == user;
+}
+
+bool isScalarIntAdd(const Instruction* inst)
+{
+	return inst->getOpcode() == Instruction::Add && inst->getType()->isIntegerTy();
+}
+
+// The fused handlers access memory with plain reads and writes
+bool isNonAtomicAccess(const Instruction* inst)
+{
+	if (auto loadInst = dyn_cast<LoadInst>(inst))
+		return !loadInst->isAtomic();
+	if (auto storeInst = dyn_cast<StoreInst>(inst))
+		return !storeInst->isAtomic();
+	return false;
+}
+
+}
+
+const Interpreter::BlockPlan& Interpreter::getBlockPlan(const BasicBlock* bb)
+{
+	auto& blockPlans = currentThread->blockPlans;
+	auto itr = blockPlans.find(bb);
+	if (itr != blockPlans.end())
+		return itr->second;
+
+	auto plan = BlockPlan();
+	plan.fusedCond = nullptr;
+
+	auto insts = std::vector<const Instruction*>();
+	for (auto const& inst: *bb)
+	{
+		if (!isa<PHINode>(inst) && !inst.isTerminator())
+			insts.push_back(&inst);
+	}
+
+	auto termInst = bb->getTerminator();
+	if (fusionEnabled && !insts.empty())
+	{
+		// An icmp that only decides the branch is evaluated as part of the branch
+		auto brInst = dyn_cast<BranchInst>(termInst);
+		auto cmpInst = dyn_cast<ICmpInst>(insts.back());
+		if (brInst != nullptr && brInst->isConditional() && cmpInst != nullptr && brInst->getCondition() == cmpInst && feedsOnly(cmpInst, brInst))
+		{
+			plan.fusedCond = cmpInst;
+			insts.pop_back();
+		}
+	}
+
+	for (auto i = 0u, e = static_cast<unsigned>(insts.size()); i < e; ++i)
+	{
+		auto inst = insts[i];
+		auto next = (i + 1 < e) ? insts[i + 1] : nullptr;
+		auto next2 = (i + 2 < e) ? insts[i + 2] : nullptr;
+
+		// Loads from read-only globals are folded right here, while the plan is built, so executing them costs no more than a binding
+		if (auto loadInst = dyn_cast<LoadInst>(inst))
+		{
+			auto foldedVal = foldConstantLoad(loadInst);
+			if (!foldedVal.isUndefValue())
+			{
+				plan.insts.push_back(DecodedInst { inst, inst, FusedOp::FOLDED_LOAD, static_cast<unsigned>(plan.foldedValues.size()) });
+				plan.foldedValues.push_back(std::move(foldedVal));
+				continue;
+			}
+		}
+
+		auto decoded = DecodedInst { inst, inst, FusedOp::NONE, 0 };
+		if (fusionEnabled && next != nullptr && feedsOnly(inst, next))
+		{
+			if (auto loadInst = dyn_cast<LoadInst>(inst))
+			{
+				// load p; add; store p: read-modify-write of a memory location
+				auto storeInst = dyn_cast_or_null<StoreInst>(next2);
+				if (storeInst != nullptr && isNonAtomicAccess(loadInst) && isNonAtomicAccess(storeInst) && loadInst->getType()->isIntegerTy() && isScalarIntAdd(next) && feedsOnly(next, storeInst) && storeInst->getValueOperand() == next && storeInst->getPointerOperand() == loadInst->getPointerOperand())
+					decoded = DecodedInst { inst, storeInst, FusedOp::LOAD_ADD_STORE, 0 };
+			}
+			else if (isa<GetElementPtrInst>(inst) && inst->getType()->isPointerTy())
+			{
+				if (isa<LoadInst>(next) && isNonAtomicAccess(next))
+					decoded = DecodedInst { inst, next, FusedOp::GEP_LOAD, 0 };
+				else if (auto storeInst = dyn_cast<StoreInst>(next))
+				{
+					if (storeInst->getPointerOperand() == inst && storeInst->getValueOperand() != inst && isNonAtomicAccess(storeInst))
+						decoded = DecodedInst { inst, next, FusedOp::GEP_STORE, 0 };
+				}
+			}
+			else if (isScalarIntAdd(inst) && isa<ICmpInst>(next))
+				decoded = DecodedInst { inst, next, FusedOp::ADD_ICMP, 0 };
+		}
+
+		plan.insts.push_back(decoded);
+		// Skip over the rest of the fused sequence
+		while (insts[i] != decoded.last)
+			++i;
+	}
+
+	return blockPlans.insert(std::make_pair(bb, std::move(plan))).first->second;
+}
+
+void Interpreter::evaluateFusedInstruction(StackFrame& frame, const DecodedInst& decoded)
+{
+	switch (decoded.op)
+	{
+		case FusedOp::NONE:
+			evaluateInstruction(frame, decoded.first);
+			break;
+		case FusedOp::GEP_LOAD:
+		{
+			// The pointer operand is the GEP instruction, never a constant, so there is no constant load to fold here
+			auto loadInst = cast<LoadInst>(decoded.last);
+			auto ptrVal = evaluateGEP(frame, cast<GetElementPtrInst>(decoded.first));
+			frame.insertBinding(loadInst, readFromPointer(ptrVal.getAsPointerValue(), loadInst->getType()));
+			break;
+		}
+		case FusedOp::GEP_STORE:
+		{
+			auto storeInst = cast<StoreInst>(decoded.last);
+
+			auto ptrVal = evaluateGEP(frame, cast<GetElementPtrInst>(decoded.first));
+			auto storeVal = evaluateOperand(frame, storeInst->getValueOperand());
+			writeToPointer(ptrVal.getAsPointerValue(), storeVal);
+			break;
+		}
+		case FusedOp::ADD_ICMP:
+		{
+			auto addInst = decoded.first;
+			auto cmpInst = cast<ICmpInst>(decoded.last);
+
+			auto addVal0 = evaluateOperand(frame, addInst->getOperand(0));
+			auto addVal1 = evaluateOperand(frame, addInst->getOperand(1));
+			auto sumVal = DynamicValue::getIntValue(addVal0.getAsIntValue().getInt() + addVal1.getAsIntValue().getInt());
+
+			auto cmpVal0 = (cmpInst->getOperand(0) == addInst) ? sumVal : evaluateOperand(frame, cmpInst->getOperand(0));
+			auto cmpVal1 = (cmpInst->getOperand(1) == addInst) ? sumVal : evaluateOperand(frame, cmpInst->getOperand(1));
+			frame.insertBinding(cmpInst, evaluateICmp(cmpInst->getPredicate(), cmpVal0, cmpVal1));
+			break;
+		}
+		case FusedOp::LOAD_ADD_STORE:
+		{
+			auto loadInst = cast<LoadInst>(decoded.first);
+			auto addInst = cast<Instruction>(*loadInst->user_begin());
+
+			auto ptrVal = evaluateOperand(frame, loadInst->getPointerOperand());
+			auto& ptr = ptrVal.getAsPointerValue();
+			auto loadedVal = readFromPointer(ptr, loadInst->getType());
+			auto otherVal = evaluateOperand(frame, addInst->getOperand(addInst->getOperand(0) == loadInst ? 1 : 0));
+			writeToPointer(ptr, DynamicValue::getIntValue(loadedVal.getAsIntValue().getInt() + otherVal.getAsIntValue().getInt()));
+			break;
+		}
+	}
+}
+
+void Interpreter::enableFusionProfile()
+{
+	// Sequences are mined from unfused blocks, so plans built so far have to go
+	fusionEnabled = false;
+	threads[0]->blockPlans.clear();
+	fusionProfile = std::make_unique<FusionProfile>();
+}
+
+void Interpreter::printFusionProfile(raw_ostream& os, unsigned topN) const
+{
+	if (fusionProfile != nullptr)
+		fusionProfile->print(os, topN);
+}
+
+void FusionProfile::print(raw_ostream& os, unsigned topN) const
+{
+	struct SequenceCount
+	{
+		uint64_t executed = 0;
+		uint64_t fusable = 0;
+	};
+	auto pairs = std::map<std::string, SequenceCount>();
+	auto triples = std::map<std::string, SequenceCount>();
+
+	for (auto const& entry: blockCounts)
+	{
+		auto count = entry.second;
+
+		auto insts = std::vector<const Instruction*>();
+		for (auto const& inst: *entry.first)
+		{
+			if (!isa<PHINode>(inst))
+				insts.push_back(&inst);
+		}
+
+		for (auto i = 1u; i < insts.size(); ++i)
+		{
+			if (!usesValue(insts[i], insts[i - 1]))
+				continue;
+
+			auto pairFusable = insts[i - 1]->hasOneUse();
+			auto& pairCount = pairs[std::string(insts[i - 1]->getOpcodeName()) + " + " + insts[i]->getOpcodeName()];
+			pairCount.executed += count;
+			if (pairFusable)
+				pairCount.fusable += count;
+
+			if (i >= 2 && usesValue(insts[i - 1], insts[i - 2]))
+			{
+				auto& tripleCount = triples[std::string(insts[i - 2]->getOpcodeName()) + " + " + insts[i - 1]->getOpcodeName() + " + " + insts[i]->getOpcodeName()];
+				tripleCount.executed += count;
+				if (pairFusable && insts[i - 2]->hasOneUse())
+					tripleCount.fusable += count;
+			}
+		}
+	}
+
+	auto printTop = [&os, topN] (const char* title, const std::map<std::string, SequenceCount>& sequences)
+	{
+		auto sorted = std::vector<std::pair<std::string, SequenceCount>>(sequences.begin(), sequences.end());
+		std::stable_sort(sorted.begin(), sorted.end(),
+			[] (const std::pair<std::string, SequenceCount>& lhs, const std::pair<std::string, SequenceCount>& rhs)
+			{
+				return lhs.second.executed > rhs.second.executed;
+			}
+		);
+		if (sorted.size() > topN)
+			sorted.resize(topN);
+
+		os << title << " (executed / fusable):\n";
+		for (auto const& entry: sorted)
+			os << "  " << entry.first << ": " << entry.second.executed << " / " << entry.second.fusable << "\n";
+	};
+	printTop("Dependent instruction pairs", pairs);
+	printTop("Dependent instruction triples", triples);
+}
@@ -0,0 +1,445 @@
+#include "Interpreter.h"
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/ErrorHandling.h"
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+using namespace llvm;
+using namespace llvm_interpreter;
+
+// This file contains guest threads and the atomic instructions. Every guest thread runs on a host thread of its own. Atomic instructions are performed with host atomics directly on the bytes of guest memory, so they are atomic with respect to all guest threads
+
+thread_local Interpreter::GuestThread* Interpreter::currentThread = nullptr;
+
+namespace
+{
+
+// Address ranges reserved for global memory and for each stack once there is more than one thread. Pages are only committed when touched
+const size_t GLOBAL_RESERVE_SIZE = size_t(1) << 34;
+const size_t STACK_RESERVE_SIZE = size_t(1) << 30;
+
+DynamicValue makeErrorCode(int err)
+{
+	return DynamicValue::getIntValue(APInt(32, err));
+}
+
+bool isNullPointer(const PointerValue& ptr)
+{
+	return ptr.getAddressSpace() == PointerAddressSpace::GLOBAL_SPACE && ptr.getAddress() == 0;
+}
+
+// Atomic accesses are done on the unsigned host integer of the same size. Integers that do not fill their store size would get their padding bits clobbered, so they are rejected
+uint64_t getAtomicSize(const DataLayout& dataLayout, Type* type)
+{
+	auto size = dataLayout.getTypeStoreSize(type).getFixedSize();
+	if (type->isIntegerTy() && type->getIntegerBitWidth() != size * 8)
+		throw std::runtime_error("atomic operations on i" + std::to_string(type->getIntegerBitWidth()) + " are not supported");
+	if (!type->isIntegerTy() && !type->isPointerTy() && !type->isFloatTy() && !type->isDoubleTy())
+		throw std::runtime_error("atomic operations only support integer, pointer, float and double values");
+	return size;
+}
+
+// Call (fn) with a zero of the unsigned host integer type that is (size) bytes wide
+template <typename Fn>
+auto withAtomicWidth(uint64_t size, Fn&& fn)
+{
+	switch (size)
+	{
+		case 1:
+			return fn(uint8_t(0));
+		case 2:
+			return fn(uint16_t(0));
+		case 4:
+			return fn(uint32_t(0));
+		case 8:
+			return fn(uint64_t(0));
+	}
+	throw std::runtime_error("atomic operations on " + std::to_string(size) + "-byte values are not supported");
+}
+
+uint64_t toRawBits(const DynamicValue& val)
+{
+	switch (val.getType())
+	{
+		case DynamicValueType::INT_VALUE:
+			return val.getAsIntValue().getInt().getZExtValue();
+		case DynamicValueType::POINTER_VALUE:
+			return MemorySection::encodePointer(val.getAsPointerValue());
+		case DynamicValueType::FLOAT_VALUE:
+		{
+			auto& fpVal = val.getAsFloatValue();
+			if (fpVal.isDouble())
+			{
+				double f = fpVal.getFloat();
+				uint64_t bits = 0;
+				std::memcpy(&bits, &f, sizeof(f));
+				return bits;
+			}
+			else
+			{
+				float f = fpVal.getFloat();
+				uint32_t bits = 0;
+				std::memcpy(&bits, &f, sizeof(f));
+				return bits;
+			}
+		}
+		default:
+			throw std::runtime_error("atomic operations only support integer, pointer, float and double values");
+	}
+}
+
+DynamicValue fromRawBits(uint64_t bits, Type* type)
+{
+	if (type->isIntegerTy())
+		return DynamicValue::getIntValue(APInt(type->getIntegerBitWidth(), bits));
+	if (type->isPointerTy())
+		return MemorySection::decodePointer(bits);
+	if (type->isDoubleTy())
+	{
+		double f = 0;
+		std::memcpy(&f, &bits, sizeof(f));
+		return DynamicValue::getFloatValue(f, true);
+	}
+	auto floatBits = static_cast<uint32_t>(bits);
+	float f = 0;
+	std::memcpy(&f, &floatBits, sizeof(f));
+	return DynamicValue::getFloatValue(f, false);
+}
+
+template <typename T, typename F>
+T applyFloatRMW(AtomicRMWInst::BinOp op, T oldBits, T valBits)
+{
+	F oldVal, val;
+	std::memcpy(&oldVal, &oldBits, sizeof(F));
+	std::memcpy(&val, &valBits, sizeof(F));
+	F res = (op == AtomicRMWInst::FAdd) ? oldVal + val : oldVal - val;
+	T resBits;
+	std::memcpy(&resBits, &res, sizeof(F));
+	return resBits;
+}
+
+// The new memory value of the operations that have no host fetch-and-op builtin
+template <typename T>
+T applyRMW(AtomicRMWInst::BinOp op, T oldVal, T val)
+{
+	using S = std::make_signed_t<T>;
+	switch (op)
+	{
+		case AtomicRMWInst::Max:
+			return static_cast<S>(oldVal) > static_cast<S>(val) ? oldVal : val;
+		case AtomicRMWInst::Min:
+			return static_cast<S>(oldVal) < static_cast<S>(val) ? oldVal : val;
+		case AtomicRMWInst::UMax:
+			return oldVal > val ? oldVal : val;
+		case AtomicRMWInst::UMin:
+			return oldVal < val ? oldVal : val;
+		case AtomicRMWInst::FAdd:
+		case AtomicRMWInst::FSub:
+			if constexpr (sizeof(T) == sizeof(float))
+				return applyFloatRMW<T, float>(op, oldVal, val);
+			else if constexpr (sizeof(T) == sizeof(double))
+				return applyFloatRMW<T, double>(op, oldVal, val);
+			else
+				throw std::runtime_error("atomicrmw on half precision floats is not supported");
+		default:
+			llvm_unreachable("Unsupported atomicrmw operation");
+	}
+}
+
+// Perform the read-modify-write and return the old memory value
+template <typename T>
+T atomicRMW(T* addr, AtomicRMWInst::BinOp op, T val)
+{
+	switch (op)
+	{
+		case AtomicRMWInst::Xchg:
+			return __atomic_exchange_n(addr, val, __ATOMIC_SEQ_CST);
+		case AtomicRMWInst::Add:
+			return __atomic_fetch_add(addr, val, __ATOMIC_SEQ_CST);
+		case AtomicRMWInst::Sub:
+			return __atomic_fetch_sub(addr, val, __ATOMIC_SEQ_CST);
+		case AtomicRMWInst::And:
+			return __atomic_fetch_and(addr, val, __ATOMIC_SEQ_CST);
+		case AtomicRMWInst::Nand:
+			return __atomic_fetch_nand(addr, val, __ATOMIC_SEQ_CST);
+		case AtomicRMWInst::Or:
+			return __atomic_fetch_or(addr, val, __ATOMIC_SEQ_CST);
+		case AtomicRMWInst::Xor:
+			return __atomic_fetch_xor(addr, val, __ATOMIC_SEQ_CST);
+		default:
+			break;
+	}
+
+	auto oldVal = __atomic_load_n(addr, __ATOMIC_SEQ_CST);
+	while (!__atomic_compare_exchange_n(addr, &oldVal, applyRMW(op, oldVal, val), true, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+		;
+	return oldVal;
+}
+
+}
+
+void Interpreter::enterMultiThreadedMode()
+{
+	if (multiThreaded)
+		return;
+	if (globalMem.hasSnapshot())
+		throw std::runtime_error("Guest threads cannot be created while a snapshot exists");
+	if (heapMem.isFileBacked())
+		throw std::runtime_error("Guest threads cannot be created when the heap is file-backed");
+
+	// Lazy globals and function addresses are assigned on first use, which modifies the global environment. Assign them all now so that threads only ever read it
+	auto pending = std::vector<const GlobalVariable*>(pendingGlobals.begin(), pendingGlobals.end());
+	for (auto gv: pending)
+		getGlobalAddress(gv);
+	for (auto const& f: *module)
+		getFunctionAddress(&f);
+
+	// Host pointers into a section that grows by reallocation could dangle while another thread uses them
+	globalMem.reserve(GLOBAL_RESERVE_SIZE);
+	heapMem.reserve(HEAP_RESERVE_SIZE);
+	threads[0]->stackMem.reserve(STACK_RESERVE_SIZE);
+	multiThreaded = true;
+}
+
+DynamicValue Interpreter::runThreadStart(const Function* f, DynamicValue arg)
+{
+	auto argValues = std::vector<DynamicValue>();
+	argValues.push_back(std::move(arg));
+	try
+	{
+		return callFunction(f, std::move(argValues));
+	}
+	catch (const GuestThreadExit& e)
+	{
+		while (!currentThread->stack.empty())
+			popStack();
+		return e.retVal;
+	}
+}
+
+void Interpreter::runGuestThread(GuestThread* thread, const Function* f, DynamicValue arg)
+{
+	currentThread = thread;
+	try
+	{
+		thread->retVal = runThreadStart(f, std::move(arg));
+	}
+	catch (...)
+	{
+		// An exception must not leave the body of a std::thread, so it is handed to whoever joins the thread
+		thread->failure = std::current_exception();
+		while (!thread->stack.empty())
+			popStack();
+	}
+
+	auto lock = std::lock_guard<std::mutex>(threadsMutex);
+	thread->finished = true;
+	if (thread->detached)
+	{
+		if (detachedFailure == nullptr)
+			detachedFailure = thread->failure;
+		threads[thread->index].reset();
+		detachedThreadExited.notify_all();
+	}
+}
+
+DynamicValue Interpreter::createGuestThread(const std::vector<DynamicValue>& argValues)
+{
+	// int pthread_create(pthread_t* thread, const pthread_attr_t* attr, void* (*start)(void*), void* arg). Thread attributes are ignored
+	assert(argValues.size() >= 4);
+
+	auto& threadPtr = argValues.at(0).getAsPointerValue();
+	auto f = image->funPtrMap.at(argValues.at(2).getAsPointerValue().getAddress());
+	if (f->isDeclaration())
+		throw std::runtime_error("pthread_create() cannot start external function " + f->getName().str());
+
+	if (!greenThreads)
+		enterMultiThreadedMode();
+
+	auto lock = std::lock_guard<std::mutex>(threadsMutex);
+	auto index = 1u;
+	while (index < MAX_GUEST_THREADS && threads[index] != nullptr)
+		++index;
+	if (index == MAX_GUEST_THREADS)
+		return makeErrorCode(EAGAIN);
+
+	threads[index] = std::make_unique<GuestThread>(this, index);
+	auto thread = threads[index].get();
+	writeToPointer(threadPtr, DynamicValue::getIntValue(APInt(64, index)));
+	if (greenThreads)
+	{
+		thread->startFn = f;
+		thread->startArg = argValues.at(3);
+		startGreenThread(thread);
+		return makeErrorCode(0);
+	}
+	thread->stackMem.reserve(STACK_RESERVE_SIZE);
+	thread->hostThread = std::thread(&Interpreter::runGuestThread, this, thread, f, argValues.at(3));
+	return makeErrorCode(0);
+}
+
+DynamicValue Interpreter::joinGuestThread(const std::vector<DynamicValue>& argValues)
+{
+	// int pthread_join(pthread_t thread, void** retval)
+	assert(argValues.size() >= 2);
+
+	auto index = argValues.at(0).getAsIntValue().getInt().getZExtValue();
+	auto thread = static_cast<GuestThread*>(nullptr);
+	{
+		auto lock = std::lock_guard<std::mutex>(threadsMutex);
+		if (index == 0 || index >= MAX_GUEST_THREADS || threads[index] == nullptr)
+			return makeErrorCode(ESRCH);
+		thread = threads[index].get();
+		if (thread == currentThread)
+			return makeErrorCode(EDEADLK);
+		if (thread->detached || thread->joiner != nullptr)
+			return makeErrorCode(EINVAL);
+	}
+
+	if (!greenThreads)
+		thread->hostThread.join();
+	else if (!thread->finished)
+	{
+		thread->joiner = currentThread;
+		blockGreenThread(GreenWait::JOIN);
+	}
+	auto failure = thread->failure;
+	if (failure == nullptr)
+	{
+		auto& retPtr = argValues.at(1).getAsPointerValue();
+		if (!isNullPointer(retPtr))
+			writeToPointer(retPtr, thread->retVal);
+	}
+
+	{
+		auto lock = std::lock_guard<std::mutex>(threadsMutex);
+		threads[index].reset();
+	}
+	if (failure != nullptr)
+		std::rethrow_exception(failure);
+	return makeErrorCode(0);
+}
+
+void Interpreter::rethrowDetachedFailure()
+{
+	auto lock = std::unique_lock<std::mutex>(threadsMutex);
+	auto failure = detachedFailure;
+	detachedFailure = nullptr;
+	lock.unlock();
+	if (failure != nullptr)
+		std::rethrow_exception(failure);
+}
+
+DynamicValue Interpreter::detachGuestThread(const std::vector<DynamicValue>& argValues)
+{
+	// int pthread_detach(pthread_t thread)
+	assert(argValues.size() >= 1);
+
+	auto index = argValues.at(0).getAsIntValue().getInt().getZExtValue();
+	auto lock = std::lock_guard<std::mutex>(threadsMutex);
+	if (index == 0 || index >= MAX_GUEST_THREADS || threads[index] == nullptr)
+		return makeErrorCode(ESRCH);
+
+	auto& thread = threads[index];
+	if (thread->detached)
+		return makeErrorCode(EINVAL);
+	if (thread->finished)
+	{
+		// Nobody is going to join it anymore, so its slot can go right away
+		if (!greenThreads)
+			thread->hostThread.join();
+		if (detachedFailure == nullptr)
+			detachedFailure = thread->failure;
+		thread.reset();
+		return makeErrorCode(0);
+	}
+	thread->detached = true;
+	if (!greenThreads)
+		thread->hostThread.detach();
+	return makeErrorCode(0);
+}
+
+void* Interpreter::getAtomicPointer(const PointerValue& ptr, uint64_t size)
+{
+	if (ptr.getAddressSpace() == PointerAddressSpace::GLOBAL_SPACE && isReadOnlyGlobalRange(ptr.getAddress(), 1))
+		throw std::runtime_error("Atomic operation writes to read-only global memory");
+	return getWritablePointer(ptr, size);
+}
+
+DynamicValue Interpreter::evaluateAtomicLoad(const PointerValue& ptr, Type* type)
+{
+	auto addr = getRawPointer(ptr);
+	auto bits = withAtomicWidth(getAtomicSize(getDataLayout(), type), [addr] (auto zero) -> uint64_t
+	{
+		using T = decltype(zero);
+		return __atomic_load_n(static_cast<T*>(addr), __ATOMIC_SEQ_CST);
+	});
+	return fromRawBits(bits, type);
+}
+
+void Interpreter::evaluateAtomicStore(const PointerValue& ptr, const DynamicValue& val, Type* type)
+{
+	auto size = getAtomicSize(getDataLayout(), type);
+	auto addr = getAtomicPointer(ptr, size);
+	auto bits = toRawBits(val);
+	withAtomicWidth(size, [addr, bits] (auto zero)
+	{
+		using T = decltype(zero);
+		__atomic_store_n(static_cast<T*>(addr), static_cast<T>(bits), __ATOMIC_SEQ_CST);
+	});
+}
+
+DynamicValue Interpreter::evaluateAtomicRMW(const StackFrame& frame, const AtomicRMWInst* rmwInst)
+{
+	auto ptrVal = evaluateOperand(frame, rmwInst->getPointerOperand());
+	auto val = evaluateOperand(frame, rmwInst->getValOperand());
+
+	auto type = rmwInst->getValOperand()->getType();
+	auto size = getAtomicSize(getDataLayout(), type);
+	auto addr = getAtomicPointer(ptrVal.getAsPointerValue(), size);
+	auto op = rmwInst->getOperation();
+	auto bits = toRawBits(val);
+	auto oldBits = withAtomicWidth(size, [addr, op, bits] (auto zero) -> uint64_t
+	{
+		using T = decltype(zero);
+		return atomicRMW(static_cast<T*>(addr), op, static_cast<T>(bits));
+	});
+	return fromRawBits(oldBits, type);
+}
+
+DynamicValue Interpreter::evaluateCmpXchg(const StackFrame& frame, const AtomicCmpXchgInst* cxInst)
+{
+	auto ptrVal = evaluateOperand(frame, cxInst->getPointerOperand());
+	auto cmpVal = evaluateOperand(frame, cxInst->getCompareOperand());
+	auto newVal = evaluateOperand(frame, cxInst->getNewValOperand());
+
+	auto type = cxInst->getCompareOperand()->getType();
+	auto size = getAtomicSize(getDataLayout(), type);
+	auto addr = getAtomicPointer(ptrVal.getAsPointerValue(), size);
+	auto cmpBits = toRawBits(cmpVal);
+	auto newBits = toRawBits(newVal);
+	// A weak cmpxchg is allowed to fail spuriously, but never has to
+	auto success = false;
+	auto oldBits = withAtomicWidth(size, [addr, cmpBits, newBits, &success] (auto zero) -> uint64_t
+	{
+		using T = decltype(zero);
+		auto expected = static_cast<T>(cmpBits);
+		success = __atomic_compare_exchange_n(static_cast<T*>(addr), &expected, static_cast<T>(newBits), false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+		return expected;
+	});
+
+	// The result is a {T, i1} struct of the loaded value and the success flag
+	auto stType = cast<StructType>(cxInst->getType());
+	auto stLayout = getDataLayout().getStructLayout(stType);
+	auto retVal = DynamicValue::getStructValue(getDataLayout().getTypeAllocSize(stType));
+	auto& structVal = retVal.getAsStructValue();
+	structVal.addField(stLayout->getElementOffset(0), fromRawBits(oldBits, type));
+	structVal.addField(stLayout->getElementOffset(1), DynamicValue::getIntValue(APInt(1, success)));
+	return retVal;
+}
@@ -0,0 +1,152 @@
+#include "Interpreter.h"
+
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MathExtras.h"
+
+#include <cstring>
+
+using namespace llvm;
+using namespace llvm_interpreter;
+
+// This file contains variadic functions. The arguments passed through an ellipsis are written to the stack memory of the callee the way the target passes arguments on the stack, and va_list is laid out as the target ABI defines it, so va_arg is a pointer bump plus a typed load. This works both for the va_arg instruction and for the inline code that clang emits for va_arg on x86-64 and AArch64
+
+namespace
+{
+
+// The stack size of an argument for which the call site is not known
+uint64_t getVarArgSize(const DynamicValue& val)
+{
+	switch (val.getType())
+	{
+		case DynamicValueType::INT_VALUE:
+			return (val.getAsIntValue().getInt().getBitWidth() + 7) / 8;
+		case DynamicValueType::FLOAT_VALUE:
+			return val.getAsFloatValue().isDouble() ? 8 : 4;
+		case DynamicValueType::POINTER_VALUE:
+			return PointerValue::getPointerSize();
+		case DynamicValueType::VECTOR_VALUE:
+			return val.getAsVectorValue().getRawSize();
+		default:
+			throw std::runtime_error("Aggregates can only be passed through an ellipsis by a call instruction");
+	}
+}
+
+}
+
+void Interpreter::layOutVarArgs(StackFrame& frame, std::vector<DynamicValue>& argValues, unsigned firstVarArg, const CallBase* cs)
+{
+	// Every argument takes a whole number of pointer-sized slots. Arguments aligned beyond that start at their own alignment
+	auto slotSize = uint64_t(getDataLayout().getPointerSize());
+	auto offsets = std::vector<uint64_t>();
+	auto sizes = std::vector<uint64_t>();
+	auto areaSize = uint64_t(0);
+	auto areaAlign = slotSize;
+	for (auto i = firstVarArg, e = unsigned(argValues.size()); i < e; ++i)
+	{
+		auto size = uint64_t(0);
+		auto align = uint64_t(0);
+		if (cs != nullptr)
+		{
+			auto type = cs->isByValArgument(i) ? cs->getParamByValType(i) : cs->getArgOperand(i)->getType();
+			size = getDataLayout().getTypeAllocSize(type);
+			align = getDataLayout().getABITypeAlign(type).value();
+		}
+		else
+			size = align = getVarArgSize(argValues[i]);
+
+		align = std::max(align, slotSize);
+		areaSize = alignTo(areaSize, align);
+		offsets.push_back(areaSize);
+		sizes.push_back(size);
+		areaSize += alignTo(size, slotSize);
+		areaAlign = std::max(areaAlign, align);
+	}
+
+	auto area = allocateStackMem(frame, areaSize, areaAlign);
+	frame.setVarArgArea(area);
+	for (auto i = firstVarArg, e = unsigned(argValues.size()); i < e; ++i)
+	{
+		auto argPtr = DynamicValue::getPointerValue(PointerAddressSpace::STACK_SPACE, area + offsets[i - firstVarArg]);
+		auto size = sizes[i - firstVarArg];
+		// A byval argument is a pointer at the IR level, but what gets passed is a copy of the memory it points to
+		if (cs != nullptr && cs->isByValArgument(i))
+			std::memcpy(getWritablePointer(argPtr.getAsPointerValue(), size), getRawPointer(argValues[i].getAsPointerValue()), size);
+		else
+			writeToPointer(argPtr.getAsPointerValue(), argValues[i]);
+	}
+}
+
+uint64_t Interpreter::getVaListSize() const
+{
+	switch (vaListKind)
+	{
+		case VaListKind::POINTER:
+			return getDataLayout().getPointerSize();
+		case VaListKind::X86_64_SYSV:
+			return 24;
+		case VaListKind::AARCH64:
+			return 32;
+	}
+	llvm_unreachable("Illegal va_list kind");
+}
+
+DynamicValue Interpreter::getVaListCursor(const PointerValue& vaList) const
+{
+	auto offset = (vaListKind == VaListKind::X86_64_SYSV) ? 8 : 0;
+	return DynamicValue::getPointerValue(vaList.getAddressSpace(), vaList.getAddress() + offset);
+}
+
+void Interpreter::startVaList(const StackFrame& frame, const PointerValue& vaList)
+{
+	auto area = DynamicValue::getPointerValue(PointerAddressSpace::STACK_SPACE, frame.getVarArgArea());
+	auto nullPtr = DynamicValue::getPointerValue(PointerAddressSpace::GLOBAL_SPACE, 0);
+	auto writeField = [this, &vaList] (uint64_t offset, const DynamicValue& val)
+	{
+		auto fieldPtr = DynamicValue::getPointerValue(vaList.getAddressSpace(), vaList.getAddress() + offset);
+		writeToPointer(fieldPtr.getAsPointerValue(), val);
+	};
+
+	switch (vaListKind)
+	{
+		case VaListKind::POINTER:
+			writeField(0, area);
+			break;
+		case VaListKind::X86_64_SYSV:
+			// All 6 general purpose and 8 vector argument registers are taken
+			writeField(0, DynamicValue::getIntValue(APInt(32, 48)));
+			writeField(4, DynamicValue::getIntValue(APInt(32, 48 + 8 * 16)));
+			writeField(8, area);
+			writeField(16, nullPtr);
+			break;
+		case VaListKind::AARCH64:
+			// Non-negative register offsets mean that the register save areas are used up
+			writeField(0, area);
+			writeField(8, nullPtr);
+			writeField(16, nullPtr);
+			writeField(24, DynamicValue::getIntValue(APInt(32, 0)));
+			writeField(28, DynamicValue::getIntValue(APInt(32, 0)));
+			break;
+	}
+}
+
+DynamicValue Interpreter::readVarArg(DynamicValue& cursor, Type* type)
+{
+	auto slotSize = uint64_t(getDataLayout().getPointerSize());
+	auto addrSpace = cursor.getAsPointerValue().getAddressSpace();
+	auto align = std::max(uint64_t(getDataLayout().getABITypeAlign(type).value()), slotSize);
+	auto addr = alignTo(cursor.getAsPointerValue().getAddress(), align);
+
+	auto argPtr = DynamicValue::getPointerValue(addrSpace, addr);
+	auto val = readFromPointer(argPtr.getAsPointerValue(), type);
+	cursor = DynamicValue::getPointerValue(addrSpace, addr + alignTo(getDataLayout().getTypeAllocSize(type), slotSize));
+	return val;
+}
+
+DynamicValue Interpreter::evaluateVAArg(const PointerValue& vaList, Type* type)
+{
+	auto cursorPtr = getVaListCursor(vaList);
+	auto cursor = readFromPointer(cursorPtr.getAsPointerValue(), bytePtrType);
+	auto val = readVarArg(cursor, type);
+	writeToPointer(cursorPtr.getAsPointerValue(), cursor);
+	return val;
+}
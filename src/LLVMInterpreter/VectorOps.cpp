@@ -0,0 +1,599 @@
+#include "VectorOps.h"
+
+#include "llvm/ADT/APInt.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/Support/ErrorHandling.h"
+
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+
+using namespace llvm;
+using namespace llvm_interpreter;
+
+// This file contains the element-wise kernels behind vector instructions. They are compiled with full optimization (see CMakeLists.txt) so that the lane loops get vectorized by the host compiler
+
+namespace
+{
+
+// Call fn with a value of the unsigned integer type that holds vector lanes of (laneBytes) bytes
+template <typename Fn>
+void dispatchIntLanes(unsigned laneBytes, Fn&& fn)
+{
+	switch (laneBytes)
+	{
+		case 1:
+			fn(uint8_t());
+			break;
+		case 2:
+			fn(uint16_t());
+			break;
+		case 4:
+			fn(uint32_t());
+			break;
+		case 8:
+			fn(uint64_t());
+			break;
+		default:
+			llvm_unreachable("Illegal vector lane size");
+	}
+}
+
+template <typename Fn>
+void dispatchFloatLanes(VectorLaneType laneType, Fn&& fn)
+{
+	if (laneType == VectorLaneType::FLOAT)
+		fn(float());
+	else
+		fn(double());
+}
+
+// Lane arithmetic is done in at least unsigned int, so that narrow lanes are not promoted to (signed) int by the usual arithmetic conversions
+template <typename T>
+using PromotedType = std::conditional_t<(sizeof(T) < sizeof(unsigned)), unsigned, T>;
+
+// Integer lanes of width (bits) stored zero-extended in a T
+template <typename T>
+class IntLane
+{
+private:
+	unsigned bits;
+	unsigned shift;
+public:
+	using S = std::make_signed_t<T>;
+
+	IntLane(unsigned b): bits(b), shift(sizeof(T) * 8 - b) {}
+
+	bool isFullWidth() const { return shift == 0; }
+	T getMask() const { return static_cast<T>(~T(0)) >> shift; }
+	S sext(T x) const
+	{
+		return static_cast<S>(static_cast<T>(x << shift)) >> shift;
+	}
+};
+
+template <typename T>
+void intBinOpKernel(unsigned opcode, unsigned bits, T* dst, const T* a, const T* b, unsigned n)
+{
+	using U = PromotedType<T>;
+	auto lane = IntLane<T>(bits);
+
+	switch (opcode)
+	{
+		case Instruction::Add:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = U(a[i]) + U(b[i]);
+			break;
+		case Instruction::Sub:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = U(a[i]) - U(b[i]);
+			break;
+		case Instruction::Mul:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = U(a[i]) * U(b[i]);
+			break;
+		case Instruction::UDiv:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = U(a[i]) / U(b[i]);
+			break;
+		case Instruction::URem:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = U(a[i]) % U(b[i]);
+			break;
+		case Instruction::SDiv:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = static_cast<T>(lane.sext(a[i]) / lane.sext(b[i]));
+			break;
+		case Instruction::SRem:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = static_cast<T>(lane.sext(a[i]) % lane.sext(b[i]));
+			break;
+		case Instruction::And:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = a[i] & b[i];
+			break;
+		case Instruction::Or:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = a[i] | b[i];
+			break;
+		case Instruction::Xor:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = a[i] ^ b[i];
+			break;
+		// Shifting by the lane width or more yields poison in LLVM. We produce a defined value instead of invoking undefined behavior on the host
+		case Instruction::Shl:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = (b[i] >= bits) ? 0 : U(a[i]) << b[i];
+			break;
+		case Instruction::LShr:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = (b[i] >= bits) ? 0 : U(a[i]) >> b[i];
+			break;
+		case Instruction::AShr:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = static_cast<T>(lane.sext(a[i]) >> ((b[i] >= bits) ? bits - 1 : b[i]));
+			break;
+		default:
+			llvm_unreachable("Illegal vector integer binary operator");
+	}
+
+	if (!lane.isFullWidth())
+	{
+		auto mask = lane.getMask();
+		for (auto i = 0u; i < n; ++i)
+			dst[i] &= mask;
+	}
+}
+
+template <typename T>
+void floatBinOpKernel(unsigned opcode, T* dst, const T* a, const T* b, unsigned n)
+{
+	switch (opcode)
+	{
+		case Instruction::FAdd:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = a[i] + b[i];
+			break;
+		case Instruction::FSub:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = a[i] - b[i];
+			break;
+		case Instruction::FMul:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = a[i] * b[i];
+			break;
+		case Instruction::FDiv:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = a[i] / b[i];
+			break;
+		case Instruction::FRem:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = std::fmod(a[i], b[i]);
+			break;
+		default:
+			llvm_unreachable("Illegal vector floating point binary operator");
+	}
+}
+
+template <typename T>
+void icmpKernel(CmpInst::Predicate pred, unsigned bits, uint8_t* dst, const T* a, const T* b, unsigned n)
+{
+	auto lane = IntLane<T>(bits);
+
+	switch (pred)
+	{
+		case CmpInst::ICMP_EQ:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = a[i] == b[i];
+			break;
+		case CmpInst::ICMP_NE:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = a[i] != b[i];
+			break;
+		case CmpInst::ICMP_UGT:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = a[i] > b[i];
+			break;
+		case CmpInst::ICMP_UGE:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = a[i] >= b[i];
+			break;
+		case CmpInst::ICMP_ULT:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = a[i] < b[i];
+			break;
+		case CmpInst::ICMP_ULE:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = a[i] <= b[i];
+			break;
+		case CmpInst::ICMP_SGT:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = lane.sext(a[i]) > lane.sext(b[i]);
+			break;
+		case CmpInst::ICMP_SGE:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = lane.sext(a[i]) >= lane.sext(b[i]);
+			break;
+		case CmpInst::ICMP_SLT:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = lane.sext(a[i]) < lane.sext(b[i]);
+			break;
+		case CmpInst::ICMP_SLE:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = lane.sext(a[i]) <= lane.sext(b[i]);
+			break;
+		default:
+			llvm_unreachable("Illegal icmp predicate");
+	}
+}
+
+// Host comparisons are ordered (false when either side is NaN), so the unordered predicates are the negations of the opposite ordered ones
+template <typename T>
+void fcmpKernel(CmpInst::Predicate pred, uint8_t* dst, const T* a, const T* b, unsigned n)
+{
+	switch (pred)
+	{
+		case CmpInst::FCMP_FALSE:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = 0;
+			break;
+		case CmpInst::FCMP_OEQ:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = a[i] == b[i];
+			break;
+		case CmpInst::FCMP_OGT:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = a[i] > b[i];
+			break;
+		case CmpInst::FCMP_OGE:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = a[i] >= b[i];
+			break;
+		case CmpInst::FCMP_OLT:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = a[i] < b[i];
+			break;
+		case CmpInst::FCMP_OLE:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = a[i] <= b[i];
+			break;
+		case CmpInst::FCMP_ONE:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = (a[i] < b[i]) || (a[i] > b[i]);
+			break;
+		case CmpInst::FCMP_ORD:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = (a[i] == a[i]) && (b[i] == b[i]);
+			break;
+		case CmpInst::FCMP_UEQ:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = !((a[i] < b[i]) || (a[i] > b[i]));
+			break;
+		case CmpInst::FCMP_UGT:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = !(a[i] <= b[i]);
+			break;
+		case CmpInst::FCMP_UGE:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = !(a[i] < b[i]);
+			break;
+		case CmpInst::FCMP_ULT:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = !(a[i] >= b[i]);
+			break;
+		case CmpInst::FCMP_ULE:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = !(a[i] > b[i]);
+			break;
+		case CmpInst::FCMP_UNE:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = a[i] != b[i];
+			break;
+		case CmpInst::FCMP_UNO:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = (a[i] != a[i]) || (b[i] != b[i]);
+			break;
+		case CmpInst::FCMP_TRUE:
+			for (auto i = 0u; i < n; ++i)
+				dst[i] = 1;
+			break;
+		default:
+			llvm_unreachable("Illegal fcmp predicate");
+	}
+}
+
+uint64_t signExtendLane(uint64_t val, unsigned bits)
+{
+	auto shift = 64 - bits;
+	return static_cast<uint64_t>(static_cast<int64_t>(val << shift) >> shift);
+}
+
+bool hasByteSizedLanes(const VectorValue& vec)
+{
+	return vec.getLaneBits() == vec.getLaneBytes() * 8;
+}
+
+// The bit pattern of a value, as seen by bitcast. Lane 0 of a vector occupies the least significant bits
+APInt getBitPattern(const DynamicValue& val, const Type* type)
+{
+	if (val.isVectorValue())
+	{
+		auto& vec = val.getAsVectorValue();
+		auto laneBits = vec.getLaneBits();
+		auto bits = APInt(laneBits * vec.getNumLanes(), 0);
+		for (auto i = 0u, e = vec.getNumLanes(); i < e; ++i)
+		{
+			uint64_t laneVal = 0;
+			if (vec.getLaneType() == VectorLaneType::FLOAT)
+				laneVal = APInt::floatToBits(vec.getFloatLane(i)).getZExtValue();
+			else if (vec.getLaneType() == VectorLaneType::DOUBLE)
+				laneVal = APInt::doubleToBits(vec.getFloatLane(i)).getZExtValue();
+			else
+				laneVal = vec.getIntLane(i);
+			bits.insertBits(APInt(laneBits, laneVal), i * laneBits);
+		}
+		return bits;
+	}
+	else if (val.isIntValue())
+		return val.getAsIntValue().getInt();
+	else if (val.isFloatValue())
+	{
+		if (type->isFloatTy())
+			return APInt::floatToBits(val.getAsFloatValue().getFloat());
+		else
+			return APInt::doubleToBits(val.getAsFloatValue().getFloat());
+	}
+	else if (val.isUndefValue())
+		return APInt(type->getPrimitiveSizeInBits(), 0);
+	else
+		llvm_unreachable("Unsupported bitcast operand");
+}
+
+DynamicValue createFromBitPattern(const APInt& bits, const Type* type)
+{
+	if (type->isVectorTy())
+	{
+		auto retVal = createVectorValue(type);
+		auto& vec = retVal.getAsVectorValue();
+		auto laneBits = vec.getLaneBits();
+		for (auto i = 0u, e = vec.getNumLanes(); i < e; ++i)
+		{
+			auto laneVal = bits.extractBits(laneBits, i * laneBits);
+			if (vec.getLaneType() == VectorLaneType::FLOAT)
+				vec.setFloatLane(i, laneVal.bitsToFloat());
+			else if (vec.getLaneType() == VectorLaneType::DOUBLE)
+				vec.setFloatLane(i, laneVal.bitsToDouble());
+			else
+				vec.setIntLane(i, laneVal.getZExtValue());
+		}
+		return retVal;
+	}
+	else if (type->isIntegerTy())
+		return DynamicValue::getIntValue(bits);
+	else if (type->isFloatTy())
+		return DynamicValue::getFloatValue(bits.bitsToFloat(), false);
+	else if (type->isDoubleTy())
+		return DynamicValue::getFloatValue(bits.bitsToDouble(), true);
+	else
+		llvm_unreachable("Unsupported bitcast destination type");
+}
+
+DynamicValue evaluateVectorBitCast(const DynamicValue& srcVal, const Type* srcType, const Type* dstType)
+{
+	// Between vectors of byte-sized lanes a bitcast is just a reinterpretation of the raw lane storage
+	if (srcVal.isVectorValue() && dstType->isVectorTy())
+	{
+		auto retVal = createVectorValue(dstType);
+		auto& src = srcVal.getAsVectorValue();
+		auto& dst = retVal.getAsVectorValue();
+		if (hasByteSizedLanes(src) && hasByteSizedLanes(dst))
+		{
+			assert(src.getRawSize() == dst.getRawSize());
+			std::memcpy(dst.getRawData(), src.getRawData(), dst.getRawSize());
+			return retVal;
+		}
+	}
+
+	return createFromBitPattern(getBitPattern(srcVal, srcType), dstType);
+}
+
+}
+
+DynamicValue llvm_interpreter::createVectorValue(const Type* type)
+{
+	auto vecType = dyn_cast<FixedVectorType>(type);
+	if (vecType == nullptr)
+		llvm_unreachable("Scalable vectors are not supported");
+
+	auto elemType = vecType->getElementType();
+	auto numLanes = vecType->getNumElements();
+	if (auto intType = dyn_cast<IntegerType>(elemType))
+		return DynamicValue::getVectorValue(VectorLaneType::INT, intType->getBitWidth(), numLanes);
+	else if (elemType->isFloatTy())
+		return DynamicValue::getVectorValue(VectorLaneType::FLOAT, 32, numLanes);
+	else if (elemType->isDoubleTy())
+		return DynamicValue::getVectorValue(VectorLaneType::DOUBLE, 64, numLanes);
+	else
+		llvm_unreachable("Unsupported vector element type");
+}
+
+DynamicValue llvm_interpreter::evaluateVectorBinOp(unsigned opcode, const VectorValue& v0, const VectorValue& v1)
+{
+	assert(v0.getNumLanes() == v1.getNumLanes() && v0.getLaneBits() == v1.getLaneBits());
+
+	auto retVal = DynamicValue::getVectorValue(v0.getLaneType(), v0.getLaneBits(), v0.getNumLanes());
+	auto& dst = retVal.getAsVectorValue();
+	auto n = v0.getNumLanes();
+
+	if (v0.getLaneType() == VectorLaneType::INT)
+	{
+		dispatchIntLanes(v0.getLaneBytes(),
+			[&] (auto tag)
+			{
+				using T = decltype(tag);
+				intBinOpKernel(opcode, v0.getLaneBits(), dst.getLanes<T>(), v0.getLanes<T>(), v1.getLanes<T>(), n);
+			}
+		);
+	}
+	else
+	{
+		dispatchFloatLanes(v0.getLaneType(),
+			[&] (auto tag)
+			{
+				using T = decltype(tag);
+				floatBinOpKernel(opcode, dst.getLanes<T>(), v0.getLanes<T>(), v1.getLanes<T>(), n);
+			}
+		);
+	}
+
+	return retVal;
+}
+
+DynamicValue llvm_interpreter::evaluateVectorFNeg(const VectorValue& v)
+{
+	auto retVal = DynamicValue::getVectorValue(v.getLaneType(), v.getLaneBits(), v.getNumLanes());
+	auto& dst = retVal.getAsVectorValue();
+	dispatchFloatLanes(v.getLaneType(),
+		[&] (auto tag)
+		{
+			using T = decltype(tag);
+			auto dstLanes = dst.getLanes<T>();
+			auto srcLanes = v.getLanes<T>();
+			for (auto i = 0u, e = v.getNumLanes(); i < e; ++i)
+				dstLanes[i] = -srcLanes[i];
+		}
+	);
+	return retVal;
+}
+
+DynamicValue llvm_interpreter::evaluateVectorCmp(CmpInst::Predicate pred, const VectorValue& v0, const VectorValue& v1)
+{
+	assert(v0.getNumLanes() == v1.getNumLanes() && v0.getLaneBits() == v1.getLaneBits());
+
+	auto retVal = DynamicValue::getVectorValue(VectorLaneType::INT, 1, v0.getNumLanes());
+	auto dst = retVal.getAsVectorValue().getLanes<uint8_t>();
+	auto n = v0.getNumLanes();
+
+	if (v0.getLaneType() == VectorLaneType::INT)
+	{
+		dispatchIntLanes(v0.getLaneBytes(),
+			[&] (auto tag)
+			{
+				using T = decltype(tag);
+				icmpKernel(pred, v0.getLaneBits(), dst, v0.getLanes<T>(), v1.getLanes<T>(), n);
+			}
+		);
+	}
+	else
+	{
+		dispatchFloatLanes(v0.getLaneType(),
+			[&] (auto tag)
+			{
+				using T = decltype(tag);
+				fcmpKernel(pred, dst, v0.getLanes<T>(), v1.getLanes<T>(), n);
+			}
+		);
+	}
+
+	return retVal;
+}
+
+DynamicValue llvm_interpreter::evaluateVectorCast(unsigned opcode, const DynamicValue& srcVal, const Type* srcType, const Type* dstType)
+{
+	if (opcode == Instruction::BitCast)
+		return evaluateVectorBitCast(srcVal, srcType, dstType);
+
+	auto& src = srcVal.getAsVectorValue();
+	auto retVal = createVectorValue(dstType);
+	auto& dst = retVal.getAsVectorValue();
+	auto srcBits = src.getLaneBits();
+	auto dstBits = dst.getLaneBits();
+
+	for (auto i = 0u, e = src.getNumLanes(); i < e; ++i)
+	{
+		switch (opcode)
+		{
+			// setIntLane() truncates to the lane width
+			case Instruction::Trunc:
+			case Instruction::ZExt:
+				dst.setIntLane(i, src.getIntLane(i));
+				break;
+			case Instruction::SExt:
+				dst.setIntLane(i, signExtendLane(src.getIntLane(i), srcBits));
+				break;
+			case Instruction::FPTrunc:
+			case Instruction::FPExt:
+				dst.setFloatLane(i, src.getFloatLane(i));
+				break;
+			case Instruction::FPToUI:
+			case Instruction::FPToSI:
+				dst.setIntLane(i, APIntOps::RoundDoubleToAPInt(src.getFloatLane(i), dstBits).getZExtValue());
+				break;
+			// Convert straight to the lane type. Going through double would round float lanes twice
+			case Instruction::UIToFP:
+				if (dst.getLaneType() == VectorLaneType::FLOAT)
+					dst.setFloatLane(i, static_cast<float>(src.getIntLane(i)));
+				else
+					dst.setFloatLane(i, static_cast<double>(src.getIntLane(i)));
+				break;
+			case Instruction::SIToFP:
+			{
+				auto laneVal = static_cast<int64_t>(signExtendLane(src.getIntLane(i), srcBits));
+				if (dst.getLaneType() == VectorLaneType::FLOAT)
+					dst.setFloatLane(i, static_cast<float>(laneVal));
+				else
+					dst.setFloatLane(i, static_cast<double>(laneVal));
+				break;
+			}
+			default:
+				llvm_unreachable("Unsupported vector cast");
+		}
+	}
+
+	return retVal;
+}
+
+DynamicValue llvm_interpreter::evaluateVectorSelect(const DynamicValue& cond, const DynamicValue& trueVal, const DynamicValue& falseVal)
+{
+	if (!cond.isVectorValue())
+		return cond.getAsIntValue().getInt().getBoolValue() ? trueVal : falseVal;
+
+	auto retVal = trueVal;
+	auto& dst = retVal.getAsVectorValue();
+	auto& other = falseVal.getAsVectorValue();
+	auto condLanes = cond.getAsVectorValue().getLanes<uint8_t>();
+	// Float lanes are selected by their bit pattern, so integer containers of the same size do for every lane type
+	dispatchIntLanes(dst.getLaneBytes(),
+		[&] (auto tag)
+		{
+			using T = decltype(tag);
+			auto dstLanes = dst.getLanes<T>();
+			auto otherLanes = other.getLanes<T>();
+			for (auto i = 0u, e = dst.getNumLanes(); i < e; ++i)
+				dstLanes[i] = condLanes[i] ? dstLanes[i] : otherLanes[i];
+		}
+	);
+	return retVal;
+}
+
+DynamicValue llvm_interpreter::evaluateShuffleVector(const VectorValue& v0, const VectorValue& v1, ArrayRef<int> mask)
+{
+	auto retVal = DynamicValue::getVectorValue(v0.getLaneType(), v0.getLaneBits(), mask.size());
+	auto& dst = retVal.getAsVectorValue();
+
+	auto laneBytes = v0.getLaneBytes();
+	auto srcLanes = static_cast<int>(v0.getNumLanes());
+	auto dstData = static_cast<uint8_t*>(dst.getRawData());
+	auto src0 = static_cast<const uint8_t*>(v0.getRawData());
+	auto src1 = static_cast<const uint8_t*>(v1.getRawData());
+	for (auto i = 0u, e = static_cast<unsigned>(mask.size()); i < e; ++i)
+	{
+		auto idx = mask[i];
+		if (idx < 0)
+			continue;
+		auto src = (idx < srcLanes) ? src0 + idx * laneBytes : src1 + (idx - srcLanes) * laneBytes;
+		std::memcpy(dstData + i * laneBytes, src, laneBytes);
+	}
+	return retVal;
+}
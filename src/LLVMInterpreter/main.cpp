@@ -1,4 +1,8 @@
+#include "Batch.h"
+#include "ForkServer.h"
 #include "Interpreter.h"
+#include "ModuleCache.h"
+#include "Prepass.h"
 
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
@@ -19,6 +23,50 @@ cl::opt<std::string> InputFile(cl::desc("<input bitcode>"), cl::Positional, cl::
 
 cl::opt<std::string> FunctionName("function", cl::desc("Function to execute (default: main)"), cl::init("main"));
 
+cl::opt<PrepassLevel> PrepassOpt("prepass", cl::desc("Transform the module before executing it:"), cl::init(PrepassLevel::NONE),
+	cl::values(
+		clEnumValN(PrepassLevel::NONE, "none", "Run no passes"),
+		clEnumValN(PrepassLevel::LOWER, "lower", "Lower invoke"),
+		clEnumValN(PrepassLevel::BASIC, "basic", "Also promote memory to registers and clean up locally"),
+		clEnumValN(PrepassLevel::FULL, "full", "Also run SCCP, LICM and GVN")
+	));
+
+cl::opt<std::string> ModuleCacheDir("module-cache", cl::desc("Keep parsed and prepared modules as bitcode in this directory, and load their function bodies on first call"), cl::value_desc("directory"), cl::init(""));
+
+cl::opt<unsigned> InlineThreshold("inline-callee-size", cl::desc("Inline callees of at most this many instructions at call time (0 = no inlining)"), cl::init(0));
+
+cl::opt<bool> DisableFusion("disable-fusion", cl::desc("Do not execute common instruction sequences as superinstructions"), cl::init(false));
+
+cl::opt<bool> FusionProfileOpt("fusion-profile", cl::desc("Print the most frequently executed instruction pairs and triples on exit (disables fusion)"), cl::init(false));
+
+cl::opt<bool> GreenThreads("green-threads", cl::desc("Run guest threads as green threads on one host thread, with a reproducible schedule"), cl::init(false));
+
+cl::opt<uint64_t> GreenSeed("green-seed", cl::desc("Seed of the green thread scheduler"), cl::init(0));
+
+cl::opt<unsigned> GreenQuantum("green-quantum", cl::desc("Instructions a green thread runs before the scheduler picks the next one"), cl::init(1000));
+
+cl::opt<uint64_t> StdioBufferSize("stdio-buffer-size", cl::desc("Bytes of guest output held back before it is written out"), cl::init(GuestStdio::DEFAULT_BUFFER_SIZE));
+
+cl::opt<bool> LazyGlobals("lazy-globals", cl::desc("Initialize globals on first use instead of at startup"), cl::init(false));
+
+cl::opt<std::string> HeapFileDir("heap-file-dir", cl::desc("Back the guest heap with a sparse file created in this directory"), cl::value_desc("directory"), cl::init(""));
+
+cl::opt<bool> HeapStats("heap-stats", cl::desc("Print paging statistics of the file-backed guest heap on exit"), cl::init(false));
+
+cl::opt<std::string> RecordCalls("record-calls", cl::desc("Log the external calls that reach the host (I/O, file mappings) to this file"), cl::value_desc("file"), cl::init(""));
+
+cl::opt<std::string> ReplayCalls("replay-calls", cl::desc("Take the results of the external calls that reach the host from a log written by -record-calls"), cl::value_desc("file"), cl::init(""));
+
+cl::opt<std::string> ForkServer("fork-server", cl::desc("Prepare the module once, then run main in a forked child for every request on this Unix socket"), cl::value_desc("socket"), cl::init(""));
+
+cl::opt<std::string> ForkClient("fork-client", cl::desc("Have the fork server on this Unix socket run main with the program arguments, instead of loading the input"), cl::value_desc("socket"), cl::init(""));
+
+cl::opt<std::string> BatchManifest("batch", cl::desc("Run every entry of this manifest (\"<module> <function> [<arg>...] [=> <expected>]\" per line) instead of the input"), cl::value_desc("manifest"), cl::init(""));
+
+cl::opt<std::string> BatchResults("batch-results", cl::desc("Write the outcome and timings of every -batch entry to this file as JSON lines. Guests write to stdout as well, so it is a file by default"), cl::value_desc("file"), cl::init("batch-results.jsonl"));
+
+cl::opt<unsigned> BatchJobs("batch-jobs", cl::desc("Number of threads running -batch entries"), cl::init(1));
+
 cl::list<std::string> InputArgv(cl::ConsumeAfter, cl::desc("<program arguments>..."));
 
 // Main driver of the interpreter
@@ -34,39 +82,164 @@ int main(int argc, char** argv, char* const *envp)
 
 	cl::ParseCommandLineOptions(argc, argv, "llvm interpreter & dynamic compiler\n");
 
+	if (!BatchManifest.empty())
+	{
+		if (!HeapFileDir.empty() || !RecordCalls.empty() || !ReplayCalls.empty() || !ForkServer.empty())
+		{
+			errs() << "-batch cannot be combined with -heap-file-dir, -record-calls, -replay-calls or -fork-server\n";
+			return -1;
+		}
+		auto opts = BatchOptions();
+		opts.prepass = PrepassOpt;
+		opts.inlineThreshold = InlineThreshold;
+		opts.numJobs = BatchJobs;
+		opts.configure = [] (Interpreter& interpreter)
+		{
+			interpreter.setFusion(!DisableFusion);
+			interpreter.setStdioBufferSize(StdioBufferSize);
+			if (GreenThreads)
+				interpreter.setGreenThreads(GreenSeed, GreenQuantum);
+		};
+		try
+		{
+			return runBatch(BatchManifest, BatchResults, opts) ? 0 : 1;
+		}
+		catch (const std::exception& e)
+		{
+			errs() << e.what() << "\n";
+			return -1;
+		}
+	}
+
+	if (!ForkClient.empty())
+	{
+		// The server has the module already, so the input file only becomes argv[0]
+		std::vector<std::string> mainArgs = InputArgv;
+		mainArgs.insert(mainArgs.begin(), InputFile);
+		try
+		{
+			return runForkClient(ForkClient, mainArgs);
+		}
+		catch (const std::exception& e)
+		{
+			errs() << e.what() << "\n";
+			return 1;
+		}
+	}
+
 	// Disable core file
 	sys::Process::PreventCoreFiles();
 
 	// Read and parse the IR file
 	SMDiagnostic err;
-	auto module = parseIRFile(InputFile, err, context);
+	auto module = std::unique_ptr<Module>();
+	if (ModuleCacheDir.empty())
+	{
+		module = parseIRFile(InputFile, err, context);
+		if (module)
+			runPrepasses(*module, PrepassOpt);
+	}
+	else
+	{
+		// A cached module is prepared already and has its function bodies read as they are called
+		try
+		{
+			module = ModuleCache(ModuleCacheDir).loadModule(InputFile, PrepassOpt, context, err);
+		}
+		catch (const std::exception& e)
+		{
+			errs() << e.what() << "\n";
+			return -1;
+		}
+	}
 	if (!module)
 	{
 		err.print(argv[0], errs());
 		std::exit(1);
 	}
 
-	// Load the whole bitcode file eagerly
-	// In LLVM 20, materializeAllPermanently() was removed, functions are materialized on demand
-	// No need to explicitly materialize
-
 	Interpreter interpreter(module.get());
+	interpreter.setLazyGlobals(LazyGlobals);
+	interpreter.setInlineThreshold(InlineThreshold);
+	interpreter.setFusion(!DisableFusion);
+	interpreter.setStdioBufferSize(StdioBufferSize);
+	if (GreenThreads)
+		interpreter.setGreenThreads(GreenSeed, GreenQuantum);
+	if (FusionProfileOpt)
+		interpreter.enableFusionProfile();
 	interpreter.evaluateGlobals();
 
+	try
+	{
+		if (!HeapFileDir.empty())
+			interpreter.mapHeapToFile(HeapFileDir);
+		if (!RecordCalls.empty())
+			interpreter.recordExternalCalls(RecordCalls);
+		if (!ReplayCalls.empty())
+			interpreter.replayExternalCalls(ReplayCalls);
+	}
+	catch (const std::exception& e)
+	{
+		errs() << e.what() << "\n";
+		return -1;
+	}
+
 	auto entryFn = module->getFunction(FunctionName);
 	if (entryFn == nullptr)
 	{
 		errs() << "Function \'" << FunctionName << "\' not found in module.\n";
 		return -1;
 	}
+
+	if (!ForkServer.empty())
+	{
+		if (FunctionName != "main" || !HeapFileDir.empty() || !RecordCalls.empty())
+		{
+			errs() << "-fork-server only runs main, and cannot be combined with -heap-file-dir or -record-calls\n";
+			return -1;
+		}
+		try
+		{
+			runForkServer(ForkServer, [&] (const std::vector<std::string>& mainArgs)
+			{
+				// The child has the descriptors of the client now
+				interpreter.resetStdStreams();
+				try
+				{
+					auto retInt = interpreter.runMain(entryFn, mainArgs);
+					errs() << "Interpreter returns value " << retInt << "\n";
+					return retInt;
+				}
+				catch (const std::exception& e)
+				{
+					// A guest fault ends this request only. The client gets the error on its stderr and a failing result
+					errs() << e.what() << "\n";
+					return -1;
+				}
+			});
+		}
+		catch (const std::exception& e)
+		{
+			errs() << e.what() << "\n";
+			return -1;
+		}
+	}
 	
 	if (FunctionName == "main")
 	{
 		// For main function, use the special runMain that handles argv
 		std::vector<std::string> mainArgs = InputArgv;
 		mainArgs.insert(mainArgs.begin(), InputFile);
-		auto retInt = interpreter.runMain(entryFn, mainArgs);
-		errs() << "Interpreter returns value " << retInt << "\n";
+		try
+		{
+			auto retInt = interpreter.runMain(entryFn, mainArgs);
+			errs() << "Interpreter returns value " << retInt << "\n";
+		}
+		catch (const std::exception& e)
+		{
+			errs() << e.what() << "\n";
+			return -1;
+		}
 	}
 	else
 	{
@@ -119,7 +292,16 @@ int main(int argc, char** argv, char* const *envp)
 			errs() << "Warning: " << (InputArgv.size() - argIdx) << " extra arguments ignored\n";
 		}
 		
-		auto retVal = interpreter.runFunction(entryFn, args);
+		auto retVal = DynamicValue::getUndefValue();
+		try
+		{
+			retVal = interpreter.runFunction(entryFn, args);
+		}
+		catch (const std::exception& e)
+		{
+			errs() << e.what() << "\n";
+			return -1;
+		}
 		
 		// Print return value
 		if (retVal.isUndefValue())
@@ -176,5 +358,16 @@ int main(int argc, char** argv, char* const *envp)
 		}
 	}
 
+	if (FusionProfileOpt)
+		interpreter.printFusionProfile(errs(), 20);
+
+	if (HeapStats)
+	{
+		auto stats = interpreter.getHeapPagingStats();
+		errs() << "Heap mapped bytes: " << stats.mappedBytes << "\n";
+		errs() << "Heap resident bytes: " << stats.residentBytes << "\n";
+		errs() << "Page faults since mapping: " << stats.majorFaults << " major, " << stats.minorFaults << " minor\n";
+	}
+
 	return 0;
 }
\ No newline at end of file